@@ -1,7 +1,15 @@
 #include "benchmark/benchmark.h"
 #include "simpledb/btree.h"
+#include "simpledb/string_btree.h"
+#include <algorithm>
+#include <array>
 #include <barrier>
+#include <cstdio>
+#include <memory>
+#include <numeric>
+#include <optional>
 #include <random>
+#include <string>
 #include <thread>
 #include <vector>
 
@@ -43,4 +51,219 @@ void Btree_Multi(benchmark::State& state) {
          t.join();
    }
 }
+void Btree_Lookup(benchmark::State& state) {
+   // read-only, every node is resident
+   constexpr size_t kKeys = 64 * BTree::LeafNode::kCapacity;
+   static std::unique_ptr<BufferManager> buffer_manager;
+   static std::unique_ptr<BTree> tree;
+   if (state.thread_index() == 0) {
+      buffer_manager = std::make_unique<BufferManager>(1024, 1024);
+      tree = std::make_unique<BTree>(0, *buffer_manager);
+      for (uint64_t i = 0; i < kKeys; ++i) {
+         tree->insert(i, 2 * i);
+      }
+   }
+   std::mt19937_64 engine{static_cast<uint64_t>(state.thread_index())};
+   std::uniform_int_distribution<uint64_t> keys{0, kKeys - 1};
+   for (auto _ : state) {
+      benchmark::DoNotOptimize(tree->lookup(keys(engine)));
+   }
+   state.SetItemsProcessed(state.iterations());
+   if (state.thread_index() == 0) {
+      tree.reset();
+      buffer_manager.reset();
+   }
+}
+
+/// Compares like std::less<>, but keeps the node search on the scalar path.
+struct ScalarLess {
+   bool operator()(uint64_t lhs, uint64_t rhs) const { return lhs < rhs; }
+};
+
+template <typename Compare>
+void Btree_NodeSearch(benchmark::State& state) {
+   auto n = static_cast<size_t>(state.range(0));
+   std::vector<uint64_t> keys(n);
+   for (size_t i = 0; i < n; ++i) {
+      keys[i] = 2 * i;
+   }
+   std::mt19937_64 engine{0};
+   std::uniform_int_distribution<uint64_t> distribution{0, 2 * n};
+   std::vector<uint64_t> probes(1024);
+   for (auto& probe : probes) {
+      probe = distribution(engine);
+   }
+   size_t i = 0;
+   for (auto _ : state) {
+      benchmark::DoNotOptimize(simpledb::lower_bound_simd(keys.data(), keys.data() + n, probes[i++ % probes.size()], Compare{}));
+   }
+   state.SetItemsProcessed(state.iterations());
+}
+
+template <typename Compare>
+void Btree_LookupSearch(benchmark::State& state) {
+   using Tree = simpledb::BTree<uint64_t, uint64_t, Compare, 1u << 16>;
+   constexpr size_t kKeys = 16 * Tree::LeafNode::kCapacity;
+   BufferManager buffer_manager(1u << 16, 64);
+   Tree tree(0, buffer_manager);
+   std::vector<std::pair<uint64_t, uint64_t>> entries;
+   for (uint64_t i = 0; i < kKeys; ++i) {
+      entries.emplace_back(i, 2 * i);
+   }
+   tree.bulk_load(entries.begin(), entries.end());
+   std::mt19937_64 engine{0};
+   std::uniform_int_distribution<uint64_t> keys{0, kKeys - 1};
+   for (auto _ : state) {
+      benchmark::DoNotOptimize(tree.lookup(keys(engine)));
+   }
+   state.SetItemsProcessed(state.iterations());
+}
+
+/// A `Char(32)` key padded with zeros.
+using CharKey = std::array<char, 32>;
+
+CharKey make_char_key(uint64_t i) {
+   CharKey key{};
+   std::snprintf(key.data(), key.size(), "customer#%011lu", i);
+   return key;
+}
+
+/// Lookups of `Char(32)` keys in a BTree with the keys padded to their full width.
+void Btree_CharKeys_Fixed(benchmark::State& state) {
+   using Tree = simpledb::BTree<CharKey, uint64_t, std::less<>, 4096>;
+   constexpr size_t kKeys = 1u << 16;
+   BufferManager buffer_manager(4096, 1024);
+   Tree tree(0, buffer_manager);
+   std::vector<std::pair<CharKey, uint64_t>> entries;
+   for (uint64_t i = 0; i < kKeys; ++i) {
+      entries.emplace_back(make_char_key(i), i);
+   }
+   tree.bulk_load(entries.begin(), entries.end(), 0.7);
+   std::mt19937_64 engine{0};
+   std::uniform_int_distribution<uint64_t> keys{0, kKeys - 1};
+   for (auto _ : state) {
+      benchmark::DoNotOptimize(tree.lookup(entries[keys(engine)].first));
+   }
+   state.SetItemsProcessed(state.iterations());
+   state.counters["nodes"] = static_cast<double>(tree.nodeCount.load());
+   state.counters["height"] = tree.treeHeight.load();
+}
+
+/// Lookups of the same keys in a StringBTree without the padding.
+void Btree_CharKeys_String(benchmark::State& state) {
+   using Tree = simpledb::StringBTree<uint64_t, 4096>;
+   constexpr size_t kKeys = 1u << 16;
+   BufferManager buffer_manager(4096, 1024);
+   Tree tree(0, buffer_manager);
+   std::vector<std::string> keys;
+   for (uint64_t i = 0; i < kKeys; ++i) {
+      keys.emplace_back(make_char_key(i).data());
+   }
+   // random order so the nodes are about as full as the bulk loaded ones
+   std::vector<uint64_t> order(kKeys);
+   std::iota(order.begin(), order.end(), 0);
+   std::shuffle(order.begin(), order.end(), std::mt19937_64{0});
+   for (auto i : order) {
+      tree.insert(keys[i], i);
+   }
+   std::mt19937_64 engine{0};
+   std::uniform_int_distribution<uint64_t> distribution{0, kKeys - 1};
+   for (auto _ : state) {
+      benchmark::DoNotOptimize(tree.lookup(keys[distribution(engine)]));
+   }
+   state.SetItemsProcessed(state.iterations());
+   state.counters["nodes"] = static_cast<double>(tree.nodeCount.load());
+   state.counters["height"] = tree.treeHeight.load();
+}
+
+/// Probes a tree that is much larger than the CPU caches with batches of random keys, either
+/// one `lookup()` after another or all at once with `lookup_batch()`.
+void Btree_LookupBatch(benchmark::State& state) {
+   constexpr size_t kKeys = 1u << 22;
+   static std::unique_ptr<BufferManager> buffer_manager;
+   static std::unique_ptr<BTree> tree;
+   if (!tree) {
+      buffer_manager = std::make_unique<BufferManager>(1024, kKeys / BTree::LeafNode::kCapacity * 5 / 4);
+      tree = std::make_unique<BTree>(0, *buffer_manager);
+      std::vector<std::pair<uint64_t, uint64_t>> entries;
+      for (uint64_t i = 0; i < kKeys; ++i) {
+         entries.emplace_back(i, 2 * i);
+      }
+      tree->bulk_load(entries.begin(), entries.end());
+   }
+
+   std::mt19937_64 engine{0};
+   std::uniform_int_distribution<uint64_t> distribution{0, kKeys - 1};
+   std::vector<uint64_t> keys(state.range(1));
+   std::vector<std::optional<uint64_t>> values(keys.size());
+   for (auto _ : state) {
+      state.PauseTiming();
+      for (auto& key : keys) {
+         key = distribution(engine);
+      }
+      state.ResumeTiming();
+      if (state.range(0)) {
+         tree->lookup_batch(keys, values);
+      } else {
+         for (size_t i = 0; i < keys.size(); ++i) {
+            values[i] = tree->lookup(keys[i]);
+         }
+      }
+      benchmark::DoNotOptimize(values.data());
+   }
+   state.SetItemsProcessed(state.iterations() * keys.size());
+}
+
+void Btree_Load(benchmark::State& state) {
+   constexpr size_t kKeys = 256 * BTree::LeafNode::kCapacity;
+   std::vector<std::pair<uint64_t, uint64_t>> entries;
+   for (uint64_t i = 0; i < kKeys; ++i) {
+      entries.emplace_back(i, 2 * i);
+   }
+   for (auto _ : state) {
+      BufferManager buffer_manager(1024, 1024);
+      BTree tree(0, buffer_manager);
+      if (state.range(0)) {
+         tree.bulk_load(entries.begin(), entries.end());
+      } else {
+         for (auto& [key, value] : entries) {
+            tree.insert(key, value);
+         }
+      }
+   }
+   state.SetItemsProcessed(state.iterations() * kKeys);
+}
+
+void Btree_Scan(benchmark::State& state) {
+   constexpr size_t kKeys = 64 * BTree::LeafNode::kCapacity;
+   BufferManager buffer_manager(1024, 1024);
+   BTree tree(0, buffer_manager);
+   for (uint64_t i = 0; i < kKeys; ++i) {
+      tree.insert(i, 2 * i);
+   }
+   const auto length = static_cast<uint64_t>(state.range(0));
+   std::mt19937_64 engine{0};
+   std::uniform_int_distribution<uint64_t> keys{0, kKeys - length};
+   for (auto _ : state) {
+      auto from = keys(engine);
+      uint64_t sum = 0;
+      tree.scan(from, from + length - 1, [&](uint64_t, uint64_t value) {
+         sum += value;
+         return true;
+      });
+      benchmark::DoNotOptimize(sum);
+   }
+   state.SetItemsProcessed(state.iterations() * length);
+}
+
 BENCHMARK(Btree_Multi)->UseRealTime()->MinTime(30);
+BENCHMARK(Btree_Lookup)->UseRealTime()->Threads(1)->Threads(8)->Threads(32);
+BENCHMARK_TEMPLATE(Btree_NodeSearch, std::less<>)->Arg(BTree::LeafNode::kCapacity)->Arg(4095);
+BENCHMARK_TEMPLATE(Btree_NodeSearch, ScalarLess)->Arg(BTree::LeafNode::kCapacity)->Arg(4095);
+BENCHMARK_TEMPLATE(Btree_LookupSearch, std::less<>);
+BENCHMARK_TEMPLATE(Btree_LookupSearch, ScalarLess);
+BENCHMARK(Btree_CharKeys_Fixed);
+BENCHMARK(Btree_CharKeys_String);
+BENCHMARK(Btree_LookupBatch)->ArgNames({"batch", "keys"})->ArgsProduct({{0, 1}, {64, 4096}});
+BENCHMARK(Btree_Load)->ArgName("bulk")->Arg(0)->Arg(1);
+BENCHMARK(Btree_Scan)->Arg(10)->Arg(100)->Arg(1000);
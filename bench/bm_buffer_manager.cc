@@ -1,5 +1,8 @@
 #include "benchmark/benchmark.h"
 #include "simpledb/buffer_manager.h"
+#include "simpledb/wal.h"
+#include <chrono>
+#include <cstring>
 #include <random>
 #include <thread>
 #include <vector>
@@ -42,6 +45,59 @@ void BufferManager(benchmark::State& state) {
       }
    }
 }
+
+void BufferManagerHits(benchmark::State& state) {
+   // all pages are resident, so every fix is a hit
+   constexpr size_t kPages = 4096;
+   static std::unique_ptr<simpledb::BufferManager> buffer_manager;
+   if (state.thread_index() == 0) {
+      buffer_manager = std::make_unique<simpledb::BufferManager>(1024, kPages);
+      for (uint64_t i = 0; i < kPages; ++i) {
+         auto& page = buffer_manager->fix_page(i, false);
+         buffer_manager->unfix_page(page, false);
+      }
+   }
+   std::mt19937_64 engine{static_cast<uint64_t>(state.thread_index())};
+   std::uniform_int_distribution<uint64_t> page_distr{0, kPages - 1};
+   for (auto _ : state) {
+      auto& page = buffer_manager->fix_page(page_distr(engine), false);
+      benchmark::DoNotOptimize(*page.get_data());
+      buffer_manager->unfix_page(page, false);
+   }
+   state.SetItemsProcessed(state.iterations());
+   if (state.thread_index() == 0) {
+      buffer_manager.reset();
+   }
+}
+
+void BufferManagerCommits(benchmark::State& state) {
+   // every iteration changes a page and waits until the change is durable
+   static std::unique_ptr<simpledb::WriteAheadLog> wal;
+   static std::unique_ptr<simpledb::BufferManager> buffer_manager;
+   if (state.thread_index() == 0) {
+      wal = std::make_unique<simpledb::WriteAheadLog>(simpledb::File::make_temporary_file(), std::chrono::microseconds{state.range(0)});
+      buffer_manager = std::make_unique<simpledb::BufferManager>(1024, 1024);
+      buffer_manager->set_wal(wal.get());
+   }
+   auto page_id = static_cast<uint64_t>(state.thread_index());
+   uint64_t counter = 0;
+   for (auto _ : state) {
+      auto& page = buffer_manager->fix_page(page_id, true);
+      ++counter;
+      std::memcpy(page.get_data(), &counter, sizeof(counter));
+      buffer_manager->unfix_page(page, true);
+      wal->commit();
+   }
+   state.SetItemsProcessed(state.iterations());
+   if (state.thread_index() == 0) {
+      state.counters["syncs"] = static_cast<double>(wal->get_sync_count());
+      buffer_manager.reset();
+      wal.reset();
+   }
+}
 } // namespace
 
 BENCHMARK(BufferManager)->UseRealTime()->MinTime(30);
+BENCHMARK(BufferManagerHits)->UseRealTime()->ThreadRange(1, 32);
+// the argument is the group commit window in microseconds
+BENCHMARK(BufferManagerCommits)->UseRealTime()->ThreadRange(1, 32)->Arg(0)->Arg(100);
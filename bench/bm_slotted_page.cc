@@ -5,12 +5,15 @@
 #include "simpledb/segment.h"
 #include "simpledb/slotted_page.h"
 #include <algorithm>
+#include <cstring>
 #include <random>
+#include <span>
 #include <vector>
 // ---------------------------------------------------------------------------------------------------
 
 using BufferManager = simpledb::BufferManager;
 using FSISegment = simpledb::FSISegment;
+using PAXSegment = simpledb::PAXSegment;
 using SPSegment = simpledb::SPSegment;
 using SchemaSegment = simpledb::SchemaSegment;
 using SlottedPage = simpledb::SlottedPage;
@@ -113,6 +116,86 @@ void SlottedPages(benchmark::State& state) {
       }
    }
 }
+
+/// Inserts customer-sized records one by one with `allocate()` and `write()`, or all at once with `insert_batch()`.
+void SlottedPages_Insert(benchmark::State& state) {
+   BufferManager buffer_manager(4096, 1000);
+   SchemaSegment schema_segment(0, buffer_manager);
+   schema_segment.set_schema(getTPCHSchemaLight());
+   auto& table = schema_segment.get_schema()->tables[0];
+
+   constexpr size_t record_count = 10000;
+   std::vector<std::byte> arena(record_count * 220);
+   std::vector<std::span<const std::byte>> records;
+   for (size_t i = 0; i < record_count; ++i) {
+      records.emplace_back(arena.data() + i * 220, 200 + i % 20);
+   }
+
+   for (auto _ : state) {
+      table.allocated_pages = 0;
+      FSISegment fsi_segment(table.fsi_segment, buffer_manager, table);
+      SPSegment sp_segment(table.sp_segment, buffer_manager, schema_segment, fsi_segment, table);
+      if (state.range(0)) {
+         benchmark::DoNotOptimize(sp_segment.insert_batch(records));
+      } else {
+         for (auto record : records) {
+            auto tid = sp_segment.allocate(record.size());
+            sp_segment.write(tid, const_cast<std::byte*>(record.data()), record.size());
+         }
+      }
+   }
+   state.SetItemsProcessed(state.iterations() * record_count);
+}
+/// Counts the customers whose c_acctbal is in a range, with a scan of the slotted pages or with
+/// `count_between()` on PAX pages of the same table.
+void Customer_CountBetween(benchmark::State& state) {
+   BufferManager buffer_manager(4096, 4000);
+   SchemaSegment schema_segment(0, buffer_manager);
+   schema_segment.set_schema(getTPCHSchemaLight());
+   auto& customer = schema_segment.get_schema()->tables[0];
+   schema::Table table(customer.id, customer.columns, customer.primary_key, customer.sp_segment, customer.fsi_segment, 0, state.range(0) ? schema::Table::kPax : schema::Table::kRows);
+   constexpr size_t acctbal_offset = 4 + 25 + 40 + 4 + 15;
+
+   constexpr size_t record_count = 50000;
+   std::mt19937_64 engine{0};
+   std::uniform_int_distribution<int32_t> acctbal{-1000, 10000};
+   std::vector<std::byte> arena(record_count * 219);
+   std::vector<std::span<const std::byte>> records;
+   for (size_t i = 0; i < record_count; ++i) {
+      auto value = acctbal(engine);
+      std::memcpy(arena.data() + i * 219 + acctbal_offset, &value, sizeof(value));
+      records.emplace_back(arena.data() + i * 219, 219);
+   }
+
+   FSISegment fsi_segment(table.fsi_segment, buffer_manager, table);
+   SPSegment sp_segment(table.sp_segment, buffer_manager, schema_segment, fsi_segment, table);
+   PAXSegment pax_segment(table.sp_segment, buffer_manager, table);
+   if (state.range(0)) {
+      pax_segment.insert_batch(records);
+   } else {
+      sp_segment.insert_batch(records);
+   }
+
+   for (auto _ : state) {
+      uint64_t count = 0;
+      if (state.range(0)) {
+         count = pax_segment.count_between(5, 0, 5000);
+      } else {
+         sp_segment.scan([&](const SPSegment::ScanBatch& batch) {
+            for (size_t i = 0; i < batch.size(); ++i) {
+               int32_t value;
+               std::memcpy(&value, batch.get_record(i).data() + acctbal_offset, sizeof(value));
+               count += 0 <= value && value <= 5000;
+            }
+            return true;
+         });
+      }
+      benchmark::DoNotOptimize(count);
+   }
+   state.SetItemsProcessed(state.iterations() * record_count);
+}
 } // namespace
 
 BENCHMARK(SlottedPages)->UseRealTime()->MinTime(30);
+BENCHMARK(SlottedPages_Insert)->ArgName("batch")->Arg(0)->Arg(1);
+BENCHMARK(Customer_CountBetween)->ArgName("pax")->Arg(0)->Arg(1);
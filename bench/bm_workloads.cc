@@ -0,0 +1,284 @@
+#include "benchmark/benchmark.h"
+#include "simpledb/btree.h"
+#include "simpledb/database.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+// ---------------------------------------------------------------------------------------------------
+
+using BufferManager = simpledb::BufferManager;
+using BTree = simpledb::BTree<uint64_t, uint64_t, std::less<>, 1024>;
+using Database = simpledb::Database;
+
+namespace schema = simpledb::schema;
+
+namespace {
+
+/// Draws keys of [0, n) with a Zipfian distribution, key 0 is the most popular one. Follows the
+/// generator of YCSB (Gray et al., "Quickly Generating Billion-Record Synthetic Databases").
+class ZipfianGenerator {
+   public:
+   ZipfianGenerator(uint64_t n, double theta = 0.99)
+      : n(n), theta(theta), alpha(1 / (1 - theta)), zetan(zeta(n, theta)), eta((1 - std::pow(2.0 / static_cast<double>(n), 1 - theta)) / (1 - zeta(2, theta) / zetan)) {}
+
+   template <typename Engine>
+   uint64_t operator()(Engine& engine) {
+      auto u = std::uniform_real_distribution<double>{0, 1}(engine);
+      auto uz = u * zetan;
+      if (uz < 1)
+         return 0;
+      if (uz < 1 + std::pow(0.5, theta))
+         return 1;
+      return std::min(n - 1, static_cast<uint64_t>(static_cast<double>(n) * std::pow(eta * u - eta + 1, alpha)));
+   }
+
+   private:
+   static double zeta(uint64_t n, double theta) {
+      double sum = 0;
+      for (uint64_t i = 1; i <= n; ++i) {
+         sum += 1 / std::pow(static_cast<double>(i), theta);
+      }
+      return sum;
+   }
+
+   uint64_t n;
+   double theta;
+   double alpha;
+   double zetan;
+   double eta;
+};
+
+/// Spreads the popular keys of a Zipfian distribution over the whole key space, like YCSB's
+/// scrambled Zipfian, so that they don't all share the first leaves.
+uint64_t scramble(uint64_t rank, uint64_t n) {
+   return (rank * 0x9E3779B97F4A7C15ull) % n;
+}
+
+std::unique_ptr<schema::Schema> getTPCHSchemaLight(schema::Table::Layout layout) {
+   std::vector<schema::Table> tables{
+      schema::Table(
+         "customer",
+         {
+            schema::Column("c_custkey", schema::Type::Integer()),
+            schema::Column("c_name", schema::Type::Char(25)),
+            schema::Column("c_address", schema::Type::Char(40)),
+            schema::Column("c_nationkey", schema::Type::Integer()),
+            schema::Column("c_phone", schema::Type::Char(15)),
+            schema::Column("c_acctbal", schema::Type::Integer()),
+            schema::Column("c_mktsegment", schema::Type::Char(10)),
+            schema::Column("c_comment", schema::Type::Char(117)),
+         },
+         {"c_custkey"},
+         10, 11,
+         0, layout),
+   };
+   return std::make_unique<schema::Schema>(std::move(tables));
+}
+
+/// Rows of the TPC-H customer table, as dbgen would print them.
+std::vector<std::vector<std::string>> makeCustomers(size_t count) {
+   static constexpr const char* kSegments[] = {"AUTOMOBILE", "BUILDING", "FURNITURE", "HOUSEHOLD", "MACHINERY"};
+   std::mt19937_64 engine{0};
+   std::uniform_int_distribution<int32_t> acctbal{-999, 9999};
+   std::uniform_int_distribution<int32_t> nation{0, 24};
+   std::vector<std::vector<std::string>> rows;
+   rows.reserve(count);
+   for (size_t i = 0; i < count; ++i) {
+      auto key = std::to_string(i + 1);
+      rows.push_back({key, "Customer#" + key, "address of customer " + key, std::to_string(nation(engine)),
+                      "25-989-741-2988", std::to_string(acctbal(engine)), kSegments[i % 5],
+                      "regular, ironic deposits haggle furiously along the carefully final accounts"});
+   }
+   return rows;
+}
+
+/// Removes the segment files of the customer table.
+void removeCustomerFiles() {
+   for (const char* file : {"0", "10", "11"}) {
+      std::remove(file);
+   }
+}
+
+/// Drops the pages of a file from the page cache of the operating system.
+void dropPageCache(const char* filename) {
+   auto fd = ::open(filename, O_RDONLY | O_CLOEXEC);
+   if (fd < 0)
+      return;
+   ::fdatasync(fd);
+   ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+   ::close(fd);
+}
+
+/// The operations of the YCSB core workloads.
+enum Workload : int64_t {
+   /// 50% reads, 50% updates
+   kYcsbA,
+   /// 95% reads, 5% updates
+   kYcsbB,
+   /// only reads
+   kYcsbC,
+};
+
+/// Runs a YCSB workload with Zipfian keys over a B+-tree whose pool holds `pool` percent of the
+/// tree's pages, with every thread count of the range.
+void Ycsb(benchmark::State& state) {
+   constexpr size_t kKeys = 256 * BTree::LeafNode::kCapacity;
+   static std::unique_ptr<BufferManager> buffer_manager;
+   static std::unique_ptr<BTree> tree;
+   static std::unique_ptr<ZipfianGenerator> zipfian;
+   if (state.thread_index() == 0) {
+      std::remove("0");
+      buffer_manager = std::make_unique<BufferManager>(1024, 4096, false, 4096);
+      tree = std::make_unique<BTree>(0, *buffer_manager);
+      std::vector<std::pair<uint64_t, uint64_t>> entries;
+      for (uint64_t i = 0; i < kKeys; ++i) {
+         entries.emplace_back(i, 2 * i);
+      }
+      // leave room for updates that grow the leaves
+      tree->bulk_load(entries.begin(), entries.end(), 0.7);
+      auto pages = buffer_manager->get_fifo_list().size() + buffer_manager->get_lru_list().size();
+      // every thread holds a few pages while it descends
+      buffer_manager->resize(std::max<size_t>(pages * state.range(1) / 100, 64));
+      if (!zipfian)
+         zipfian = std::make_unique<ZipfianGenerator>(kKeys);
+   }
+   const double read_share = state.range(0) == kYcsbA ? 0.5 : state.range(0) == kYcsbB ? 0.95 : 1.0;
+   std::mt19937_64 engine{static_cast<uint64_t>(state.thread_index())};
+   std::bernoulli_distribution read{read_share};
+   for (auto _ : state) {
+      auto key = scramble((*zipfian)(engine), kKeys);
+      if (read(engine)) {
+         benchmark::DoNotOptimize(tree->lookup(key));
+      } else {
+         tree->insert(key, key + 1);
+      }
+   }
+   state.SetItemsProcessed(state.iterations());
+   if (state.thread_index() == 0) {
+      tree.reset();
+      buffer_manager.reset();
+      std::remove("0");
+   }
+}
+
+/// Inserts TPC-H customers through `Database`, one row or a batch at a time.
+void Database_Insert(benchmark::State& state) {
+   constexpr size_t kRows = 20000;
+   const auto batch_size = static_cast<size_t>(state.range(0));
+   auto rows = makeCustomers(kRows);
+   for (auto _ : state) {
+      state.PauseTiming();
+      removeCustomerFiles();
+      auto database = std::make_unique<Database>(std::vector<Database::PoolOptions>{{4096, 8192, 0}});
+      database->load_new_schema(getTPCHSchemaLight(schema::Table::kRows));
+      auto& table = database->get_schema().tables[0];
+      state.ResumeTiming();
+
+      for (size_t i = 0; i < kRows; i += batch_size) {
+         std::vector<std::vector<std::string>> batch(rows.begin() + i, rows.begin() + std::min(i + batch_size, kRows));
+         benchmark::DoNotOptimize(database->insert_batch(table, batch));
+      }
+
+      state.PauseTiming();
+      database.reset();
+      state.ResumeTiming();
+   }
+   state.SetItemsProcessed(state.iterations() * kRows);
+   removeCustomerFiles();
+}
+
+/// Sums c_acctbal of all customers with a scan through `Database`, with the slotted page or the
+/// PAX layout and a pool that holds `pool` percent of the table.
+void Database_Scan(benchmark::State& state) {
+   constexpr size_t kRows = 50000;
+   constexpr size_t acctbal_offset = 4 + 25 + 40 + 4 + 15;
+   removeCustomerFiles();
+   {
+      Database database({{4096, 8192, 0}});
+      database.load_new_schema(getTPCHSchemaLight(state.range(0) ? schema::Table::kPax : schema::Table::kRows));
+      database.insert_batch(database.get_schema().tables[0], makeCustomers(kRows));
+      auto& pool = database.get_pool(0);
+      auto pages = pool.get_fifo_list().size() + pool.get_lru_list().size();
+      pool.resize(std::max<size_t>(pages * state.range(1) / 100, 64));
+
+      auto& table = database.get_schema().tables[0];
+      for (auto _ : state) {
+         int64_t sum = 0;
+         database.scan(table, [&](simpledb::TID, std::span<const std::byte> record) {
+            int32_t value;
+            std::memcpy(&value, record.data() + acctbal_offset, sizeof(value));
+            sum += value;
+            return true;
+         });
+         benchmark::DoNotOptimize(sum);
+      }
+   }
+   state.SetItemsProcessed(state.iterations() * kRows);
+   removeCustomerFiles();
+}
+
+/// The states of the caches before a scan.
+enum Cache : int64_t {
+   /// the pages are in the buffer pool
+   kWarmPool,
+   /// the pages are only in the page cache of the operating system
+   kWarmOs,
+   /// the pages have to be read from the disk
+   kCold,
+};
+
+/// Scans the customer table through `Database` from a warm pool, from the page cache, or from
+/// disk. The database is opened again from its catalog for the cold scans.
+void Io_Scan(benchmark::State& state) {
+   constexpr size_t kRows = 50000;
+   const auto cache = state.range(0);
+   const std::vector<Database::PoolOptions> pools{{4096, 8192, 0}};
+   removeCustomerFiles();
+   {
+      Database database(pools);
+      database.load_new_schema(getTPCHSchemaLight(schema::Table::kRows));
+      database.insert_batch(database.get_schema().tables[0], makeCustomers(kRows));
+   }
+
+   auto database = std::make_unique<Database>(pools);
+   database->load_schema(0);
+   for (auto _ : state) {
+      if (cache != kWarmPool) {
+         state.PauseTiming();
+         database = std::make_unique<Database>(pools);
+         database->load_schema(0);
+         if (cache == kCold)
+            dropPageCache("10");
+         state.ResumeTiming();
+      }
+      size_t count = 0;
+      database->scan(database->get_schema().tables[0], [&](simpledb::TID, std::span<const std::byte>) {
+         ++count;
+         return true;
+      });
+      benchmark::DoNotOptimize(count);
+   }
+   state.SetItemsProcessed(state.iterations() * kRows);
+   database.reset();
+   removeCustomerFiles();
+}
+
+} // namespace
+
+BENCHMARK(Ycsb)
+   ->ArgNames({"workload", "pool"})
+   ->ArgsProduct({{kYcsbA, kYcsbB, kYcsbC}, {10, 50, 100}})
+   ->UseRealTime()
+   ->ThreadRange(1, static_cast<int>(std::max(1u, std::thread::hardware_concurrency())));
+BENCHMARK(Database_Insert)->ArgName("batch")->Arg(1)->Arg(1000)->UseRealTime();
+BENCHMARK(Database_Scan)->ArgNames({"pax", "pool"})->ArgsProduct({{0, 1}, {10, 100}})->UseRealTime();
+BENCHMARK(Io_Scan)->ArgName("cache")->Arg(kWarmPool)->Arg(kWarmOs)->Arg(kCold)->UseRealTime();
@@ -2,6 +2,7 @@ set(BENCH_CC
         bench/bm_buffer_manager.cc
         bench/bm_slotted_page.cc
         bench/bm_btree.cc
+        bench/bm_workloads.cc
         )
 
 add_executable(benchmarks bench/benchmark.cc ${BENCH_CC})
@@ -3,11 +3,16 @@ set(
         include/simpledb/binary_search.h
         include/simpledb/btree.h
         include/simpledb/buffer_manager.h
+        include/simpledb/compression.h
         include/simpledb/config.h
         include/simpledb/database.h
         include/simpledb/file.h
         include/simpledb/hex_dump.h
+        include/simpledb/metrics.h
+        include/simpledb/pax_page.h
         include/simpledb/schema.h
         include/simpledb/segment.h
         include/simpledb/slotted_page.h
+        include/simpledb/string_btree.h
+        include/simpledb/wal.h
 )
\ No newline at end of file
@@ -1,6 +1,15 @@
 #pragma once
 #include <bit>
+#include <cstddef>
+#include <cstdint>
 #include <functional>
+#include <iterator>
+#include <type_traits>
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
 
 namespace simpledb {
 
@@ -22,4 +31,112 @@ size_t lower_bound_branchless(It low, It up, const T& val, Compare cmp = {}) {
    return i;
 }
 
-}
\ No newline at end of file
+/// Whether `lower_bound_simd()` compares keys of type `T` with `Compare` in SIMD registers.
+template <typename T, typename Compare>
+constexpr bool kSimdSearchable = std::is_integral_v<T> && (sizeof(T) == 4 || sizeof(T) == 8) &&
+   (std::is_same_v<Compare, std::less<>> || std::is_same_v<Compare, std::less<T>>);
+
+namespace detail {
+
+/// The number of keys that are compared at once at the end of `lower_bound_simd()`, one cache line.
+template <typename T>
+constexpr size_t kSimdBlock = 64 / sizeof(T);
+
+/// Returns the number of keys in [keys, keys + n) that are less than `val`.
+/// `n` must not be larger than `kSimdBlock<T>`, no key past `n` is read.
+template <typename T>
+size_t count_less(const T* keys, size_t n, T val) {
+#if defined(__AVX512F__)
+   // a single masked compare of the whole cache line
+   auto mask = static_cast<uint16_t>((1u << n) - 1);
+   if constexpr (sizeof(T) == 8) {
+      auto k = _mm512_maskz_loadu_epi64(static_cast<__mmask8>(mask), keys);
+      auto v = _mm512_set1_epi64(static_cast<int64_t>(val));
+      __mmask8 less = std::is_signed_v<T> ? _mm512_mask_cmplt_epi64_mask(static_cast<__mmask8>(mask), k, v) : _mm512_mask_cmplt_epu64_mask(static_cast<__mmask8>(mask), k, v);
+      return std::popcount(static_cast<unsigned>(less));
+   } else {
+      auto k = _mm512_maskz_loadu_epi32(mask, keys);
+      auto v = _mm512_set1_epi32(static_cast<int32_t>(val));
+      __mmask16 less = std::is_signed_v<T> ? _mm512_mask_cmplt_epi32_mask(mask, k, v) : _mm512_mask_cmplt_epu32_mask(mask, k, v);
+      return std::popcount(static_cast<unsigned>(less));
+   }
+#elif defined(__AVX2__)
+   // AVX2 only compares signed integers, flipping the sign bit maps unsigned ones onto them
+   constexpr size_t kLanes = 32 / sizeof(T);
+   size_t count = 0;
+   size_t i = 0;
+   if constexpr (sizeof(T) == 8) {
+      auto flip = _mm256_set1_epi64x(std::is_signed_v<T> ? 0 : INT64_MIN);
+      auto v = _mm256_xor_si256(_mm256_set1_epi64x(static_cast<int64_t>(val)), flip);
+      for (; i + kLanes <= n; i += kLanes) {
+         auto k = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + i)), flip);
+         count += std::popcount(static_cast<unsigned>(_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(v, k)))));
+      }
+   } else {
+      auto flip = _mm256_set1_epi32(std::is_signed_v<T> ? 0 : INT32_MIN);
+      auto v = _mm256_xor_si256(_mm256_set1_epi32(static_cast<int32_t>(val)), flip);
+      for (; i + kLanes <= n; i += kLanes) {
+         auto k = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + i)), flip);
+         count += std::popcount(static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(v, k)))));
+      }
+   }
+   for (; i < n; ++i) {
+      count += keys[i] < val;
+   }
+   return count;
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+   constexpr size_t kLanes = 16 / sizeof(T);
+   size_t count = 0;
+   size_t i = 0;
+   for (; i + kLanes <= n; i += kLanes) {
+      // every lane that compares less is all ones, the shift leaves a one in it
+      if constexpr (sizeof(T) == 8 && std::is_signed_v<T>) {
+         count += vaddvq_u64(vshrq_n_u64(vcltq_s64(vld1q_s64(keys + i), vdupq_n_s64(val)), 63));
+      } else if constexpr (sizeof(T) == 8) {
+         count += vaddvq_u64(vshrq_n_u64(vcltq_u64(vld1q_u64(keys + i), vdupq_n_u64(val)), 63));
+      } else if constexpr (std::is_signed_v<T>) {
+         count += vaddvq_u32(vshrq_n_u32(vcltq_s32(vld1q_s32(keys + i), vdupq_n_s32(val)), 31));
+      } else {
+         count += vaddvq_u32(vshrq_n_u32(vcltq_u32(vld1q_u32(keys + i), vdupq_n_u32(val)), 31));
+      }
+   }
+   for (; i < n; ++i) {
+      count += keys[i] < val;
+   }
+   return count;
+#else
+   // simple enough for the compiler to vectorize on its own
+   size_t count = 0;
+   for (size_t i = 0; i < n; ++i) {
+      count += keys[i] < val;
+   }
+   return count;
+#endif
+}
+
+} // namespace detail
+
+/// Returns the same as `lower_bound_branchless()`. For integer keys in ascending order, the range
+/// is narrowed down to a single cache line by a branchless binary search first, whose keys are then
+/// compared all at once in SIMD registers (AVX-512, AVX2 or NEON, whatever the target supports).
+/// Falls back to `lower_bound_branchless()` for all other keys and comparators.
+template <typename It, typename T, typename Compare = std::less<>>
+size_t lower_bound_simd(It low, It up, const T& val, Compare cmp = {}) {
+   using KeyT = std::remove_cv_t<std::remove_pointer_t<It>>;
+   if constexpr (std::is_pointer_v<It> && std::is_same_v<KeyT, T> && kSimdSearchable<KeyT, Compare>) {
+      size_t l = up - low;
+      size_t i = 0;
+
+      // the lower bound is in [i, i + l]
+      while (l > detail::kSimdBlock<KeyT>) {
+         auto half = l / 2;
+         i = low[i + half] < val ? i + half : i;
+         l -= half;
+      }
+      return i + detail::count_less(low + i, l, val);
+   } else {
+      return lower_bound_branchless(low, up, val, cmp);
+   }
+}
+
+}
@@ -2,11 +2,20 @@
 
 #include "simpledb/binary_search.h"
 #include "simpledb/buffer_manager.h"
+#include "simpledb/metrics.h"
 #include "simpledb/segment.h"
+#include <algorithm>
+#include <array>
 #include <atomic>
 #include <cassert>
 #include <cstring>
+#include <iterator>
 #include <mutex>
+#include <numeric>
+#include <optional>
+#include <span>
+#include <utility>
+#include <vector>
 
 namespace simpledb {
 
@@ -47,7 +56,7 @@ struct BTree : public Segment {
          if (this->count == 0)
             return {0, false};
          auto cmp = ComparatorT{};
-         auto i = lower_bound_branchless(&keys[0], &keys[this->count - 1], key, cmp);
+         auto i = lower_bound_simd(&keys[0], &keys[this->count - 1], key, cmp);
          return {i, i < this->count - 1UL && keys[i] == key};
       }
 
@@ -125,16 +134,20 @@ struct BTree : public Segment {
    };
 
    struct LeafNode : public Node {
+      /// Value of `next` in the rightmost leaf.
+      static constexpr uint64_t kNoLeaf = ~0ull;
       /// The capacity of a node.
-      static constexpr uint32_t kCapacity = (PageSize - sizeof(Node)) / (sizeof(KeyT) + sizeof(ValueT));
+      static constexpr uint32_t kCapacity = (PageSize - sizeof(Node) - sizeof(uint64_t)) / (sizeof(KeyT) + sizeof(ValueT));
 
+      /// The page of the right sibling.
+      uint64_t next;
       /// The keys.
       KeyT keys[kCapacity];
       /// The values.
       ValueT values[kCapacity];
 
       /// Constructor.
-      LeafNode() : Node(0, 0) {}
+      LeafNode() : Node(0, 0), next(kNoLeaf) {}
 
       /// Returns if there is enough space left to fit another entry.
       [[nodiscard]] bool has_space() const { return this->count < kCapacity; };
@@ -144,7 +157,7 @@ struct BTree : public Segment {
          if (this->count == 0)
             return {0, false};
          auto cmp = ComparatorT{};
-         auto i = lower_bound_branchless(&keys[0], &keys[this->count], key, cmp);
+         auto i = lower_bound_simd(&keys[0], &keys[this->count], key, cmp);
          return {i, i < this->count && keys[i] == key};
       }
 
@@ -241,17 +254,34 @@ struct BTree : public Segment {
       }
    };
 
+   static_assert(sizeof(InnerNode) <= PageSize && sizeof(LeafNode) <= PageSize);
+
    /// The root.
-   uint64_t root;
+   std::atomic<uint64_t> root;
+   /// The frame the root was in last time, saves the page table lookup on every traversal.
+   std::atomic<BufferFrame*> rootFrame = nullptr;
 
-   /// Node count.
+   /// Node count, including the nodes that were freed again.
    std::atomic<uint64_t> nodeCount = 0;
    /// Tree height.
    std::atomic<uint16_t> treeHeight = 0;
 
+   /// Nodes that are below this share of their capacity are merged with or refilled from a sibling.
+   double underflowThreshold;
+
+   /// Latch for `freeNodes`.
+   std::mutex freeLatch;
+   /// Nodes that were merged away and are reused for new ones.
+   std::vector<uint64_t> freeNodes;
+
    /// Constructor.
-   BTree(uint16_t segment_id, BufferManager& buffer_manager)
-      : Segment(segment_id, buffer_manager) {
+   /// @param[in] segment_id           The segment of the tree.
+   /// @param[in] buffer_manager       The buffer manager.
+   /// @param[in] underflow_threshold  Nodes below this share of their capacity are rebalanced after
+   ///                                 an erase, 0 never rebalances. At most 0.5.
+   BTree(uint16_t segment_id, BufferManager& buffer_manager, double underflow_threshold = 0.25)
+      : Segment(segment_id, buffer_manager), underflowThreshold(underflow_threshold) {
+      assert(underflow_threshold >= 0 && underflow_threshold <= 0.5);
       auto pid = create_new_node();
       auto& bf = buffer_manager.fix_page(pid, true);
       new (bf.get_data()) LeafNode();
@@ -267,9 +297,29 @@ struct BTree : public Segment {
 
    /// Creates a new node and returns its PID.
    uint64_t create_new_node() {
+      {
+         std::unique_lock lock(freeLatch);
+         if (!freeNodes.empty()) {
+            auto pid = freeNodes.back();
+            freeNodes.pop_back();
+            return pid;
+         }
+      }
       return (static_cast<uint64_t>(segment_id) << 48) ^ nodeCount++;
    }
 
+   /// Returns a node that is no longer part of the tree, so it can be reused.
+   void free_node(uint64_t pid) {
+      std::unique_lock lock(freeLatch);
+      freeNodes.push_back(pid);
+   }
+
+   /// Returns if a node is below the underflow threshold.
+   [[nodiscard]] bool is_underfull(const Node& node) const {
+      auto capacity = node.is_leaf() ? LeafNode::kCapacity : InnerNode::kCapacity;
+      return node.count < underflowThreshold * capacity;
+   }
+
    /// Grows the root of the tree and returns the new root's buffer frame.
    BufferFrame& grow_root(uint16_t level, KeyT sep_key, uint64_t left_child, uint64_t right_child) {
       auto pid = create_new_node();
@@ -289,101 +339,599 @@ struct BTree : public Segment {
       return bf;
    }
 
+   /// Builds the tree bottom-up from entries in strictly ascending key order. Every node is filled
+   /// up to `fill_factor` of its capacity and the pages are allocated in the order in which they are
+   /// written, so the leaves and each level of inner nodes end up consecutive in the segment.
+   /// Must be called on an empty tree without concurrent accesses.
+   /// @param[in] begin        The first entry, a pair of key and value.
+   /// @param[in] end          The end of the entries.
+   /// @param[in] fill_factor  The share of each node that is filled, the rest is left for later inserts.
+   template <typename Iterator>
+   void bulk_load(Iterator begin, Iterator end, double fill_factor = 1.0) {
+      assert(fill_factor > 0 && fill_factor <= 1);
+      assert(treeHeight == 1 && nodeCount == 1 && "bulk_load() needs an empty tree");
+
+      size_t entryCount = std::distance(begin, end);
+      if (entryCount == 0)
+         return;
+
+      // the separator key and the page of every node of the level that was built last
+      std::vector<std::pair<KeyT, uint64_t>> level;
+
+      // spread the entries evenly over the leaves, so the last one isn't almost empty
+      auto leafFill = std::max<size_t>(fill_factor * LeafNode::kCapacity, 1);
+      auto leafCount = (entryCount + leafFill - 1) / leafFill;
+      level.reserve(leafCount);
+
+      // the first leaf replaces the empty root
+      auto pid = root.load();
+      for (size_t i = 0; i < leafCount; ++i) {
+         auto count = entryCount / leafCount + (i < entryCount % leafCount);
+         auto& frame = buffer_manager.fix_page(pid, true);
+         auto& leafNode = *new (frame.get_data()) LeafNode();
+
+         for (size_t j = 0; j < count; ++j, ++begin) {
+            assert((level.empty() && j == 0) || ComparatorT{}(j == 0 ? level.back().first : leafNode.keys[j - 1], begin->first));
+            leafNode.keys[j] = begin->first;
+            leafNode.values[j] = begin->second;
+         }
+         leafNode.count = count;
+
+         auto nextPid = i + 1 < leafCount ? create_new_node() : LeafNode::kNoLeaf;
+         leafNode.next = nextPid;
+         level.emplace_back(leafNode.keys[count - 1], pid);
+
+         buffer_manager.unfix_page(frame, true);
+         pid = nextPid;
+      }
+
+      // at least three children per inner node, so none of them ends up with a single child
+      auto innerFill = std::max<size_t>(fill_factor * InnerNode::kCapacity, 3);
+      uint16_t height = 1;
+      while (level.size() > 1) {
+         auto innerCount = (level.size() + innerFill - 1) / innerFill;
+         std::vector<std::pair<KeyT, uint64_t>> upperLevel;
+         upperLevel.reserve(innerCount);
+
+         size_t child = 0;
+         for (size_t i = 0; i < innerCount; ++i) {
+            auto count = level.size() / innerCount + (i < level.size() % innerCount);
+            pid = create_new_node();
+            auto& frame = buffer_manager.fix_page(pid, true);
+            auto& innerNode = *new (frame.get_data()) InnerNode();
+            innerNode.level = height;
+            innerNode.count = count;
+
+            // the last child is bounded by the separator in the parent
+            for (size_t j = 0; j < count; ++j) {
+               innerNode.children[j] = level[child + j].second;
+               if (j + 1 < count)
+                  innerNode.keys[j] = level[child + j].first;
+            }
+            upperLevel.emplace_back(level[child + count - 1].first, pid);
+            child += count;
+
+            buffer_manager.unfix_page(frame, true);
+         }
+
+         level = std::move(upperLevel);
+         ++height;
+      }
+
+      root = level[0].second;
+      treeHeight = height;
+   }
+
+   /// Descend to the leaf that is responsible for a key without latching anything.
+   /// Returns false if a concurrent modification was detected and the caller has to restart.
+   /// @param[in]  key     The key.
+   /// @param[out] frame   The leaf's frame, the leaf itself is not validated yet.
+   /// @param[out] version The version of the leaf's frame.
+   bool find_leaf_optimistic(const KeyT& key, BufferFrame*& frame, uint64_t& version) {
+      auto rootPid = root.load();
+      frame = &buffer_manager.fix_page_optimistic(rootPid, version, rootFrame.load(std::memory_order_relaxed), AccessHint::PIN_HOT);
+      if (root != rootPid) {
+         // root changed -> restart
+         return false;
+      }
+      if (rootFrame.load(std::memory_order_relaxed) != frame) {
+         rootFrame.store(frame, std::memory_order_relaxed);
+      }
+
+      while (!reinterpret_cast<const Node*>(frame->get_optimistic_data())->is_leaf()) {
+         auto& innerNode = *reinterpret_cast<const InnerNode*>(frame->get_optimistic_data());
+
+         // the node may change under our feet, don't trust the count
+         uint32_t count = innerNode.count;
+         if (count == 0 || count > InnerNode::kCapacity) {
+            return false;
+         }
+         auto pos = lower_bound_simd(&innerNode.keys[0], &innerNode.keys[count - 1], key, ComparatorT{});
+         auto childPid = innerNode.children[pos];
+         if (!BufferManager::validate(*frame, version)) {
+            return false;
+         }
+
+         // move down, the parent must still be unchanged once we have the child's version
+         // inner nodes are needed by every lookup, leaves are hit at random
+         auto parentFrame = frame;
+         auto parentVersion = version;
+         auto access = innerNode.level > 1 ? AccessHint::PIN_HOT : AccessHint::RANDOM;
+         frame = &buffer_manager.fix_page_optimistic(childPid, version, nullptr, access);
+         if (!BufferManager::validate(*parentFrame, parentVersion)) {
+            return false;
+         }
+      }
+      return true;
+   }
+
    /// Lookup an entry in the tree.
+   /// Does not latch any node and restarts instead when it runs into concurrent modifications.
    /// @param[in] key      The key that should be searched.
    /// @return             Whether the key was in the tree.
    std::optional<ValueT> lookup(const KeyT& key) {
-   restart:
-      BufferFrame* parentFrame = nullptr;
-      BufferFrame* currentFrame;
+      while (true) {
+         BufferFrame* frame;
+         uint64_t version;
+         if (!find_leaf_optimistic(key, frame, version)) {
+            metrics::count(metrics::Counter::BTREE_RESTARTS);
+            continue;
+         }
 
-      auto rootPid = root;
-      currentFrame = &buffer_manager.fix_page(rootPid, false);
+         auto& leafNode = *reinterpret_cast<const LeafNode*>(frame->get_optimistic_data());
 
-      if (root != rootPid) {
-         // root changed -> restart
-         buffer_manager.unfix_page(*currentFrame, false);
-         goto restart;
+         uint32_t count = leafNode.count;
+         if (count > LeafNode::kCapacity) {
+            metrics::count(metrics::Counter::BTREE_RESTARTS);
+            continue;
+         }
+         auto pos = lower_bound_simd(&leafNode.keys[0], &leafNode.keys[count], key, ComparatorT{});
+         auto val = pos < count && leafNode.keys[pos] == key ? std::optional<ValueT>(leafNode.values[pos]) : std::optional<ValueT>{};
+
+         if (BufferManager::validate(*frame, version)) {
+            return val;
+         }
+         metrics::count(metrics::Counter::BTREE_RESTARTS);
       }
+   }
 
-      while (!reinterpret_cast<Node*>(currentFrame->get_data())->is_leaf()) {
-         auto& innerNode = *reinterpret_cast<InnerNode*>(currentFrame->get_data());
+   /// The number of keys that `lookup_batch()` moves down the tree together.
+   static constexpr size_t kLookupGroupSize = 16;
+
+   /// Looks up many keys at once, sets `values[i]` to the value of `keys[i]` if it is in the tree.
+   /// Sorts the keys first and descends with groups of neighboring keys level by level, so nodes that
+   /// several keys of a group pass through are searched in a row and validated once, and all
+   /// children of a level are prefetched before the first of them is searched. This overlaps the
+   /// cache misses of the group instead of stalling on one after the other.
+   /// @param[in]  keys     The keys that should be searched.
+   /// @param[out] values   The values, same size as `keys`.
+   void lookup_batch(std::span<const KeyT> keys, std::span<std::optional<ValueT>> values) {
+      assert(keys.size() == values.size());
+
+      std::vector<uint32_t> order(keys.size());
+      std::iota(order.begin(), order.end(), 0);
+      std::sort(order.begin(), order.end(), [&keys](uint32_t lhs, uint32_t rhs) { return ComparatorT{}(keys[lhs], keys[rhs]); });
+
+      for (size_t begin = 0; begin < order.size(); begin += kLookupGroupSize) {
+         std::span<const uint32_t> group{&order[begin], std::min(kLookupGroupSize, order.size() - begin)};
+         while (!lookup_group(keys, values, group)) {
+            metrics::count(metrics::Counter::BTREE_RESTARTS);
+         }
+      }
+   }
 
-         auto pos = innerNode.lower_bound(key);
-         assert(pos.first <= innerNode.count);
+   /// Looks up a group of `lookup_batch()` in ascending key order.
+   /// Returns false if a concurrent modification was detected and the caller has to restart.
+   bool lookup_group(std::span<const KeyT> keys, std::span<std::optional<ValueT>> values, std::span<const uint32_t> group) {
+      std::array<BufferFrame*, kLookupGroupSize> frames;
+      std::array<uint64_t, kLookupGroupSize> versions;
 
-         // move down
-         if (parentFrame) {
-            buffer_manager.unfix_page(*parentFrame, false);
+      auto rootPid = root.load();
+      frames[0] = &buffer_manager.fix_page_optimistic(rootPid, versions[0], rootFrame.load(std::memory_order_relaxed), AccessHint::PIN_HOT);
+      if (root != rootPid) {
+         return false;
+      }
+      std::fill_n(frames.begin() + 1, group.size() - 1, frames[0]);
+      std::fill_n(versions.begin() + 1, group.size() - 1, versions[0]);
+
+      // the tree is balanced, so all keys reach the leaves at once
+      while (!reinterpret_cast<const Node*>(frames[0]->get_optimistic_data())->is_leaf()) {
+         auto parents = frames;
+         auto parentVersions = versions;
+         uint64_t previousPid = 0;
+         for (size_t i = 0; i < group.size(); ++i) {
+            auto& innerNode = *reinterpret_cast<const InnerNode*>(parents[i]->get_optimistic_data());
+            uint32_t count = innerNode.count;
+            if (count == 0 || count > InnerNode::kCapacity) {
+               return false;
+            }
+            auto pos = lower_bound_simd(&innerNode.keys[0], &innerNode.keys[count - 1], keys[group[i]], ComparatorT{});
+            auto childPid = innerNode.children[pos];
+
+            if (i > 0 && childPid == previousPid) {
+               // sorted keys often share the child
+               frames[i] = frames[i - 1];
+               versions[i] = versions[i - 1];
+               continue;
+            }
+            frames[i] = &buffer_manager.fix_page_optimistic(childPid, versions[i], nullptr, innerNode.level > 1 ? AccessHint::PIN_HOT : AccessHint::NORMAL);
+            prefetch_node(frames[i]->get_optimistic_data());
+            previousPid = childPid;
+         }
+
+         // the children are only right if the parents were unchanged
+         for (size_t i = 0; i < group.size(); ++i) {
+            if ((i == 0 || parents[i] != parents[i - 1]) && !BufferManager::validate(*parents[i], parentVersions[i])) {
+               return false;
+            }
          }
-         parentFrame = currentFrame;
-         currentFrame = &buffer_manager.fix_page(innerNode.children[pos.first], false);
       }
 
-      assert(reinterpret_cast<Node*>(currentFrame->get_data())->is_leaf());
+      for (size_t i = 0; i < group.size(); ++i) {
+         auto& leafNode = *reinterpret_cast<const LeafNode*>(frames[i]->get_optimistic_data());
+         uint32_t count = leafNode.count;
+         if (!leafNode.is_leaf() || count > LeafNode::kCapacity) {
+            return false;
+         }
+         const auto& key = keys[group[i]];
+         auto pos = lower_bound_simd(&leafNode.keys[0], &leafNode.keys[count], key, ComparatorT{});
+         values[group[i]] = pos < count && leafNode.keys[pos] == key ? std::optional<ValueT>(leafNode.values[pos]) : std::optional<ValueT>{};
+      }
+      for (size_t i = 0; i < group.size(); ++i) {
+         if ((i == 0 || frames[i] != frames[i - 1]) && !BufferManager::validate(*frames[i], versions[i])) {
+            return false;
+         }
+      }
+      return true;
+   }
 
-      auto& leafNode = *reinterpret_cast<LeafNode*>(currentFrame->get_data());
+   /// Prefetches the start of a node into the cache, its header and the keys that are searched first.
+   static void prefetch_node(const char* data) {
+      for (size_t offset = 0; offset < std::min<size_t>(PageSize, 4 * 64); offset += 64) {
+         __builtin_prefetch(data + offset);
+      }
+   }
 
-      auto pos = leafNode.lower_bound(key);
-      assert(pos.first <= leafNode.count);
+   /// Calls `callback(key, value)` for all entries with a key in [from, to] in ascending key order
+   /// until it returns false. Walks the leaves through their sibling links and prefetches the next
+   /// one while the current one is processed. Only holds a second leaf while moving on to it, so
+   /// the sibling can't be merged away in between.
+   /// Entries that are inserted or erased concurrently may or may not be seen. The callback must not
+   /// modify the tree.
+   /// @param[in] from     The smallest key of the range.
+   /// @param[in] to       The largest key of the range.
+   /// @param[in] callback Invoked with the key and value of each entry, returns whether to continue.
+   template <typename Callback>
+   void scan(const KeyT& from, const KeyT& to, Callback&& callback) {
+      auto cmp = ComparatorT{};
+
+      BufferFrame* frame;
+      uint64_t version;
+      while (!find_leaf_optimistic(from, frame, version) || !buffer_manager.upgrade(*frame, version, false)) {
+         metrics::count(metrics::Counter::BTREE_RESTARTS);
+      }
 
-      auto val = pos.second ? std::optional<ValueT>(leafNode.values[pos.first]) : std::optional<ValueT>{};
+      bool started = false;
+      KeyT last{};
+      while (true) {
+         auto& leafNode = *reinterpret_cast<LeafNode*>(frame->get_data());
+         auto next = leafNode.next;
+         if (next != LeafNode::kNoLeaf) {
+            buffer_manager.prefetch(next, 1);
+         }
 
-      if (parentFrame) {
-         buffer_manager.unfix_page(*parentFrame, false);
-      }
-      buffer_manager.unfix_page(*currentFrame, false);
+         // continue after the last key we have seen, the leaf may have been split in between
+         uint32_t pos;
+         if (started) {
+            pos = leafNode.count == 0 ? 0 : lower_bound_simd(&leafNode.keys[0], &leafNode.keys[leafNode.count], last, cmp);
+            if (pos < leafNode.count && !cmp(last, leafNode.keys[pos]))
+               ++pos;
+         } else {
+            pos = leafNode.lower_bound(from).first;
+         }
+
+         for (; pos < leafNode.count; ++pos) {
+            if (cmp(to, leafNode.keys[pos]) || !callback(leafNode.keys[pos], leafNode.values[pos])) {
+               buffer_manager.unfix_page(*frame, false);
+               return;
+            }
+            last = leafNode.keys[pos];
+            started = true;
+         }
 
-      return val;
+         // move on to the right sibling, latches are always acquired from left to right
+         if (next == LeafNode::kNoLeaf) {
+            buffer_manager.unfix_page(*frame, false);
+            return;
+         }
+         auto nextFrame = &buffer_manager.fix_page(next, false);
+         buffer_manager.unfix_page(*frame, false);
+         frame = nextFrame;
+      }
    }
 
    /// Erase an entry in the tree.
+   /// Only latches the leaf, unless it falls below the underflow threshold and has to be rebalanced.
    /// @param[in] key      The key that should be searched.
    void erase(const KeyT& key) {
-   restart:
-      BufferFrame* parentFrame = nullptr;
-      BufferFrame* currentFrame;
+      while (true) {
+         BufferFrame* frame;
+         uint64_t version;
+         if (!find_leaf_optimistic(key, frame, version) || !buffer_manager.upgrade(*frame, version)) {
+            metrics::count(metrics::Counter::BTREE_RESTARTS);
+            continue;
+         }
 
-      auto rootPid = root;
-      currentFrame = &buffer_manager.fix_page(rootPid, treeHeight == 1);
+         // the leaf is unchanged, so it still is the one for the key
+         auto& leafNode = *reinterpret_cast<LeafNode*>(frame->get_data());
+         auto erased = leafNode.erase(key);
+         auto underfull = erased && is_underfull(leafNode) && frame->get_page_id() != root;
+         buffer_manager.unfix_page(*frame, erased);
+         if (underfull) {
+            rebalance(key);
+         }
+         return;
+      }
+   }
 
-      if (root != rootPid) {
+   /// Merges the nodes on the path to a key that are below the underflow threshold with a sibling
+   /// or moves entries over from it, and shrinks the root while it only has a single child.
+   /// Latches the path exclusively with lock coupling.
+   /// @param[in] key      The key.
+   void rebalance(const KeyT& key) {
+   restart:
+      auto currentPid = root.load();
+      auto* currentFrame = &buffer_manager.fix_page(currentPid, true);
+      if (root != currentPid) {
          // root changed -> restart
          buffer_manager.unfix_page(*currentFrame, false);
+         metrics::count(metrics::Counter::BTREE_RESTARTS);
+         goto restart;
+      }
+
+      if (auto& rootNode = *reinterpret_cast<InnerNode*>(currentFrame->get_data()); !rootNode.is_leaf() && rootNode.count == 1) {
+         // the only child becomes the root
+         root = rootNode.children[0];
+         --treeHeight;
+         buffer_manager.unfix_page(*currentFrame, true);
+         free_node(currentPid);
          goto restart;
       }
 
       while (!reinterpret_cast<Node*>(currentFrame->get_data())->is_leaf()) {
          auto& innerNode = *reinterpret_cast<InnerNode*>(currentFrame->get_data());
+         auto pos = innerNode.lower_bound(key).first;
+         auto* childFrame = &buffer_manager.fix_page(innerNode.children[pos], true);
+         auto& child = *reinterpret_cast<Node*>(childFrame->get_data());
+
+         if (is_underfull(child) && innerNode.count > 1) {
+            // latch the siblings from left to right, the parent keeps the children where they are
+            BufferFrame* leftFrame = childFrame;
+            BufferFrame* rightFrame;
+            if (pos + 1 < innerNode.count) {
+               rightFrame = &buffer_manager.fix_page(innerNode.children[pos + 1], true);
+            } else {
+               buffer_manager.unfix_page(*childFrame, false);
+               --pos;
+               leftFrame = &buffer_manager.fix_page(innerNode.children[pos], true);
+               rightFrame = &buffer_manager.fix_page(innerNode.children[pos + 1], true);
+            }
 
-         auto pos = innerNode.lower_bound(key);
-         assert(pos.first <= innerNode.count);
+            // merge if both fit into one node, otherwise share the entries evenly
+            auto& left = *reinterpret_cast<Node*>(leftFrame->get_data());
+            auto& right = *reinterpret_cast<Node*>(rightFrame->get_data());
+            auto capacity = left.is_leaf() ? LeafNode::kCapacity : InnerNode::kCapacity;
+            size_t total = left.count + right.count;
+            auto rightPid = innerNode.children[pos + 1];
+            auto merged = redistribute(innerNode, pos, left, right, total <= capacity ? total : total / 2);
+
+            buffer_manager.unfix_page(*leftFrame, true);
+            buffer_manager.unfix_page(*rightFrame, true);
+            buffer_manager.unfix_page(*currentFrame, true);
+            if (merged) {
+               free_node(rightPid);
+            }
+
+            // the parent may be underfull now
+            goto restart;
+         }
 
          // move down
-         if (parentFrame) {
-            buffer_manager.unfix_page(*parentFrame, false);
+         buffer_manager.unfix_page(*currentFrame, false);
+         currentFrame = childFrame;
+      }
+
+      buffer_manager.unfix_page(*currentFrame, false);
+   }
+
+   /// Rebuilds the tree in place, so that every node but the last one below the same parent is
+   /// filled up to `fill_factor` of its capacity. Nodes are only refilled from their right sibling
+   /// or merged with it, never split, and the emptied ones are freed for reuse.
+   /// Runs concurrently with other operations, it only latches one parent and two of its children at
+   /// a time. Works level by level from the leaves up, leaves below different parents are not merged.
+   /// @param[in] fill_factor  The share of the capacity that each node is filled to.
+   void compact(double fill_factor = 1.0) {
+      assert(fill_factor > 0 && fill_factor <= 1);
+
+      for (uint16_t level = 0; level + 1 < treeHeight; ++level) {
+         auto capacity = level == 0 ? LeafNode::kCapacity : InnerNode::kCapacity;
+         auto fill = std::max<size_t>(fill_factor * capacity, level == 0 ? 1 : 2);
+
+         // go through the parents of the level from left to right
+         std::optional<KeyT> after;
+         do {
+            auto parentFrame = fix_parent(level + 1, after);
+            if (!parentFrame) {
+               // the tree got lower in the meantime
+               break;
+            }
+            auto& parent = *reinterpret_cast<InnerNode*>(parentFrame->get_data());
+
+            bool changed = false;
+            for (uint32_t pos = 0; pos + 1 < parent.count;) {
+               auto& leftFrame = buffer_manager.fix_page(parent.children[pos], true);
+               auto& rightFrame = buffer_manager.fix_page(parent.children[pos + 1], true);
+               auto& left = *reinterpret_cast<Node*>(leftFrame.get_data());
+               auto& right = *reinterpret_cast<Node*>(rightFrame.get_data());
+
+               size_t total = left.count + right.count;
+               auto rightPid = parent.children[pos + 1];
+               bool merged = false;
+               bool moved = left.count < std::min(total, fill);
+               if (moved) {
+                  merged = redistribute(parent, pos, left, right, std::min(total, fill));
+                  changed = true;
+               }
+
+               buffer_manager.unfix_page(leftFrame, moved);
+               buffer_manager.unfix_page(rightFrame, moved);
+               if (merged) {
+                  free_node(rightPid);
+               } else {
+                  // the left one is as full as it gets
+                  ++pos;
+               }
+            }
+            buffer_manager.unfix_page(*parentFrame, changed);
+         } while (after);
+      }
+
+      // shrink the root
+      if (treeHeight > 1) {
+         rebalance(KeyT{});
+      }
+   }
+
+   /// Moves entries between two neighboring children of an inner node, so that the left one ends
+   /// up with `left_count` of them. If that are all of them, the right one is removed from the
+   /// parent and has to be freed by the caller. All three nodes must be latched exclusively.
+   /// @param[in] parent       The parent.
+   /// @param[in] pos          The position of the left child in the parent.
+   /// @param[in] left         The left child.
+   /// @param[in] right        The right child.
+   /// @param[in] left_count   The number of entries or children that the left child gets.
+   /// @return                 Whether the children were merged.
+   bool redistribute(InnerNode& parent, uint32_t pos, Node& left, Node& right, size_t left_count) {
+      size_t total = left.count + right.count;
+      assert(left_count > 0 && left_count <= total);
+
+      KeyT separator{};
+      if (left.is_leaf()) {
+         auto& leftLeaf = static_cast<LeafNode&>(left);
+         auto& rightLeaf = static_cast<LeafNode&>(right);
+         std::vector<KeyT> keys(leftLeaf.keys, leftLeaf.keys + leftLeaf.count);
+         keys.insert(keys.end(), rightLeaf.keys, rightLeaf.keys + rightLeaf.count);
+         std::vector<ValueT> values(leftLeaf.values, leftLeaf.values + leftLeaf.count);
+         values.insert(values.end(), rightLeaf.values, rightLeaf.values + rightLeaf.count);
+
+         std::copy_n(keys.begin(), left_count, leftLeaf.keys);
+         std::copy_n(values.begin(), left_count, leftLeaf.values);
+         std::copy(keys.begin() + left_count, keys.end(), rightLeaf.keys);
+         std::copy(values.begin() + left_count, values.end(), rightLeaf.values);
+         separator = keys[left_count - 1];
+         if (left_count == total) {
+            leftLeaf.next = rightLeaf.next;
+         }
+      } else {
+         // the separator in the parent moves down between the keys of both children
+         auto& leftInner = static_cast<InnerNode&>(left);
+         auto& rightInner = static_cast<InnerNode&>(right);
+         std::vector<KeyT> keys(leftInner.keys, leftInner.keys + leftInner.count - 1);
+         keys.push_back(parent.keys[pos]);
+         keys.insert(keys.end(), rightInner.keys, rightInner.keys + rightInner.count - 1);
+         std::vector<uint64_t> children(leftInner.children, leftInner.children + leftInner.count);
+         children.insert(children.end(), rightInner.children, rightInner.children + rightInner.count);
+
+         std::copy_n(keys.begin(), left_count - 1, leftInner.keys);
+         std::copy_n(children.begin(), left_count, leftInner.children);
+         if (left_count < total) {
+            std::copy(keys.begin() + left_count, keys.end(), rightInner.keys);
+            std::copy(children.begin() + left_count, children.end(), rightInner.children);
+            separator = keys[left_count - 1];
          }
-         parentFrame = currentFrame;
-         currentFrame = &buffer_manager.fix_page(innerNode.children[pos.first], innerNode.level == 1);
       }
+      left.count = left_count;
+      right.count = total - left_count;
 
-      assert(reinterpret_cast<Node*>(currentFrame->get_data())->is_leaf());
+      if (left_count < total) {
+         parent.keys[pos] = separator;
+         return false;
+      }
 
-      auto& leafNode = *reinterpret_cast<LeafNode*>(currentFrame->get_data());
+      // remove the right child, the left one takes over its separator
+      auto moved = parent.count - 2 - pos;
+      memmove(&parent.keys[pos], &parent.keys[pos + 1], moved * sizeof(KeyT));
+      memmove(&parent.children[pos + 1], &parent.children[pos + 2], moved * sizeof(uint64_t));
+      --parent.count;
+      return true;
+   }
 
-      auto erased = leafNode.erase(key);
+   /// Latches the node on a level that is responsible for the keys right after `after` exclusively,
+   /// or for the smallest keys if there is no `after`. Sets `after` to the largest key the node is
+   /// responsible for, or to nothing if it is the rightmost one.
+   /// Returns nullptr if the tree is not that high.
+   BufferFrame* fix_parent(uint16_t level, std::optional<KeyT>& after) {
+   restart:
+      auto currentPid = root.load();
+      auto* currentFrame = &buffer_manager.fix_page(currentPid, true);
+      if (root != currentPid) {
+         buffer_manager.unfix_page(*currentFrame, false);
+         goto restart;
+      }
+      if (reinterpret_cast<Node*>(currentFrame->get_data())->level < level) {
+         buffer_manager.unfix_page(*currentFrame, false);
+         return nullptr;
+      }
 
-      if (parentFrame) {
-         buffer_manager.unfix_page(*parentFrame, false);
+      std::optional<KeyT> upperBound;
+      while (reinterpret_cast<Node*>(currentFrame->get_data())->level > level) {
+         auto& innerNode = *reinterpret_cast<InnerNode*>(currentFrame->get_data());
+         uint32_t pos = 0;
+         if (after) {
+            // the first child whose keys are not all <= after
+            auto bound = innerNode.lower_bound(*after);
+            pos = bound.first + bound.second;
+            pos = std::min<uint32_t>(pos, innerNode.count - 1);
+         }
+         if (pos + 1 < innerNode.count) {
+            upperBound = innerNode.keys[pos];
+         }
+
+         auto* childFrame = &buffer_manager.fix_page(innerNode.children[pos], true);
+         buffer_manager.unfix_page(*currentFrame, false);
+         currentFrame = childFrame;
       }
-      buffer_manager.unfix_page(*currentFrame, erased);
+
+      after = upperBound;
+      return currentFrame;
    }
 
    /// Inserts a new entry into the tree.
    /// @param[in] key      The key that should be inserted.
    /// @param[in] value    The value that should be inserted.
    void insert(const KeyT& key, const ValueT& value) {
-      bool exclusive = false;
+      // try to only latch the leaf first
+      while (true) {
+         BufferFrame* frame;
+         uint64_t version;
+         if (!find_leaf_optimistic(key, frame, version) || !buffer_manager.upgrade(*frame, version)) {
+            metrics::count(metrics::Counter::BTREE_RESTARTS);
+            continue;
+         }
+
+         auto& leafNode = *reinterpret_cast<LeafNode*>(frame->get_data());
+         if (!leafNode.has_space()) {
+            // we have to split
+            buffer_manager.unfix_page(*frame, false);
+            break;
+         }
+         leafNode.insert(key, value);
+         buffer_manager.unfix_page(*frame, true);
+         return;
+      }
+
+      // split with lock coupling
+      bool exclusive = true;
 
    restart:
       BufferFrame* parentFrame = nullptr;
@@ -396,6 +944,7 @@ struct BTree : public Segment {
       if (root != currentPid) {
          // root changed -> restart
          buffer_manager.unfix_page(*currentFrame, false);
+         metrics::count(metrics::Counter::BTREE_RESTARTS);
          goto restart;
       }
 
@@ -418,6 +967,7 @@ struct BTree : public Segment {
             auto rightPid = create_new_node();
             auto& rightBf = buffer_manager.fix_page(rightPid, true);
             auto splitKey = innerNode.split((std::byte*) rightBf.get_data());
+            metrics::count(metrics::Counter::BTREE_SPLITS);
 
             if (parentFrame) {
                // insert split key into parent
@@ -469,6 +1019,12 @@ struct BTree : public Segment {
          auto rightPid = create_new_node();
          auto& rightBf = buffer_manager.fix_page(rightPid, true);
          auto splitKey = leafNode.split((std::byte*) rightBf.get_data());
+         metrics::count(metrics::Counter::BTREE_SPLITS);
+
+         // link the new leaf in right after the old one
+         auto& rightNode = *reinterpret_cast<LeafNode*>(rightBf.get_data());
+         rightNode.next = leafNode.next;
+         leafNode.next = rightPid;
 
          if (parentFrame) {
             // insert split key into parent
@@ -1,12 +1,16 @@
 #pragma once
 
 #include <array>
+#include <atomic>
+#include <condition_variable>
 #include <cstddef>
 #include <cstdint>
+#include <deque>
 #include <exception>
 #include <mutex>
 #include <queue>
 #include <shared_mutex>
+#include <thread>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
@@ -15,30 +19,175 @@
 
 namespace simpledb {
 
+class WriteAheadLog;
+
 using Latch = std::shared_mutex;
 using ExclusiveLatch = std::unique_lock<Latch>;
 using SharedLatch = std::shared_lock<Latch>;
 
+/// Shared mutex with a version that is odd while it is locked exclusively and advances with every
+/// exclusive lock and unlock. Readers can access the protected data without locking anything
+/// and check afterwards whether a writer got in between (optimistic latching):
+/// ```
+/// auto version = latch.read_version(); // odd -> locked, retry
+/// ... read the data, it may be inconsistent ...
+/// if (!latch.validate(version)) retry;
+/// ```
+class VersionLatch {
+   private:
+   Latch latch;
+   std::atomic<uint64_t> version{0};
+
+   public:
+   void lock() {
+      latch.lock();
+      version.store(version.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      // optimistic readers must not see our writes without seeing the odd version
+      std::atomic_thread_fence(std::memory_order_release);
+   }
+
+   bool try_lock() {
+      if (!latch.try_lock())
+         return false;
+      version.store(version.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+      return true;
+   }
+
+   /// Releases the latch in whatever mode the calling thread holds it.
+   void unlock() {
+      // the version can only be odd if it is us who holds the latch exclusively
+      auto current = version.load(std::memory_order_relaxed);
+      if (current & 1) {
+         version.store(current + 1, std::memory_order_release);
+         latch.unlock();
+      } else {
+         latch.unlock_shared();
+      }
+   }
+
+   void lock_shared() { latch.lock_shared(); }
+
+   bool try_lock_shared() { return latch.try_lock_shared(); }
+
+   void unlock_shared() { latch.unlock_shared(); }
+
+   /// Locks the latch exclusively if there was no exclusive lock since `read_version()` returned
+   /// `expected`. Returns whether it did.
+   bool upgrade(uint64_t expected) {
+      lock();
+      if (version.load(std::memory_order_relaxed) == expected + 1)
+         return true;
+      unlock();
+      return false;
+   }
+
+   /// Locks the latch in shared mode if there was no exclusive lock since `read_version()`
+   /// returned `expected`. Returns whether it did.
+   bool upgrade_shared(uint64_t expected) {
+      lock_shared();
+      if (version.load(std::memory_order_relaxed) == expected)
+         return true;
+      unlock_shared();
+      return false;
+   }
+
+   /// Returns the version to validate an optimistic read against. Odd if the latch is locked exclusively.
+   [[nodiscard]] uint64_t read_version() const { return version.load(std::memory_order_acquire); }
+
+   /// Returns whether there was no exclusive lock since `read_version()` returned `expected`.
+   [[nodiscard]] bool validate(uint64_t expected) const {
+      std::atomic_thread_fence(std::memory_order_acquire);
+      return version.load(std::memory_order_relaxed) == expected;
+   }
+};
+
 enum class PageState : uint8_t {
    IN_FIFO,
    IN_LRU,
+   /// Page that was loaded by a scan, see `AccessHint::SEQUENTIAL_ONCE`.
+   IN_RING,
    NOT_LOADED,
-   LOADING
+   LOADING,
+   /// Page of a segment that is mapped read-only, its data lives in the mapping.
+   MAPPED
+};
+
+/// How the pages of a segment are stored in its file.
+enum class PageCompression : uint8_t {
+   /// Every page is stored as it is in its frame.
+   NONE,
+   /// Every page is compressed with `lz_compress()` when it is written and decompressed when it
+   /// is loaded, pages that don't shrink are stored as they are.
+   LZ
+};
+
+/// How a page is going to be accessed, passed to `BufferManager::fix_page()`.
+enum class AccessHint : uint8_t {
+   /// The page may or may not be used again, it is managed by the fifo and lru lists (2Q).
+   NORMAL,
+   /// The page is read once by a scan. It is loaded into a small ring of frames that the scan
+   /// reuses right away, so it doesn't evict the pages that are in the fifo or lru list, and a
+   /// hit on a page that is already loaded doesn't count as a reference.
+   SEQUENTIAL_ONCE,
+   /// The page is accessed at random, a miss never starts reading ahead.
+   RANDOM,
+   /// The page is used all the time, e.g. an upper level of a B+-tree. It goes to the lru list
+   /// right away and is skipped by eviction as long as other pages can be evicted. At most a
+   /// quarter of all pages are pinned like this, further ones are treated as `NORMAL`.
+   PIN_HOT,
+   /// The whole page is going to be overwritten by an exclusive fix. A page that isn't in memory
+   /// starts as zeros instead of being read, so a page that is torn on disk can be replaced.
+   OVERWRITE
 };
 
 class BufferFrame {
    private:
    friend class BufferManager;
+   friend class FrameList;
+
+   /// Page id of an unused frame.
+   static constexpr uint64_t invalidPid = ~0ull;
 
-   uint64_t pid;
-   PageState pageState;
-   Latch pageLatch;
-   std::mutex loadingLatch;
-   bool isDirty;
+   std::atomic<uint64_t> pid;
+   std::atomic<PageState> pageState;
+   VersionLatch pageLatch;
+   /// Set by writers that hold the latch exclusively, cleared by whoever writes the page back
+   /// while holding it in any mode.
+   std::atomic<bool> isDirty;
    char* data;
 
+   /// Value of the lru clock when the frame was last moved to the back of the lru list.
+   std::atomic<uint64_t> lruStamp;
+
+   /// Set for a prefetched page until it is fixed for the first time.
+   std::atomic<bool> prefetched;
+   /// Whether the first fix of this prefetched page should read ahead the next window.
+   bool readAheadMarker;
+
+   /// Set by optimistic fixes, which can't touch the fifo/lru lists. Eviction gives such frames a
+   /// second chance instead.
+   std::atomic<bool> referenced;
+
+   /// Set for a page that was fixed with `AccessHint::PIN_HOT` until it is evicted.
+   std::atomic<bool> hot;
+
+   /// The LSN of the last change that was logged for the page, 0 if it is unchanged since it was
+   /// loaded. The log must be durable up to here before the page is written.
+   std::atomic<uint64_t> pageLsn;
+   /// A LSN at or in front of the first logged change of the page since it was last written, 0 if
+   /// there is none. That change is logged as an image of the whole page.
+   std::atomic<uint64_t> recLsn;
+   /// The content of the page when it was fixed exclusively, compared with it when it is unfixed
+   /// to log the changes. Only set while a write-ahead log is attached.
+   char* beforeImage;
+
+   // intrusive hooks for the fifo/lru list the frame is currently in
+   BufferFrame* prev;
+   BufferFrame* next;
+
    public:
-   explicit BufferFrame(uint64_t pid) : pid{pid}, pageState{PageState::NOT_LOADED}, isDirty{false}, data{nullptr} {}
+   BufferFrame() : pid{invalidPid}, pageState{PageState::NOT_LOADED}, isDirty{false}, data{nullptr}, lruStamp{0}, prefetched{false}, readAheadMarker{false}, referenced{false}, hot{false}, pageLsn{0}, recLsn{0}, beforeImage{nullptr}, prev{nullptr}, next{nullptr} {}
 
    BufferFrame(const BufferFrame& frame) = delete;
    BufferFrame& operator=(const BufferFrame& frame) = delete;
@@ -47,6 +196,82 @@ class BufferFrame {
 
    /// Returns a pointer to this page's data.
    char* get_data();
+
+   /// Returns the id of the page in this frame. Only stable while the frame is fixed.
+   [[nodiscard]] uint64_t get_page_id() const { return pid; }
+
+   /// Returns the LSN of the last logged change of the page in this frame.
+   [[nodiscard]] uint64_t get_page_lsn() const { return pageLsn; }
+
+   /// Returns a pointer to this page's data for an optimistic read. The frame may hold another
+   /// page or no page at all by now, which `BufferManager::validate()` detects.
+   [[nodiscard]] const char* get_optimistic_data() const { return data; }
+};
+
+/// Intrusive doubly linked list of BufferFrames.
+/// The hooks are stored in the frames themselves, so all operations are O(1) and never allocate.
+/// A frame can be in at most one list at a time.
+/// NOT thread-safe.
+class FrameList {
+   private:
+   BufferFrame* head = nullptr;
+   BufferFrame* tail = nullptr;
+   size_t count = 0;
+
+   public:
+   /// Append a frame at the back of the list.
+   void push_back(BufferFrame* frame);
+
+   /// Unlink a frame from the list.
+   void remove(BufferFrame* frame);
+
+   /// Returns the first frame of the list or nullptr if the list is empty.
+   [[nodiscard]] BufferFrame* front() const { return head; }
+
+   /// Returns the last frame of the list or nullptr if the list is empty.
+   [[nodiscard]] BufferFrame* back() const { return tail; }
+
+   /// Returns the successor of a frame or nullptr if it is the last one.
+   [[nodiscard]] static BufferFrame* next(const BufferFrame* frame) { return frame->next; }
+
+   /// Returns the number of frames in the list.
+   [[nodiscard]] size_t size() const { return count; }
+};
+
+/// Maps page ids to the frames they are loaded into.
+/// The table is partitioned into independently latched shards that live on their own cache lines,
+/// so concurrent lookups of different pages almost never contend on the same latch.
+/// thread-safe.
+class PageTable {
+   private:
+   struct alignas(64) Shard {
+      Latch latch;
+      std::unordered_map<uint64_t, BufferFrame*> frames;
+   };
+
+   std::unique_ptr<Shard[]> shards; // NOLINT(cppcoreguidelines-avoid-c-arrays)
+   const uint32_t shardBits;
+
+   Shard& get_shard(uint64_t pid) const {
+      // fibonacci hashing, the segment id in the upper bits would otherwise dominate
+      return shards[shardBits == 0 ? 0 : (pid * 0x9E3779B97F4A7C15ull) >> (64 - shardBits)];
+   }
+
+   public:
+   /// Constructor.
+   /// @param[in] shard_count   Number of shards, rounded up to the next power of two.
+   /// @param[in] capacity      Expected maximum number of entries.
+   PageTable(size_t shard_count, size_t capacity);
+
+   /// Returns the frame a page is loaded into or nullptr.
+   BufferFrame* find(uint64_t pid) const;
+
+   /// Inserts a page unless it is already contained.
+   /// Returns the frame the page is mapped to afterwards.
+   BufferFrame* insert(uint64_t pid, BufferFrame* frame);
+
+   /// Removes a page. Does nothing if the page is not mapped to the given frame.
+   void erase(uint64_t pid, const BufferFrame* frame);
 };
 
 class buffer_full_error
@@ -61,18 +286,143 @@ class BufferManager {
    private:
    // parameters
    const size_t pageSize;
-   const size_t pageCount;
+   /// Number of frames that can be used, see `resize()`.
+   std::atomic<size_t> pageCount;
+   /// Number of frames whose memory is reserved.
+   const size_t maxPageCount;
 
    // data structures
    std::unique_ptr<std::array<std::pair<std::unique_ptr<File>, Latch>, 65536>> segments;
-   std::unordered_map<uint64_t, BufferFrame> pageTable;
-   std::vector<BufferFrame*> fifoList; // TODO: Use std::list or std::forward_list
-   std::vector<BufferFrame*> lruList;
+   /// A segment that is served from a read-only mapping of its file instead of the frames.
+   struct MappedSegment {
+      std::unique_ptr<MappedFile> file;
+      /// One frame per page that points into the mapping.
+      std::unique_ptr<BufferFrame[]> frames; // NOLINT(cppcoreguidelines-avoid-c-arrays)
+      size_t pageCount;
+   };
+   std::unique_ptr<std::array<std::unique_ptr<MappedSegment>, 65536>> mappedSegments;
+   /// The compression of every segment.
+   std::unique_ptr<std::array<PageCompression, 65536>> compressions;
+   /// One mapping that holds the data of all frames. Frame i owns [i * pageSize, (i + 1) * pageSize[.
+   char* arena;
+   size_t arenaSize;
+   std::unique_ptr<BufferFrame[]> frames; // NOLINT(cppcoreguidelines-avoid-c-arrays)
+   PageTable pageTable;
+   std::vector<BufferFrame*> freeFrames;
+   /// Frames that are not used because the pool was made smaller. They don't hold any memory.
+   std::vector<BufferFrame*> retiredFrames;
+   /// Serializes resizing.
+   std::mutex resizeLatch;
+   FrameList fifoList;
+   FrameList lruList;
+   /// Pages that were loaded by scans, in the order they were loaded.
+   FrameList ringList;
+
+   /// Incremented whenever a frame is moved to the back of the lru list.
+   std::atomic<uint64_t> lruClock;
+   /// Mirrors `lruList.size()` for readers that don't hold the lru latch.
+   std::atomic<size_t> lruSize;
+   /// Number of frames the ring of scan pages grows to before it reuses its own frames.
+   std::atomic<size_t> ringSize;
+   /// Number of frames that are pinned with `AccessHint::PIN_HOT`.
+   std::atomic<size_t> hotFrames;
 
    // latches
-   mutable Latch pageTableLatch;
+   mutable std::mutex freeFramesLatch;
    mutable Latch fifoListLatch;
    mutable Latch lruListLatch;
+   /// Acquired before the fifo and lru latches if they are needed together.
+   mutable Latch ringListLatch;
+
+   // background writer
+   /// Number of frames at the eviction end of each list that the writer keeps clean.
+   std::atomic<size_t> cleanWindow;
+   std::mutex writerLatch;
+   std::condition_variable writerCv;
+   bool stopWriter;
+   std::thread writer;
+
+   /// Main loop of the background writer.
+   void runWriter();
+
+   /// Write the pages of the given frames to disk and unlock them. The frames must be locked in
+   /// shared mode and dirty. Pages that are adjacent in the same segment are written together.
+   void writeBack(std::vector<BufferFrame*>& dirtyFrames);
+
+   // prefetching
+   struct PrefetchRequest {
+      uint64_t pid;
+      size_t count;
+      bool readAhead;
+      AccessHint access;
+   };
+   /// Number of pages that are read ahead on sequential access, 0 if disabled.
+   std::atomic<size_t> readAheadWindow;
+   /// Last page id that missed, per segment (modulo the size).
+   std::array<std::atomic<uint64_t>, 64> lastMisses;
+   std::mutex prefetcherLatch;
+   std::condition_variable prefetcherCv;
+   std::deque<PrefetchRequest> prefetchRequests;
+   bool stopPrefetcher;
+   std::thread prefetcher;
+
+   /// Main loop of the background prefetcher.
+   void runPrefetcher();
+
+   /// Queue a request for the prefetcher.
+   void queuePrefetch(PrefetchRequest request);
+
+   /// Start reading ahead if a missed page directly follows the last missed page of its segment.
+   /// The pages that are read ahead are accessed like the missed one.
+   void detectSequentialMiss(uint64_t pid, AccessHint access);
+
+   // access hints
+   /// Append a frame that is in no list to the back of the lru list.
+   void appendLru(BufferFrame* frame, ExclusiveLatch& exclLruListLatch);
+
+   /// Pin a frame that was fixed with `AccessHint::PIN_HOT`, unless too many are pinned already.
+   /// Returns whether the frame is pinned.
+   bool pinFrame(BufferFrame* frame);
+
+   /// Find the first frame of the ring that is not locked in any mode and locks it. Pages that
+   /// were read ahead but not fixed yet are skipped while the ring is small.
+   /// Returns nullptr if there is none.
+   BufferFrame* lockRingFrame(ExclusiveLatch& exclRingListLatch);
+
+   // compression
+   /// Returns the distance between two pages in the file of a segment. Compressed pages need
+   /// room for their size in front of them.
+   [[nodiscard]] size_t getSlotSize(uint16_t segment_id) const;
+
+   /// Compress a page into a slot of a compressed segment.
+   /// Returns the number of bytes of the slot that have to be written.
+   size_t encodePage(const char* data, char* slot) const;
+
+   /// Decompress the slot of a compressed segment into a page.
+   /// Throws `std::runtime_error` if the slot is corrupt.
+   void decodePage(const char* slot, char* data) const;
+
+   /// Free the disk blocks of a slot of a compressed segment behind the `size` bytes that were
+   /// written to it.
+   /// The segment must be locked in shared mode.
+   void discardSlotTail(File& file, uint64_t pid, size_t size) const;
+
+   // write-ahead logging
+   /// The log that the changes to the pages go to, if any.
+   WriteAheadLog* wal;
+   std::mutex beforeImagesLatch;
+   /// Unused memory for the before images of frames.
+   std::vector<std::unique_ptr<char[]>> beforeImages; // NOLINT(cppcoreguidelines-avoid-c-arrays)
+
+   /// Remember the content of a frame that was just fixed exclusively, if there is a log.
+   void beginLogging(BufferFrame& frame);
+
+   /// Log the changes to a frame that is about to be unfixed, if there is a log.
+   void endLogging(BufferFrame& frame, bool is_dirty);
+
+   /// Number of frames that the background writer or prefetcher currently hold latched.
+   /// They become evictable again shortly without anyone unfixing them.
+   std::atomic<size_t> busyFrames;
 
    public:
    BufferManager(const BufferManager&) = delete;
@@ -80,38 +430,80 @@ class BufferManager {
    BufferManager& operator=(const BufferManager&) = delete;
    BufferManager& operator=(BufferManager&&) = delete;
    /// Constructor.
-   /// @param[in] page_size  Size in bytes that all pages will have.
-   /// @param[in] page_count Maximum number of pages that should reside in memory at the same time.
-   BufferManager(size_t page_size, size_t page_count);
+   /// Reserves the memory of all `max_page_count` pages up front and starts a background thread
+   /// that writes dirty pages back before they are evicted.
+   /// @param[in] page_size      Size in bytes that all pages will have.
+   /// @param[in] page_count     Maximum number of pages that should reside in memory at the same time.
+   /// @param[in] huge_pages     Try to back the page memory with huge pages. Falls back to regular
+   ///                           pages if the system doesn't provide any.
+   /// @param[in] max_page_count Up to how many pages the pool can grow with `resize()`, at least
+   ///                           `page_count`. Only the address space is reserved for the pages
+   ///                           beyond `page_count`.
+   BufferManager(size_t page_size, size_t page_count, bool huge_pages = false, size_t max_page_count = 0);
 
-   /// Destructor. Writes all dirty pages to disk.
+   /// Destructor. Writes all dirty pages to disk, see `flush_all()`.
    ~BufferManager();
 
-   /// Get the BufferFrame for a given page id.
+   /// Write all dirty pages to disk, e.g. for a checkpoint. Pages that are dirtied concurrently
+   /// may or may not be included. Without a write-ahead log the segment files are synced
+   /// afterwards, so the pages are durable when it returns.
+   /// The calling thread must not have any page fixed.
+   /// thread-safe.
+   void flush_all();
+
+   /// Returns the file of a segment that is at least `min_size` bytes large and locks the segment
+   /// in shared mode. Creates and grows the segment file if needed.
+   /// thread-safe.
+   File& getSegmentFile(uint16_t segment_id, size_t min_size, SharedLatch& latch);
+
+   /// Read a page from its segment file into the given buffer.
+   /// Creates and grows the segment file if needed.
+   /// thread-safe.
+   void readPage(uint64_t pid, char* data);
+
+   /// Load up to `count` consecutive pages starting at `pid` that are not loaded yet with one
+   /// batch of reads and append them to the fifo list, or the ring for
+   /// `AccessHint::SEQUENTIAL_ONCE`. Loads at most a quarter of all pages and stops early if no
+   /// frame can be evicted.
    /// thread-safe.
-   BufferFrame* getBufferFrame(uint64_t pageId);
+   void loadPages(uint64_t pid, size_t count, bool read_ahead_marker, AccessHint access = AccessHint::NORMAL);
 
-   std::unique_ptr<char[]> getSegmentData(uint64_t pid);
+   /// Load the page for a given BufferFrame into memory and append it to the list that the
+   /// access hint asks for.
+   /// The frame must be locked exclusively and already be registered in the page table.
+   /// thread-safe.
+   void loadPage(BufferFrame& frame, AccessHint access = AccessHint::NORMAL);
 
-   /// Load the page for a given BufferFrame into memory.
-   /// Returns true on success.
+   /// Record a hit on a loaded BufferFrame, i.e. promote it from the fifo to the lru list or
+   /// move it to the back of the lru list. A page of the ring moves to the fifo list.
+   /// The frame must be locked in any mode.
    /// thread-safe.
-   bool loadPage(BufferFrame& frame);
+   void touchFrame(BufferFrame* frame, AccessHint access = AccessHint::NORMAL);
 
+   /// Move a frame to the back of the lru list.
    void updateLru(BufferFrame* frame, ExclusiveLatch& exclLruListLatch);
 
-   /// Insert the given BufferFrame into the fifo list.
-   /// Returns true on success.
+   /// Move a frame from the fifo to the back of the lru list.
+   void promoteFrame(BufferFrame* frame, ExclusiveLatch& exclFifoListLatch, ExclusiveLatch& exclLruListLatch);
+
+   /// Get an unused BufferFrame, evicting a page if there is no free frame left. A full ring of
+   /// scan pages is reused first, then the fifo and the lru list are tried.
+   /// The returned frame is locked exclusively and neither in the page table nor in any list.
+   /// Returns nullptr if every frame is fixed.
+   /// thread-safe.
+   BufferFrame* allocateBufferFrame();
+
+   /// Return an unused BufferFrame that is locked exclusively to the free frames and unlock it.
    /// thread-safe.
-   bool insertBufferFrame(BufferFrame& frame);
+   void releaseBufferFrame(BufferFrame* frame);
 
    /// Find the first BufferFrame in the given list that is not locked in any mode, locks it
-   /// and return its index.
+   /// and returns it. Returns nullptr if every frame in the list is currently fixed.
    /// NOT thread-safe.
-   static long lockEvictableFrame(std::vector<BufferFrame*>& frameList, ExclusiveLatch& frameListLatch);
+   static BufferFrame* lockEvictableFrame(FrameList& frameList, ExclusiveLatch& frameListLatch);
 
-   /// Flush a BufferFrame's page to disk.
-   /// NOT thread-safe.
+   /// Flush a BufferFrame's page to disk. The frame must be locked in any mode.
+   /// thread-safe.
    void flushPage(BufferFrame& frame);
 
    /// Returns a reference to a `BufferFrame` object for a given page id. When
@@ -119,13 +511,97 @@ class BufferManager {
    /// loaded page is used.
    /// When the page cannot be loaded because the buffer is full, throws the
    /// exception `buffer_full_error`.
+   /// Pages of mapped segments must be fixed in shared mode and must exist, otherwise
+   /// `std::logic_error` or `std::out_of_range` is thrown.
    /// Is thread-safe w.r.t. other concurrent calls to `fix_page()` and
    /// `unfix_page()`.
    /// @param[in] page_id   Page id of the page that should be loaded.
    /// @param[in] exclusive If `exclusive` is true, the page is locked
    ///                      exclusively. Otherwise it is locked
    ///                      non-exclusively (shared).
-   BufferFrame& fix_page(uint64_t page_id, bool exclusive);
+   /// @param[in] access    How the page is going to be accessed.
+   BufferFrame& fix_page(uint64_t page_id, bool exclusive, AccessHint access = AccessHint::NORMAL);
+
+   /// Loads `count` consecutive pages starting at `page_id` in the background, so that
+   /// later calls to `fix_page()` find them in memory. Prefetched pages are appended to the
+   /// FIFO list, or the ring for `AccessHint::SEQUENTIAL_ONCE`, and stay there when they are
+   /// fixed for the first time.
+   /// Best effort: at most a quarter of all pages are prefetched at once.
+   /// thread-safe.
+   void prefetch(uint64_t page_id, size_t count, AccessHint access = AccessHint::NORMAL);
+
+   /// Enables reading ahead `window` pages when pages of a segment are missed in ascending
+   /// order. A `window` of 0 disables read-ahead, which is the default. The window is limited to a
+   /// quarter of all pages.
+   /// thread-safe.
+   void set_read_ahead(size_t window);
+
+   /// Serves all pages of a segment from a read-only mapping of its file from now on, so
+   /// `fix_page()` hands out pointers into the OS page cache and needs no frame and no copy.
+   /// The segment's pages can only be fixed in shared mode and the segment can't grow anymore.
+   /// Writes its dirty pages first. Throws `std::system_error` if the file can't be mapped.
+   /// Must not be called concurrently with other calls for the same segment.
+   /// @param[in] segment_id Segment that should be mapped.
+   /// @param[in] advice     How the pages are going to be accessed.
+   void map_segment(uint16_t segment_id, MappedFile::Advice advice);
+
+   /// Sets how the pages of a segment are stored in its file, see `PageCompression`. The
+   /// in-memory format of the pages doesn't change. Compressed pages take as much room in the
+   /// file as they need, the disk blocks behind them are freed if the file system supports it.
+   /// The compression isn't stored anywhere, so it must be set before any page of the segment is
+   /// accessed, and to the same value whenever the segment's file is used again.
+   /// Compressed segments can't be mapped with `map_segment()`.
+   /// @param[in] segment_id  The segment.
+   /// @param[in] compression The compression of its pages.
+   void set_compression(uint16_t segment_id, PageCompression compression);
+
+   /// Returns how the pages of a segment are stored in its file.
+   [[nodiscard]] PageCompression get_compression(uint16_t segment_id) const { return (*compressions)[segment_id]; }
+
+   /// Serves a mapped segment from the frames again.
+   /// None of its pages may be fixed and no other thread may access it during the call.
+   void unmap_segment(uint16_t segment_id);
+
+   /// Returns the frame of a page without latching it, together with the version that
+   /// optimistic reads of the frame have to be validated against with `validate()`. Only
+   /// `BufferFrame::get_optimistic_data()` may be used to access the frame, and nothing that was
+   /// read may be relied upon before it was validated. The frame must not be unfixed.
+   /// Loads the page if it is not in memory, which may throw `buffer_full_error`.
+   /// thread-safe.
+   /// @param[in]  page_id Page id of the page.
+   /// @param[out] version The version of the frame's latch.
+   /// @param[in]  hint    A frame the page was in before, saves the page table lookup if it still is.
+   /// @param[in]  access  How the page is going to be accessed. Only `AccessHint::PIN_HOT` has an
+   ///                     effect on a page that is loaded already.
+   BufferFrame& fix_page_optimistic(uint64_t page_id, uint64_t& version, BufferFrame* hint = nullptr, AccessHint access = AccessHint::NORMAL);
+
+   /// Returns whether a frame that was returned by `fix_page_optimistic()` still holds the
+   /// same page and was not modified since.
+   static bool validate(const BufferFrame& frame, uint64_t version) { return frame.pageLatch.validate(version); }
+
+   /// Fixes a frame that was returned by `fix_page_optimistic()` like `fix_page()` if it is
+   /// unchanged since `version`. Returns whether it did.
+   /// thread-safe.
+   bool upgrade(BufferFrame& frame, uint64_t version, bool exclusive = true);
+
+   /// Logs the changes to all pages into a write-ahead log from now on, or stops logging if
+   /// `wal` is nullptr. Before a changed page is written, the log is made durable up to its
+   /// last change. The log must outlive the buffer manager or be detached before it is destroyed.
+   /// Must not be called while any page is fixed.
+   void set_wal(WriteAheadLog* wal) { this->wal = wal; }
+
+   /// Returns the write-ahead log the changes to the pages go to, nullptr if there is none.
+   [[nodiscard]] WriteAheadLog* get_wal() const { return wal; }
+
+   /// Returns the pages with logged changes that are not written back yet, together with a LSN at
+   /// or in front of their first such change. Pages that are changed concurrently may or may not
+   /// be included, but a page whose change was logged before the call is.
+   /// thread-safe.
+   [[nodiscard]] std::vector<std::pair<uint64_t, uint64_t>> get_dirty_pages() const;
+
+   /// Waits until every page that was written back is on stable storage.
+   /// thread-safe.
+   void sync_segments();
 
    /// Takes a `BufferFrame` reference that was returned by an earlier call to
    /// `fix_page()` and unfixes it. When `is_dirty` is / true, the page is
@@ -142,6 +618,24 @@ class BufferManager {
    /// Is not thread-safe.
    [[nodiscard]] std::vector<uint64_t> get_lru_list() const;
 
+   /// Returns the page ids of all pages (fixed and unfixed) that are in the
+   /// ring of scan pages in the order they were loaded.
+   /// Is not thread-safe.
+   [[nodiscard]] std::vector<uint64_t> get_ring_list() const;
+
+   /// Changes the number of pages that may reside in memory at the same time, up to the maximum
+   /// the buffer manager was created with. Shrinking evicts pages and gives the memory of their
+   /// frames back to the system. Stops early if every remaining page is fixed.
+   /// Returns the number of pages afterwards.
+   /// thread-safe.
+   size_t resize(size_t page_count);
+
+   /// Returns the number of pages that may reside in memory at the same time.
+   [[nodiscard]] size_t get_page_count() const { return pageCount.load(std::memory_order_relaxed); }
+
+   /// Returns up to how many pages the pool can grow.
+   [[nodiscard]] size_t get_max_page_count() const { return maxPageCount; }
+
    /// Returns the page size.
    uint32_t get_page_size() const { return pageSize; }
 
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+
+namespace simpledb {
+
+/// Compress a buffer with a byte-oriented LZ77 codec in the block format of LZ4: a sequence is a
+/// token with the lengths of its literals and its match, the literals, and a 16 bit offset of the
+/// match. Compression finds matches of at least 4 bytes with a hash table of the last positions,
+/// so memory that is mostly zero or repetitive (like the free space of a page) shrinks a lot and
+/// random bytes cost little time.
+/// @param[in]  src       The data that should be compressed.
+/// @param[in]  size      The size of the data.
+/// @param[out] dst       The buffer that receives the compressed data.
+/// @param[in]  capacity  The capacity of `dst`.
+/// @return               The size of the compressed data, 0 if it doesn't fit into `capacity`.
+size_t lz_compress(const char* src, size_t size, char* dst, size_t capacity);
+
+/// Decompress a buffer that was compressed with `lz_compress()`.
+/// Throws `std::runtime_error` if the data is corrupt or doesn't decompress to exactly `size` bytes.
+/// @param[in]  src       The compressed data.
+/// @param[in]  src_size  The size of the compressed data.
+/// @param[out] dst       The buffer that receives the data.
+/// @param[in]  size      The size of the data.
+void lz_decompress(const char* src, size_t src_size, char* dst, size_t size);
+
+}
@@ -3,14 +3,43 @@
 #include "segment.h"
 #include "simpledb/buffer_manager.h"
 #include "simpledb/schema.h"
+#include <functional>
 #include <memory>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 namespace simpledb {
 
 class Database {
    public:
+   /// A buffer pool of the database
+   struct PoolOptions {
+      /// The page size of the pool
+      size_t page_size;
+      /// The number of pages the pool holds
+      size_t page_count;
+      /// Up to how many pages the pool can grow with `resize_pool()`, 0 for `page_count`
+      size_t max_page_count;
+   };
+
    /// Constructor.
-   Database() : buffer_manager(1024, 10) {}
+   /// @param[in] pools    The buffer pools, the first one holds the segments that aren't assigned
+   ///                     to another one.
+   explicit Database(const std::vector<PoolOptions>& pools = {{1024, 10, 0}});
+
+   /// Assign a segment to a buffer pool, e.g. to keep the pages of a table from evicting the
+   /// pages of an index. Throws `std::logic_error` if the segment belongs to the loaded schema,
+   /// the old pool writes its changes of the segment back before it moves.
+   void assign_pool(uint16_t segment_id, size_t pool);
+   /// Get the buffer pool that a segment is assigned to
+   BufferManager& get_buffer_manager(uint16_t segment_id);
+   /// Get a buffer pool
+   BufferManager& get_pool(size_t pool) { return *buffer_managers.at(pool); }
+   /// Change the number of pages of a buffer pool while the database is running, returns the
+   /// number of pages afterwards
+   size_t resize_pool(size_t pool, size_t page_count) { return buffer_managers.at(pool)->resize(page_count); }
 
    /// Load a new schema
    void load_new_schema(std::unique_ptr<schema::Schema> schema);
@@ -19,19 +48,44 @@ class Database {
    /// Get the currently loaded schema
    schema::Schema& get_schema();
    /// Insert into a table
-   void insert(const schema::Table& table, const std::vector<std::string>& data);
+   TID insert(const schema::Table& table, const std::vector<std::string>& data);
+   /// Insert many rows into a table at once, returns their TIDs in the same order
+   std::vector<TID> insert_batch(const schema::Table& table, const std::vector<std::vector<std::string>>& rows);
    /// Read a tuple by TID from the table
    void read_tuple(const schema::Table& table, TID tid);
+   /// Read a serialized row by TID from the table, returns the bytes that have been read, 0 if the
+   /// row was erased
+   uint32_t read(const schema::Table& table, TID tid, std::byte* record, uint32_t capacity);
+   /// Read all rows of a table in the order they are stored, `callback` gets every serialized row
+   /// and returns whether to continue
+   void scan(const schema::Table& table, const std::function<bool(TID, std::span<const std::byte>)>& callback);
 
    protected:
-   /// The buffer manager
-   BufferManager buffer_manager;
+   /// Append the serialized row to `insert_arena`
+   void serialize(const schema::Table& table, const std::vector<std::string>& data);
+   /// Is the segment used by the loaded schema?
+   [[nodiscard]] bool is_open(uint16_t segment_id) const;
+   /// Save the loaded schema and drop the segments of its tables
+   void close_tables();
+   /// Create the segments of the tables of the loaded schema
+   void open_tables();
+   /// Print a serialized row, the columns that don't fit into `record` are left out
+   void print_tuple(const schema::Table& table, std::span<const std::byte> record);
+
+   /// The buffer pools
+   std::vector<std::unique_ptr<BufferManager>> buffer_managers;
+   /// The pools of the segments that aren't in the first one
+   std::unordered_map<uint16_t, size_t> pool_assignments;
    /// The segment of the schema
    std::unique_ptr<SchemaSegment> schema_segment;
    /// The segments of the schema's table's slotted pages
    std::unordered_map<int16_t, std::unique_ptr<SPSegment>> slotted_pages;
    /// The segment of the schema's free space inventory
    std::unordered_map<int16_t, std::unique_ptr<FSISegment>> free_space_inventory;
+   /// The segments of the schema's tables with the PAX layout
+   std::unordered_map<int16_t, std::unique_ptr<PAXSegment>> pax_segments;
+   /// The serialized rows of the current insert
+   std::vector<std::byte> insert_arena;
 };
 
 }
@@ -2,6 +2,8 @@
 
 #include <cstdint>
 #include <memory>
+#include <span>
+#include <sys/uio.h>
 
 namespace simpledb {
 
@@ -14,6 +16,21 @@ class File {
    enum Mode { READ,
                WRITE };
 
+   /// A single operation of a batch that is passed to `submit()`.
+   struct IoRequest {
+      /// Kind of operation
+      enum Kind : uint8_t { READ,
+                            WRITE };
+
+      /// Whether the buffers are read into or written from.
+      Kind kind;
+      /// The offset in the file at which the first buffer is transferred.
+      size_t offset;
+      /// The memory buffers. They are transferred consecutively, i.e. each buffer starts in the
+      /// file right after the end of the previous one.
+      std::span<const ::iovec> buffers;
+   };
+
    File() = default;
    File(const File&) = default;
    File(File&&) = default;
@@ -34,6 +51,17 @@ class File {
    /// Is not thread-safe.
    virtual void resize(size_t new_size) = 0;
 
+   /// Tells the file system that a range of the file is not needed anymore, so it can free the
+   /// disk blocks that lie completely within the range. The range reads as zero bytes afterwards,
+   /// the size of the file doesn't change.
+   /// The default implementation does nothing, which is also the fallback if the file system
+   /// can't free ranges.
+   /// Is thread-safe w.r.t concurrent calls to `read_block()` and
+   /// `write_block()` on other ranges.
+   /// @param[in] offset The offset of the range.
+   /// @param[in] size   The size of the range.
+   virtual void discard(size_t /*offset*/, size_t /*size*/) {}
+
    /// Reads a block of the file. `offset + size` must not be larger than
    /// `size()`.
    /// Is thread-safe w.r.t concurrent calls to `read_block()` and
@@ -65,11 +93,32 @@ class File {
    /// @param[in] size   The size of the block.
    virtual void write_block(const char* block, size_t offset, size_t size) = 0;
 
+   /// Waits until everything that was written to the file is on stable storage. Writes are
+   /// not synchronous, so without this call they may be lost on a crash.
+   /// Is thread-safe w.r.t concurrent calls to `read_block()` and
+   /// `write_block()`.
+   virtual void sync() = 0;
+
+   /// Performs a batch of reads and writes. Implementations may issue all requests at once;
+   /// the call returns when every one of them has completed. Requests must stay within
+   /// `size()` and must not overlap each other.
+   /// The default implementation runs them one after another through `read_block()` and
+   /// `write_block()`.
+   /// Is thread-safe w.r.t concurrent calls to `read_block()`, `write_block()` and `submit()`.
+   /// @param[in] requests The requests.
+   virtual void submit(std::span<const IoRequest> requests);
+
    /// Opens a file with the given mode. Existing files are never overwritten.
    /// @param[in] filename Path to the file.
    /// @param[in] mode     `Mode` that should be used to open the file.
    [[nodiscard]] static std::unique_ptr<File> open_file(const char* filename, Mode mode);
 
+   /// Opens a file like `open_file()` that can keep many `submit()`ed requests in flight.
+   /// Uses io_uring if the kernel supports it and a shared pool of I/O threads otherwise.
+   /// @param[in] filename Path to the file.
+   /// @param[in] mode     `Mode` that should be used to open the file.
+   [[nodiscard]] static std::unique_ptr<File> open_async_file(const char* filename, Mode mode);
+
    /// Opens a temporary file in `WRITE` mode. The file will be deleted
    /// automatically after use.
    [[nodiscard]] static std::unique_ptr<File> make_temporary_file();
@@ -77,13 +126,17 @@ class File {
 
 class PosixFile
    : public File {
-   private:
+   protected:
    Mode mode;
    int fd;
    size_t cached_size;
 
    [[nodiscard]] size_t read_size() const;
 
+   /// Synchronously transfers a request with `preadv()`/`pwritev()`, skipping the first
+   /// `transferred` bytes that have already been transferred.
+   void transfer(const IoRequest& request, size_t transferred = 0) const;
+
    public:
    PosixFile(Mode mode, int fd, size_t size);
    PosixFile(const char* filename, Mode mode);
@@ -100,9 +153,111 @@ class PosixFile
 
    void resize(size_t new_size) override;
 
+   /// Punches a hole with `fallocate()`.
+   void discard(size_t offset, size_t size) override;
+
    void read_block(size_t offset, size_t, char* block) override;
 
    void write_block(const char* block, size_t offset, size_t size) override;
+
+   /// Calls `fdatasync()`.
+   void sync() override;
+
+   /// Runs the requests one after another with one vectored syscall each.
+   void submit(std::span<const IoRequest> requests) override;
+};
+
+///
+/// PosixFile that submits batches through an io_uring, so the device sees all of them at once.
+///
+class IoUringFile
+   : public PosixFile {
+   private:
+   struct Ring;
+   std::unique_ptr<Ring> ring;
+
+   public:
+   /// Constructors. Throw `std::system_error` if no io_uring can be set up.
+   IoUringFile(Mode mode, int fd, size_t size);
+   IoUringFile(const char* filename, Mode mode);
+   IoUringFile(const IoUringFile&) = delete;
+   IoUringFile(IoUringFile&&) = delete;
+   IoUringFile& operator=(const IoUringFile&) = delete;
+   IoUringFile& operator=(IoUringFile&&) = delete;
+
+   ~IoUringFile() override;
+
+   void submit(std::span<const IoRequest> requests) override;
+
+   /// Makes `count` calls of `io_uring_enter()` of all rings fail with `error` after the next
+   /// `skip` ones succeeded, to test how failures are handled.
+   static void inject_enter_failures(int error, unsigned count, unsigned skip = 0);
+};
+
+///
+/// PosixFile that hands the requests of a batch to a process-wide pool of I/O threads.
+/// Used where io_uring is not available.
+///
+class ThreadPoolFile
+   : public PosixFile {
+   public:
+   using PosixFile::PosixFile;
+
+   void submit(std::span<const IoRequest> requests) override;
+};
+
+///
+/// File in `READ` mode that is mapped into memory as a whole. Reads are served straight from
+/// the OS page cache and `data()` hands out pointers into it without any copy.
+/// Writing and resizing fail with `EBADF`, like writing to a file that was opened in `READ` mode.
+///
+class MappedFile
+   : public File {
+   private:
+   int fd;
+   size_t file_size;
+   char* mapping;
+
+   public:
+   /// Access patterns that can be announced to the kernel.
+   enum Advice { NORMAL,
+                 SEQUENTIAL,
+                 RANDOM,
+                 WILLNEED };
+
+   /// Constructor. Maps the whole file, so it must already exist.
+   explicit MappedFile(const char* filename);
+   MappedFile(const MappedFile&) = delete;
+   MappedFile(MappedFile&&) = delete;
+   MappedFile& operator=(const MappedFile&) = delete;
+   MappedFile& operator=(MappedFile&&) = delete;
+
+   ~MappedFile() override;
+
+   [[nodiscard]] Mode get_mode() const override { return READ; }
+
+   [[nodiscard]] size_t size() const override { return file_size; }
+
+   void resize(size_t new_size) override;
+
+   void read_block(size_t offset, size_t size, char* block) override;
+
+   void write_block(const char* block, size_t offset, size_t size) override;
+
+   /// Does nothing, the file can't be written.
+   void sync() override {}
+
+   void submit(std::span<const IoRequest> requests) override;
+
+   /// Returns a pointer to the data at the given offset that stays valid as long as the file.
+   [[nodiscard]] const char* data(size_t offset = 0) const { return mapping + offset; }
+
+   /// Tells the kernel how a range of the file is going to be accessed, e.g. so it reads ahead
+   /// aggressively for `SEQUENTIAL` or not at all for `RANDOM`.
+   /// @param[in] advice The access pattern.
+   /// @param[in] offset The start of the range.
+   /// @param[in] size   The size of the range, everything up to the end of the file by default.
+   void advise(Advice advice, size_t offset = 0, size_t size = SIZE_MAX);
 };
 
 }
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <ostream>
+
+namespace simpledb::metrics {
+
+/// The events that are counted.
+enum class Counter : uint8_t {
+   /// `fix_page()` found the page in memory.
+   PAGE_HITS,
+   /// `fix_page()` had to load the page.
+   PAGE_MISSES,
+   /// A page moved from the fifo to the lru list.
+   PROMOTIONS,
+   /// A clean page was evicted.
+   CLEAN_EVICTIONS,
+   /// A dirty page was evicted and had to be written first.
+   DIRTY_EVICTIONS,
+   /// `fix_page()` threw `buffer_full_error`.
+   BUFFER_FULL_ERRORS,
+   /// Bytes that were read from files.
+   BYTES_READ,
+   /// Bytes that were written to files.
+   BYTES_WRITTEN,
+   /// A B+-tree node was split.
+   BTREE_SPLITS,
+   /// A B+-tree operation ran into a concurrent change and started over.
+   BTREE_RESTARTS,
+   COUNT
+};
+
+/// The latches whose waits are measured.
+enum class LatchKind : uint8_t {
+   /// The latch of a page.
+   PAGE,
+   /// The latches of the fifo, lru and ring list.
+   LIST,
+   /// The latches of the page table shards.
+   PAGE_TABLE,
+   COUNT
+};
+
+constexpr size_t kCounterCount = static_cast<size_t>(Counter::COUNT);
+constexpr size_t kLatchKindCount = static_cast<size_t>(LatchKind::COUNT);
+/// Bucket i of a wait histogram counts the waits of [2^i, 2^(i+1)[ ns, the last one all longer ones.
+constexpr size_t kWaitBuckets = 40;
+
+/// Hits and misses of a segment.
+struct SegmentCounters {
+   uint64_t hits = 0;
+   uint64_t misses = 0;
+};
+
+/// The sum of the counters of all threads at some point.
+struct Snapshot {
+   std::array<uint64_t, kCounterCount> counters{};
+   /// The segments that had any hit or miss.
+   std::map<uint16_t, SegmentCounters> segments;
+   /// A histogram of the waits for every kind of latch, see `kWaitBuckets`. Latches that were
+   /// acquired right away are not included.
+   std::array<std::array<uint64_t, kWaitBuckets>, kLatchKindCount> latch_waits{};
+
+   /// Returns a counter.
+   [[nodiscard]] uint64_t operator[](Counter counter) const { return counters[static_cast<size_t>(counter)]; }
+
+   /// Returns what was counted since an earlier snapshot.
+   [[nodiscard]] Snapshot operator-(const Snapshot& earlier) const;
+
+   /// Prints the counters and histograms that are not zero, one per line.
+   void print(std::ostream& out) const;
+};
+
+/// Returns the sum of the counters of all threads, including the ones that exited. Counts of
+/// other threads that happen concurrently may or may not be included.
+/// thread-safe.
+Snapshot snapshot();
+
+namespace detail {
+
+/// Hits and misses of 256 consecutive segments.
+struct SegmentChunk {
+   std::array<std::array<std::atomic<uint64_t>, 2>, 256> counters{};
+};
+
+/// The counters of a thread. Only the thread itself writes them, so counting is a plain load
+/// and store on a cache line that no other thread writes.
+struct alignas(64) ThreadCounters {
+   std::array<std::atomic<uint64_t>, kCounterCount> counters{};
+   std::array<std::array<std::atomic<uint64_t>, kWaitBuckets>, kLatchKindCount> waits{};
+   /// Allocated when a segment in them is counted for the first time.
+   std::array<std::atomic<SegmentChunk*>, 256> segments{};
+};
+
+/// Returns the counters of the calling thread.
+ThreadCounters& local();
+
+inline void add(std::atomic<uint64_t>& counter, uint64_t n) {
+   counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+/// Allocates the chunk of a segment for the calling thread.
+SegmentChunk& allocate_chunk(ThreadCounters& counters, uint16_t segment_id);
+
+/// Counts a wait for a latch.
+void count_wait(LatchKind kind, std::chrono::steady_clock::duration wait);
+
+} // namespace detail
+
+/// Counts an event `n` times.
+inline void count(Counter counter, uint64_t n = 1) {
+   detail::add(detail::local().counters[static_cast<size_t>(counter)], n);
+}
+
+/// Counts a hit or a miss of a page of a segment.
+inline void count_access(uint16_t segment_id, bool hit) {
+   auto& counters = detail::local();
+   detail::add(counters.counters[static_cast<size_t>(hit ? Counter::PAGE_HITS : Counter::PAGE_MISSES)], 1);
+   auto* chunk = counters.segments[segment_id >> 8].load(std::memory_order_relaxed);
+   detail::add((chunk ? *chunk : detail::allocate_chunk(counters, segment_id)).counters[segment_id & 0xFF][hit ? 0 : 1], 1);
+}
+
+/// Locks a latch exclusively, or a `std::shared_lock` in shared mode, and counts how long it
+/// waited if it couldn't be locked right away.
+template <typename LatchT>
+void lock(LatchT& latch, LatchKind kind) {
+   if (latch.try_lock())
+      return;
+   auto begin = std::chrono::steady_clock::now();
+   latch.lock();
+   detail::count_wait(kind, std::chrono::steady_clock::now() - begin);
+}
+
+/// Locks a latch in shared mode and counts how long it waited if it couldn't be locked right away.
+template <typename LatchT>
+void lock_shared(LatchT& latch, LatchKind kind) {
+   if (latch.try_lock_shared())
+      return;
+   auto begin = std::chrono::steady_clock::now();
+   latch.lock_shared();
+   detail::count_wait(kind, std::chrono::steady_clock::now() - begin);
+}
+
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "simpledb/schema.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace simpledb {
+
+/// A page that stores the fixed-width records of a table column by column (PAX).
+/// Every column has a minipage with its values of all records on the page, so a scan only
+/// touches the columns it needs. Records are appended and never move, an erased one is only
+/// marked in a bitmap.
+struct PaxPage {
+   struct Header {
+      /// Number of records on the page, including the erased ones.
+      uint32_t record_count;
+      /// Number of erased records.
+      uint32_t erased_count;
+   };
+
+   /// Where the minipages of a table are on its pages.
+   struct Layout {
+      /// Constructor.
+      /// @param[in] table        The table, all columns are stored with their fixed width.
+      /// @param[in] page_size    The size of a buffer frame.
+      Layout(const schema::Table& table, uint32_t page_size);
+
+      /// Get the width of a column's values.
+      static uint32_t get_width(const schema::Type& type);
+
+      /// The width of the values of each column.
+      std::vector<uint32_t> widths;
+      /// The offset of each column's minipage in the page, aligned to a cache line.
+      std::vector<uint32_t> offsets;
+      /// The offset of each column's values in a record.
+      std::vector<uint32_t> record_offsets;
+      /// The offset of the bitmap of erased records.
+      uint32_t erased_offset;
+      /// The width of a whole record.
+      uint32_t record_width;
+      /// The number of records that fit on a page.
+      uint32_t capacity;
+   };
+
+   /// Constructor, initializes an empty page.
+   /// @param[in] layout       The layout of the table's pages.
+   explicit PaxPage(const Layout& layout);
+
+   /// Get data.
+   std::byte* get_data() { return reinterpret_cast<std::byte*>(this); }
+   /// Get constant data.
+   [[nodiscard]] const std::byte* get_data() const { return reinterpret_cast<const std::byte*>(this); }
+
+   /// Is full?
+   [[nodiscard]] bool is_full(const Layout& layout) const { return header.record_count == layout.capacity; }
+
+   /// Get the minipage of a column.
+   std::byte* get_column(const Layout& layout, size_t column) { return get_data() + layout.offsets[column]; }
+   /// Get the constant minipage of a column.
+   [[nodiscard]] const std::byte* get_column(const Layout& layout, size_t column) const { return get_data() + layout.offsets[column]; }
+
+   /// Get the bitmap of erased records, bit i of word i / 64 is set if record i is erased.
+   [[nodiscard]] const uint64_t* get_erased(const Layout& layout) const { return reinterpret_cast<const uint64_t*>(get_data() + layout.erased_offset); }
+   /// Is erased?
+   [[nodiscard]] bool is_erased(const Layout& layout, uint32_t record_id) const { return (get_erased(layout)[record_id / 64] >> (record_id % 64)) & 1; }
+
+   /// Append a record.
+   /// @param[in] layout       The layout of the table's pages.
+   /// @param[in] record       The record in row format, `layout.record_width` bytes.
+   /// @return                 The id of the record on the page.
+   uint32_t append(const Layout& layout, const std::byte* record);
+
+   /// Read a record.
+   /// @param[in] layout       The layout of the table's pages.
+   /// @param[in] record_id    The record that should be read.
+   /// @param[in] record       The buffer that the record is read into in row format.
+   /// @param[in] capacity     The capacity of the buffer.
+   /// @return                 The bytes that have been read.
+   uint32_t read(const Layout& layout, uint32_t record_id, std::byte* record, uint32_t capacity) const;
+
+   /// Erase a record.
+   /// @param[in] layout       The layout of the table's pages.
+   /// @param[in] record_id    The record that should be erased.
+   void erase(const Layout& layout, uint32_t record_id);
+
+   /// The header.
+   /// Like a slotted page, a PAX page resides on the buffer frame and is reinterpret_cast from
+   /// BufferFrame.get_data(). It only knows where its minipages are from the table's `Layout`.
+   Header header;
+};
+
+/// Sets bit i of `selection` (in words of 64 bits) for every i in [0, count) with
+/// low <= values[i] <= high, and clears all others. The values are compared in SIMD
+/// registers (AVX-512, AVX2 or NEON, whatever the target supports).
+void filter_between(const int32_t* values, size_t count, int32_t low, int32_t high, uint64_t* selection);
+
+}
@@ -6,6 +6,7 @@
 #include <mutex>
 #include <stack>
 #include <string>
+#include <string_view>
 #include <tuple>
 #include <unordered_map>
 #include <utility>
@@ -45,6 +46,14 @@ struct Column {
 };
 
 struct Table {
+   /// Page layout
+   enum Layout : uint8_t {
+      /// Rows on slotted pages
+      kRows,
+      /// Columns on PAX pages, see `PaxPage`
+      kPax
+   };
+
    /// Name of the table
    const std::string id;
    /// Columns
@@ -58,10 +67,18 @@ struct Table {
 
    /// Number of allocated slotted pages
    uint64_t allocated_pages;
+   /// The free cache of the free space inventory when the schema was written, empty if unknown.
+   /// Saves the scan over the free space inventory when it is opened again.
+   std::vector<uint64_t> free_cache;
+   /// Layout of the pages in the sp segment, PAX tables don't use their fsi segment
+   const Layout layout;
 
    /// Constructor
-   Table(std::string id, std::vector<Column> columns, std::vector<std::string> primary_key, uint16_t sp_segment, uint16_t fsi_segment, uint64_t allocated_pages = 0)
-      : id(std::move(id)), columns(std::move(columns)), primary_key(std::move(primary_key)), sp_segment(sp_segment), fsi_segment(fsi_segment), allocated_pages(allocated_pages) {}
+   Table(std::string id, std::vector<Column> columns, std::vector<std::string> primary_key, uint16_t sp_segment, uint16_t fsi_segment, uint64_t allocated_pages = 0, Layout layout = kRows)
+      : id(std::move(id)), columns(std::move(columns)), primary_key(std::move(primary_key)), sp_segment(sp_segment), fsi_segment(fsi_segment), allocated_pages(allocated_pages), layout(layout) {}
+
+   /// Get layout name
+   [[nodiscard]] const char* layout_name() const;
 };
 
 struct Schema {
@@ -72,6 +89,11 @@ struct Schema {
    explicit Schema(std::vector<Table>&& tables)
       : tables(std::move(tables)) {
    }
+
+   /// Parse a schema from JSON, e.g. to import it
+   static std::unique_ptr<Schema> from_json(std::string_view json);
+   /// Serialize the schema to JSON, e.g. to export it
+   [[nodiscard]] std::string to_json() const;
 };
 
 }
@@ -1,10 +1,18 @@
 #pragma once
 
 #include "simpledb/buffer_manager.h"
+#include "simpledb/pax_page.h"
 #include "simpledb/schema.h"
 #include "simpledb/slotted_page.h"
 #include <array>
+#include <atomic>
+#include <functional>
+#include <initializer_list>
+#include <mutex>
 #include <optional>
+#include <span>
+#include <utility>
+#include <vector>
 
 namespace simpledb {
 
@@ -42,45 +50,91 @@ class SchemaSegment : public Segment {
    SchemaSegment& operator=(SchemaSegment&&) = delete;
 
    /// Set the schema of the schema segment
-   void set_schema(std::unique_ptr<schema::Schema> new_schema) { schema = std::move(new_schema); }
+   void set_schema(std::unique_ptr<schema::Schema> new_schema) {
+      schema = std::move(new_schema);
+      catalogTables = kNoCatalog;
+   }
    /// Get the schema of the schema segment
    schema::Schema* get_schema() { return schema.get(); }
 
    /// Read the schema from disk.
    /// The schema segment is structured as follows:
-   /// [0-8[   Schema string length in #bytes
-   /// [8-?]   schema::Schema object serialized as JSON
-   /// Note that the serialized schema *could* be larger than 1 page.
+   /// [0-8[   Catalog length in #bytes
+   /// [8-12[  `kBinaryCatalog`, otherwise the catalog is a schema::Schema serialized as JSON
+   /// [12-16[ Number of tables
+   /// [16-20[ Reserved
+   /// [20-?]  The allocated pages of all tables, followed by the rest of the tables
+   /// Note that the catalog *could* be larger than 1 page.
    void read();
 
    /// Write the schema to disk.
-   /// Note that we need to track the number of slotted pages in the schema segment.
-   /// For this assignment, you can simply write the schema segment to disk whenever you allocate a slotted page.
    void write();
 
+   /// Write only the number of allocated pages of a table, which changes whenever a slotted page
+   /// is allocated. Writes the whole schema if it wasn't written since it was set.
+   /// Thread-safe w.r.t. other calls to `write_allocated_pages()`.
+   /// @param[in] table    A table of the schema.
+   void write_allocated_pages(schema::Table& table);
+
+   /// Tag of the binary catalog
+   static constexpr uint32_t kBinaryCatalog = 0x43424453;
+
    protected:
    /// The schema
    std::unique_ptr<schema::Schema> schema;
+
+   private:
+   /// Marks that the schema wasn't written since it was set
+   static constexpr size_t kNoCatalog = ~0ull;
+   /// Offset of the catalog in the segment
+   static constexpr size_t kCatalogOffset = 20;
+
+   /// Number of tables of the catalog on disk, `kNoCatalog` if it doesn't belong to the schema
+   size_t catalogTables = kNoCatalog;
+   /// Serializes writes of the allocated pages
+   std::mutex allocatedPagesLatch;
+
+   /// Read `size` bytes at `offset` in the segment, which may span pages
+   void readBytes(size_t offset, char* data, size_t size);
+   /// Write `size` bytes at `offset` in the segment, which may span pages
+   void writeBytes(size_t offset, const char* data, size_t size);
 };
 
 class FSISegment : public Segment {
    public:
    /// Constructor
+   /// Takes the free cache from the table if it was written with the schema, otherwise rebuilds
+   /// it from the pages of the fsi.
    /// @param[in] segment_id       Id of the segment that the fsi is stored in.
    /// @param[in] buffer_manager   The buffer manager that should be used by the fsi segment.
    /// @param[in] table            The table that the fsi belongs to.
    FSISegment(uint16_t segment_id, BufferManager& buffer_manager, schema::Table& table);
+   /// Destructor. Saves the free cache.
+   ~FSISegment();
+
+   FSISegment(const FSISegment&) = delete;
+   FSISegment(FSISegment&&) = delete;
+   FSISegment& operator=(const FSISegment&) = delete;
+   FSISegment& operator=(FSISegment&&) = delete;
+
+   /// Copy the free cache into the table, so that the next `SchemaSegment::write()` stores it.
+   /// The cache is only a hint, so it doesn't matter if updates since then are lost in a crash.
+   void save_free_cache();
 
    /// Update a the free space of a page.
    /// The free space inventory encodes the free space of a target page in 4 bits.
    /// It is left up to you whether you want to implement completely linear free space entries
    /// or half logarithmic ones. (cf. lecture slides)
    ///
+   /// Thread-safe.
+   ///
    /// @param[in] target_page      The (slotted) page number.
    /// @param[in] free_space       The new free space on that page.
    void update(uint64_t target_page, uint32_t free_space);
 
    /// Find a free page
+   /// Thread-safe, but concurrent updates may make it return a page that doesn't have the required
+   /// space anymore. Callers have to check the page and `update()` it if it was wrong.
    /// @param[in] required_space       The required space.
    std::optional<uint64_t> find(uint32_t required_space);
 
@@ -98,7 +152,7 @@ class FSISegment : public Segment {
    /// Free cache storing page indices for pages with enough free space.
    /// Note that a value with the upper 2 bytes set represents that no
    /// page with the given amount of free space exists.
-   std::array<uint64_t, 16> free_cache;
+   std::array<std::atomic<uint64_t>, 16> free_cache;
 
    static constexpr uint64_t invalidPid = 0xFFFF000000000000;
 
@@ -116,12 +170,93 @@ class SPSegment : public simpledb::Segment {
    /// @param[in] table            The table that the fsi belongs to.
    SPSegment(uint16_t segment_id, BufferManager& buffer_manager, SchemaSegment& schema, FSISegment& fsi, schema::Table& table);
 
+   /// Records that are handed out together by `scan()`.
+   class ScanBatch {
+      public:
+      /// Get the number of records.
+      [[nodiscard]] size_t size() const { return tids.size(); }
+      /// Get the TID of a record.
+      [[nodiscard]] TID get_tid(size_t i) const { return tids[i]; }
+      /// Get the data of a record, valid until the batch is changed.
+      [[nodiscard]] std::span<const std::byte> get_record(size_t i) const {
+         return {data.data() + offsets[i], offsets[i + 1] - offsets[i]};
+      }
+
+      /// Append a copy of a record.
+      void append(TID tid, const std::byte* record, uint32_t size);
+      /// Remove all records, but keep the memory.
+      void clear();
+
+      private:
+      /// The TIDs of the records.
+      std::vector<TID> tids;
+      /// Record i is stored in [offsets[i], offsets[i + 1]) of `data`.
+      std::vector<uint32_t> offsets{0};
+      /// The data of all records.
+      std::vector<std::byte> data;
+   };
+
+   /// A record that is read in place. Keeps the page that holds the record fixed in shared mode
+   /// until it is destroyed or released, so it must not outlive the segment's buffer manager and the
+   /// thread that holds it must not fix the page exclusively in the meantime.
+   class RecordView {
+      public:
+      /// Constructor, views no record.
+      RecordView() = default;
+      /// Destructor, unfixes the page.
+      ~RecordView() { release(); }
+
+      RecordView(const RecordView&) = delete;
+      RecordView& operator=(const RecordView&) = delete;
+      RecordView(RecordView&& other) noexcept;
+      RecordView& operator=(RecordView&& other) noexcept;
+
+      /// Is there a record?
+      explicit operator bool() const { return frame != nullptr; }
+      /// Get the data of the record, empty if there is none.
+      [[nodiscard]] std::span<const std::byte> get_data() const { return record; }
+
+      /// Unfix the page, the view is empty afterwards.
+      void release();
+
+      private:
+      friend class SPSegment;
+      /// Constructor.
+      RecordView(BufferManager& buffer_manager, BufferFrame& frame, std::span<const std::byte> record)
+         : buffer_manager(&buffer_manager), frame(&frame), record(record) {}
+
+      /// The buffer manager that the page is fixed in.
+      BufferManager* buffer_manager = nullptr;
+      /// The frame of the page, nullptr if there is no record.
+      BufferFrame* frame = nullptr;
+      /// The record on the page.
+      std::span<const std::byte> record;
+   };
+
+   /// The number of records after which `scan()` hands out a batch by default.
+   static constexpr size_t kScanBatchSize = 1024;
+   /// The number of pages that `scan()` prefetches ahead of the page it reads.
+   static constexpr uint64_t kScanPrefetchPages = 8;
+   /// The number of consecutive pages that a worker of `parallel_scan()` reads at once.
+   static constexpr uint64_t kMorselPages = 16;
+   /// The number of pages that threads insert into at the same time.
+   static constexpr size_t kInsertPages = 16;
+
    /// Allocate a new record.
    /// Returns a TID that stores the page as well as the slot of the allocated record.
    /// The allocate method should use the free-space inventory to find a suitable page quickly.
+   /// Every thread keeps inserting into the same page until it is full, so that threads that
+   /// insert concurrently don't contend for the same page.
    /// @param[in] size         The size that should be allocated.
    TID allocate(uint32_t size, bool is_redirect_target = false);
 
+   /// Allocates and writes many records at once.
+   /// Every page that is chosen for a record is filled with as many of the following records as
+   /// fit under a single exclusive fix, and the free-space inventory is updated once per page.
+   /// @param[in] records      The data of the records.
+   /// @return                 The TIDs of the records, in the same order.
+   std::vector<TID> insert_batch(std::span<const std::span<const std::byte>> records);
+
    /// Read the data of the record into a buffer.
    /// @param[in] tid          The TID that identifies the record.
    /// @param[in] record       The buffer that is read into.
@@ -129,6 +264,12 @@ class SPSegment : public simpledb::Segment {
    /// @return                 The bytes that have been read.
    uint32_t read(TID tid, std::byte* record, uint32_t capacity) const;
 
+   /// Read a record in place, without copying it.
+   /// A redirected record is viewed on the page of its target, only that page stays fixed.
+   /// @param[in] tid          The TID that identifies the record.
+   /// @return                 The view of the record, empty if the record was erased.
+   [[nodiscard]] RecordView view(TID tid) const;
+
    /// Write a record.
    /// @param[in] tid          The TID that identifies the record.
    /// @param[in] record       The buffer that is written.
@@ -147,16 +288,151 @@ class SPSegment : public simpledb::Segment {
    /// @param[in] tid          The TID that identifies the record.
    void erase(TID tid);
 
+   /// Reads all records of the table in the order of their pages and slots and calls `callback`
+   /// with them in batches. A batch always holds all records of a page and is handed out as soon as
+   /// it holds at least `batch_size` records. Redirected records are read from their target once and
+   /// returned with the TID that points to the redirect. Each page is only latched shared while its
+   /// records are copied into the batch. Records that are changed concurrently may or may not be seen
+   /// in their new state.
+   /// @param[in] callback     Invoked with every batch, returns whether to continue.
+   /// @param[in] batch_size   The number of records after which a batch is handed out.
+   void scan(const std::function<bool(const ScanBatch&)>& callback, size_t batch_size = kScanBatchSize) const;
+
+   /// Reads all records of the table like `scan()`, but with `thread_count` threads. The pages are
+   /// split into morsels of `kMorselPages` pages, each worker starts on its own share of them and
+   /// steals morsels from the others when it runs out. Every worker fills its own batches and calls
+   /// `callback` with its index in [0, thread_count) concurrently with the other workers. The calling
+   /// thread is worker 0. If a worker throws, the others stop after their current batch and the
+   /// exception is rethrown.
+   /// @param[in] callback     Invoked with the worker's index and every batch it read.
+   /// @param[in] thread_count The number of workers, 0 uses all hardware threads.
+   /// @param[in] batch_size   The number of records after which a batch is handed out.
+   void parallel_scan(const std::function<void(size_t, const ScanBatch&)>& callback, size_t thread_count = 0, size_t batch_size = kScanBatchSize) const;
+
+   /// Aggregates all records of the table with `parallel_scan()`. Every worker folds its batches
+   /// into its own copy of `init` with `fold(T&, const ScanBatch&)`, which also filters the records,
+   /// and the copies are combined with `merge(T&, const T&)` in the end. `init` must not change what
+   /// it is merged into.
+   template <typename T, typename Fold, typename Merge>
+   T parallel_aggregate(const T& init, Fold&& fold, Merge&& merge, size_t thread_count = 0) const {
+      std::vector<T> partials(resolve_thread_count(thread_count), init);
+      parallel_scan([&](size_t worker, const ScanBatch& batch) { fold(partials[worker], batch); }, partials.size());
+      T result = init;
+      for (const auto& partial : partials) {
+         merge(result, partial);
+      }
+      return result;
+   }
+
    /// Helper function to get the slot for a specific TID.
    [[nodiscard]] std::tuple<BufferFrame&, simpledb::SlottedPage*, SlottedPage::Slot&> get_slot(TID tid, bool exlusive) const;
 
    protected:
+   /// Allocate a new record on another page than the `fixed_pages` that the caller holds.
+   TID allocate(uint32_t size, bool is_redirect_target, std::initializer_list<uint64_t> fixed_pages);
+
+   /// Fixes a page exclusively that has room for a record of `size` bytes, creating a new one if the
+   /// free-space inventory knows none. Tries the calling thread's insert page first and skips the
+   /// insert pages of other threads.
+   /// @param[in]  size         The size of the record.
+   /// @param[out] pid          The page id of the page.
+   /// @param[in]  fixed_pages  The page ids of pages that the caller holds, which are skipped.
+   BufferFrame& fix_free_page(uint32_t size, uint64_t& pid, std::initializer_list<uint64_t> fixed_pages = {});
+
+   /// Reads the pages [first, last) into `batch` and hands it to `callback` whenever it holds at
+   /// least `batch_size` records. Records that are left over stay in `batch`.
+   /// Returns false if `callback` stopped the scan.
+   bool scan_pages(uint64_t first, uint64_t last, ScanBatch& batch, std::vector<std::pair<TID, TID>>& redirects, const std::function<bool(const ScanBatch&)>& callback, size_t batch_size) const;
+
+   /// Returns the number of threads that a `thread_count` of a parallel scan stands for.
+   static size_t resolve_thread_count(size_t thread_count);
+
    /// Schema segment
    SchemaSegment& schema;
    /// Free space inventory
    FSISegment& fsi;
    /// The table
    schema::Table& table;
+   /// The page indices that the threads insert into, threads share them round robin.
+   std::array<std::atomic<uint64_t>, kInsertPages> insertPages;
+};
+
+
+class PAXSegment : public simpledb::Segment {
+   public:
+   /// Constructor
+   /// @param[in] segment_id       Id of the segment that the PAX pages are stored in.
+   /// @param[in] buffer_manager   The buffer manager that should be used by the PAX segment.
+   /// @param[in] table            The table that is stored in the segment.
+   PAXSegment(uint16_t segment_id, BufferManager& buffer_manager, schema::Table& table);
+
+   /// The minipages of the requested columns of a page that are handed out by `scan()`.
+   struct ColumnBatch {
+      /// The page index.
+      uint64_t page_index;
+      /// The number of records on the page, including the erased ones.
+      uint32_t record_count;
+      /// The bitmap of erased records, see `PaxPage::get_erased()`.
+      const uint64_t* erased;
+      /// The minipages of the requested columns, in the requested order.
+      std::vector<const std::byte*> columns;
+
+      /// Get the TID of a record.
+      [[nodiscard]] TID get_tid(uint32_t record_id) const { return TID(page_index, record_id); }
+      /// Is erased?
+      [[nodiscard]] bool is_erased(uint32_t record_id) const { return (erased[record_id / 64] >> (record_id % 64)) & 1; }
+      /// Get the values of a requested column.
+      template <typename T>
+      [[nodiscard]] const T* get_values(size_t column) const { return reinterpret_cast<const T*>(columns[column]); }
+   };
+
+   /// Get the layout of the pages.
+   [[nodiscard]] const PaxPage::Layout& get_layout() const { return layout; }
+
+   /// Insert a record.
+   /// @param[in] record       The record in row format, it has to be `get_layout().record_width` bytes.
+   /// @return                 The TID of the record.
+   TID insert(std::span<const std::byte> record);
+
+   /// Insert many records at once, they are appended to the last page under a single exclusive fix
+   /// of every page that they fill.
+   /// @param[in] records      The records in row format.
+   /// @return                 The TIDs of the records, in the same order.
+   std::vector<TID> insert_batch(std::span<const std::span<const std::byte>> records);
+
+   /// Read the data of the record into a buffer in row format.
+   /// @param[in] tid          The TID that identifies the record.
+   /// @param[in] record       The buffer that is read into.
+   /// @param[in] capacity     The capacity of the buffer that is read into.
+   /// @return                 The bytes that have been read, 0 if the record was erased.
+   uint32_t read(TID tid, std::byte* record, uint32_t capacity) const;
+
+   /// Erase a record, its space is not reused.
+   /// @param[in] tid          The TID that identifies the record.
+   void erase(TID tid);
+
+   /// Calls `callback` with the minipages of `columns` of every page in order. Only these minipages
+   /// are touched, the page is latched shared while `callback` runs.
+   /// @param[in] columns      The indices of the columns that should be read.
+   /// @param[in] callback     Invoked with every page, returns whether to continue.
+   void scan(std::span<const size_t> columns, const std::function<bool(const ColumnBatch&)>& callback) const;
+
+   /// Counts the records with low <= value <= high in an integer column, filtering each minipage
+   /// with `filter_between()`.
+   /// @param[in] column       The index of the column, it has to be an integer column.
+   /// @param[in] low          The lower bound.
+   /// @param[in] high         The upper bound.
+   uint64_t count_between(size_t column, int32_t low, int32_t high) const;
+
+   protected:
+   /// Fixes the last page exclusively if it isn't full, or appends and initializes a new one.
+   /// @param[out] page_index  The index of the page.
+   BufferFrame& fix_last_page(uint64_t& page_index);
+
+   /// The table
+   schema::Table& table;
+   /// The layout of the pages
+   const PaxPage::Layout layout;
 };
 
 }
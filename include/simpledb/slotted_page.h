@@ -137,6 +137,8 @@ struct SlottedPage {
    void erase(uint16_t slot_id);
 
    /// Compact the page.
+   /// The records are packed into scratch memory of the calling thread and only the data that is
+   /// in use is copied back, so compaction neither allocates nor rewrites the free space.
    /// @param[in] page_size    The size of a buffer frame.
    void compactify(uint32_t page_size);
 
@@ -0,0 +1,513 @@
+#pragma once
+
+#include "simpledb/buffer_manager.h"
+#include "simpledb/segment.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+namespace simpledb {
+
+///
+/// B+-Tree for variable-length byte string keys, e.g. `Char(n)` columns. Nodes are slotted pages:
+/// the slots grow from the front, the key bytes and values from the back. Every node stores the
+/// fence keys that bound its keys, and the prefix they have in common is stored only once and cut
+/// off all keys in the node. Leaf splits pick the shortest separator that divides the two halves.
+///
+template <typename ValueT, size_t PageSize>
+struct StringBTree : public Segment {
+   static_assert(std::is_trivially_copyable_v<ValueT>);
+   static_assert(PageSize <= (1u << 16), "slot offsets are 16 bit");
+
+   struct Slot {
+      /// The offset of the key suffix in the node, its payload follows right after it.
+      uint16_t offset;
+      /// The length of the key suffix.
+      uint16_t length;
+      /// The first bytes of the key suffix in big-endian order, decides most comparisons.
+      uint32_t head;
+   };
+
+   struct Node {
+      /// The level in the tree.
+      uint16_t level;
+      /// The number of slots.
+      uint16_t count;
+      /// The length of the prefix that all keys in the node share.
+      uint16_t prefixLength;
+      /// The length of the lower fence key, keys in the node are greater than it.
+      uint16_t lowerFenceLength;
+      /// The length of the upper fence key, keys in the node are not greater than it.
+      uint16_t upperFenceLength;
+      /// The offset of the lower fence key.
+      uint16_t lowerFenceOffset;
+      /// The offset of the upper fence key.
+      uint16_t upperFenceOffset;
+      /// Whether there is an upper fence key, there is none in the rightmost node of each level.
+      bool hasUpperFence;
+      /// The lower end of the key bytes and values.
+      uint32_t dataStart;
+      /// The bytes above `dataStart` that are in use, the rest is left by erased entries.
+      uint32_t spaceUsed;
+      /// The rightmost child of an inner node, responsible for keys greater than all of its keys.
+      uint64_t upper;
+
+      /// The size of the values.
+      [[nodiscard]] size_t payload_size() const { return is_leaf() ? sizeof(ValueT) : sizeof(uint64_t); }
+
+      /// Is the node a leaf node?
+      [[nodiscard]] bool is_leaf() const { return level == 0; }
+
+      /// Returns the slots.
+      Slot* slots() { return reinterpret_cast<Slot*>(this + 1); }
+      /// Returns the slots.
+      [[nodiscard]] const Slot* slots() const { return reinterpret_cast<const Slot*>(this + 1); }
+
+      /// Returns a pointer into the node.
+      char* ptr(size_t offset) { return reinterpret_cast<char*>(this) + offset; }
+      /// Returns a pointer into the node.
+      [[nodiscard]] const char* ptr(size_t offset) const { return reinterpret_cast<const char*>(this) + offset; }
+
+      /// Returns the lower fence key.
+      [[nodiscard]] std::string_view lower_fence() const { return {ptr(lowerFenceOffset), lowerFenceLength}; }
+      /// Returns the upper fence key, if there is one.
+      [[nodiscard]] std::optional<std::string_view> upper_fence() const {
+         if (!hasUpperFence)
+            return {};
+         return std::string_view{ptr(upperFenceOffset), upperFenceLength};
+      }
+      /// Returns the prefix that all keys in the node share.
+      [[nodiscard]] std::string_view prefix() const { return {ptr(lowerFenceOffset), prefixLength}; }
+
+      /// Returns the key at a slot without the prefix.
+      [[nodiscard]] std::string_view suffix(uint32_t slot) const { return {ptr(slots()[slot].offset), slots()[slot].length}; }
+      /// Returns the full key at a slot.
+      [[nodiscard]] std::string key(uint32_t slot) const {
+         std::string key{prefix()};
+         key += suffix(slot);
+         return key;
+      }
+
+      /// Returns the value at a slot.
+      [[nodiscard]] ValueT value(uint32_t slot) const {
+         ValueT value;
+         memcpy(&value, ptr(slots()[slot].offset + slots()[slot].length), sizeof(ValueT));
+         return value;
+      }
+      /// Overwrites the value at a slot.
+      void set_value(uint32_t slot, const ValueT& value) { memcpy(ptr(slots()[slot].offset + slots()[slot].length), &value, sizeof(ValueT)); }
+
+      /// Returns the child at a slot, `count` is the rightmost child.
+      [[nodiscard]] uint64_t child(uint32_t slot) const {
+         if (slot == count)
+            return upper;
+         uint64_t child;
+         memcpy(&child, ptr(slots()[slot].offset + slots()[slot].length), sizeof(uint64_t));
+         return child;
+      }
+      /// Overwrites the child at a slot, `count` is the rightmost child.
+      void set_child(uint32_t slot, uint64_t child) {
+         if (slot == count) {
+            upper = child;
+         } else {
+            memcpy(ptr(slots()[slot].offset + slots()[slot].length), &child, sizeof(uint64_t));
+         }
+      }
+
+      /// Returns the free space between the slots and the data.
+      [[nodiscard]] size_t free_space() const { return dataStart - sizeof(Node) - count * sizeof(Slot); }
+      /// Returns the free space after `compact()`.
+      [[nodiscard]] size_t free_space_after_compaction() const { return PageSize - sizeof(Node) - count * sizeof(Slot) - spaceUsed; }
+
+      /// Returns the space an entry with the key takes up in this node.
+      [[nodiscard]] size_t space_needed(std::string_view key) const { return key.size() - prefixLength + payload_size() + sizeof(Slot); }
+
+      /// Makes sure that a number of bytes is free, compacts the node if necessary.
+      /// Returns false if they don't fit even then.
+      bool request_space(size_t space) {
+         if (space <= free_space())
+            return true;
+         if (space <= free_space_after_compaction()) {
+            compact();
+            return true;
+         }
+         return false;
+      }
+
+      /// Returns the head of a key suffix.
+      static uint32_t head(std::string_view suffix) {
+         std::array<unsigned char, 4> bytes{};
+         memcpy(bytes.data(), suffix.data(), std::min<size_t>(suffix.size(), bytes.size()));
+         return (static_cast<uint32_t>(bytes[0]) << 24) | (static_cast<uint32_t>(bytes[1]) << 16) | (static_cast<uint32_t>(bytes[2]) << 8) | bytes[3];
+      }
+
+      /// Initializes an empty node.
+      /// @param[in] node_level   The level in the tree.
+      /// @param[in] lower        The lower fence key.
+      /// @param[in] upper_fence  The upper fence key, none for the rightmost node of the level.
+      void init(uint16_t node_level, std::string_view lower, std::optional<std::string_view> upper_fence) {
+         level = node_level;
+         count = 0;
+         dataStart = PageSize;
+         spaceUsed = 0;
+         upper = 0;
+
+         hasUpperFence = upper_fence.has_value();
+         auto store = [this](std::string_view fence) {
+            dataStart -= fence.size();
+            spaceUsed += fence.size();
+            if (!fence.empty())
+               memcpy(ptr(dataStart), fence.data(), fence.size());
+            return static_cast<uint16_t>(dataStart);
+         };
+         upperFenceLength = hasUpperFence ? upper_fence->size() : 0;
+         upperFenceOffset = hasUpperFence ? store(*upper_fence) : 0;
+         lowerFenceLength = lower.size();
+         lowerFenceOffset = store(lower);
+
+         // keys between the fences all start with what the fences have in common
+         prefixLength = 0;
+         if (hasUpperFence) {
+            auto limit = std::min(lower.size(), upper_fence->size());
+            while (prefixLength < limit && lower[prefixLength] == (*upper_fence)[prefixLength])
+               ++prefixLength;
+         }
+      }
+
+      /// Get the index of the first key that is not less than a provided key.
+      /// The key must lie between the fences.
+      [[nodiscard]] std::pair<uint32_t, bool> lower_bound(std::string_view key) const {
+         assert(key.substr(0, prefixLength) == prefix());
+         auto suffix = key.substr(prefixLength);
+         auto keyHead = head(suffix);
+
+         uint32_t low = 0;
+         uint32_t high = count;
+         while (low < high) {
+            auto mid = low + (high - low) / 2;
+            const auto& slot = slots()[mid];
+            bool less = slot.head != keyHead ? slot.head < keyHead : std::string_view{ptr(slot.offset), slot.length} < suffix;
+            if (less) {
+               low = mid + 1;
+            } else {
+               high = mid;
+            }
+         }
+         return {low, low < count && this->suffix(low) == suffix};
+      }
+
+      /// Inserts an entry at a slot, there must be enough free space.
+      /// @param[in] slot     The slot, following entries are moved back.
+      /// @param[in] key      The full key.
+      /// @param[in] payload  The value or child.
+      void insert_at(uint32_t slot, std::string_view key, const void* payload) {
+         auto suffix = key.substr(prefixLength);
+         auto size = suffix.size() + payload_size();
+         assert(free_space() >= size + sizeof(Slot));
+
+         memmove(&slots()[slot + 1], &slots()[slot], (count - slot) * sizeof(Slot));
+         dataStart -= size;
+         spaceUsed += size;
+         memcpy(ptr(dataStart), suffix.data(), suffix.size());
+         memcpy(ptr(dataStart + suffix.size()), payload, payload_size());
+         slots()[slot] = {static_cast<uint16_t>(dataStart), static_cast<uint16_t>(suffix.size()), head(suffix)};
+         ++count;
+      }
+
+      /// Removes the entry at a slot. Its space is reclaimed by the next compaction.
+      void erase_at(uint32_t slot) {
+         spaceUsed -= slots()[slot].length + payload_size();
+         memmove(&slots()[slot], &slots()[slot + 1], (count - slot - 1) * sizeof(Slot));
+         --count;
+      }
+
+      /// Appends the entries [begin, end) of another node, they must lie between the fences.
+      void copy_from(const Node& other, uint32_t begin, uint32_t end) {
+         for (auto i = begin; i < end; ++i) {
+            insert_at(count, other.key(i), other.ptr(other.slots()[i].offset + other.slots()[i].length));
+         }
+      }
+
+      /// Moves all entries to the end of the node, so the space of erased entries is free again.
+      void compact() {
+         alignas(Node) std::array<char, PageSize> buffer;
+         auto& tmp = *reinterpret_cast<Node*>(buffer.data());
+         tmp.init(level, lower_fence(), upper_fence());
+         tmp.copy_from(*this, 0, count);
+         tmp.upper = upper;
+         memcpy(this, &tmp, PageSize);
+      }
+   };
+
+   /// The longest key that can be stored. Keeps room for the fences and a few entries per node,
+   /// so a split always leaves space in both halves.
+   static constexpr size_t kMaxKeyLength = (PageSize - sizeof(Node)) / 8 - sizeof(Slot) - sizeof(uint64_t);
+
+   /// The space an inner node needs for the separator that a split of one of its children inserts.
+   static constexpr size_t kSeparatorSpace = kMaxKeyLength + sizeof(uint64_t) + sizeof(Slot);
+
+   static_assert(kMaxKeyLength >= 16, "too small pages");
+
+   /// The root.
+   std::atomic<uint64_t> root;
+
+   /// Node count.
+   std::atomic<uint64_t> nodeCount = 0;
+   /// Tree height.
+   std::atomic<uint16_t> treeHeight = 0;
+
+   /// Constructor.
+   StringBTree(uint16_t segment_id, BufferManager& buffer_manager)
+      : Segment(segment_id, buffer_manager) {
+      auto pid = create_new_node();
+      auto& bf = buffer_manager.fix_page(pid, true);
+      reinterpret_cast<Node*>(bf.get_data())->init(0, {}, {});
+
+      root = pid;
+      treeHeight = 1;
+
+      buffer_manager.unfix_page(bf, true);
+   }
+
+   /// Creates a new node and returns its PID.
+   uint64_t create_new_node() {
+      return (static_cast<uint64_t>(segment_id) << 48) ^ nodeCount++;
+   }
+
+   /// Lookup an entry in the tree.
+   /// @param[in] key      The key that should be searched.
+   /// @return             The value of the key, if it is in the tree.
+   std::optional<ValueT> lookup(std::string_view key) {
+      if (key.size() > kMaxKeyLength)
+         return {};
+
+      while (true) {
+         auto pid = root.load();
+         auto* frame = &buffer_manager.fix_page(pid, false);
+         if (root != pid) {
+            // root changed -> restart
+            buffer_manager.unfix_page(*frame, false);
+            continue;
+         }
+
+         // shared lock coupling down to the leaf
+         while (!reinterpret_cast<Node*>(frame->get_data())->is_leaf()) {
+            auto& node = *reinterpret_cast<Node*>(frame->get_data());
+            auto* child = &buffer_manager.fix_page(node.child(node.lower_bound(key).first), false);
+            buffer_manager.unfix_page(*frame, false);
+            frame = child;
+         }
+
+         auto& leaf = *reinterpret_cast<Node*>(frame->get_data());
+         auto pos = leaf.lower_bound(key);
+         auto value = pos.second ? std::optional<ValueT>(leaf.value(pos.first)) : std::optional<ValueT>{};
+         buffer_manager.unfix_page(*frame, false);
+         return value;
+      }
+   }
+
+   /// Erase an entry in the tree.
+   /// @param[in] key      The key that should be erased.
+   void erase(std::string_view key) {
+      if (key.size() > kMaxKeyLength)
+         return;
+
+      while (true) {
+         auto pid = root.load();
+         auto* frame = &buffer_manager.fix_page(pid, treeHeight == 1);
+         if (root != pid) {
+            buffer_manager.unfix_page(*frame, false);
+            continue;
+         }
+
+         while (!reinterpret_cast<Node*>(frame->get_data())->is_leaf()) {
+            auto& node = *reinterpret_cast<Node*>(frame->get_data());
+            auto* child = &buffer_manager.fix_page(node.child(node.lower_bound(key).first), node.level == 1);
+            buffer_manager.unfix_page(*frame, false);
+            frame = child;
+         }
+
+         auto& leaf = *reinterpret_cast<Node*>(frame->get_data());
+         auto pos = leaf.lower_bound(key);
+         if (pos.second)
+            leaf.erase_at(pos.first);
+         buffer_manager.unfix_page(*frame, pos.second);
+         return;
+      }
+   }
+
+   /// Inserts a new entry into the tree or overwrites the value of an existing one.
+   /// Throws `std::length_error` if the key is longer than `kMaxKeyLength`.
+   /// @param[in] key      The key that should be inserted.
+   /// @param[in] value    The value that should be inserted.
+   void insert(std::string_view key, const ValueT& value) {
+      if (key.size() > kMaxKeyLength)
+         throw std::length_error("key is too long");
+
+      bool exclusive = false;
+
+   restart:
+      BufferFrame* parentFrame = nullptr;
+      uint64_t currentPid = root;
+      BufferFrame* currentFrame = &buffer_manager.fix_page(currentPid, exclusive || treeHeight == 1);
+
+      if (root != currentPid) {
+         // root changed -> restart
+         buffer_manager.unfix_page(*currentFrame, false);
+         goto restart;
+      }
+
+      while (true) {
+         auto& node = *reinterpret_cast<Node*>(currentFrame->get_data());
+
+         // inner nodes need room for any separator, leaves for this key
+         // (leaves are always latched exclusively, inner nodes are only compacted once they get one)
+         auto pos = node.lower_bound(key);
+         bool fits = node.is_leaf() ?
+            (pos.second || node.request_space(node.space_needed(key))) :
+            node.free_space_after_compaction() >= kSeparatorSpace;
+
+         if (!fits) {
+            // we have to split
+            if (!exclusive) {
+               // we are not exclusive -> restart
+               buffer_manager.unfix_page(*currentFrame, false);
+               if (parentFrame)
+                  buffer_manager.unfix_page(*parentFrame, false);
+
+               exclusive = true;
+               goto restart;
+            }
+
+            if (!parentFrame) {
+               // no parent -> grow root
+               parentFrame = &grow_root(node.level + 1, currentPid);
+            }
+            split(*reinterpret_cast<Node*>(parentFrame->get_data()), node, currentPid);
+
+            buffer_manager.unfix_page(*currentFrame, true);
+            buffer_manager.unfix_page(*parentFrame, true);
+
+            // restart again without exclusive
+            exclusive = false;
+            goto restart;
+         }
+
+         if (node.is_leaf()) {
+            if (pos.second) {
+               node.set_value(pos.first, value);
+            } else {
+               node.insert_at(pos.first, key, &value);
+            }
+            break;
+         }
+
+         // move down
+         if (parentFrame)
+            buffer_manager.unfix_page(*parentFrame, false);
+         parentFrame = currentFrame;
+         currentPid = node.child(pos.first);
+         currentFrame = &buffer_manager.fix_page(currentPid, exclusive || node.level == 1);
+      }
+
+      buffer_manager.unfix_page(*currentFrame, true);
+      if (parentFrame)
+         buffer_manager.unfix_page(*parentFrame, false);
+   }
+
+   private:
+   /// Grows the root of the tree and returns the new root's buffer frame.
+   /// The new root only has the old one as child until it is split.
+   BufferFrame& grow_root(uint16_t level, uint64_t child) {
+      auto pid = create_new_node();
+      auto& bf = buffer_manager.fix_page(pid, true);
+      auto& newRoot = *reinterpret_cast<Node*>(bf.get_data());
+      newRoot.init(level, {}, {});
+      newRoot.upper = child;
+
+      root = pid;
+      ++treeHeight;
+
+      return bf;
+   }
+
+   /// Splits a node into itself and a new right sibling and inserts the separator into the parent,
+   /// which must have space for it.
+   /// @param[in] parent   The parent.
+   /// @param[in] node     The node that is split.
+   /// @param[in] pid      The page of the node.
+   void split(Node& parent, Node& node, uint64_t pid) {
+      assert(node.count >= 2);
+
+      // split in the middle of the bytes, not of the entries
+      uint32_t mid = 0;
+      size_t used = 0;
+      while (mid + 1 < node.count && used < (node.spaceUsed - node.lowerFenceLength - node.upperFenceLength) / 2) {
+         used += node.slots()[mid].length + node.payload_size();
+         ++mid;
+      }
+      mid = std::max<uint32_t>(mid, 1);
+
+      std::string separator;
+      uint32_t leftEnd = mid;
+      if (node.is_leaf()) {
+         // move the split a little to where neighboring keys differ as early as possible
+         auto commonPrefix = [&node](uint32_t slot) {
+            auto left = node.suffix(slot - 1);
+            auto right = node.suffix(slot);
+            return std::mismatch(left.begin(), left.end(), right.begin(), right.end()).first - left.begin();
+         };
+         uint32_t window = node.count / 8;
+         auto best = mid;
+         for (auto slot = std::max<uint32_t>(mid, window + 1) - window; slot <= std::min<uint32_t>(mid + window, node.count - 1); ++slot) {
+            if (commonPrefix(slot) < commonPrefix(best))
+               best = slot;
+         }
+         mid = leftEnd = best;
+
+         // the shortest key that is not less than the left half and less than the right half
+         auto left = node.suffix(mid - 1);
+         auto right = node.suffix(mid);
+         auto common = commonPrefix(mid);
+         separator = node.prefix();
+         separator += static_cast<size_t>(common) + 1 < right.size() ? right.substr(0, common + 1) : left;
+      } else {
+         // the separator moves up and its child becomes the rightmost one of the left half
+         separator = node.key(mid - 1);
+         leftEnd = mid - 1;
+      }
+
+      auto rightPid = create_new_node();
+      auto& rightFrame = buffer_manager.fix_page(rightPid, true);
+      auto& right = *reinterpret_cast<Node*>(rightFrame.get_data());
+      right.init(node.level, separator, node.upper_fence());
+      right.copy_from(node, mid, node.count);
+      right.upper = node.upper;
+
+      alignas(Node) std::array<char, PageSize> buffer;
+      auto& left = *reinterpret_cast<Node*>(buffer.data());
+      left.init(node.level, node.lower_fence(), separator);
+      left.copy_from(node, 0, leftEnd);
+      left.upper = node.is_leaf() ? 0 : node.child(mid - 1);
+      memcpy(&node, &left, PageSize);
+
+      // the parent's entry for the node now points to the right half, the left half goes before it
+      [[maybe_unused]] auto fits = parent.request_space(parent.space_needed(separator));
+      assert(fits);
+      auto pos = parent.lower_bound(separator);
+      assert(parent.child(pos.first) == pid);
+      parent.set_child(pos.first, rightPid);
+      parent.insert_at(pos.first, separator, &pid);
+
+      buffer_manager.unfix_page(rightFrame, true);
+   }
+};
+
+}
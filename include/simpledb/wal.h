@@ -0,0 +1,248 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "simpledb/file.h"
+
+namespace simpledb {
+
+class BufferManager;
+
+/// Redo log of the changes to the pages of a `BufferManager`.
+/// Once it is attached with `BufferManager::set_wal()`, every page that is unfixed dirty after an
+/// exclusive fix is compared with its content from before the fix, and the byte ranges that
+/// changed are appended as one record. This covers all segments (slotted pages, B+-trees, ...)
+/// without them knowing about the log. Records are buffered in memory and written sequentially
+/// to a preallocated log file by a background thread, which also syncs the file.
+///
+/// A record's log sequence number (LSN) is the offset in the log file right behind it. Frames
+/// remember the LSN of their last change, and the buffer manager makes the log durable up to it
+/// before the page is written back, so a page on disk never contains changes the log doesn't.
+///
+/// `commit()` waits until everything that was logged so far is durable. Commits that arrive
+/// while the log is being synced, or within the group commit window, share one write and sync.
+///
+/// Replaying a record writes its byte ranges into the page. That is idempotent, and the first
+/// change of a page after it was written back is logged as an image of the whole page, so replay
+/// never depends on a page on disk that may be torn by a crash. The page isn't even read for an
+/// image, a torn slot of a compressed segment couldn't be decoded.
+///
+/// `checkpoint()` makes the log shorter without stopping anyone: it remembers the dirty pages of
+/// the buffer manager and the LSN of their first change since they were written, syncs the
+/// segment files and stores where recovery has to start in a master block at the start of the
+/// log file. The log in front of that is discarded.
+/// thread-safe.
+class WriteAheadLog {
+   public:
+   /// Every record starts with this header, followed by the ranges of the page that changed.
+   struct RecordHeader {
+      /// CRC-32C of the rest of the record.
+      uint32_t checksum;
+      /// The size of the whole record.
+      uint32_t size;
+      /// Incremented whenever the log is opened. A record of an older epoch behind one of a newer
+      /// epoch is what is left of a log tail that was never durable and has been overwritten.
+      uint32_t epoch;
+      /// What the record is about, see `RecordKind`.
+      uint32_t kind;
+      /// The page that changed.
+      uint64_t page_id;
+   };
+
+   /// The kinds of records.
+   enum RecordKind : uint32_t {
+      /// Ranges of a page that changed.
+      kPageRecord,
+      /// A `CheckpointHeader` followed by the dirty pages as `DirtyPage` entries.
+      kCheckpointRecord
+   };
+
+   /// The start of a checkpoint record behind its `RecordHeader`.
+   struct CheckpointHeader {
+      /// The LSN when the checkpoint started. The records in front of it are on disk, unless they
+      /// belong to one of the dirty pages.
+      uint64_t begin_lsn;
+      /// The number of dirty pages.
+      uint64_t dirty_page_count;
+   };
+
+   /// A page that was dirty when a checkpoint started.
+   struct DirtyPage {
+      uint64_t page_id;
+      /// The recovery LSN of the page, its records in front of it are on disk.
+      uint64_t rec_lsn;
+   };
+
+   /// Where recovery starts, stored in two alternating copies in front of the records.
+   struct MasterRecord {
+      /// CRC-32C of the rest of the master record.
+      uint32_t checksum;
+      /// The epoch of the last time the log was opened, so the next open gets a larger one even
+      /// if none of the records of this one became durable.
+      uint32_t epoch;
+      /// The start of the last checkpoint record, 0 if there was none.
+      uint64_t checkpoint_lsn;
+      /// The start of the first record that recovery has to replay.
+      uint64_t redo_lsn;
+   };
+
+   /// A range of a page that changed, followed by its new content.
+   struct RangeHeader {
+      uint32_t offset;
+      uint32_t size;
+   };
+
+   /// The log is grown in steps of this size by default.
+   static constexpr size_t kDefaultChunkSize = 16ull << 20;
+   /// The copies of the master record are at offsets 0 and `kMasterSlotSize`, so a torn write
+   /// only breaks one of them.
+   static constexpr size_t kMasterSlotSize = 512;
+   /// The records start behind the master records.
+   static constexpr uint64_t kLogStart = 4096;
+
+   private:
+   std::unique_ptr<File> file;
+   /// How long a commit waits for others that can join its write.
+   const std::chrono::microseconds groupCommitWindow;
+   /// The step in which the file is grown and filled with zeros.
+   const size_t chunkSize;
+   /// The epoch of the records that are appended.
+   uint32_t epoch;
+
+   std::mutex latch;
+   /// The records that were appended but not written yet.
+   std::vector<char> buffer;
+   /// The LSN of the last record that was appended, i.e. the end of `buffer` in the file.
+   uint64_t appendedLsn;
+   /// The offset of `buffer` in the file.
+   uint64_t bufferOffset;
+   /// Everything up to here is durable.
+   std::atomic<uint64_t> flushedLsn;
+   /// Everything up to here should become durable.
+   uint64_t requestedLsn;
+   /// Whether someone waits for the log without a group commit window, e.g. to write a page back.
+   bool urgent;
+   /// The error that broke the log, the records behind `flushedLsn` can't be written anymore.
+   std::exception_ptr error;
+   /// Number of times the log file was synced.
+   std::atomic<uint64_t> syncCount;
+
+   /// Serializes checkpoints.
+   std::mutex checkpointLatch;
+   /// The master record of the last checkpoint and the current epoch.
+   MasterRecord master;
+   /// The copy of the master record that the next checkpoint writes.
+   size_t nextMasterSlot;
+
+   // background flusher
+   std::condition_variable flusherCv;
+   std::condition_variable flushedCv;
+   bool stopFlusher;
+   std::thread flusher;
+
+   /// Main loop of the background flusher.
+   void runFlusher();
+
+   /// Grows the file in chunks of zeros until it holds `size` bytes, so appending doesn't
+   /// allocate disk blocks and syncing doesn't have to write file system metadata.
+   void preallocate(size_t size);
+
+   /// Checksums and appends a record whose header is left to fill in. Returns its LSN.
+   uint64_t append(std::vector<char>& record, uint64_t page_id, RecordKind kind);
+
+   /// Waits until the log is durable up to `lsn`.
+   void waitFlushed(std::unique_lock<std::mutex>& lock, uint64_t lsn, bool urgent);
+
+   /// Reads the newer valid copy of the master record, all zero if there is none.
+   /// The copies are ordered by their epoch, and by their checkpoint within an epoch.
+   [[nodiscard]] MasterRecord readMaster(size_t& slot) const;
+
+   /// Checksums a master record and makes it durable in the copy that is older.
+   void writeMaster(MasterRecord& new_master);
+
+   /// Calls `callback` with every valid record from `offset` on and returns the end of the last
+   /// one. Stops at the first record that is torn or left over from an older epoch, or when
+   /// `callback` returns false.
+   uint64_t scan(uint64_t offset, const std::function<bool(uint64_t offset, const RecordHeader& header, const char* record)>& callback, uint32_t& last_epoch) const;
+
+   public:
+   WriteAheadLog(const WriteAheadLog&) = delete;
+   WriteAheadLog(WriteAheadLog&&) = delete;
+   WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+   WriteAheadLog& operator=(WriteAheadLog&&) = delete;
+
+   /// Constructor.
+   /// Appends behind the valid records that are already in the file and starts a background
+   /// thread that writes the log. Only the records behind the last checkpoint are read.
+   /// @param[in] file                 The log file, opened in `WRITE` mode.
+   /// @param[in] group_commit_window  How long the flusher waits after a commit for more commits
+   ///                                 that share its write. 0 only groups the commits that arrive
+   ///                                 while the previous write is in progress.
+   /// @param[in] chunk_size           The step in which the file is preallocated.
+   explicit WriteAheadLog(std::unique_ptr<File> file, std::chrono::microseconds group_commit_window = std::chrono::microseconds{0}, size_t chunk_size = kDefaultChunkSize);
+
+   /// Destructor. Makes everything that was logged durable.
+   /// The buffer managers the log is attached to must be destroyed or detached before.
+   ~WriteAheadLog();
+
+   /// Appends a record of the ranges in which a page differs from its content before the change.
+   /// Returns the LSN of the record, or 0 if the page didn't change.
+   /// @param[in] page_id   The page.
+   /// @param[in] before    The content of the page before the change.
+   /// @param[in] after     The content of the page after the change.
+   /// @param[in] page_size The size of a page, a multiple of 8.
+   uint64_t log_page(uint64_t page_id, const char* before, const char* after, size_t page_size);
+
+   /// Appends a record of the whole content of a page. Returns the LSN of the record.
+   /// @param[in] page_id   The page.
+   /// @param[in] data      The content of the page.
+   /// @param[in] page_size The size of a page, a multiple of 8.
+   uint64_t log_image(uint64_t page_id, const char* data, size_t page_size);
+
+   /// Waits until everything that was logged so far is durable and returns the LSN up to which it is.
+   /// Throws if the log file can't be written.
+   uint64_t commit();
+
+   /// Waits until the log is durable up to `lsn`, without waiting for other commits.
+   /// Throws if the log file can't be written.
+   void flush(uint64_t lsn);
+
+   /// Takes a fuzzy checkpoint of a buffer manager that logs into this log, so recovery and
+   /// opening the log only read the records from the first change that may not be on disk yet.
+   /// The pages are neither written nor latched, the buffer manager keeps running.
+   /// Changes that were made while no log was attached must have been written back before.
+   /// Returns the LSN from which recovery replays the log.
+   /// Throws if the segment files or the log file can't be synced.
+   uint64_t checkpoint(BufferManager& buffer_manager);
+
+   /// Writes the records of the log into the pages of a buffer manager that doesn't log into it,
+   /// i.e. before it is attached. Starts at the last checkpoint and skips the records of pages
+   /// that were on disk by then. Afterwards the pages are as they were when the last durable
+   /// record was logged, and written back to their segment files.
+   /// Throws `std::logic_error` if the buffer manager logs into this log.
+   void recover(BufferManager& buffer_manager) const;
+
+   /// Returns the LSN of the last record that was appended.
+   [[nodiscard]] uint64_t get_lsn();
+
+   /// Returns the LSN up to which the log is durable.
+   [[nodiscard]] uint64_t get_flushed_lsn() const { return flushedLsn.load(); }
+
+   /// Returns how often the log file was synced.
+   [[nodiscard]] uint64_t get_sync_count() const { return syncCount.load(); }
+
+   /// Returns the LSN from which recovery replays the log.
+   [[nodiscard]] uint64_t get_redo_lsn();
+};
+
+}
@@ -0,0 +1,463 @@
+#include "simpledb/file.h"
+#include "simpledb/metrics.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <latch>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <vector>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace simpledb {
+
+namespace {
+
+[[noreturn]] void throw_errno(int error = errno) {
+   throw std::system_error{error, std::system_category()};
+}
+
+/// Number of submission queue entries of a ring.
+constexpr unsigned kRingEntries = 256;
+
+int io_uring_setup(unsigned entries, ::io_uring_params* params) {
+   return static_cast<int>(::syscall(__NR_io_uring_setup, entries, params));
+}
+
+/// The calls of `io_uring_enter()` that fail on purpose, see `IoUringFile::inject_enter_failures()`.
+struct InjectedFailures {
+   std::mutex latch;
+   /// The number of calls that fail, read without the latch to keep the common case cheap.
+   std::atomic<unsigned> count = 0;
+   /// The number of calls that succeed before the first one fails.
+   unsigned skip = 0;
+   /// The errno of the calls that fail.
+   int error = 0;
+
+   /// Returns whether the current call should fail.
+   bool fail() {
+      if (count.load(std::memory_order_relaxed) == 0) {
+         return false;
+      }
+      std::unique_lock lock(latch);
+      if (count.load(std::memory_order_relaxed) == 0) {
+         return false;
+      }
+      if (skip > 0) {
+         --skip;
+         return false;
+      }
+      count.fetch_sub(1, std::memory_order_relaxed);
+      errno = error;
+      return true;
+   }
+};
+
+InjectedFailures injectedFailures;
+
+int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+   if (injectedFailures.fail()) {
+      return -1;
+   }
+   return static_cast<int>(::syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+}
+
+/// Returns whether the kernel lets us set up an io_uring.
+bool io_uring_available() {
+   static const bool available = [] {
+      ::io_uring_params params = {};
+      int fd = io_uring_setup(1, &params);
+      if (fd < 0) {
+         return false;
+      }
+      ::close(fd);
+      return true;
+   }();
+   return available;
+}
+
+/// Completion state of a single submitted request.
+struct Completion {
+   /// Number of requests of the batch that are still in flight.
+   std::atomic<size_t>* pending;
+   /// Bytes transferred or negative errno.
+   int32_t result;
+};
+
+/// Process-wide pool of threads that execute blocking I/O.
+class IoThreadPool {
+   private:
+   std::mutex latch;
+   std::condition_variable cv;
+   std::deque<std::function<void()>> tasks;
+   std::vector<std::thread> threads;
+   bool stop = false;
+
+   void run() {
+      while (true) {
+         std::unique_lock lock(latch);
+         cv.wait(lock, [&] { return stop || !tasks.empty(); });
+         if (tasks.empty()) {
+            return;
+         }
+         auto task = std::move(tasks.front());
+         tasks.pop_front();
+         lock.unlock();
+
+         task();
+      }
+   }
+
+   public:
+   explicit IoThreadPool(size_t thread_count) {
+      for (size_t i = 0; i < thread_count; ++i) {
+         threads.emplace_back([this] { run(); });
+      }
+   }
+
+   IoThreadPool(const IoThreadPool&) = delete;
+   IoThreadPool(IoThreadPool&&) = delete;
+   IoThreadPool& operator=(const IoThreadPool&) = delete;
+   IoThreadPool& operator=(IoThreadPool&&) = delete;
+
+   ~IoThreadPool() {
+      {
+         std::unique_lock lock(latch);
+         stop = true;
+      }
+      cv.notify_all();
+      for (auto& thread : threads) {
+         thread.join();
+      }
+   }
+
+   /// Run a task on one of the threads.
+   void post(std::function<void()> task) {
+      {
+         std::unique_lock lock(latch);
+         tasks.push_back(std::move(task));
+      }
+      cv.notify_one();
+   }
+
+   /// Returns the pool shared by all files.
+   static IoThreadPool& get() {
+      // enough threads to keep a device queue busy even on small machines
+      static IoThreadPool pool(std::max(8u, 2 * std::thread::hardware_concurrency()));
+      return pool;
+   }
+};
+
+} // namespace
+
+struct IoUringFile::Ring {
+   int fd = -1;
+
+   // mappings shared with the kernel
+   void* sqRing = MAP_FAILED;
+   size_t sqRingSize = 0;
+   void* cqRing = MAP_FAILED;
+   size_t cqRingSize = 0;
+   void* sqes = MAP_FAILED;
+   size_t sqesSize = 0;
+
+   // submission queue
+   uint32_t* sqHead = nullptr;
+   uint32_t* sqTail = nullptr;
+   uint32_t* sqArray = nullptr;
+   uint32_t sqMask = 0;
+   uint32_t sqEntries = 0;
+
+   // completion queue
+   uint32_t* cqHead = nullptr;
+   uint32_t* cqTail = nullptr;
+   ::io_uring_cqe* cqes = nullptr;
+   uint32_t cqMask = 0;
+
+   /// Serializes writers of the submission queue tail.
+   std::mutex sqLatch;
+   /// Serializes readers of the completion queue. Only the holder waits in the kernel.
+   std::mutex cqLatch;
+
+   Ring() {
+      ::io_uring_params params = {};
+      fd = io_uring_setup(kRingEntries, &params);
+      if (fd < 0) {
+         throw_errno();
+      }
+
+      sqRingSize = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+      cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(::io_uring_cqe);
+      bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+      if (singleMmap) {
+         sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+      }
+      sqesSize = params.sq_entries * sizeof(::io_uring_sqe);
+
+      sqRing = ::mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+      if (sqRing != MAP_FAILED) {
+         cqRing = singleMmap ? sqRing : ::mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+      }
+      if (cqRing != MAP_FAILED) {
+         sqes = ::mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+      }
+      if (sqes == MAP_FAILED) {
+         auto error = errno;
+         release();
+         throw_errno(error);
+      }
+
+      auto* sq = static_cast<char*>(sqRing);
+      sqHead = reinterpret_cast<uint32_t*>(sq + params.sq_off.head);
+      sqTail = reinterpret_cast<uint32_t*>(sq + params.sq_off.tail);
+      sqArray = reinterpret_cast<uint32_t*>(sq + params.sq_off.array);
+      sqMask = *reinterpret_cast<uint32_t*>(sq + params.sq_off.ring_mask);
+      sqEntries = *reinterpret_cast<uint32_t*>(sq + params.sq_off.ring_entries);
+
+      auto* cq = static_cast<char*>(cqRing);
+      cqHead = reinterpret_cast<uint32_t*>(cq + params.cq_off.head);
+      cqTail = reinterpret_cast<uint32_t*>(cq + params.cq_off.tail);
+      cqes = reinterpret_cast<::io_uring_cqe*>(cq + params.cq_off.cqes);
+      cqMask = *reinterpret_cast<uint32_t*>(cq + params.cq_off.ring_mask);
+   }
+
+   Ring(const Ring&) = delete;
+   Ring(Ring&&) = delete;
+   Ring& operator=(const Ring&) = delete;
+   Ring& operator=(Ring&&) = delete;
+
+   ~Ring() { release(); }
+
+   void release() {
+      if (sqes != MAP_FAILED) {
+         ::munmap(sqes, sqesSize);
+      }
+      if (cqRing != MAP_FAILED && cqRing != sqRing) {
+         ::munmap(cqRing, cqRingSize);
+      }
+      if (sqRing != MAP_FAILED) {
+         ::munmap(sqRing, sqRingSize);
+      }
+      if (fd >= 0) {
+         ::close(fd);
+      }
+   }
+
+   /// Queue as many of the requests as there is space for in the submission queue.
+   /// Returns the number of queued requests.
+   size_t push(int file, std::span<const IoRequest> requests, Completion* completions) {
+      std::unique_lock lock(sqLatch);
+
+      auto head = std::atomic_ref(*sqHead).load(std::memory_order_acquire);
+      auto tail = *sqTail;
+      auto count = std::min<size_t>(sqEntries - (tail - head), requests.size());
+
+      auto* entries = static_cast<::io_uring_sqe*>(sqes);
+      for (size_t i = 0; i < count; ++i, ++tail) {
+         const auto& request = requests[i];
+         auto index = tail & sqMask;
+         auto& sqe = entries[index];
+
+         std::memset(&sqe, 0, sizeof(sqe));
+         sqe.opcode = request.kind == IoRequest::READ ? IORING_OP_READV : IORING_OP_WRITEV;
+         sqe.fd = file;
+         sqe.addr = reinterpret_cast<uint64_t>(request.buffers.data());
+         sqe.len = static_cast<uint32_t>(request.buffers.size());
+         sqe.off = request.offset;
+         sqe.user_data = reinterpret_cast<uint64_t>(&completions[i]);
+         sqArray[index] = index;
+      }
+
+      // publish the entries to the kernel
+      std::atomic_ref(*sqTail).store(tail, std::memory_order_release);
+      return count;
+   }
+
+   /// Hand up to `to_submit` queued entries to the kernel.
+   void enter(unsigned to_submit) {
+      // other threads may have submitted our entries along with theirs already
+      while (to_submit > 0 && std::atomic_ref(*sqHead).load(std::memory_order_acquire) != std::atomic_ref(*sqTail).load(std::memory_order_acquire)) {
+         auto submitted = io_uring_enter(fd, to_submit, 0, 0);
+         if (submitted < 0) {
+            if (errno == EINTR) {
+               continue;
+            }
+            if (errno == EAGAIN || errno == EBUSY) {
+               // completion queue is overflowing, make room first
+               std::unique_lock lock(cqLatch);
+               reap();
+               continue;
+            }
+            throw_errno();
+         }
+         to_submit -= std::min<unsigned>(to_submit, submitted);
+      }
+   }
+
+   /// Process all available completions. `cqLatch` must be held.
+   /// Returns whether there were any.
+   bool reap() {
+      auto head = *cqHead;
+      auto tail = std::atomic_ref(*cqTail).load(std::memory_order_acquire);
+      if (head == tail) {
+         return false;
+      }
+
+      for (; head != tail; ++head) {
+         const auto& cqe = cqes[head & cqMask];
+         auto* completion = reinterpret_cast<Completion*>(cqe.user_data);
+         completion->result = cqe.res;
+         completion->pending->fetch_sub(1, std::memory_order_release);
+      }
+
+      std::atomic_ref(*cqHead).store(head, std::memory_order_release);
+      return true;
+   }
+
+   /// Wait until no request of a batch is in flight anymore.
+   void wait(const std::atomic<size_t>& pending) {
+      std::unique_lock lock(cqLatch);
+
+      // whoever holds the latch reaps the completions of all batches
+      while (pending.load(std::memory_order_acquire) > 0) {
+         if (reap()) {
+            continue;
+         }
+         if (io_uring_enter(fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR) {
+            throw_errno();
+         }
+      }
+   }
+
+   /// Like `wait()`, but also submits the entries that are still queued and never throws. Used
+   /// after an error, when the kernel may still complete requests into memory of the caller.
+   void drain(const std::atomic<size_t>& pending) noexcept {
+      std::unique_lock lock(cqLatch);
+      while (pending.load(std::memory_order_acquire) > 0) {
+         if (reap()) {
+            continue;
+         }
+         auto queued = std::atomic_ref(*sqTail).load(std::memory_order_acquire) - std::atomic_ref(*sqHead).load(std::memory_order_acquire);
+         if (io_uring_enter(fd, queued, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY && errno != ENOMEM) {
+            // returning would let the kernel write into freed memory
+            std::terminate();
+         }
+      }
+   }
+};
+
+IoUringFile::IoUringFile(Mode mode, int fd, size_t size) : PosixFile(mode, fd, size), ring(std::make_unique<Ring>()) {}
+
+IoUringFile::IoUringFile(const char* filename, Mode mode) : PosixFile(filename, mode), ring(std::make_unique<Ring>()) {}
+
+IoUringFile::~IoUringFile() = default;
+
+void IoUringFile::inject_enter_failures(int error, unsigned count, unsigned skip) {
+   std::unique_lock lock(injectedFailures.latch);
+   injectedFailures.error = error;
+   injectedFailures.skip = skip;
+   injectedFailures.count.store(count, std::memory_order_relaxed);
+}
+
+void IoUringFile::submit(std::span<const IoRequest> requests) {
+   if (requests.size() == 1) {
+      // nothing to overlap, a plain syscall is cheaper
+      transfer(requests[0]);
+      return;
+   }
+
+   std::atomic<size_t> pending = requests.size();
+   std::vector<Completion> completions(requests.size(), Completion{&pending, 0});
+
+   // submit all requests
+   size_t pushed = 0;
+   try {
+      while (pushed < requests.size()) {
+         auto queued = ring->push(fd, requests.subspan(pushed), &completions[pushed]);
+         if (queued == 0) {
+            // the queue is full of entries of other threads, push them to the kernel for them
+            ring->enter(ring->sqEntries);
+            continue;
+         }
+         pushed += queued;
+         ring->enter(queued);
+      }
+
+      ring->wait(pending);
+   } catch (...) {
+      // the entries that were pushed point into `completions`, they have to complete before it
+      // goes away
+      pending.fetch_sub(requests.size() - pushed, std::memory_order_release);
+      ring->drain(pending);
+      throw;
+   }
+
+   // check the results
+   for (size_t i = 0; i < requests.size(); ++i) {
+      auto result = completions[i].result;
+      if (result < 0) {
+         throw_errno(-result);
+      }
+      metrics::count(requests[i].kind == IoRequest::READ ? metrics::Counter::BYTES_READ : metrics::Counter::BYTES_WRITTEN, static_cast<uint64_t>(result));
+
+      size_t size = 0;
+      for (const auto& buffer : requests[i].buffers) {
+         size += buffer.iov_len;
+      }
+      if (static_cast<size_t>(result) < size) {
+         // short transfer, do the rest synchronously
+         transfer(requests[i], result);
+      }
+   }
+}
+
+void ThreadPoolFile::submit(std::span<const IoRequest> requests) {
+   if (requests.empty()) {
+      return;
+   }
+
+   // run the first request on this thread and the others in the pool
+   std::latch done(static_cast<ptrdiff_t>(requests.size() - 1));
+   std::vector<std::exception_ptr> errors(requests.size());
+   auto& pool = IoThreadPool::get();
+   for (size_t i = 1; i < requests.size(); ++i) {
+      pool.post([this, &requests, &errors, &done, i] {
+         try {
+            transfer(requests[i]);
+         } catch (...) {
+            errors[i] = std::current_exception();
+         }
+         done.count_down();
+      });
+   }
+   try {
+      transfer(requests[0]);
+   } catch (...) {
+      errors[0] = std::current_exception();
+   }
+   done.wait();
+
+   for (const auto& error : errors) {
+      if (error) {
+         std::rethrow_exception(error);
+      }
+   }
+}
+
+std::unique_ptr<File> File::open_async_file(const char* filename, Mode mode) {
+   if (io_uring_available()) {
+      return std::make_unique<IoUringFile>(filename, mode);
+   }
+   return std::make_unique<ThreadPoolFile>(filename, mode);
+}
+
+}
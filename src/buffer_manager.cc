@@ -1,277 +1,834 @@
 #include "simpledb/buffer_manager.h"
+#include "simpledb/compression.h"
+#include "simpledb/metrics.h"
+#include "simpledb/wal.h"
+#include <algorithm>
+#include <bit>
 #include <cassert>
+#include <chrono>
+#include <cerrno>
 #include <cmath>
 #include <cstring>
 #include <iostream>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <sys/mman.h>
+#include <unistd.h>
 
 namespace simpledb {
 
+namespace {
+
+/// Size of a huge page (x86-64 and aarch64 default).
+constexpr size_t kHugePageSize = 2ull << 20;
+
+/// How often the background writer looks for dirty pages if nobody wakes it up.
+constexpr std::chrono::milliseconds kWriterInterval{50};
+
+/// Maximum number of adjacent pages that are combined into one write.
+constexpr size_t kMaxWriteRun = 64;
+
+/// Every slot of a compressed segment starts with the size of the stored page. 0 stands for a
+/// page that was never written, the page size for a page that is stored uncompressed.
+using SlotHeader = uint32_t;
+
+/// The granularity in which the disk blocks behind compressed pages are freed.
+constexpr size_t kDiscardBlockSize = 4096;
+
+/// Locks the latch of a frame list exclusively and counts how long that took.
+ExclusiveLatch lockList(Latch& latch) {
+   ExclusiveLatch exclLatch(latch, std::defer_lock);
+   metrics::lock(exclLatch, metrics::LatchKind::LIST);
+   return exclLatch;
+}
+
+} // namespace
+
 char* BufferFrame::get_data() {
-   assert(pageState == PageState::IN_FIFO || pageState == PageState::IN_LRU);
+   assert(pageState == PageState::IN_FIFO || pageState == PageState::IN_LRU || pageState == PageState::IN_RING || pageState == PageState::MAPPED);
    return data;
 }
 
-BufferManager::BufferManager(size_t page_size, size_t page_count) : pageSize{page_size}, pageCount{page_count} {
-   segments = std::make_unique<std::array<std::pair<std::unique_ptr<File>, Latch>, 65536>>();
+void FrameList::push_back(BufferFrame* frame) {
+   assert(!frame->prev && !frame->next && head != frame);
 
-   fifoList.reserve(page_count);
-   lruList.reserve(page_count);
+   frame->prev = tail;
+   if (tail)
+      tail->next = frame;
+   else
+      head = frame;
+   tail = frame;
+   ++count;
 }
 
-BufferManager::~BufferManager() {
-   // write out dirty pages and free data memory
+void FrameList::remove(BufferFrame* frame) {
+   assert(count > 0);
 
-   fifoListLatch.lock();
-   for (auto bf : fifoList) {
-      bf->pageLatch.lock();
-      assert(bf->pageState == PageState::IN_FIFO);
+   if (frame->prev)
+      frame->prev->next = frame->next;
+   else
+      head = frame->next;
 
-      if (bf->isDirty)
-         flushPage(*bf);
+   if (frame->next)
+      frame->next->prev = frame->prev;
+   else
+      tail = frame->prev;
 
-      assert(bf->data);
-      free(bf->data);
+   frame->prev = nullptr;
+   frame->next = nullptr;
+   --count;
+}
 
-      bf->pageLatch.unlock();
+PageTable::PageTable(size_t shard_count, size_t capacity) : shardBits{static_cast<uint32_t>(std::bit_width(std::bit_ceil(shard_count)) - 1)} {
+   shards = std::make_unique<Shard[]>(1ull << shardBits); // NOLINT(cppcoreguidelines-avoid-c-arrays)
+   for (size_t i = 0; i < (1ull << shardBits); ++i) {
+      shards[i].frames.reserve(capacity / (1ull << shardBits) + 1);
    }
-   fifoListLatch.unlock();
+}
+
+BufferFrame* PageTable::find(uint64_t pid) const {
+   auto& shard = get_shard(pid);
+   SharedLatch latch(shard.latch, std::defer_lock);
+   metrics::lock(latch, metrics::LatchKind::PAGE_TABLE);
+
+   auto it = shard.frames.find(pid);
+   return it == shard.frames.end() ? nullptr : it->second;
+}
 
-   lruListLatch.lock();
-   for (auto bf : lruList) {
-      bf->pageLatch.lock();
-      assert(bf->pageState == PageState::IN_LRU);
+BufferFrame* PageTable::insert(uint64_t pid, BufferFrame* frame) {
+   auto& shard = get_shard(pid);
+   ExclusiveLatch latch(shard.latch, std::defer_lock);
+   metrics::lock(latch, metrics::LatchKind::PAGE_TABLE);
 
-      if (bf->isDirty)
-         flushPage(*bf);
+   return shard.frames.try_emplace(pid, frame).first->second;
+}
+
+void PageTable::erase(uint64_t pid, const BufferFrame* frame) {
+   auto& shard = get_shard(pid);
+   ExclusiveLatch latch(shard.latch, std::defer_lock);
+   metrics::lock(latch, metrics::LatchKind::PAGE_TABLE);
+
+   auto it = shard.frames.find(pid);
+   if (it != shard.frames.end() && it->second == frame)
+      shard.frames.erase(it);
+}
+
+BufferManager::BufferManager(size_t page_size, size_t page_count, bool huge_pages, size_t max_page_count)
+   : pageSize{page_size}, pageCount{page_count}, maxPageCount{std::max(page_count, max_page_count)},
+     pageTable{4 * std::max(4u, std::thread::hardware_concurrency()), page_count},
+     lruClock{0}, lruSize{0}, ringSize{std::clamp<size_t>(page_count / 16, 1, 256)}, hotFrames{0},
+     cleanWindow{std::clamp<size_t>(page_count / 16, 1, 256)}, stopWriter{false},
+     readAheadWindow{0}, stopPrefetcher{false}, wal{nullptr}, busyFrames{0} {
+   segments = std::make_unique<std::array<std::pair<std::unique_ptr<File>, Latch>, 65536>>();
+   mappedSegments = std::make_unique<std::array<std::unique_ptr<MappedSegment>, 65536>>();
+   compressions = std::make_unique<std::array<PageCompression, 65536>>();
+   compressions->fill(PageCompression::NONE);
+
+   // reserve the memory of all frames at once
+   arenaSize = std::max<size_t>(page_size * maxPageCount, 1);
+   arena = static_cast<char*>(MAP_FAILED);
+   if (huge_pages) {
+      arenaSize = (arenaSize + kHugePageSize - 1) & ~(kHugePageSize - 1);
+      arena = static_cast<char*>(::mmap(nullptr, arenaSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0));
+   }
+   if (arena == MAP_FAILED) {
+      arena = static_cast<char*>(::mmap(nullptr, arenaSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0));
+      if (arena == MAP_FAILED) {
+         throw std::system_error{errno, std::system_category()};
+      }
+      if (huge_pages) {
+         // no reserved huge pages, try transparent ones
+         ::madvise(arena, arenaSize, MADV_HUGEPAGE);
+      }
+   }
+
+   frames = std::make_unique<BufferFrame[]>(maxPageCount); // NOLINT(cppcoreguidelines-avoid-c-arrays)
+   for (size_t i = 0; i < maxPageCount; ++i) {
+      frames[i].data = arena + i * page_size;
+   }
 
-      assert(bf->data);
-      free(bf->data);
+   // hand out the frames in order, the ones beyond the page count wait for the pool to grow
+   freeFrames.reserve(maxPageCount);
+   for (size_t i = page_count; i > 0; --i) {
+      freeFrames.push_back(&frames[i - 1]);
+   }
+   for (size_t i = maxPageCount; i > page_count; --i) {
+      retiredFrames.push_back(&frames[i - 1]);
+   }
 
-      bf->pageLatch.unlock();
+   for (auto& lastMiss : lastMisses) {
+      lastMiss = BufferFrame::invalidPid;
    }
-   lruListLatch.unlock();
+
+   writer = std::thread([this] { runWriter(); });
+   prefetcher = std::thread([this] { runPrefetcher(); });
 }
 
-BufferFrame* BufferManager::getBufferFrame(uint64_t pageId) {
-   BufferFrame* frame;
+BufferManager::~BufferManager() {
+   {
+      std::unique_lock latch(prefetcherLatch);
+      stopPrefetcher = true;
+   }
+   prefetcherCv.notify_one();
+   prefetcher.join();
 
-   pageTableLatch.lock_shared();
+   {
+      std::unique_lock latch(writerLatch);
+      stopWriter = true;
+   }
+   writerCv.notify_one();
+   writer.join();
 
-   // check if page is already contained in the page table
-   if (pageTable.contains(pageId)) {
-      frame = &pageTable.at(pageId);
+   flush_all();
 
-      pageTableLatch.unlock_shared();
-   } else {
-      // we will need an exclusive lock on the hashtable
-      pageTableLatch.unlock_shared();
-      pageTableLatch.lock();
+   ::munmap(arena, arenaSize);
+}
 
-      if (pageTable.contains(pageId)) {
-         // someone inserted this page in the meantime
-         frame = &pageTable.at(pageId);
+void BufferManager::flush_all() {
+   // take the frames that are available right away first
+   std::vector<BufferFrame*> dirtyFrames;
+   std::vector<BufferFrame*> busyFrames;
+   for (size_t i = 0; i < maxPageCount; ++i) {
+      auto& bf = frames[i];
+      if (!bf.isDirty)
+         continue;
+      if (!bf.pageLatch.try_lock_shared()) {
+         busyFrames.push_back(&bf);
+         continue;
+      }
+      if ((bf.pageState == PageState::IN_FIFO || bf.pageState == PageState::IN_LRU || bf.pageState == PageState::IN_RING) && bf.isDirty)
+         dirtyFrames.push_back(&bf);
+      else
+         bf.pageLatch.unlock_shared();
+   }
+   writeBack(dirtyFrames);
+
+   // wait for the others one by one, so we never block while holding a latch
+   for (auto* bf : busyFrames) {
+      bf->pageLatch.lock_shared();
+      if ((bf->pageState == PageState::IN_FIFO || bf->pageState == PageState::IN_LRU || bf->pageState == PageState::IN_RING) && bf->isDirty) {
+         dirtyFrames.assign(1, bf);
+         writeBack(dirtyFrames);
       } else {
-         // insert new buffer frame
-         auto p = pageTable.emplace(pageId, pageId);
+         bf->pageLatch.unlock_shared();
+      }
+   }
 
-         if (!p.second) {
-            throw std::runtime_error("Error while inserting new buffer frame into page table");
-         }
+   // without a log the pages themselves have to be durable
+   if (!wal) {
+      sync_segments();
+   }
+}
 
-         frame = &p.first->second;
+void BufferManager::writeBack(std::vector<BufferFrame*>& dirtyFrames) {
+   std::sort(dirtyFrames.begin(), dirtyFrames.end(), [](auto* a, auto* b) { return a->pid < b->pid; });
+   busyFrames += dirtyFrames.size();
+
+   // the requests point into `buffers`, so it must never reallocate
+   std::vector<::iovec> buffers;
+   buffers.reserve(dirtyFrames.size());
+   std::vector<File::IoRequest> requests;
+   std::vector<char> scratch;
+
+   size_t begin = 0;
+   try {
+      // the log has to contain every change that is written
+      if (wal) {
+         uint64_t lsn = 0;
+         for (auto* bf : dirtyFrames) {
+            lsn = std::max<uint64_t>(lsn, bf->pageLsn);
+         }
+         wal->flush(lsn);
       }
 
-      pageTableLatch.unlock();
+      // one batch per segment
+      for (size_t end; begin < dirtyFrames.size(); begin = end) {
+         auto segId = get_segment_id(dirtyFrames[begin]->pid);
+
+         buffers.clear();
+         requests.clear();
+         for (end = begin; end < dirtyFrames.size() && get_segment_id(dirtyFrames[end]->pid) == segId; ++end) {}
+
+         // compressed pages are written from scratch memory, each to its own slot
+         auto slotSize = getSlotSize(segId);
+         if (slotSize != pageSize) {
+            scratch.resize((end - begin) * slotSize);
+            for (auto i = begin; i < end; ++i) {
+               auto* slot = scratch.data() + (i - begin) * slotSize;
+               buffers.push_back({slot, encodePage(dirtyFrames[i]->data, slot)});
+               requests.push_back({File::IoRequest::WRITE, get_segment_page_id(dirtyFrames[i]->pid) * slotSize, {&buffers.back(), 1}});
+            }
+         } else {
+            for (auto i = begin; i < end; ++i) {
+               auto* bf = dirtyFrames[i];
+               buffers.push_back({bf->data, pageSize});
+
+               // extend the previous write if this page follows it on disk
+               if (i > begin && dirtyFrames[i - 1]->pid + 1 == bf->pid && requests.back().buffers.size() < kMaxWriteRun) {
+                  auto& previous = requests.back();
+                  previous.buffers = {previous.buffers.data(), previous.buffers.size() + 1};
+               } else {
+                  requests.push_back({File::IoRequest::WRITE, get_segment_page_id(bf->pid) * pageSize, {&buffers.back(), 1}});
+               }
+            }
+         }
+
+         auto& seg = (*segments)[segId];
+         {
+            SharedLatch latch(seg.second);
+            seg.first->submit(requests);
+            for (auto i = begin; slotSize != pageSize && i < end; ++i) {
+               discardSlotTail(*seg.first, dirtyFrames[i]->pid, buffers[i - begin].iov_len);
+            }
+         }
+
+         for (auto i = begin; i < end; ++i) {
+            dirtyFrames[i]->isDirty = false;
+            dirtyFrames[i]->recLsn = 0;
+            dirtyFrames[i]->pageLatch.unlock_shared();
+         }
+         busyFrames -= end - begin;
+      }
+   } catch (...) {
+      // the pages that weren't written stay dirty
+      for (auto i = begin; i < dirtyFrames.size(); ++i) {
+         dirtyFrames[i]->pageLatch.unlock_shared();
+      }
+      busyFrames -= dirtyFrames.size() - begin;
+      throw;
    }
+}
 
-   return frame;
+void BufferManager::runWriter() {
+   std::vector<BufferFrame*> dirtyFrames;
+
+   // collect the dirty frames among the next ones to be evicted
+   auto collect = [&](const FrameList& frameList, Latch& frameListLatch) {
+      SharedLatch latch(frameListLatch);
+      size_t i = 0;
+      auto window = cleanWindow.load(std::memory_order_relaxed);
+      for (auto bf = frameList.front(); bf && i < window; bf = FrameList::next(bf), ++i) {
+         if (!bf->isDirty || !bf->pageLatch.try_lock_shared())
+            continue;
+         if (bf->isDirty)
+            dirtyFrames.push_back(bf);
+         else
+            bf->pageLatch.unlock_shared();
+      }
+   };
+
+   std::unique_lock latch(writerLatch);
+   while (!stopWriter) {
+      writerCv.wait_for(latch, kWriterInterval);
+      if (stopWriter)
+         break;
+      latch.unlock();
+
+      dirtyFrames.clear();
+      collect(ringList, ringListLatch);
+      collect(fifoList, fifoListLatch);
+      collect(lruList, lruListLatch);
+      try {
+         writeBack(dirtyFrames);
+      } catch (...) {
+         // the pages stay dirty, eviction writes them synchronously and reports the error
+      }
+
+      latch.lock();
+   }
 }
 
-std::unique_ptr<char[]> BufferManager::getSegmentData(uint64_t pid) {
-   auto segId = get_segment_id(pid);
-   auto segIdString = std::to_string(segId);
-   auto segPageId = get_segment_page_id(pid);
+File& BufferManager::getSegmentFile(uint16_t segment_id, size_t min_size, SharedLatch& latch) {
+   auto& seg = (*segments)[segment_id];
 
-   auto minSize = segPageId * pageSize + pageSize;
-   auto& seg = (*segments)[segId];
+   while (true) {
+      latch = SharedLatch(seg.second);
+      if (seg.first && seg.first->size() >= min_size) {
+         return *seg.first;
+      }
+      latch.unlock();
 
-   // check if segment file does not exist yet
-   if (!seg.first) {
-      seg.second.lock();
+      ExclusiveLatch exclLatch(seg.second);
 
-      // has it been created in the meantime?
+      // check if segment file does not exist yet
       if (!seg.first) {
-         seg.first = File::open_file(segIdString.c_str(), File::WRITE);
+         auto segIdString = std::to_string(segment_id);
+         seg.first = File::open_async_file(segIdString.c_str(), File::WRITE);
+      }
+
+      // check if segment file is big enough
+      if (seg.first->size() < min_size) {
+         seg.first->resize(min_size);
       }
+   }
+}
+
+void BufferManager::readPage(uint64_t pid, char* data) {
+   auto segPageId = get_segment_page_id(pid);
 
-      seg.second.unlock();
+   // read page data from segment file
+   SharedLatch latch;
+   auto slotSize = getSlotSize(get_segment_id(pid));
+   auto& file = getSegmentFile(get_segment_id(pid), segPageId * slotSize + slotSize, latch);
+   if (slotSize == pageSize) {
+      file.read_block(segPageId * pageSize, pageSize, data);
+      return;
    }
 
-   // check if segment file is big enough
-   if (seg.first->size() < minSize) {
-      seg.second.lock();
+   thread_local std::vector<char> slot;
+   slot.resize(slotSize);
+   file.read_block(segPageId * slotSize, slotSize, slot.data());
+   decodePage(slot.data(), data);
+}
+
+void BufferManager::loadPages(uint64_t pid, size_t count, bool read_ahead_marker, AccessHint access) {
+   // stay within the segment and leave most of the pool alone
+   count = std::min<size_t>({count, (1ull << 48) - get_segment_page_id(pid), std::max<size_t>(pageCount.load(std::memory_order_relaxed) / 4, 1)});
+
+   // reserve frames for the pages
+   std::vector<BufferFrame*> batch;
+   for (size_t i = 0; i < count; ++i) {
+      if (pageTable.find(pid + i))
+         continue;
+
+      auto frame = allocateBufferFrame();
+      if (!frame)
+         break;
 
-      // has it been resized in the meantime
-      if (seg.first->size() < minSize) {
-         seg.first->resize(minSize);
+      frame->pid = pid + i;
+      if (pageTable.insert(pid + i, frame) != frame) {
+         releaseBufferFrame(frame);
+         continue;
+      }
+      frame->pageState = PageState::LOADING;
+      batch.push_back(frame);
+      ++busyFrames;
+   }
+   if (batch.empty())
+      return;
+
+   // read them, adjacent pages with one request, compressed ones into scratch memory first
+   auto slotSize = getSlotSize(get_segment_id(pid));
+   std::vector<char> scratch(slotSize == pageSize ? 0 : batch.size() * slotSize);
+   std::vector<::iovec> buffers;
+   std::vector<File::IoRequest> requests;
+   buffers.reserve(batch.size());
+   for (size_t i = 0; i < batch.size(); ++i) {
+      buffers.push_back({scratch.empty() ? batch[i]->data : scratch.data() + i * slotSize, slotSize});
+      if (i > 0 && batch[i - 1]->pid + 1 == batch[i]->pid) {
+         auto& previous = requests.back();
+         previous.buffers = {previous.buffers.data(), previous.buffers.size() + 1};
+      } else {
+         requests.push_back({File::IoRequest::READ, get_segment_page_id(batch[i]->pid) * slotSize, {&buffers.back(), 1}});
       }
+   }
 
-      seg.second.unlock();
+   try {
+      SharedLatch latch;
+      auto& file = getSegmentFile(get_segment_id(pid), (get_segment_page_id(batch.back()->pid) + 1) * slotSize, latch);
+      file.submit(requests);
+      for (size_t i = 0; !scratch.empty() && i < batch.size(); ++i) {
+         decodePage(scratch.data() + i * slotSize, batch[i]->data);
+      }
+   } catch (...) {
+      for (auto* frame : batch) {
+         pageTable.erase(frame->pid, frame);
+         frame->pageState = PageState::NOT_LOADED;
+         releaseBufferFrame(frame);
+      }
+      busyFrames -= batch.size();
+      throw;
    }
 
-   // read page data from segment file
-   seg.second.lock_shared();
-   auto data = seg.first->read_block(segPageId * pageSize, pageSize);
-   seg.second.unlock_shared();
+   // done loading, insert at the back of the fifo list or the ring
+   {
+      auto scan = access == AccessHint::SEQUENTIAL_ONCE;
+      auto exclListLatch = lockList(scan ? ringListLatch : fifoListLatch);
+      for (auto* frame : batch) {
+         frame->pageState = scan ? PageState::IN_RING : PageState::IN_FIFO;
+         frame->prefetched = true;
+         frame->readAheadMarker = read_ahead_marker && frame == batch.front();
+         (scan ? ringList : fifoList).push_back(frame);
+      }
+   }
+   for (auto* frame : batch) {
+      frame->pageLatch.unlock();
+   }
+   busyFrames -= batch.size();
+}
 
-   return data;
+void BufferManager::prefetch(uint64_t page_id, size_t count, AccessHint access) {
+   // don't bother the prefetcher with pages that are loaded already
+   count = std::min(count, std::max<size_t>(pageCount.load(std::memory_order_relaxed) / 4, 1));
+   for (; count > 0 && pageTable.find(page_id); ++page_id, --count) {}
+   queuePrefetch({page_id, count, false, access});
 }
 
-bool BufferManager::loadPage(simpledb::BufferFrame& frame) {
-   frame.loadingLatch.lock();
+void BufferManager::set_read_ahead(size_t window) {
+   // larger windows would be cut short by loadPages()
+   readAheadWindow = std::min(window, std::max<size_t>(pageCount.load(std::memory_order_relaxed) / 4, 1));
+}
 
-   if (frame.pageState == PageState::LOADING) {
-      throw std::runtime_error("Frame in invalid state. We hold the loading latch but page is in loading?");
+void BufferManager::queuePrefetch(PrefetchRequest request) {
+   if (request.count == 0)
+      return;
+   {
+      std::unique_lock latch(prefetcherLatch);
+      prefetchRequests.push_back(request);
    }
+   prefetcherCv.notify_one();
+}
 
-   if (frame.pageState == PageState::IN_FIFO || frame.pageState == PageState::IN_LRU) {
-      // someone else loaded before us
-      frame.loadingLatch.unlock();
-      return true;
-   }
+void BufferManager::runPrefetcher() {
+   std::unique_lock latch(prefetcherLatch);
+   while (true) {
+      prefetcherCv.wait(latch, [&] { return stopPrefetcher || !prefetchRequests.empty(); });
+      if (stopPrefetcher)
+         break;
 
-   // load the page
-   assert(frame.pageState == PageState::NOT_LOADED);
-   frame.pageState = PageState::LOADING;
+      auto request = prefetchRequests.front();
+      prefetchRequests.pop_front();
+      latch.unlock();
 
-   // try insert the buffer frame into the fifo list
-   if (!insertBufferFrame(frame)) {
-      frame.pageState = PageState::NOT_LOADED;
-      frame.loadingLatch.unlock();
-      return false;
+      try {
+         loadPages(request.pid, request.count, request.readAhead, request.access);
+      } catch (...) {
+         // prefetching is only a hint, fix_page() reports the error when the page is needed
+      }
+
+      latch.lock();
    }
+}
 
-   // load data
-   auto data = getSegmentData(frame.pid);
-   frame.data = (char*) malloc(pageSize);
-   assert(frame.data);
-   memcpy(frame.data, data.get(), pageSize);
+void BufferManager::detectSequentialMiss(uint64_t pid, AccessHint access) {
+   auto window = readAheadWindow.load(std::memory_order_relaxed);
+   if (window == 0 || access == AccessHint::RANDOM || access == AccessHint::OVERWRITE)
+      return;
 
-   // done loading
-   frame.pageState = PageState::IN_FIFO;
-   frame.loadingLatch.unlock();
-   return true;
+   auto& lastMiss = lastMisses[get_segment_id(pid) % lastMisses.size()];
+   auto previous = lastMiss.exchange(pid, std::memory_order_relaxed);
+   if (previous != BufferFrame::invalidPid && previous + 1 == pid) {
+      // the first page of the window continues the read-ahead when it is fixed
+      queuePrefetch({pid + 1, window, true, access == AccessHint::SEQUENTIAL_ONCE ? access : AccessHint::NORMAL});
+   }
 }
 
-bool BufferManager::insertBufferFrame(simpledb::BufferFrame& frame) {
-   ExclusiveLatch exclFifoLatch(fifoListLatch);
+void BufferManager::loadPage(simpledb::BufferFrame& frame, AccessHint access) {
+   assert(frame.pageState == PageState::NOT_LOADED);
+   frame.pageState = PageState::LOADING;
+
+   // load data straight into the frame
+   if (access == AccessHint::OVERWRITE) {
+      // the file is still opened and grown, the page is written back into it
+      SharedLatch latch;
+      auto slotSize = getSlotSize(get_segment_id(frame.pid));
+      getSegmentFile(get_segment_id(frame.pid), get_segment_page_id(frame.pid) * slotSize + slotSize, latch);
+      std::memset(frame.data, 0, pageSize);
+   } else {
+      readPage(frame.pid, frame.data);
+   }
 
-   // check if we still have free space
-   lruListLatch.lock_shared();
-   if (fifoList.size() + lruList.size() < pageCount) {
-      // just insert at the back of the fifo list
+   // done loading, insert at the back of the list the page belongs to
+   if (access == AccessHint::SEQUENTIAL_ONCE) {
+      auto exclRingLatch = lockList(ringListLatch);
+      frame.pageState = PageState::IN_RING;
+      ringList.push_back(&frame);
+   } else if (access == AccessHint::PIN_HOT && pinFrame(&frame)) {
+      auto exclLruLatch = lockList(lruListLatch);
+      appendLru(&frame, exclLruLatch);
+   } else {
+      auto exclFifoLatch = lockList(fifoListLatch);
+      frame.pageState = PageState::IN_FIFO;
       fifoList.push_back(&frame);
+   }
+}
 
-      // done
-      lruListLatch.unlock_shared();
-      exclFifoLatch.unlock();
-      return true;
+BufferFrame* BufferManager::allocateBufferFrame() {
+   // take a free frame if there is one
+   {
+      std::unique_lock latch(freeFramesLatch);
+      if (!freeFrames.empty()) {
+         auto bf = freeFrames.back();
+         freeFrames.pop_back();
+         latch.unlock();
+
+         // a thread that found this frame in the page table before it became free might still
+         // hold the latch for a moment, so we can't just try_lock here
+         bf->pageLatch.lock();
+         assert(bf->pageState == PageState::NOT_LOADED);
+         return bf;
+      }
    }
-   lruListLatch.unlock_shared();
 
-   // find a free spot in fifo list
-   auto i = lockEvictableFrame(fifoList, exclFifoLatch);
-   if (i != -1) {
-      auto bf = fifoList[i];
-      assert(bf->pageState == PageState::IN_FIFO);
+   // A full ring of scan pages reuses its frames, so scans don't push the pages of the fifo and
+   // lru list out. Its pages were only used once, unless an optimistic fix referenced them since.
+   BufferFrame* bf = nullptr;
+   {
+      auto exclRingLatch = lockList(ringListLatch);
+      if (ringList.size() >= ringSize.load(std::memory_order_relaxed)) {
+         bf = lockRingFrame(exclRingLatch);
+         for (auto chances = ringList.size(); bf && chances > 0 && (bf->hot || bf->referenced.exchange(false)); --chances) {
+            auto exclFifoLatch = lockList(fifoListLatch);
+            ringList.remove(bf);
+            bf->pageState = PageState::IN_FIFO;
+            fifoList.push_back(bf);
+            bf->pageLatch.unlock();
+            bf = lockRingFrame(exclRingLatch);
+         }
+         if (bf) {
+            assert(bf->pageState == PageState::IN_RING);
+            ringList.remove(bf);
+         }
+      }
+   }
 
-      // evict old frame
-      fifoList.erase(fifoList.begin() + i);
+   // find a frame to evict in the fifo list first and in the lru list second
+   // frames that were fixed optimistically or pinned get a second chance, which is bounded, as
+   // optimistic readers may mark them again right away
+   if (!bf) {
+      auto exclFifoLatch = lockList(fifoListLatch);
+      bf = lockEvictableFrame(fifoList, exclFifoLatch);
+      for (auto chances = fifoList.size(); bf && chances > 0 && (bf->hot || bf->referenced.exchange(false)); --chances) {
+         // that was its second reference
+         auto exclLruLatch = lockList(lruListLatch);
+         promoteFrame(bf, exclFifoLatch, exclLruLatch);
+         bf->pageLatch.unlock();
+         bf = lockEvictableFrame(fifoList, exclFifoLatch);
+      }
+      if (bf) {
+         assert(bf->pageState == PageState::IN_FIFO);
+         fifoList.remove(bf);
+      }
+   }
+   if (!bf) {
+      auto exclLruLatch = lockList(lruListLatch);
+      bf = lockEvictableFrame(lruList, exclLruLatch);
+      for (auto chances = lruList.size(); bf && chances > 0 && (bf->hot || bf->referenced.exchange(false)); --chances) {
+         updateLru(bf, exclLruLatch);
+         bf->pageLatch.unlock();
+         bf = lockEvictableFrame(lruList, exclLruLatch);
+      }
+      if (bf) {
+         assert(bf->pageState == PageState::IN_LRU);
+         lruList.remove(bf);
+         --lruSize;
+      }
+   }
+   if (!bf) {
+      // the ring is all that is left, even pages that were read ahead for a scan
+      auto exclRingLatch = lockList(ringListLatch);
+      bf = lockEvictableFrame(ringList, exclRingLatch);
+      if (bf)
+         ringList.remove(bf);
+   }
+   if (!bf) {
+      // couldn't find a free spot anywhere :(
+      return nullptr;
+   }
 
-      // insert new frame
-      fifoList.push_back(&frame);
+   // evict old page
+   if (bf->isDirty) {
+      // the background writer didn't keep up, flush it ourselves and let it catch up
+      writerCv.notify_one();
+      flushPage(*bf);
+      metrics::count(metrics::Counter::DIRTY_EVICTIONS);
+   } else {
+      metrics::count(metrics::Counter::CLEAN_EVICTIONS);
+   }
+   pageTable.erase(bf->pid, bf);
+   bf->pid = BufferFrame::invalidPid;
+   bf->pageState = PageState::NOT_LOADED;
+   bf->prefetched = false;
+   bf->referenced = false;
+   if (bf->hot.exchange(false))
+      --hotFrames;
+   bf->pageLsn = 0;
+
+   return bf;
+}
+
+size_t BufferManager::resize(size_t page_count) {
+   std::unique_lock latch(resizeLatch);
+   page_count = std::clamp<size_t>(page_count, 1, maxPageCount);
+   auto current = pageCount.load();
 
-      exclFifoLatch.unlock();
+   if (page_count > current) {
+      std::unique_lock freeLatch(freeFramesLatch);
+      for (; current < page_count; ++current) {
+         freeFrames.push_back(retiredFrames.back());
+         retiredFrames.pop_back();
+      }
+   }
 
-      if (bf->isDirty) {
-         // frame is dirty. flush it to disk
-         flushPage(*bf);
+   while (current > page_count) {
+      // takes a free frame or evicts a page
+      auto* frame = allocateBufferFrame();
+      if (!frame) {
+         if (busyFrames.load() > 0) {
+            // frames that are only being written or prefetched don't count as fixed
+            std::this_thread::yield();
+            continue;
+         }
+         break;
       }
-      assert(bf->pageState == PageState::IN_FIFO);
-      bf->pageState = PageState::NOT_LOADED;
-      assert(bf->data);
-      free(bf->data);
+      --current;
+      frame->pid = BufferFrame::invalidPid;
+      frame->pageLatch.unlock();
+
+      // give the pages that lie completely within the frame back to the system
+      auto pageSizeOs = static_cast<uintptr_t>(::sysconf(_SC_PAGESIZE));
+      auto begin = (reinterpret_cast<uintptr_t>(frame->data) + pageSizeOs - 1) & ~(pageSizeOs - 1);
+      auto end = (reinterpret_cast<uintptr_t>(frame->data) + pageSize) & ~(pageSizeOs - 1);
+      if (begin < end)
+         ::madvise(reinterpret_cast<void*>(begin), end - begin, MADV_DONTNEED);
+
+      std::unique_lock freeLatch(freeFramesLatch);
+      retiredFrames.push_back(frame);
+   }
+
+   pageCount = current;
+   cleanWindow = std::clamp<size_t>(current / 16, 1, 256);
+   ringSize = std::clamp<size_t>(current / 16, 1, 256);
+   return current;
+}
 
-      bf->pageLatch.unlock();
+void BufferManager::releaseBufferFrame(BufferFrame* frame) {
+   assert(frame->pageState == PageState::NOT_LOADED);
+   frame->pid = BufferFrame::invalidPid;
+   frame->pageLatch.unlock();
 
-      return true;
+   std::unique_lock latch(freeFramesLatch);
+   freeFrames.push_back(frame);
+}
+
+BufferFrame* BufferManager::lockEvictableFrame(FrameList& frameList, ExclusiveLatch&) {
+   // the list is ordered by eviction priority, so usually the first frame can be taken
+   for (auto bf = frameList.front(); bf; bf = FrameList::next(bf)) {
+      if (bf->pageLatch.try_lock())
+         return bf;
+   }
+   return nullptr;
+}
+
+BufferFrame* BufferManager::lockRingFrame(ExclusiveLatch&) {
+   // a scan fixes the pages it read ahead soon, unless the ring already holds a lot of them
+   auto skipPrefetched = ringList.size() < std::max<size_t>(pageCount.load(std::memory_order_relaxed) / 4, 1);
+   for (auto bf = ringList.front(); bf; bf = FrameList::next(bf)) {
+      if (skipPrefetched && bf->prefetched.load(std::memory_order_relaxed))
+         continue;
+      if (bf->pageLatch.try_lock())
+         return bf;
    }
+   return nullptr;
+}
 
-   // find a free spot in the lru list
-   ExclusiveLatch exclLruLatch(lruListLatch);
-   i = lockEvictableFrame(lruList, exclLruLatch);
-   if (i != -1) {
-      auto bf = lruList[i];
-      assert(bf->pageState == PageState::IN_LRU);
+void BufferManager::updateLru(simpledb::BufferFrame* frame, simpledb::ExclusiveLatch&) {
+   assert(frame->pageState == PageState::IN_LRU);
 
-      // evict old frame
-      lruList.erase(lruList.begin() + i);
+   frame->lruStamp.store(lruClock.fetch_add(1, std::memory_order_relaxed) + 1, std::memory_order_relaxed);
 
-      exclLruLatch.unlock();
+   if (lruList.back() == frame)
+      // already the most recently used frame
+      return;
 
-      // insert new frame
-      fifoList.push_back(&frame);
+   // reinsert at the back of the lru list
+   lruList.remove(frame);
+   lruList.push_back(frame);
+}
+
+void BufferManager::touchFrame(simpledb::BufferFrame* frame, AccessHint access) {
+   if (frame->prefetched.load(std::memory_order_relaxed) && frame->prefetched.exchange(false)) {
+      // first reference to a prefetched page, it stays in the fifo list or the ring like a page that was just loaded
+      auto window = readAheadWindow.load(std::memory_order_relaxed);
+      if (frame->readAheadMarker && window > 0)
+         queuePrefetch({frame->pid + window, window, true, frame->pageState == PageState::IN_RING ? AccessHint::SEQUENTIAL_ONCE : AccessHint::NORMAL});
+      return;
+   }
 
-      exclFifoLatch.unlock();
+   if (access == AccessHint::SEQUENTIAL_ONCE) {
+      // a scan doesn't tell whether the page is going to be used again
+      return;
+   }
+   if (access == AccessHint::PIN_HOT) {
+      pinFrame(frame);
+   }
 
-      if (bf->isDirty) {
-         // frame is dirty. flush it to disk
-         flushPage(*bf);
+   if (frame->pageState == PageState::IN_RING) {
+      // the first reference that is not part of a scan, the page is treated as if it was just loaded
+      auto exclRingLatch = lockList(ringListLatch);
+      if (frame->pageState == PageState::IN_RING) {
+         ringList.remove(frame);
+         if (frame->hot) {
+            auto exclLruLatch = lockList(lruListLatch);
+            appendLru(frame, exclLruLatch);
+         } else {
+            auto exclFifoLatch = lockList(fifoListLatch);
+            frame->pageState = PageState::IN_FIFO;
+            fifoList.push_back(frame);
+         }
+         return;
       }
-      assert(bf->pageState == PageState::IN_LRU);
-      bf->pageState = PageState::NOT_LOADED;
-      assert(bf->data);
-      free(bf->data);
+      // moved by someone else in the meantime
+   }
 
-      bf->pageLatch.unlock();
+   if (frame->pageState == PageState::IN_LRU) {
+      if (frame->hot) {
+         // pinned pages aren't evicted anyway
+         return;
+      }
 
-      return true;
+      // Every frame that was moved to the back of the lru list after this one did so by advancing the
+      // clock, so the difference bounds the distance to the back of the list. Frames that are still in
+      // the most recently used quarter don't need to be moved, which keeps hits on hot pages off the
+      // lru latch.
+      auto distance = lruClock.load(std::memory_order_relaxed) - frame->lruStamp.load(std::memory_order_relaxed);
+      if (distance < lruSize.load(std::memory_order_relaxed) / 4)
+         return;
+
+      auto exclLruLatch = lockList(lruListLatch);
+      updateLru(frame, exclLruLatch);
+      return;
    }
 
-   // couldn't find a free spot anywhere :(
-   exclLruLatch.unlock();
-   exclFifoLatch.unlock();
-   return false;
-}
+   // move from fifo to lru list
+   auto exclFifoLatch = lockList(fifoListLatch);
+   auto exclLruLatch = lockList(lruListLatch);
 
-long BufferManager::lockEvictableFrame(std::vector<BufferFrame*>& frameList, ExclusiveLatch&) {
-   for (size_t i = 0; i < frameList.size(); ++i) {
-      if (frameList[i]->pageLatch.try_lock())
-         return static_cast<long>(i);
+   // could have been moved to LRU in the meantime
+   if (frame->pageState == PageState::IN_LRU) {
+      updateLru(frame, exclLruLatch);
+      return;
    }
-   return -1;
+
+   promoteFrame(frame, exclFifoLatch, exclLruLatch);
 }
 
-void BufferManager::updateLru(simpledb::BufferFrame* frame, simpledb::ExclusiveLatch&) {
-   uint64_t rpid = 0;
-   bool erased = false;
-
-   // find in lru list
-   // TODO: Iterate full list????
-   for (auto it = lruList.begin(); it != lruList.end(); ++it) {
-      if ((*it) == frame) {
-         erased = true;
-         rpid = (*it)->pid;
-         lruList.erase(it);
-         break;
-      }
-   }
+void BufferManager::promoteFrame(BufferFrame* frame, ExclusiveLatch&, ExclusiveLatch& exclLruListLatch) {
+   assert(frame->pageState == PageState::IN_FIFO);
 
-   assert(erased);
-   assert(frame->pid == rpid);
+   // move to the back of the lru list
+   fifoList.remove(frame);
+   appendLru(frame, exclLruListLatch);
+   metrics::count(metrics::Counter::PROMOTIONS);
+}
 
-   // reinsert in lru list
+void BufferManager::appendLru(BufferFrame* frame, ExclusiveLatch&) {
    lruList.push_back(frame);
+   ++lruSize;
+   frame->pageState = PageState::IN_LRU;
+   frame->lruStamp.store(lruClock.fetch_add(1, std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+bool BufferManager::pinFrame(BufferFrame* frame) {
+   if (frame->hot.load(std::memory_order_relaxed))
+      return true;
+   // concurrent pins may overshoot the limit by a few frames
+   if (hotFrames.load(std::memory_order_relaxed) >= std::max<size_t>(pageCount.load(std::memory_order_relaxed) / 4, 1))
+      return false;
+   if (!frame->hot.exchange(true))
+      ++hotFrames;
+   return true;
 }
 
 void BufferManager::flushPage(simpledb::BufferFrame& frame) {
@@ -284,102 +841,338 @@ void BufferManager::flushPage(simpledb::BufferFrame& frame) {
 
    // write changes to disk
    auto data = frame.get_data();
-   seg.first->write_block(data, segPageId * pageSize, pageSize);
+   auto slotSize = getSlotSize(segId);
+   try {
+      if (wal) {
+         wal->flush(frame.pageLsn);
+      }
+      if (slotSize == pageSize) {
+         seg.first->write_block(data, segPageId * pageSize, pageSize);
+      } else {
+         thread_local std::vector<char> slot;
+         slot.resize(slotSize);
+         auto size = encodePage(data, slot.data());
+         seg.first->write_block(slot.data(), segPageId * slotSize, size);
+         discardSlotTail(*seg.first, frame.pid, size);
+      }
+   } catch (...) {
+      seg.second.unlock_shared();
+      throw;
+   }
 
    frame.isDirty = false;
+   frame.recLsn = 0;
    seg.second.unlock_shared();
 }
 
-BufferFrame& BufferManager::fix_page(uint64_t page_id, bool exclusive) {
-   BufferFrame* frame = getBufferFrame(page_id);
+size_t BufferManager::getSlotSize(uint16_t segment_id) const {
+   return (*compressions)[segment_id] == PageCompression::NONE ? pageSize : sizeof(SlotHeader) + pageSize;
+}
 
-   // acquire page latch in given mode
-   if (exclusive) {
-      frame->pageLatch.lock();
+size_t BufferManager::encodePage(const char* data, char* slot) const {
+   // a page that doesn't get smaller than the page size is stored as it is
+   SlotHeader size = lz_compress(data, pageSize, slot + sizeof(SlotHeader), pageSize - 1);
+   if (size == 0) {
+      size = pageSize;
+      std::memcpy(slot + sizeof(SlotHeader), data, pageSize);
+   }
+   std::memcpy(slot, &size, sizeof(size));
+   return sizeof(SlotHeader) + size;
+}
+
+void BufferManager::decodePage(const char* slot, char* data) const {
+   SlotHeader size;
+   std::memcpy(&size, slot, sizeof(size));
+   if (size == 0) {
+      std::memset(data, 0, pageSize);
+   } else if (size == pageSize) {
+      std::memcpy(data, slot + sizeof(SlotHeader), pageSize);
+   } else if (size < pageSize) {
+      lz_decompress(slot + sizeof(SlotHeader), size, data, pageSize);
    } else {
-      frame->pageLatch.lock_shared();
+      throw std::runtime_error("corrupt compressed page");
    }
+}
 
-   // check if page is already in memory and if not try loading it in
-   switch (frame->pageState) {
-      case PageState::IN_FIFO: {
-         // move from fifo to lru list
-         ExclusiveLatch exclFifoLatch(fifoListLatch);
-         ExclusiveLatch exclLruLatch(lruListLatch);
+void BufferManager::discardSlotTail(File& file, uint64_t pid, size_t size) const {
+   // only whole blocks can be freed
+   auto slotSize = getSlotSize(get_segment_id(pid));
+   auto begin = get_segment_page_id(pid) * slotSize + size;
+   auto end = get_segment_page_id(pid) * slotSize + slotSize;
+   begin = (begin + kDiscardBlockSize - 1) / kDiscardBlockSize * kDiscardBlockSize;
+   end = end / kDiscardBlockSize * kDiscardBlockSize;
+   if (begin < end) {
+      file.discard(begin, end - begin);
+   }
+}
 
-         // could have been moved to LRU in the meantime
-         if (frame->pageState == PageState::IN_LRU) {
-            updateLru(frame, exclLruLatch);
-            break;
-         }
+void BufferManager::set_compression(uint16_t segment_id, PageCompression compression) {
+   (*compressions)[segment_id] = compression;
+}
 
-         assert(frame->pageState == PageState::IN_FIFO);
+void BufferManager::map_segment(uint16_t segment_id, MappedFile::Advice advice) {
+   if (getSlotSize(segment_id) != pageSize) {
+      throw std::logic_error("compressed segments can't be mapped");
+   }
 
-         uint64_t rpid = 0;
-         bool erased = false;
+   // the file has to be up to date
+   flush_all();
+
+   auto segIdString = std::to_string(segment_id);
+   auto mapped = std::make_unique<MappedSegment>();
+   mapped->file = std::make_unique<MappedFile>(segIdString.c_str());
+   mapped->file->advise(advice);
+
+   mapped->pageCount = mapped->file->size() / pageSize;
+   mapped->frames = std::make_unique<BufferFrame[]>(mapped->pageCount); // NOLINT(cppcoreguidelines-avoid-c-arrays)
+   for (size_t i = 0; i < mapped->pageCount; ++i) {
+      auto& bf = mapped->frames[i];
+      bf.pid = (static_cast<uint64_t>(segment_id) << 48) | i;
+      bf.pageState = PageState::MAPPED;
+      // never written through, the mapping is read-only
+      bf.data = const_cast<char*>(mapped->file->data(i * pageSize)); // NOLINT(cppcoreguidelines-pro-type-const-cast)
+   }
 
-         // find in fifo list
-         // TODO: Iterate full list????
-         for (auto it = fifoList.begin(); it != fifoList.end(); ++it) {
-            if ((*it) == frame) {
-               erased = true;
-               rpid = (*it)->pid;
-               fifoList.erase(it);
-               break;
-            }
-         }
+   (*mappedSegments)[segment_id] = std::move(mapped);
+}
 
-         assert(erased);
-         assert(rpid == frame->pid);
+void BufferManager::unmap_segment(uint16_t segment_id) {
+   (*mappedSegments)[segment_id].reset();
+}
 
-         // insert in lru list
-         lruList.push_back(frame);
-         frame->pageState = PageState::IN_LRU;
-         break;
+BufferFrame& BufferManager::fix_page_optimistic(uint64_t page_id, uint64_t& version, BufferFrame* hint, AccessHint access) {
+   if (const auto& mapped = (*mappedSegments)[get_segment_id(page_id)]) {
+      if (get_segment_page_id(page_id) >= mapped->pageCount) {
+         throw std::out_of_range("page is not part of the mapped segment");
       }
-      case PageState::IN_LRU: {
-         // move to the back of lru
-         ExclusiveLatch exclLruLatch(lruListLatch);
+      auto& frame = mapped->frames[get_segment_page_id(page_id)];
+      version = frame.pageLatch.read_version();
+      metrics::count_access(get_segment_id(page_id), true);
+      return frame;
+   }
 
-         assert(frame->pageState == PageState::IN_LRU);
+   // a page that has to be loaded is counted as a miss by fix_page()
+   bool missed = false;
+   while (true) {
+      auto frame = hint && hint->pid == page_id ? hint : pageTable.find(page_id);
+      hint = nullptr;
+
+      if (!frame) {
+         // load the page and try again
+         unfix_page(fix_page(page_id, false, access), false);
+         missed = true;
+         continue;
+      }
 
-         updateLru(frame, exclLruLatch);
-         break;
+      version = frame->pageLatch.read_version();
+      if (version & 1) {
+         // locked exclusively
+         std::this_thread::yield();
+         continue;
+      }
+      if (frame->pid != page_id || frame->pageState == PageState::NOT_LOADED || frame->pageState == PageState::LOADING || !validate(*frame, version)) {
+         // evicted in the meantime
+         continue;
+      }
+
+      // only write if needed, hot pages would bounce the cache line otherwise
+      if (!frame->referenced.load(std::memory_order_relaxed))
+         frame->referenced.store(true, std::memory_order_relaxed);
+      // eviction moves the page to the lru list, if it still is in the frame
+      if (access == AccessHint::PIN_HOT)
+         pinFrame(frame);
+      if (!missed)
+         metrics::count_access(get_segment_id(page_id), true);
+      return *frame;
+   }
+}
+
+BufferFrame& BufferManager::fix_page(uint64_t page_id, bool exclusive, AccessHint access) {
+   if (const auto& mapped = (*mappedSegments)[get_segment_id(page_id)]) {
+      if (exclusive) {
+         throw std::logic_error("segment is mapped read-only");
+      }
+      if (get_segment_page_id(page_id) >= mapped->pageCount) {
+         throw std::out_of_range("page is not part of the mapped segment");
       }
-      case PageState::NOT_LOADED:
-         // try load page into memory
-         if (!loadPage(*frame)) {
-            frame->pageLatch.unlock();
-            throw buffer_full_error();
+      auto& frame = mapped->frames[get_segment_page_id(page_id)];
+      metrics::lock_shared(frame.pageLatch, metrics::LatchKind::PAGE);
+      metrics::count_access(get_segment_id(page_id), true);
+      return frame;
+   }
+
+   while (true) {
+      auto frame = pageTable.find(page_id);
+
+      if (frame) {
+         // acquire page latch in given mode
+         if (exclusive) {
+            metrics::lock(frame->pageLatch, metrics::LatchKind::PAGE);
+         } else {
+            metrics::lock_shared(frame->pageLatch, metrics::LatchKind::PAGE);
          }
-         break;
-      case PageState::LOADING:
-         // wait for page to load
-         frame->loadingLatch.lock();
-         frame->loadingLatch.unlock();
-         if (frame->pageState != PageState::IN_FIFO && frame->pageState != PageState::IN_LRU) {
-            //std::cerr << "waited for failed page load" << std::endl;
-            frame->pageLatch.unlock();
-            throw buffer_full_error();
+
+         if (frame->pid != page_id || frame->pageState == PageState::NOT_LOADED) {
+            // page was evicted before we got the latch or its load failed -> retry
+            if (exclusive) {
+               frame->pageLatch.unlock();
+            } else {
+               frame->pageLatch.unlock_shared();
+            }
+            continue;
          }
-         break;
+
+         // page is loaded (the loading thread holds the latch exclusively until it is done)
+         touchFrame(frame, access);
+         metrics::count_access(get_segment_id(page_id), true);
+         if (exclusive) {
+            beginLogging(*frame);
+         }
+         return *frame;
+      }
+
+      // page is not in memory -> get a frame for it
+      frame = allocateBufferFrame();
+      if (!frame) {
+         if (busyFrames.load() > 0) {
+            // frames that are only being written or prefetched don't count as fixed
+            std::this_thread::yield();
+            continue;
+         }
+         metrics::count(metrics::Counter::BUFFER_FULL_ERRORS);
+         throw buffer_full_error();
+      }
+
+      frame->pid = page_id;
+      if (pageTable.insert(page_id, frame) != frame) {
+         // someone else started loading this page in the meantime
+         releaseBufferFrame(frame);
+         continue;
+      }
+
+      try {
+         loadPage(*frame, access);
+      } catch (...) {
+         pageTable.erase(page_id, frame);
+         frame->pageState = PageState::NOT_LOADED;
+         releaseBufferFrame(frame);
+         throw;
+      }
+      detectSequentialMiss(page_id, access);
+      metrics::count_access(get_segment_id(page_id), false);
+
+      if (exclusive) {
+         beginLogging(*frame);
+         return *frame;
+      }
+
+      // std::shared_mutex can't be downgraded, the page might get evicted in between
+      frame->pageLatch.unlock();
+      frame->pageLatch.lock_shared();
+      if (frame->pid == page_id && frame->pageState != PageState::NOT_LOADED) {
+         return *frame;
+      }
+      frame->pageLatch.unlock_shared();
+   }
+}
+
+bool BufferManager::upgrade(BufferFrame& frame, uint64_t version, bool exclusive) {
+   if (!exclusive) {
+      return frame.pageLatch.upgrade_shared(version);
+   }
+   if (!frame.pageLatch.upgrade(version)) {
+      return false;
+   }
+   beginLogging(frame);
+   return true;
+}
+
+void BufferManager::beginLogging(BufferFrame& frame) {
+   if (!wal) {
+      return;
    }
 
-   return *frame;
+   std::unique_ptr<char[]> image; // NOLINT(cppcoreguidelines-avoid-c-arrays)
+   {
+      std::unique_lock latch(beforeImagesLatch);
+      if (!beforeImages.empty()) {
+         image = std::move(beforeImages.back());
+         beforeImages.pop_back();
+      }
+   }
+   if (!image) {
+      image = std::make_unique<char[]>(pageSize); // NOLINT(cppcoreguidelines-avoid-c-arrays)
+   }
+   std::memcpy(image.get(), frame.data, pageSize);
+   frame.beforeImage = image.release();
+}
+
+void BufferManager::endLogging(BufferFrame& frame, bool is_dirty) {
+   std::unique_ptr<char[]> image(frame.beforeImage); // NOLINT(cppcoreguidelines-avoid-c-arrays)
+   frame.beforeImage = nullptr;
+   if (is_dirty && wal) {
+      uint64_t lsn = 0;
+      if (frame.recLsn != 0) {
+         lsn = wal->log_page(frame.pid, image.get(), frame.data, pageSize);
+      } else if (std::memcmp(image.get(), frame.data, pageSize) != 0) {
+         // The page on disk may be torn by a crash while it is written again, so replay must not
+         // depend on it. The recovery LSN is set before the record is appended, so a checkpoint
+         // that starts behind the record sees it.
+         frame.recLsn = wal->get_lsn();
+         lsn = wal->log_image(frame.pid, frame.data, pageSize);
+      }
+      if (lsn) {
+         frame.pageLsn = lsn;
+      }
+   }
+
+   std::unique_lock latch(beforeImagesLatch);
+   beforeImages.push_back(std::move(image));
 }
 
 void BufferManager::unfix_page(BufferFrame& page, bool is_dirty) {
    // the premise is that unfix_page is never called by a thread that fixed it in shared mode
    // with the is_dirty flag set to true, as this wouldn't make any sense
-   page.isDirty = page.isDirty || is_dirty;
+   assert(!is_dirty || page.pageState != PageState::MAPPED);
+   if (page.beforeImage) {
+      // fixed exclusively while there is a log
+      endLogging(page, is_dirty);
+   }
+   if (is_dirty)
+      page.isDirty = true;
    page.pageLatch.unlock();
 }
 
+std::vector<std::pair<uint64_t, uint64_t>> BufferManager::get_dirty_pages() const {
+   std::vector<std::pair<uint64_t, uint64_t>> dirtyPages;
+   for (size_t i = 0; i < maxPageCount; ++i) {
+      auto& bf = frames[i];
+      // A frame is written back before it gets another page, so a recovery LSN belongs to the
+      // page we read behind it. At worst the page was replaced in between, and an extra entry
+      // only makes recovery start earlier.
+      auto recLsn = bf.recLsn.load();
+      if (recLsn == 0)
+         continue;
+      auto pid = bf.pid.load();
+      if (pid != BufferFrame::invalidPid)
+         dirtyPages.emplace_back(pid, recLsn);
+   }
+   return dirtyPages;
+}
+
+void BufferManager::sync_segments() {
+   for (auto& seg : *segments) {
+      SharedLatch latch(seg.second);
+      if (seg.first)
+         seg.first->sync();
+   }
+}
+
 std::vector<uint64_t> BufferManager::get_fifo_list() const {
    SharedLatch latch(fifoListLatch);
    std::vector<uint64_t> v;
    v.reserve(fifoList.size());
-   for (auto bf : fifoList) {
+   for (auto bf = fifoList.front(); bf; bf = FrameList::next(bf)) {
       v.push_back(bf->pid);
    }
    return v;
@@ -389,7 +1182,17 @@ std::vector<uint64_t> BufferManager::get_lru_list() const {
    SharedLatch latch(lruListLatch);
    std::vector<uint64_t> v;
    v.reserve(lruList.size());
-   for (auto bf : lruList) {
+   for (auto bf = lruList.front(); bf; bf = FrameList::next(bf)) {
+      v.push_back(bf->pid);
+   }
+   return v;
+}
+
+std::vector<uint64_t> BufferManager::get_ring_list() const {
+   SharedLatch latch(ringListLatch);
+   std::vector<uint64_t> v;
+   v.reserve(ringList.size());
+   for (auto bf = ringList.front(); bf; bf = FrameList::next(bf)) {
       v.push_back(bf->pid);
    }
    return v;
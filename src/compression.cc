@@ -0,0 +1,186 @@
+#include "simpledb/compression.h"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+namespace simpledb {
+
+namespace {
+
+/// The shortest match that is worth a sequence.
+constexpr size_t kMinMatch = 4;
+/// The last bytes are always literals, like in LZ4.
+constexpr size_t kLastLiterals = 5;
+/// No match starts in the last bytes, like in LZ4.
+constexpr size_t kMatchSearchLimit = 12;
+/// The size of the hash table of positions.
+constexpr size_t kHashBits = 12;
+/// The farthest a match can be away.
+constexpr size_t kMaxOffset = 65535;
+/// The value of a length nibble that says that extension bytes follow.
+constexpr size_t kLengthMask = 15;
+
+uint32_t read32(const char* p) {
+   uint32_t value;
+   std::memcpy(&value, p, sizeof(value));
+   return value;
+}
+
+uint32_t hash(uint32_t value) {
+   return (value * 2654435761u) >> (32 - kHashBits);
+}
+
+/// Writes the extension bytes of a length that didn't fit into its nibble.
+bool write_length(char*& out, const char* end, size_t length) {
+   for (; length >= 255; length -= 255) {
+      if (out == end)
+         return false;
+      *out++ = static_cast<char>(255);
+   }
+   if (out == end)
+      return false;
+   *out++ = static_cast<char>(length);
+   return true;
+}
+
+/// Writes a sequence of literals that is followed by a match, or only the literals if
+/// `match_length` is 0. Returns false if it doesn't fit.
+bool write_sequence(char*& out, const char* end, const char* literals, size_t literal_count, size_t offset, size_t match_length) {
+   if (out == end)
+      return false;
+   auto* token = out++;
+   auto nibbles = static_cast<uint8_t>(std::min(literal_count, kLengthMask) << 4);
+   if (literal_count >= kLengthMask && !write_length(out, end, literal_count - kLengthMask))
+      return false;
+   if (static_cast<size_t>(end - out) < literal_count)
+      return false;
+   std::memcpy(out, literals, literal_count);
+   out += literal_count;
+
+   if (match_length > 0) {
+      if (end - out < 2)
+         return false;
+      *out++ = static_cast<char>(offset & 0xFF);
+      *out++ = static_cast<char>(offset >> 8);
+      auto length = match_length - kMinMatch;
+      nibbles |= static_cast<uint8_t>(std::min(length, kLengthMask));
+      if (length >= kLengthMask && !write_length(out, end, length - kLengthMask))
+         return false;
+   }
+   *token = static_cast<char>(nibbles);
+   return true;
+}
+
+[[noreturn]] void throw_corrupt() {
+   throw std::runtime_error("corrupt compressed data");
+}
+
+/// Reads a length that starts in a nibble of the token.
+size_t read_length(const char*& in, const char* end, size_t nibble) {
+   auto length = nibble;
+   if (nibble == kLengthMask) {
+      uint8_t byte;
+      do {
+         if (in == end)
+            throw_corrupt();
+         byte = static_cast<uint8_t>(*in++);
+         length += byte;
+      } while (byte == 255);
+   }
+   return length;
+}
+
+} // namespace
+
+size_t lz_compress(const char* src, size_t size, char* dst, size_t capacity) {
+   // positions + 1 of the last occurrence of 4 bytes, 0 if there was none
+   std::array<uint32_t, 1u << kHashBits> positions{};
+   char* out = dst;
+   const char* end = dst + capacity;
+
+   size_t anchor = 0;
+   if (size > kMatchSearchLimit) {
+      for (size_t i = 0; i < size - kMatchSearchLimit;) {
+         auto value = read32(src + i);
+         auto& position = positions[hash(value)];
+         auto candidate = static_cast<size_t>(position);
+         position = static_cast<uint32_t>(i + 1);
+         if (candidate == 0 || i - (candidate - 1) > kMaxOffset || read32(src + candidate - 1) != value) {
+            // skip faster the longer nothing matched, so incompressible data is cheap
+            i += 1 + ((i - anchor) >> 6);
+            continue;
+         }
+
+         // extend the match in both directions
+         auto match = candidate - 1;
+         auto length = kMinMatch;
+         auto maxLength = size - kLastLiterals - i;
+         while (length < maxLength && src[match + length] == src[i + length]) {
+            ++length;
+         }
+         while (i > anchor && match > 0 && src[i - 1] == src[match - 1]) {
+            --i;
+            --match;
+            ++length;
+         }
+
+         if (!write_sequence(out, end, src + anchor, i - anchor, i - match, length))
+            return 0;
+         i += length;
+         anchor = i;
+      }
+   }
+   if (!write_sequence(out, end, src + anchor, size - anchor, 0, 0))
+      return 0;
+   return out - dst;
+}
+
+void lz_decompress(const char* src, size_t src_size, char* dst, size_t size) {
+   const char* in = src;
+   const char* inEnd = src + src_size;
+   char* out = dst;
+   char* outEnd = dst + size;
+
+   while (true) {
+      if (in == inEnd)
+         throw_corrupt();
+      auto token = static_cast<uint8_t>(*in++);
+
+      auto literalCount = read_length(in, inEnd, token >> 4);
+      if (static_cast<size_t>(inEnd - in) < literalCount || static_cast<size_t>(outEnd - out) < literalCount)
+         throw_corrupt();
+      std::memcpy(out, in, literalCount);
+      in += literalCount;
+      out += literalCount;
+
+      // the last sequence has no match
+      if (in == inEnd)
+         break;
+
+      if (inEnd - in < 2)
+         throw_corrupt();
+      size_t offset = static_cast<uint8_t>(in[0]) | (static_cast<size_t>(static_cast<uint8_t>(in[1])) << 8);
+      in += 2;
+      auto length = read_length(in, inEnd, token & kLengthMask) + kMinMatch;
+      if (offset == 0 || offset > static_cast<size_t>(out - dst) || static_cast<size_t>(outEnd - out) < length)
+         throw_corrupt();
+
+      const char* match = out - offset;
+      if (offset >= length) {
+         std::memcpy(out, match, length);
+         out += length;
+      } else {
+         // the match overlaps what it produces, e.g. a run of a single byte
+         for (size_t i = 0; i < length; ++i) {
+            *out++ = *match++;
+         }
+      }
+   }
+
+   if (out != outEnd)
+      throw_corrupt();
+}
+
+}
@@ -1,53 +1,147 @@
 #include "simpledb/database.h"
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+#include <span>
+#include <stdexcept>
 
-void simpledb::Database::insert(const simpledb::schema::Table& table,
-                                const std::vector<std::string>& data) {
+simpledb::Database::Database(const std::vector<PoolOptions>& pools) {
+   if (pools.empty()) {
+      throw std::invalid_argument("a database needs at least one buffer pool");
+   }
+   for (const auto& pool : pools) {
+      buffer_managers.push_back(std::make_unique<BufferManager>(pool.page_size, pool.page_count, false, pool.max_page_count));
+      buffer_managers.back()->set_read_ahead(8);
+   }
+}
+
+void simpledb::Database::assign_pool(uint16_t segment_id, size_t pool) {
+   if (pool >= buffer_managers.size()) {
+      throw std::out_of_range("no such buffer pool");
+   }
+   if (is_open(segment_id)) {
+      throw std::logic_error("the segment is in use, load another schema before it moves to another pool");
+   }
+   auto& old_pool = get_buffer_manager(segment_id);
+   if (&old_pool != buffer_managers[pool].get()) {
+      // the new pool reads the pages from the file
+      old_pool.flush_all();
+   }
+   pool_assignments[segment_id] = pool;
+}
+
+bool simpledb::Database::is_open(uint16_t segment_id) const {
+   if (!schema_segment) {
+      return false;
+   }
+   if (schema_segment->segment_id == segment_id) {
+      return true;
+   }
+   auto* schema = schema_segment->get_schema();
+   return schema && std::any_of(schema->tables.begin(), schema->tables.end(), [&](const schema::Table& table) {
+      return table.sp_segment == segment_id || (table.layout != schema::Table::kPax && table.fsi_segment == segment_id);
+   });
+}
+
+simpledb::BufferManager& simpledb::Database::get_buffer_manager(uint16_t segment_id) {
+   auto it = pool_assignments.find(segment_id);
+   return *buffer_managers[it == pool_assignments.end() ? 0 : it->second];
+}
+
+void simpledb::Database::serialize(const simpledb::schema::Table& table,
+                                   const std::vector<std::string>& data) {
    if (table.columns.size() != data.size()) {
       throw std::runtime_error("invalid data");
    }
 
-   // Serialize the data
-   auto insert_buffer = std::vector<char>();
    for (size_t i = 0; i < data.size(); ++i) {
       const auto& column = table.columns[i];
       const auto& s = data[i];
 
       int integer = 0;
+      auto offset = insert_arena.size();
       switch (column.type.tclass) {
          case schema::Type::Class::kInteger:
             integer = atoi(s.c_str()); // NOLINT
-            for (size_t j = 0; j < sizeof(integer); ++j) {
-               insert_buffer.push_back(reinterpret_cast<char*>(&integer)[j]);
-            }
+            insert_arena.resize(offset + sizeof(integer));
+            std::memcpy(insert_arena.data() + offset, &integer, sizeof(integer));
             break;
          case schema::Type::Class::kChar:
-            for (size_t j = 0; j < column.type.length; ++j) {
-               if (j < s.size()) {
-                  insert_buffer.push_back(s[j]);
-               } else {
-                  insert_buffer.push_back(' ');
-               }
-            }
+            // pad with spaces
+            insert_arena.resize(offset + column.type.length, static_cast<std::byte>(' '));
+            std::memcpy(insert_arena.data() + offset, s.data(), std::min<size_t>(s.size(), column.type.length));
             break;
       }
    }
+}
+
+simpledb::TID simpledb::Database::insert(const simpledb::schema::Table& table,
+                                         const std::vector<std::string>& data) {
+   return insert_batch(table, {data}).front();
+}
+
+std::vector<simpledb::TID> simpledb::Database::insert_batch(const simpledb::schema::Table& table,
+                                                            const std::vector<std::vector<std::string>>& rows) {
+   // serialize all rows back to back, the arena keeps its memory for the next batch
+   insert_arena.clear();
+   std::vector<size_t> ends;
+   ends.reserve(rows.size());
+   for (const auto& row : rows) {
+      serialize(table, row);
+      ends.push_back(insert_arena.size());
+   }
 
+   std::vector<std::span<const std::byte>> records;
+   records.reserve(rows.size());
+   size_t begin = 0;
+   for (auto end : ends) {
+      records.emplace_back(insert_arena.data() + begin, end - begin);
+      begin = end;
+   }
+
+   if (table.layout == schema::Table::kPax) {
+      return pax_segments.at(table.sp_segment)->insert_batch(records);
+   }
    SPSegment& sp = *slotted_pages.at(table.sp_segment);
-   auto tid = sp.allocate(insert_buffer.size());
-   sp.write(tid, reinterpret_cast<std::byte*>(insert_buffer.data()), insert_buffer.size());
-   std::cout << "Tuple with TID " << tid.get_value() << " inserted!\n";
+   return sp.insert_batch(records);
 }
 
 void simpledb::Database::load_new_schema(std::unique_ptr<simpledb::schema::Schema> schema) {
-   if (schema_segment) {
-      schema_segment->write();
-   }
+   close_tables();
    // Always load it to segmentID 0, should be good enough for now
-   schema_segment = std::make_unique<SchemaSegment>(0, buffer_manager);
+   schema_segment = std::make_unique<SchemaSegment>(0, get_buffer_manager(0));
    schema_segment->set_schema(std::move(schema));
+   open_tables();
+}
+
+void simpledb::Database::close_tables() {
+   if (!schema_segment) {
+      return;
+   }
+   for (auto& [id, fsi] : free_space_inventory) {
+      fsi->save_free_cache();
+   }
+   schema_segment->write();
+   // the segments refer to the tables of the schema
+   pax_segments.clear();
+   slotted_pages.clear();
+   free_space_inventory.clear();
+}
+
+void simpledb::Database::open_tables() {
    for (auto& table : schema_segment->get_schema()->tables) {
-      free_space_inventory.emplace(table.fsi_segment, std::make_unique<FSISegment>(table.fsi_segment, buffer_manager, table));
-      slotted_pages.emplace(table.sp_segment, std::make_unique<SPSegment>(table.sp_segment, buffer_manager, *schema_segment, *free_space_inventory.at(table.fsi_segment), table));
+      auto& sp_pool = get_buffer_manager(table.sp_segment);
+      if (table.layout == schema::Table::kPax) {
+         pax_segments.emplace(table.sp_segment, std::make_unique<PAXSegment>(table.sp_segment, sp_pool, table));
+         continue;
+      }
+      // the free space inventory encodes the free space relative to its own page size
+      auto& fsi_pool = get_buffer_manager(table.fsi_segment);
+      if (fsi_pool.get_page_size() != sp_pool.get_page_size()) {
+         throw std::logic_error("the slotted pages and the free space inventory of a table need the same page size");
+      }
+      free_space_inventory.emplace(table.fsi_segment, std::make_unique<FSISegment>(table.fsi_segment, fsi_pool, table));
+      slotted_pages.emplace(table.sp_segment, std::make_unique<SPSegment>(table.sp_segment, sp_pool, *schema_segment, *free_space_inventory.at(table.fsi_segment), table));
    }
 }
 
@@ -56,27 +150,85 @@ simpledb::schema::Schema& simpledb::Database::get_schema() {
 }
 
 void simpledb::Database::read_tuple(const simpledb::schema::Table& table, simpledb::TID tid) {
-   auto& sps = *slotted_pages.at(table.sp_segment);
-   auto read_buffer = std::vector<char>(1024);
-   auto read_bytes = sps.read(tid, reinterpret_cast<std::byte*>(read_buffer.data()), read_buffer.size());
+   if (table.layout == schema::Table::kPax) {
+      // the columns of a PAX record have to be gathered into a row
+      auto& pax = *pax_segments.at(table.sp_segment);
+      std::vector<std::byte> record(pax.get_layout().record_width);
+      record.resize(pax.read(tid, record.data(), record.size()));
+      print_tuple(table, record);
+      return;
+   }
+   // print straight from the page
+   auto record = slotted_pages.at(table.sp_segment)->view(tid);
+   print_tuple(table, record.get_data());
+}
+
+uint32_t simpledb::Database::read(const simpledb::schema::Table& table, simpledb::TID tid,
+                                  std::byte* record, uint32_t capacity) {
+   if (table.layout == schema::Table::kPax) {
+      return pax_segments.at(table.sp_segment)->read(tid, record, capacity);
+   }
+   return slotted_pages.at(table.sp_segment)->read(tid, record, capacity);
+}
+
+void simpledb::Database::scan(const simpledb::schema::Table& table,
+                              const std::function<bool(TID, std::span<const std::byte>)>& callback) {
+   if (table.layout == schema::Table::kPax) {
+      // gather the values of every record from the minipages into a row
+      auto& pax = *pax_segments.at(table.sp_segment);
+      const auto& layout = pax.get_layout();
+      std::vector<size_t> columns(table.columns.size());
+      std::iota(columns.begin(), columns.end(), 0);
+      std::vector<std::byte> record(layout.record_width);
+      pax.scan(columns, [&](const PAXSegment::ColumnBatch& batch) {
+         for (uint32_t i = 0; i < batch.record_count; ++i) {
+            if (batch.is_erased(i)) {
+               continue;
+            }
+            for (size_t c = 0; c < columns.size(); ++c) {
+               std::memcpy(record.data() + layout.record_offsets[c], batch.columns[c] + i * layout.widths[c], layout.widths[c]);
+            }
+            if (!callback(batch.get_tid(i), record)) {
+               return false;
+            }
+         }
+         return true;
+      });
+      return;
+   }
+   slotted_pages.at(table.sp_segment)->scan([&](const SPSegment::ScanBatch& batch) {
+      for (size_t i = 0; i < batch.size(); ++i) {
+         if (!callback(batch.get_tid(i), batch.get_record(i))) {
+            return false;
+         }
+      }
+      return true;
+   });
+}
+
+void simpledb::Database::print_tuple(const simpledb::schema::Table& table, std::span<const std::byte> record) {
    // Deserialize the data
-   char* current = read_buffer.data();
+   size_t offset = 0;
    for (const auto& column : table.columns) {
       int integer = 0;
       switch (column.type.tclass) {
          case schema::Type::Class::kInteger:
-            integer = *reinterpret_cast<int*>(current);
+            if (offset + sizeof(integer) > record.size()) {
+               break;
+            }
+            std::memcpy(&integer, record.data() + offset, sizeof(integer));
             std::cout << integer;
-            current += sizeof(int);
+            offset += sizeof(integer);
             break;
          case schema::Type::Class::kChar:
-            for (size_t j = 0; j < column.type.length; ++j) {
-               std::cout << *current;
-               ++current;
+            if (offset + column.type.length > record.size()) {
+               break;
             }
+            std::cout.write(reinterpret_cast<const char*>(record.data() + offset), column.type.length);
+            offset += column.type.length;
             break;
       }
-      if (std::distance(read_buffer.data(), current) > read_bytes) {
+      if (offset >= record.size()) {
          break;
       }
       std::cout << " | ";
@@ -85,9 +237,8 @@ void simpledb::Database::read_tuple(const simpledb::schema::Table& table, simple
 }
 
 void simpledb::Database::load_schema(int16_t schema) {
-   if (schema_segment) {
-      schema_segment->write();
-   }
-   schema_segment = std::make_unique<SchemaSegment>(schema, buffer_manager);
+   close_tables();
+   schema_segment = std::make_unique<SchemaSegment>(schema, get_buffer_manager(schema));
    schema_segment->read();
+   open_tables();
 }
@@ -1,4 +1,6 @@
 #include "simpledb/segment.h"
+#include <algorithm>
+#include <atomic>
 #include <cmath>
 
 using FSISegment = simpledb::FSISegment;
@@ -8,10 +10,25 @@ FSISegment::FSISegment(uint16_t segment_id, BufferManager& buffer_manager, schem
      linear_factor{static_cast<uint32_t>(buffer_manager.get_page_size() / 16) + 1},
      log_factor{log2f(static_cast<float>(buffer_manager.get_page_size())) / 8.0f},
      free_cache(), table(table) {
-   free_cache.fill(invalidPid);
+   for (auto& entry : free_cache) {
+      entry.store(invalidPid, std::memory_order_relaxed);
+   }
+
+   // take the saved cache if it fits the table, it was correct when it was saved
+   auto saved = table.free_cache.size() == free_cache.size() && std::all_of(table.free_cache.begin(), table.free_cache.end(), [&](uint64_t pageIndex) {
+      return pageIndex == invalidPid || pageIndex < table.allocated_pages;
+   });
+   if (saved) {
+      for (size_t i = 0; i < free_cache.size(); ++i) {
+         free_cache[i].store(table.free_cache[i], std::memory_order_relaxed);
+      }
+      return;
+   }
 
    // initialize cache
    uint64_t curPageIndex = 0;
+   uint64_t fsiPageCount = (table.allocated_pages + buffer_manager.get_page_size() * 2 - 1) / (buffer_manager.get_page_size() * 2);
+   buffer_manager.prefetch(static_cast<uint64_t>(segment_id) << 48, fsiPageCount);
 
    while (curPageIndex < table.allocated_pages) {
       auto& bf = buffer_manager.fix_page((static_cast<uint64_t>(segment_id) << 48) ^
@@ -25,7 +42,7 @@ FSISegment::FSISegment(uint16_t segment_id, BufferManager& buffer_manager, schem
          uint8_t upper = *reinterpret_cast<uint8_t*>(bf.get_data() + fsiOffset) >> 4;
          //assert(upper == encode_free_space(reinterpret_cast<SlottedPage*>(buffer_manager.fix_page((static_cast<uint64_t>(table.sp_segment) << 48) ^ curPageIndex, false).get_data())->get_free_space()));
          if (free_cache[upper] == invalidPid)
-            free_cache[upper] = curPageIndex;
+            free_cache[upper].store(curPageIndex, std::memory_order_relaxed);
          curPageIndex++;
          if (curPageIndex == table.allocated_pages)
             break;
@@ -34,7 +51,7 @@ FSISegment::FSISegment(uint16_t segment_id, BufferManager& buffer_manager, schem
          uint8_t lower = *reinterpret_cast<uint8_t*>(bf.get_data() + fsiOffset) & 0b00001111;
          //assert(lower == encode_free_space(reinterpret_cast<SlottedPage*>(buffer_manager.fix_page((static_cast<uint64_t>(table.sp_segment) << 48) ^ curPageIndex, false).get_data())->get_free_space()));
          if (free_cache[lower] == invalidPid)
-            free_cache[lower] = curPageIndex;
+            free_cache[lower].store(curPageIndex, std::memory_order_relaxed);
          curPageIndex++;
          if (curPageIndex == table.allocated_pages)
             break;
@@ -46,6 +63,17 @@ FSISegment::FSISegment(uint16_t segment_id, BufferManager& buffer_manager, schem
    }
 }
 
+FSISegment::~FSISegment() {
+   save_free_cache();
+}
+
+void FSISegment::save_free_cache() {
+   table.free_cache.resize(free_cache.size());
+   for (size_t i = 0; i < free_cache.size(); ++i) {
+      table.free_cache[i] = free_cache[i].load(std::memory_order_relaxed);
+   }
+}
+
 uint8_t FSISegment::encode_free_space(uint32_t free_space) const {
    if (free_space < buffer_manager.get_page_size() / 2) {
       // use logarithmic
@@ -68,9 +96,10 @@ uint32_t FSISegment::decode_free_space(uint8_t free_space) const {
 }
 
 void FSISegment::update_free_cache(uint64_t pageIndex, uint8_t freeSpace) {
+   // concurrent updates may leave an entry behind, they are only hints that find() callers check
    uint8_t prevFreeSpace = 16;
    for (uint8_t i = 0; i < 16; ++i) {
-      if (free_cache[i] == pageIndex) {
+      if (free_cache[i].load(std::memory_order_relaxed) == pageIndex) {
          if (i != freeSpace) {
             // we will have to find a new cache entry for the old index
             prevFreeSpace = i;
@@ -79,62 +108,45 @@ void FSISegment::update_free_cache(uint64_t pageIndex, uint8_t freeSpace) {
       }
    }
 
-   // set new free cache
-   if (free_cache[freeSpace] == invalidPid || pageIndex < free_cache[freeSpace]) {
-      free_cache[freeSpace] = pageIndex;
+   // set new free cache, the earliest page wins
+   auto entry = free_cache[freeSpace].load(std::memory_order_relaxed);
+   while (entry == invalidPid || pageIndex < entry) {
+      if (free_cache[freeSpace].compare_exchange_weak(entry, pageIndex, std::memory_order_relaxed))
+         break;
    }
 
    // check old entry
    if (prevFreeSpace < 16) {
       // find the earliest page with same free space as prevFreeSpace
+      auto replacement = invalidPid;
+      auto allocatedPages = std::atomic_ref(table.allocated_pages).load();
 
       // since this page was the earliest entry before we can start the search at one page after this
       uint64_t curPageIndex = pageIndex + 1;
 
-      while (curPageIndex < table.allocated_pages) {
+      while (curPageIndex < allocatedPages && replacement == invalidPid) {
          uint64_t fsiIndex = curPageIndex / (buffer_manager.get_page_size() * 2);
          uint64_t fsiOffset = curPageIndex % (buffer_manager.get_page_size() * 2);
          auto& bf = buffer_manager.fix_page((static_cast<uint64_t>(segment_id) << 48) ^ fsiIndex, false);
-         bool found = false;
 
          // scan over bitmap page
-         while (fsiOffset < buffer_manager.get_page_size() * 2) {
-            if (fsiOffset % 2 == 0) {
-               // check upper
-               uint8_t upper = *reinterpret_cast<uint8_t*>(bf.get_data() + fsiOffset / 2) >> 4;
-               if (upper == prevFreeSpace) {
-                  // found
-                  free_cache[prevFreeSpace] = curPageIndex;
-                  found = true;
-                  break;
-               }
-               curPageIndex++;
-               if (curPageIndex == table.allocated_pages) break;
-            } else {
-               // check lower
-               uint8_t lower = *reinterpret_cast<uint8_t*>(bf.get_data() + fsiOffset / 2) & 0b00001111;
-               if (lower == prevFreeSpace) {
-                  // found
-                  free_cache[prevFreeSpace] = curPageIndex;
-                  found = true;
-                  break;
-               }
-               curPageIndex++;
-               if (curPageIndex == table.allocated_pages) break;
+         for (; fsiOffset < buffer_manager.get_page_size() * 2 && curPageIndex < allocatedPages; ++fsiOffset, ++curPageIndex) {
+            auto byte = *reinterpret_cast<uint8_t*>(bf.get_data() + fsiOffset / 2);
+            // upper nibble for even, lower nibble for odd pages
+            if ((fsiOffset % 2 == 0 ? byte >> 4 : byte & 0b00001111) == prevFreeSpace) {
+               // found
+               replacement = curPageIndex;
+               break;
             }
-
-            fsiOffset++;
          }
 
          buffer_manager.unfix_page(bf, false);
-
-         if (found) {
-            return;
-         }
       }
 
-      // there is no other free page with this exact amount of free memory
-      free_cache[prevFreeSpace] = invalidPid;
+      // invalid if there is no other free page with this exact amount of free memory,
+      // another update may have replaced the entry already
+      auto expected = pageIndex;
+      free_cache[prevFreeSpace].compare_exchange_strong(expected, replacement, std::memory_order_relaxed);
    }
 }
 
@@ -164,9 +176,9 @@ std::optional<uint64_t> FSISegment::find(uint32_t required_space) {
 
    // search cache
    while (ci < 16) {
-      if (free_cache[ci] != invalidPid) {
+      if (auto pageIndex = free_cache[ci].load(std::memory_order_relaxed); pageIndex != invalidPid) {
          // found page with enough free space
-         return {free_cache[ci]};
+         return {pageIndex};
       }
       ci++;
    }
@@ -13,15 +13,23 @@ set(
 
 set(
         SRC_CC
+        src/async_file.cc
         src/buffer_manager.cc
+        src/compression.cc
         src/database.cc
         src/fsi_segment.cc
         src/hex_dump.cc
+        src/mapped_file.cc
+        src/metrics.cc
+        src/pax_page.cc
+        src/pax_segment.cc
         src/posix_file.cc
+        src/schema_json.cc
         src/schema_segment.cc
         src/schema.cc
         src/slotted_page.cc
         src/sp_segment.cc
+        src/wal.cc
 )
 
 # Gather lintable files
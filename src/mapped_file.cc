@@ -0,0 +1,108 @@
+#include "simpledb/file.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace simpledb {
+
+namespace {
+
+[[noreturn]] void throw_errno(int error = errno) {
+   throw std::system_error{error, std::system_category()};
+}
+
+} // namespace
+
+MappedFile::MappedFile(const char* filename) : file_size(0), mapping(nullptr) {
+   fd = ::open(filename, O_RDONLY | O_CLOEXEC);
+   if (fd < 0) {
+      throw_errno();
+   }
+
+   struct ::stat file_stat = {};
+   if (::fstat(fd, &file_stat) < 0) {
+      auto error = errno;
+      ::close(fd);
+      throw_errno(error);
+   }
+   file_size = file_stat.st_size;
+
+   // empty files can't be mapped
+   if (file_size > 0) {
+      void* addr = ::mmap(nullptr, file_size, PROT_READ, MAP_SHARED, fd, 0);
+      if (addr == MAP_FAILED) {
+         auto error = errno;
+         ::close(fd);
+         throw_errno(error);
+      }
+      mapping = static_cast<char*>(addr);
+   }
+}
+
+MappedFile::~MappedFile() {
+   if (mapping) {
+      ::munmap(mapping, file_size);
+   }
+   ::close(fd);
+}
+
+void MappedFile::resize(size_t /*new_size*/) {
+   throw_errno(EBADF);
+}
+
+void MappedFile::read_block(size_t offset, size_t size, char* block) {
+   // like pread(), stop at the end of the file
+   if (offset < file_size) {
+      std::memcpy(block, mapping + offset, std::min(size, file_size - offset));
+   }
+}
+
+void MappedFile::write_block(const char* /*block*/, size_t /*offset*/, size_t /*size*/) {
+   throw_errno(EBADF);
+}
+
+void MappedFile::submit(std::span<const IoRequest> requests) {
+   for (const auto& request : requests) {
+      if (request.kind == IoRequest::WRITE) {
+         throw_errno(EBADF);
+      }
+   }
+   File::submit(requests);
+}
+
+void MappedFile::advise(Advice advice, size_t offset, size_t size) {
+   if (offset >= file_size) {
+      return;
+   }
+   size = std::min(size, file_size - offset);
+
+   // the range has to start at a page boundary
+   auto page_size = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+   auto begin = offset & ~(page_size - 1);
+
+   int flag = MADV_NORMAL;
+   switch (advice) {
+      case NORMAL:
+         flag = MADV_NORMAL;
+         break;
+      case SEQUENTIAL:
+         flag = MADV_SEQUENTIAL;
+         break;
+      case RANDOM:
+         flag = MADV_RANDOM;
+         break;
+      case WILLNEED:
+         flag = MADV_WILLNEED;
+         break;
+   }
+   if (::madvise(mapping + begin, offset + size - begin, flag) < 0) {
+      throw_errno();
+   }
+}
+
+}
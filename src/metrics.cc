@@ -0,0 +1,179 @@
+#include "simpledb/metrics.h"
+#include <algorithm>
+#include <bit>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <unordered_set>
+
+namespace simpledb::metrics {
+
+namespace {
+
+using detail::SegmentChunk;
+using detail::ThreadCounters;
+
+constexpr const char* kCounterNames[] = {
+   "page_hits",
+   "page_misses",
+   "promotions",
+   "clean_evictions",
+   "dirty_evictions",
+   "buffer_full_errors",
+   "bytes_read",
+   "bytes_written",
+   "btree_splits",
+   "btree_restarts",
+};
+static_assert(std::size(kCounterNames) == kCounterCount);
+
+constexpr const char* kLatchNames[] = {"page", "list", "page_table"};
+static_assert(std::size(kLatchNames) == kLatchKindCount);
+
+/// Adds the counters of a thread to a snapshot.
+void accumulate(Snapshot& snapshot, const ThreadCounters& counters) {
+   for (size_t i = 0; i < kCounterCount; ++i) {
+      snapshot.counters[i] += counters.counters[i].load(std::memory_order_relaxed);
+   }
+   for (size_t kind = 0; kind < kLatchKindCount; ++kind) {
+      for (size_t i = 0; i < kWaitBuckets; ++i) {
+         snapshot.latch_waits[kind][i] += counters.waits[kind][i].load(std::memory_order_relaxed);
+      }
+   }
+   for (size_t c = 0; c < counters.segments.size(); ++c) {
+      auto* chunk = counters.segments[c].load(std::memory_order_acquire);
+      for (size_t i = 0; chunk && i < chunk->counters.size(); ++i) {
+         auto hits = chunk->counters[i][0].load(std::memory_order_relaxed);
+         auto misses = chunk->counters[i][1].load(std::memory_order_relaxed);
+         if (hits || misses) {
+            auto& segment = snapshot.segments[static_cast<uint16_t>(c << 8 | i)];
+            segment.hits += hits;
+            segment.misses += misses;
+         }
+      }
+   }
+}
+
+/// Knows the counters of all threads.
+class Registry {
+   private:
+   std::mutex latch;
+   std::unordered_set<ThreadCounters*> threads;
+   /// The sum of the counters of the threads that exited.
+   Snapshot exited;
+
+   public:
+   static Registry& get() {
+      // never destroyed, threads may exit after static destructors ran
+      static auto* registry = new Registry();
+      return *registry;
+   }
+
+   void add(ThreadCounters* counters) {
+      std::unique_lock lock(latch);
+      threads.insert(counters);
+   }
+
+   void remove(ThreadCounters* counters) {
+      std::unique_lock lock(latch);
+      accumulate(exited, *counters);
+      threads.erase(counters);
+   }
+
+   Snapshot snapshot() {
+      std::unique_lock lock(latch);
+      auto result = exited;
+      for (auto* counters : threads) {
+         accumulate(result, *counters);
+      }
+      return result;
+   }
+};
+
+/// Registers the counters of a thread while it runs.
+struct ThreadSlot {
+   ThreadCounters counters;
+
+   ThreadSlot() { Registry::get().add(&counters); }
+
+   ThreadSlot(const ThreadSlot&) = delete;
+   ThreadSlot(ThreadSlot&&) = delete;
+   ThreadSlot& operator=(const ThreadSlot&) = delete;
+   ThreadSlot& operator=(ThreadSlot&&) = delete;
+
+   ~ThreadSlot() {
+      Registry::get().remove(&counters);
+      for (auto& chunk : counters.segments) {
+         delete chunk.load(std::memory_order_relaxed);
+      }
+   }
+};
+
+} // namespace
+
+namespace detail {
+
+ThreadCounters& local() {
+   thread_local ThreadSlot slot;
+   return slot.counters;
+}
+
+SegmentChunk& allocate_chunk(ThreadCounters& counters, uint16_t segment_id) {
+   auto* chunk = new SegmentChunk();
+   // published for snapshots, which only read it
+   counters.segments[segment_id >> 8].store(chunk, std::memory_order_release);
+   return *chunk;
+}
+
+void count_wait(LatchKind kind, std::chrono::steady_clock::duration wait) {
+   auto ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(wait).count());
+   auto bucket = std::min<size_t>(ns == 0 ? 0 : std::bit_width(ns) - 1, kWaitBuckets - 1);
+   add(local().waits[static_cast<size_t>(kind)][bucket], 1);
+}
+
+} // namespace detail
+
+Snapshot Snapshot::operator-(const Snapshot& earlier) const {
+   auto result = *this;
+   for (size_t i = 0; i < kCounterCount; ++i) {
+      result.counters[i] -= earlier.counters[i];
+   }
+   for (size_t kind = 0; kind < kLatchKindCount; ++kind) {
+      for (size_t i = 0; i < kWaitBuckets; ++i) {
+         result.latch_waits[kind][i] -= earlier.latch_waits[kind][i];
+      }
+   }
+   for (const auto& [id, segment] : earlier.segments) {
+      auto& counters = result.segments[id];
+      counters.hits -= segment.hits;
+      counters.misses -= segment.misses;
+      if (counters.hits == 0 && counters.misses == 0) {
+         result.segments.erase(id);
+      }
+   }
+   return result;
+}
+
+void Snapshot::print(std::ostream& out) const {
+   for (size_t i = 0; i < kCounterCount; ++i) {
+      if (counters[i]) {
+         out << kCounterNames[i] << " " << counters[i] << "\n";
+      }
+   }
+   for (const auto& [id, segment] : segments) {
+      out << "segment " << id << " hits " << segment.hits << " misses " << segment.misses << "\n";
+   }
+   for (size_t kind = 0; kind < kLatchKindCount; ++kind) {
+      for (size_t i = 0; i < kWaitBuckets; ++i) {
+         if (latch_waits[kind][i]) {
+            out << kLatchNames[kind] << "_latch_waits_ns_ge_" << (1ull << i) << " " << latch_waits[kind][i] << "\n";
+         }
+      }
+   }
+}
+
+Snapshot snapshot() {
+   return Registry::get().snapshot();
+}
+
+}
@@ -0,0 +1,132 @@
+#include "simpledb/pax_page.h"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+using simpledb::PaxPage;
+
+namespace {
+
+/// Minipages start at cache line boundaries.
+constexpr uint32_t align(uint32_t offset) {
+   return (offset + 63) & ~63u;
+}
+
+}
+
+PaxPage::Layout::Layout(const schema::Table& table, uint32_t page_size)
+   : erased_offset(0), record_width(0), capacity(0) {
+   for (const auto& column : table.columns) {
+      widths.push_back(get_width(column.type));
+      record_offsets.push_back(record_width);
+      record_width += widths.back();
+   }
+   assert(record_width > 0 && "a table without columns doesn't need pages");
+
+   // every record needs its values and a bit, the alignment of the minipages may cost a few records
+   auto size = [&](uint32_t records) {
+      uint32_t end = align(sizeof(Header)) + align((records + 63) / 64 * sizeof(uint64_t));
+      for (auto width : widths) {
+         end += align(records * width);
+      }
+      return end;
+   };
+   capacity = std::min<uint32_t>(page_size * 8 / (record_width * 8 + 1), 0xFFFF);
+   while (capacity > 0 && size(capacity) > page_size) {
+      --capacity;
+   }
+
+   erased_offset = align(sizeof(Header));
+   auto offset = erased_offset + align((capacity + 63) / 64 * sizeof(uint64_t));
+   for (auto width : widths) {
+      offsets.push_back(offset);
+      offset += align(capacity * width);
+   }
+}
+
+uint32_t PaxPage::Layout::get_width(const schema::Type& type) {
+   switch (type.tclass) {
+      case schema::Type::Class::kInteger: return sizeof(int32_t);
+      case schema::Type::Class::kChar: return type.length;
+   }
+   return 0;
+}
+
+PaxPage::PaxPage(const Layout& layout)
+   : header{0, 0} {
+   // the minipages are only read up to the record count, the bitmap has to be clear
+   std::memset(get_data() + layout.erased_offset, 0x00, layout.offsets.empty() ? 0 : layout.offsets.front() - layout.erased_offset);
+}
+
+uint32_t PaxPage::append(const Layout& layout, const std::byte* record) {
+   assert(!is_full(layout));
+   auto record_id = header.record_count++;
+   for (size_t column = 0; column < layout.widths.size(); ++column) {
+      auto width = layout.widths[column];
+      std::memcpy(get_column(layout, column) + record_id * width, record + layout.record_offsets[column], width);
+   }
+   return record_id;
+}
+
+uint32_t PaxPage::read(const Layout& layout, uint32_t record_id, std::byte* record, uint32_t capacity) const {
+   assert(record_id < header.record_count);
+   if (is_erased(layout, record_id))
+      return 0;
+
+   auto size = std::min(capacity, layout.record_width);
+   for (size_t column = 0; column < layout.widths.size() && layout.record_offsets[column] < size; ++column) {
+      auto width = std::min(layout.widths[column], size - layout.record_offsets[column]);
+      std::memcpy(record + layout.record_offsets[column], get_column(layout, column) + record_id * layout.widths[column], width);
+   }
+   return size;
+}
+
+void PaxPage::erase(const Layout& layout, uint32_t record_id) {
+   assert(record_id < header.record_count && !is_erased(layout, record_id));
+   auto* erased = reinterpret_cast<uint64_t*>(get_data() + layout.erased_offset);
+   erased[record_id / 64] |= 1ull << (record_id % 64);
+   ++header.erased_count;
+}
+
+void simpledb::filter_between(const int32_t* values, size_t count, int32_t low, int32_t high, uint64_t* selection) {
+   std::fill(selection, selection + (count + 63) / 64, 0);
+   size_t i = 0;
+#if defined(__AVX512F__)
+   auto lowVector = _mm512_set1_epi32(low);
+   auto highVector = _mm512_set1_epi32(high);
+   for (; i + 16 <= count; i += 16) {
+      auto v = _mm512_loadu_si512(values + i);
+      auto matches = static_cast<uint64_t>(_mm512_mask_cmple_epi32_mask(_mm512_cmpge_epi32_mask(v, lowVector), v, highVector));
+      selection[i / 64] |= matches << (i % 64);
+   }
+#elif defined(__AVX2__)
+   auto lowVector = _mm256_set1_epi32(low);
+   auto highVector = _mm256_set1_epi32(high);
+   for (; i + 8 <= count; i += 8) {
+      auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i));
+      // AVX2 only compares for greater, so collect the values outside of the range
+      auto outside = _mm256_or_si256(_mm256_cmpgt_epi32(lowVector, v), _mm256_cmpgt_epi32(v, highVector));
+      auto matches = static_cast<uint64_t>(~_mm256_movemask_ps(_mm256_castsi256_ps(outside)) & 0xFF);
+      selection[i / 64] |= matches << (i % 64);
+   }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+   auto lowVector = vdupq_n_s32(low);
+   auto highVector = vdupq_n_s32(high);
+   const uint32_t bits[4] = {1, 2, 4, 8};
+   auto bitVector = vld1q_u32(bits);
+   for (; i + 4 <= count; i += 4) {
+      auto v = vld1q_s32(values + i);
+      // every lane that matches is all ones, keep one bit of it at the lane's position
+      auto matches = vandq_u32(vandq_u32(vcgeq_s32(v, lowVector), vcleq_s32(v, highVector)), bitVector);
+      selection[i / 64] |= static_cast<uint64_t>(vaddvq_u32(matches)) << (i % 64);
+   }
+#endif
+   for (; i < count; ++i) {
+      selection[i / 64] |= static_cast<uint64_t>(low <= values[i] && values[i] <= high) << (i % 64);
+   }
+}
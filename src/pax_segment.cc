@@ -0,0 +1,121 @@
+#include "simpledb/pax_page.h"
+#include "simpledb/segment.h"
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cassert>
+#include <vector>
+
+using simpledb::PAXSegment;
+using simpledb::PaxPage;
+using simpledb::TID;
+
+PAXSegment::PAXSegment(uint16_t segment_id, BufferManager& buffer_manager, schema::Table& table)
+   : Segment(segment_id, buffer_manager), table(table), layout(table, buffer_manager.get_page_size()) {
+   assert(layout.capacity > 0 && "a record has to fit on a page");
+}
+
+simpledb::BufferFrame& PAXSegment::fix_last_page(uint64_t& page_index) {
+   std::atomic_ref allocatedPages(table.allocated_pages);
+   while (true) {
+      auto pageCount = allocatedPages.load();
+      if (pageCount > 0) {
+         page_index = pageCount - 1;
+         auto& bf = buffer_manager.fix_page((static_cast<uint64_t>(segment_id) << 48) ^ page_index, true);
+         if (!reinterpret_cast<PaxPage*>(bf.get_data())->is_full(layout))
+            return bf;
+         buffer_manager.unfix_page(bf, false);
+      }
+
+      // the new page is fixed before it is published, so nobody sees it uninitialized
+      page_index = pageCount;
+      auto& bf = buffer_manager.fix_page((static_cast<uint64_t>(segment_id) << 48) ^ page_index, true);
+      if (allocatedPages.compare_exchange_strong(pageCount, pageCount + 1)) {
+         new (bf.get_data()) PaxPage(layout);
+         return bf;
+      }
+      // another thread appended a page in the meantime
+      buffer_manager.unfix_page(bf, false);
+   }
+}
+
+TID PAXSegment::insert(std::span<const std::byte> record) {
+   return insert_batch({&record, 1}).front();
+}
+
+std::vector<TID> PAXSegment::insert_batch(std::span<const std::span<const std::byte>> records) {
+   std::vector<TID> tids;
+   tids.reserve(records.size());
+   for (size_t i = 0; i < records.size();) {
+      uint64_t pageIndex;
+      auto& bf = fix_last_page(pageIndex);
+      auto page = reinterpret_cast<PaxPage*>(bf.get_data());
+
+      // fill the page with as many of the following records as fit
+      do {
+         assert(records[i].size() == layout.record_width && "PAX records have a fixed width");
+         tids.emplace_back(pageIndex, page->append(layout, records[i].data()));
+         ++i;
+      } while (i < records.size() && !page->is_full(layout));
+      buffer_manager.unfix_page(bf, true);
+   }
+   return tids;
+}
+
+uint32_t PAXSegment::read(TID tid, std::byte* record, uint32_t capacity) const {
+   auto& bf = buffer_manager.fix_page(tid.get_page_id(segment_id), false);
+   auto page = reinterpret_cast<const PaxPage*>(bf.get_data());
+   auto size = page->read(layout, tid.get_slot(), record, capacity);
+   buffer_manager.unfix_page(bf, false);
+   return size;
+}
+
+void PAXSegment::erase(TID tid) {
+   auto& bf = buffer_manager.fix_page(tid.get_page_id(segment_id), true);
+   auto page = reinterpret_cast<PaxPage*>(bf.get_data());
+   page->erase(layout, tid.get_slot());
+   buffer_manager.unfix_page(bf, true);
+}
+
+void PAXSegment::scan(std::span<const size_t> columns, const std::function<bool(const ColumnBatch&)>& callback) const {
+   ColumnBatch batch;
+   batch.columns.resize(columns.size());
+   auto pageCount = std::atomic_ref(table.allocated_pages).load();
+   for (uint64_t pageIndex = 0; pageIndex < pageCount; ++pageIndex) {
+      if (pageIndex % SPSegment::kScanPrefetchPages == 0) {
+         // keep the next window of pages loading while this one is read
+         auto from = pageIndex == 0 ? 0 : pageIndex + SPSegment::kScanPrefetchPages;
+         auto to = std::min(pageIndex + 2 * SPSegment::kScanPrefetchPages, pageCount);
+         if (from < to)
+            buffer_manager.prefetch((static_cast<uint64_t>(segment_id) << 48) ^ from, to - from, AccessHint::SEQUENTIAL_ONCE);
+      }
+
+      // a scan must not push the pages of other queries out
+      auto& bf = buffer_manager.fix_page((static_cast<uint64_t>(segment_id) << 48) ^ pageIndex, false, AccessHint::SEQUENTIAL_ONCE);
+      auto page = reinterpret_cast<const PaxPage*>(bf.get_data());
+      batch.page_index = pageIndex;
+      batch.record_count = page->header.record_count;
+      batch.erased = page->get_erased(layout);
+      for (size_t i = 0; i < columns.size(); ++i) {
+         batch.columns[i] = page->get_column(layout, columns[i]);
+      }
+      auto proceed = callback(batch);
+      buffer_manager.unfix_page(bf, false);
+      if (!proceed)
+         return;
+   }
+}
+
+uint64_t PAXSegment::count_between(size_t column, int32_t low, int32_t high) const {
+   assert(table.columns[column].type.tclass == schema::Type::kInteger && "only integer columns can be filtered");
+   uint64_t count = 0;
+   std::vector<uint64_t> selection((layout.capacity + 63) / 64);
+   scan({&column, 1}, [&](const ColumnBatch& batch) {
+      filter_between(batch.get_values<int32_t>(0), batch.record_count, low, high, selection.data());
+      for (size_t word = 0; word < (batch.record_count + 63) / 64; ++word) {
+         count += std::popcount(selection[word] & ~batch.erased[word]);
+      }
+      return true;
+   });
+   return count;
+}
@@ -1,7 +1,11 @@
 #include "simpledb/file.h"
+#include "simpledb/metrics.h"
+#include <algorithm>
 #include <cerrno>
+#include <climits>
 #include <memory>
 #include <system_error>
+#include <vector>
 #include <fcntl.h>
 #include <stdlib.h> // NOLINT
 #include <sys/stat.h>
@@ -31,10 +35,10 @@ PosixFile::PosixFile(Mode mode, int fd, size_t size) : mode(mode), fd(fd), cache
 PosixFile::PosixFile(const char* filename, Mode mode) : mode(mode) {
    switch (mode) {
       case READ:
-         fd = ::open(filename, O_RDONLY | O_SYNC | O_CLOEXEC);
+         fd = ::open(filename, O_RDONLY | O_CLOEXEC);
          break;
       case WRITE:
-         fd = ::open(filename, O_RDWR | O_CREAT | O_SYNC | O_CLOEXEC, 0666);
+         fd = ::open(filename, O_RDWR | O_CREAT | O_CLOEXEC, 0666);
    }
    if (fd < 0) {
       throw_errno();
@@ -67,6 +71,19 @@ void PosixFile::resize(size_t new_size) {
    cached_size = new_size;
 }
 
+void PosixFile::discard(size_t offset, size_t size) {
+   if (size == 0) {
+      return;
+   }
+   if (::fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, static_cast<off_t>(offset), static_cast<off_t>(size)) < 0) {
+      // the data is still correct, only the disk space isn't freed
+      if (errno == EOPNOTSUPP || errno == ENOSYS) {
+         return;
+      }
+      throw_errno();
+   }
+}
+
 void PosixFile::read_block(size_t offset, size_t size, char* block) {
    size_t total_bytes_read = 0;
    while (total_bytes_read < size) {
@@ -84,6 +101,7 @@ void PosixFile::read_block(size_t offset, size_t size, char* block) {
          throw_errno();
       }
       total_bytes_read += static_cast<size_t>(bytes_read);
+      metrics::count(metrics::Counter::BYTES_READ, static_cast<uint64_t>(bytes_read));
    }
 }
 
@@ -104,6 +122,75 @@ void PosixFile::write_block(const char* block, size_t offset, size_t size) {
          throw_errno();
       }
       total_bytes_written += static_cast<size_t>(bytes_written);
+      metrics::count(metrics::Counter::BYTES_WRITTEN, static_cast<uint64_t>(bytes_written));
+   }
+}
+
+void PosixFile::sync() {
+   if (::fdatasync(fd) < 0) {
+      throw_errno();
+   }
+}
+
+void PosixFile::transfer(const IoRequest& request, size_t transferred) const {
+   size_t total_size = 0;
+   for (const auto& buffer : request.buffers) {
+      total_size += buffer.iov_len;
+   }
+
+   std::vector<::iovec> remaining;
+   while (transferred < total_size) {
+      // skip the buffers that are done already
+      size_t first = 0;
+      size_t skip = transferred;
+      while (skip >= request.buffers[first].iov_len) {
+         skip -= request.buffers[first].iov_len;
+         ++first;
+      }
+      const auto* buffers = &request.buffers[first];
+      auto count = static_cast<int>(std::min<size_t>(request.buffers.size() - first, IOV_MAX));
+      if (skip > 0) {
+         remaining.assign(buffers, buffers + count);
+         remaining[0].iov_base = static_cast<char*>(remaining[0].iov_base) + skip;
+         remaining[0].iov_len -= skip;
+         buffers = remaining.data();
+      }
+
+      ssize_t bytes = request.kind == IoRequest::READ ?
+         ::preadv(fd, buffers, count, static_cast<off_t>(request.offset + transferred)) :
+         ::pwritev(fd, buffers, count, static_cast<off_t>(request.offset + transferred));
+      if (bytes == 0) {
+         // end of file, see read_block() and write_block()
+         return;
+      }
+      if (bytes < 0) {
+         if (errno == EINTR) {
+            continue;
+         }
+         throw_errno();
+      }
+      transferred += static_cast<size_t>(bytes);
+      metrics::count(request.kind == IoRequest::READ ? metrics::Counter::BYTES_READ : metrics::Counter::BYTES_WRITTEN, static_cast<uint64_t>(bytes));
+   }
+}
+
+void PosixFile::submit(std::span<const IoRequest> requests) {
+   for (const auto& request : requests) {
+      transfer(request);
+   }
+}
+
+void File::submit(std::span<const IoRequest> requests) {
+   for (const auto& request : requests) {
+      auto offset = request.offset;
+      for (const auto& buffer : request.buffers) {
+         if (request.kind == IoRequest::READ) {
+            read_block(offset, buffer.iov_len, static_cast<char*>(buffer.iov_base));
+         } else {
+            write_block(static_cast<const char*>(buffer.iov_base), offset, buffer.iov_len);
+         }
+         offset += buffer.iov_len;
+      }
    }
 }
 
@@ -1,5 +1,6 @@
 #include "simpledb/schema.h"
 
+using Table = simpledb::schema::Table;
 using Type = simpledb::schema::Type;
 
 Type Type::Integer() {
@@ -22,3 +23,11 @@ const char* Type::name() const {
       default: return "unknown";
    }
 }
+
+const char* Table::layout_name() const {
+   switch (layout) {
+      case kRows: return "rows";
+      case kPax: return "pax";
+      default: return "unknown";
+   }
+}
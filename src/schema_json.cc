@@ -0,0 +1,147 @@
+#include "rapidjson/document.h"
+#include "rapidjson/stringbuffer.h"
+#include "rapidjson/writer.h"
+#include "simpledb/schema.h"
+#include <unordered_map>
+
+using Schema = simpledb::schema::Schema;
+using Type = simpledb::schema::Type;
+using Table = simpledb::schema::Table;
+using Column = simpledb::schema::Column;
+
+namespace json = rapidjson;
+
+namespace {
+
+// NOLINTNEXTLINE
+const std::unordered_map<std::string, Type::Class> types{
+   {"char", Type::kChar},
+   {"integer", Type::kInteger},
+};
+
+// NOLINTNEXTLINE
+const std::unordered_map<std::string, Table::Layout> layouts{
+   {"rows", Table::kRows},
+   {"pax", Table::kPax},
+};
+
+} // namespace
+
+std::unique_ptr<Schema> Schema::from_json(std::string_view json) {
+   json::Document document;
+   document.Parse(json.data(), json.size());
+
+   // Parse the schema
+   std::vector<Table> tables;
+   if (document.IsObject() && document.HasMember("tables") && document["tables"].IsArray()) {
+      for (auto& table : document["tables"].GetArray()) {
+         const auto* id = table.HasMember("id") ? table["id"].GetString() : "?";
+         auto sp_segment = table.HasMember("sp_segment") ? table["sp_segment"].GetInt() : -1;
+         auto fsi_segment = table.HasMember("fsi_segment") ? table["fsi_segment"].GetInt() : -1;
+         auto allocated_pages = table.HasMember("allocated_pages") ? table["allocated_pages"].GetInt() : -1;
+         auto layout = Table::kRows;
+         if (table.HasMember("layout")) {
+            auto iter = layouts.find(table["layout"].GetString());
+            if (iter != layouts.end()) {
+               layout = iter->second;
+            }
+         }
+         std::vector<Column> columns;
+         if (table.HasMember("columns") && table["columns"].IsArray()) {
+            for (auto& col : table["columns"].GetArray()) {
+               std::string id = col.HasMember("id") ? col["id"].GetString() : "?";
+               Type t;
+               if (col.HasMember("type")) {
+                  auto type = col["type"].GetObject();
+                  t.length = type.HasMember("length") ? type["length"].GetInt() : 0;
+                  t.tclass = Type::Class::kInteger;
+                  if (type.HasMember("tclass")) {
+                     auto iter = types.find(type["tclass"].GetString());
+                     if (iter != types.end()) {
+                        t.tclass = iter->second;
+                     }
+                  }
+               }
+               columns.emplace_back(id, t);
+            }
+         }
+         std::vector<std::string> primary_key;
+         if (table.HasMember("primary_key") && table["primary_key"].IsArray()) {
+            for (auto& pk : table["primary_key"].GetArray()) {
+               primary_key.emplace_back(pk.GetString());
+            }
+         }
+         tables.emplace_back(id, std::move(columns), std::move(primary_key), sp_segment, fsi_segment, allocated_pages, layout);
+         if (table.HasMember("free_cache") && table["free_cache"].IsArray()) {
+            for (auto& entry : table["free_cache"].GetArray()) {
+               tables.back().free_cache.push_back(entry.GetUint64());
+            }
+         }
+      }
+   }
+   return std::make_unique<Schema>(std::move(tables));
+}
+
+std::string Schema::to_json() const {
+   // Prepare document
+   json::Document doc(json::kObjectType);
+   auto& allocator = doc.GetAllocator();
+
+   // Write tables
+   json::Value json_tables(json::kArrayType);
+   for (const auto& table : tables) {
+      json::Value t(json::kObjectType);
+
+      // id
+      t.AddMember("id", json::StringRef(table.id.c_str()), allocator);
+      // sp_segment
+      t.AddMember("sp_segment", table.sp_segment, allocator);
+      // fsi_segment
+      t.AddMember("fsi_segment", table.fsi_segment, allocator);
+      // allocated_pages
+      t.AddMember("allocated_pages", table.allocated_pages, allocator);
+      // layout
+      t.AddMember("layout", json::StringRef(table.layout_name()), allocator);
+      // free_cache
+      json::Value free_cache(json::kArrayType);
+      for (auto entry : table.free_cache) {
+         free_cache.PushBack(entry, allocator);
+      }
+      t.AddMember("free_cache", free_cache, allocator);
+
+      // Write columns
+      json::Value columns(json::kArrayType);
+      for (const auto& col : table.columns) {
+         // id
+         json::Value column(json::kObjectType);
+         column.AddMember("id", json::StringRef(col.id.c_str()), allocator);
+
+         // tclass
+         json::Value type(json::kObjectType);
+         type.AddMember("tclass", json::StringRef(col.type.name()), allocator);
+
+         // length
+         type.AddMember("length", col.type.length, allocator);
+
+         column.AddMember("type", type, allocator);
+         columns.PushBack(column, allocator);
+      }
+      t.AddMember("columns", columns, allocator);
+
+      // Write primary key
+      json::Value primary_key(json::kArrayType);
+      for (const auto& pk : table.primary_key) {
+         primary_key.PushBack(json::StringRef(pk.c_str()), allocator);
+      }
+      t.AddMember("primary_key", primary_key, allocator);
+
+      json_tables.PushBack(t, allocator);
+   }
+   doc.AddMember("tables", json_tables, allocator);
+
+   // Write into buffer
+   json::StringBuffer buffer;
+   json::Writer<json::StringBuffer> writer(buffer);
+   doc.Accept(writer);
+   return {buffer.GetString(), buffer.GetSize()};
+}
@@ -1,11 +1,10 @@
-#include "rapidjson/document.h"
-#include "rapidjson/istreamwrapper.h"
-#include "rapidjson/stringbuffer.h"
-#include "rapidjson/writer.h"
 #include "simpledb/schema.h"
 #include "simpledb/segment.h"
+#include <algorithm>
+#include <atomic>
 #include <cstring>
-#include <sstream>
+#include <stdexcept>
+#include <string>
 
 using Segment = simpledb::Segment;
 using SchemaSegment = simpledb::SchemaSegment;
@@ -14,22 +13,60 @@ using Type = simpledb::schema::Type;
 using Table = simpledb::schema::Table;
 using Column = simpledb::schema::Column;
 
-namespace json = rapidjson;
-
 namespace {
 
-struct StreamBuffer : std::streambuf {
-   explicit StreamBuffer(std::vector<std::byte>& buffer) {
-      auto* begin = reinterpret_cast<char*>(buffer.data());
-      auto* end = reinterpret_cast<char*>(buffer.data() + buffer.size());
-      this->setg(begin, begin, end);
+/// The header at the start of the schema segment
+struct CatalogHeader {
+   uint64_t size;
+   uint32_t format;
+   uint32_t table_count;
+   uint32_t reserved;
+};
+
+/// Appends values to a binary catalog
+struct CatalogWriter {
+   std::vector<char> buffer;
+
+   template <typename T>
+   void put(T value) {
+      auto offset = buffer.size();
+      buffer.resize(offset + sizeof(value));
+      std::memcpy(buffer.data() + offset, &value, sizeof(value));
+   }
+
+   void put(const std::string& value) {
+      put(static_cast<uint32_t>(value.size()));
+      buffer.insert(buffer.end(), value.begin(), value.end());
    }
 };
 
-// NOLINTNEXTLINE
-const std::unordered_map<std::string, Type::Class> types{
-   {"char", Type::kChar},
-   {"integer", Type::kInteger},
+/// Reads the values of a binary catalog
+struct CatalogReader {
+   const std::vector<char>& buffer;
+   size_t offset = 0;
+
+   template <typename T>
+   T get() {
+      T value;
+      check(sizeof(value));
+      std::memcpy(&value, buffer.data() + offset, sizeof(value));
+      offset += sizeof(value);
+      return value;
+   }
+
+   std::string get_string() {
+      auto size = get<uint32_t>();
+      check(size);
+      std::string value(buffer.data() + offset, size);
+      offset += size;
+      return value;
+   }
+
+   void check(size_t size) const {
+      if (offset + size > buffer.size()) {
+         throw std::runtime_error("corrupt schema catalog");
+      }
+   }
 };
 
 } // namespace
@@ -43,186 +80,129 @@ SchemaSegment::~SchemaSegment() {
    write(); // NOLINT
 }
 
-void SchemaSegment::read() {
-   // Load the first page
-   auto& page = buffer_manager.fix_page(static_cast<uint64_t>(segment_id) << 48, false);
-   auto* page_data = page.get_data();
+void SchemaSegment::readBytes(size_t offset, char* data, size_t size) {
    auto page_size = buffer_manager.get_page_size();
+   while (size > 0) {
+      auto& page = buffer_manager.fix_page((static_cast<uint64_t>(segment_id) << 48) ^ (offset / page_size), false);
+      auto n = std::min<size_t>(size, page_size - offset % page_size);
+      std::memcpy(data, page.get_data() + offset % page_size, n);
+      buffer_manager.unfix_page(page, false);
+      data += n;
+      offset += n;
+      size -= n;
+   }
+}
 
-   // [0-8[   : Schema string length in #bytes
-   auto schema_size = *reinterpret_cast<uint64_t*>(page_data);
-
-   // Read schema string into buffer
-   auto remaining_bytes = schema_size;
-   std::vector<std::byte> buffer;
-   buffer.resize(schema_size);
-   auto buffer_offset = 0;
-
-   // Read the remainder of the first page
-   auto d = std::min<size_t>(remaining_bytes, page_size - 20);
-   std::memcpy(&buffer[buffer_offset], page_data + 20, d);
-   buffer_offset += d;
-   remaining_bytes -= d;
-
-   // Release first page
-   buffer_manager.unfix_page(page, false);
-
-   // Read all other schema pages
-   for (int pid = 1; remaining_bytes > 0; pid++) {
-      auto& page = buffer_manager.fix_page((static_cast<uint64_t>(segment_id) << 48) ^ pid, false);
-
-      auto* page_data = page.get_data();
-      auto n = std::min<size_t>(remaining_bytes, page_size);
-      std::memcpy(&buffer[buffer_offset], page_data, n);
-      buffer_offset += n;
-      remaining_bytes -= n;
+void SchemaSegment::writeBytes(size_t offset, const char* data, size_t size) {
+   auto page_size = buffer_manager.get_page_size();
+   while (size > 0) {
+      auto& page = buffer_manager.fix_page((static_cast<uint64_t>(segment_id) << 48) ^ (offset / page_size), true);
+      auto n = std::min<size_t>(size, page_size - offset % page_size);
+      std::memcpy(page.get_data() + offset % page_size, data, n);
+      buffer_manager.unfix_page(page, true);
+      data += n;
+      offset += n;
+      size -= n;
+   }
+}
 
-      buffer_manager.unfix_page(page, false);
+void SchemaSegment::read() {
+   CatalogHeader header{};
+   readBytes(0, reinterpret_cast<char*>(&header), kCatalogOffset);
+   std::vector<char> buffer(header.size);
+   readBytes(kCatalogOffset, buffer.data(), buffer.size());
+
+   if (header.format != kBinaryCatalog) {
+      // Import a schema that was written as JSON, it is written in binary next time
+      schema = Schema::from_json({buffer.data(), buffer.size()});
+      catalogTables = kNoCatalog;
+      return;
    }
 
-   // Parse the schema
-   json::Document document;
-   StreamBuffer sb(buffer);
-   std::istream sbi(&sb);
-   json::IStreamWrapper isw(sbi);
-   document.ParseStream(isw);
+   // The allocated pages of all tables come first, so they can be updated in place
+   CatalogReader reader{buffer};
+   std::vector<uint64_t> allocated_pages(header.table_count);
+   for (auto& pages : allocated_pages) {
+      pages = reader.get<uint64_t>();
+   }
 
-   // Parse the schema
    std::vector<Table> tables;
-   if (document.HasMember("tables") && document["tables"].IsArray()) {
-      for (auto& table : document["tables"].GetArray()) {
-         const auto* id = table.HasMember("id") ? table["id"].GetString() : "?";
-         auto sp_segment = table.HasMember("sp_segment") ? table["sp_segment"].GetInt() : -1;
-         auto fsi_segment = table.HasMember("fsi_segment") ? table["fsi_segment"].GetInt() : -1;
-         auto allocated_pages = table.HasMember("allocated_pages") ? table["allocated_pages"].GetInt() : -1;
-         std::vector<Column> columns;
-         if (table.HasMember("columns") && table["columns"].IsArray()) {
-            for (auto& col : table["columns"].GetArray()) {
-               std::string id = col.HasMember("id") ? col["id"].GetString() : "?";
-               Type t;
-               if (col.HasMember("type")) {
-                  auto type = col["type"].GetObject();
-                  t.length = type.HasMember("length") ? type["length"].GetInt() : 0;
-                  t.tclass = Type::Class::kInteger;
-                  if (type.HasMember("tclass")) {
-                     auto iter = types.find(type["tclass"].GetString());
-                     if (iter != types.end()) {
-                        t.tclass = iter->second;
-                     }
-                  }
-               }
-               columns.emplace_back(id, t);
-            }
-         }
-         std::vector<std::string> primary_key;
-         if (table.HasMember("primary_key") && table["primary_key"].IsArray()) {
-            for (auto& pk : table["primary_key"].GetArray()) {
-               primary_key.emplace_back(pk.GetString());
-            }
-         }
-         tables.emplace_back(id, std::move(columns), std::move(primary_key), sp_segment, fsi_segment, allocated_pages);
+   tables.reserve(header.table_count);
+   for (uint32_t i = 0; i < header.table_count; ++i) {
+      auto id = reader.get_string();
+      auto sp_segment = reader.get<uint16_t>();
+      auto fsi_segment = reader.get<uint16_t>();
+      auto layout = static_cast<Table::Layout>(reader.get<uint8_t>());
+      std::vector<Column> columns;
+      for (auto count = reader.get<uint32_t>(); count > 0; --count) {
+         auto column_id = reader.get_string();
+         Type t{};
+         t.tclass = static_cast<Type::Class>(reader.get<uint8_t>());
+         t.length = reader.get<uint32_t>();
+         columns.emplace_back(std::move(column_id), t);
+      }
+      std::vector<std::string> primary_key;
+      for (auto count = reader.get<uint32_t>(); count > 0; --count) {
+         primary_key.push_back(reader.get_string());
+      }
+      tables.emplace_back(std::move(id), std::move(columns), std::move(primary_key), sp_segment, fsi_segment, allocated_pages[i], layout);
+      for (auto count = reader.get<uint32_t>(); count > 0; --count) {
+         tables.back().free_cache.push_back(reader.get<uint64_t>());
       }
    }
    schema = std::make_unique<Schema>(std::move(tables));
+   catalogTables = header.table_count;
 }
 
 void SchemaSegment::write() {
-   // Load the first page
-   auto& page = buffer_manager.fix_page(static_cast<uint64_t>(segment_id) << 48, true);
-   auto* page_data = page.get_data();
-   auto page_size = buffer_manager.get_page_size();
-
-   // [0-8[   : Schema string length in #bytes
-
    if (!schema) {
-      *reinterpret_cast<uint64_t*>(page_data) = 0;
-      buffer_manager.unfix_page(page, true);
+      CatalogHeader header{};
+      writeBytes(0, reinterpret_cast<const char*>(&header), kCatalogOffset);
+      catalogTables = kNoCatalog;
       return;
    }
 
-   // Serialize the schema to json
-   json::StringBuffer buffer;
-   {
-      // Prepare document
-      json::Document doc(json::kObjectType);
-      auto& allocator = doc.GetAllocator();
-
-      // Write tables
-      json::Value tables(json::kArrayType);
-      for (auto& table : schema->tables) {
-         json::Value t(json::kObjectType);
-
-         // id
-         t.AddMember("id", json::StringRef(table.id.c_str()), allocator);
-         // sp_segment
-         t.AddMember("sp_segment", table.sp_segment, allocator);
-         // fsi_segment
-         t.AddMember("fsi_segment", table.fsi_segment, allocator);
-         // allocated_pages
-         t.AddMember("allocated_pages", table.allocated_pages, allocator);
-
-         // Write columns
-         json::Value columns(json::kArrayType);
-         for (const auto& col : table.columns) {
-            // id
-            json::Value column(json::kObjectType);
-            column.AddMember("id", json::StringRef(col.id.c_str()), allocator);
-
-            // tclass
-            json::Value type(json::kObjectType);
-            type.AddMember("tclass", json::StringRef(col.type.name()), allocator);
-
-            // length
-            type.AddMember("length", col.type.length, allocator);
-
-            column.AddMember("type", type, allocator);
-            columns.PushBack(column, allocator);
-         }
-         t.AddMember("columns", columns, allocator);
-
-         // Write primary key
-         json::Value primary_key(json::kArrayType);
-         for (const auto& pk : table.primary_key) {
-            primary_key.PushBack(json::StringRef(pk.c_str()), allocator);
-         }
-         t.AddMember("primary_key", primary_key, allocator);
-
-         tables.PushBack(t, allocator);
+   // Serialize the schema
+   CatalogWriter writer;
+   for (auto& table : schema->tables) {
+      writer.put(std::atomic_ref(table.allocated_pages).load());
+   }
+   for (const auto& table : schema->tables) {
+      writer.put(table.id);
+      writer.put(table.sp_segment);
+      writer.put(table.fsi_segment);
+      writer.put(static_cast<uint8_t>(table.layout));
+      writer.put(static_cast<uint32_t>(table.columns.size()));
+      for (const auto& col : table.columns) {
+         writer.put(col.id);
+         writer.put(static_cast<uint8_t>(col.type.tclass));
+         writer.put(col.type.length);
+      }
+      writer.put(static_cast<uint32_t>(table.primary_key.size()));
+      for (const auto& pk : table.primary_key) {
+         writer.put(pk);
+      }
+      writer.put(static_cast<uint32_t>(table.free_cache.size()));
+      for (auto entry : table.free_cache) {
+         writer.put(entry);
       }
-      doc.AddMember("tables", tables, allocator);
-
-      // Write into buffer
-      json::Writer<json::StringBuffer> writer(buffer);
-      doc.Accept(writer);
    }
 
-   // Get data
-   const char* json_str = buffer.GetString();
-   uint64_t schema_size = buffer.GetSize();
-   *reinterpret_cast<uint64_t*>(page_data) = schema_size;
-
-   auto remaining_bytes = schema_size;
-   auto buffer_offset = 0;
-
-   // Write the remainder of the first page
-   auto d = std::min<size_t>(remaining_bytes, page_size - 20);
-   std::memcpy(page_data + 20, json_str + buffer_offset, d);
-   buffer_offset += d;
-   remaining_bytes -= d;
-
-   // Release first page
-   buffer_manager.unfix_page(page, true);
-
-   // Write all other schema pages
-   for (int pid = 1; remaining_bytes > 0; pid++) {
-      auto& page = buffer_manager.fix_page((static_cast<uint64_t>(segment_id) << 48) ^ pid, true);
-
-      auto* page_data = page.get_data();
-      auto n = std::min<size_t>(remaining_bytes, page_size);
-      std::memcpy(page_data, json_str + buffer_offset, n);
-      buffer_offset += n;
-      remaining_bytes -= n;
+   CatalogHeader header{writer.buffer.size(), kBinaryCatalog, static_cast<uint32_t>(schema->tables.size()), 0};
+   writeBytes(0, reinterpret_cast<const char*>(&header), kCatalogOffset);
+   writeBytes(kCatalogOffset, writer.buffer.data(), writer.buffer.size());
+   catalogTables = schema->tables.size();
+}
 
-      buffer_manager.unfix_page(page, true);
+void SchemaSegment::write_allocated_pages(Table& table) {
+   std::unique_lock latch(allocatedPagesLatch);
+   if (catalogTables != schema->tables.size()) {
+      write();
+      return;
    }
+
+   // Read the counter under the latch, so a later value is never overwritten by an earlier one
+   auto index = &table - schema->tables.data();
+   auto pages = std::atomic_ref(table.allocated_pages).load();
+   writeBytes(kCatalogOffset + index * sizeof(pages), reinterpret_cast<const char*>(&pages), sizeof(pages));
 }
@@ -1,5 +1,6 @@
 #include "simpledb/slotted_page.h"
 #include <cstring>
+#include <vector>
 
 using simpledb::SlottedPage;
 
@@ -86,6 +87,13 @@ void SlottedPage::relocate(uint16_t slot_id, uint32_t data_size, uint32_t page_s
       // just resize slot
       header.free_space += slot.get_size() - data_size;
       slot.set_slot(slot.get_offset(), data_size, slot.is_redirect_target());
+   } else if (slot.get_offset() == header.data_start && get_fragmented_free_space() + slot.get_size() >= data_size) {
+      // the record is the lowest one -> grow it downwards without touching the others
+      auto offset = header.data_start - (data_size - slot.get_size());
+      header.data_start = offset;
+      header.free_space -= data_size - slot.get_size();
+      memmove(get_data() + offset, get_data() + slot.get_offset(), slot.get_size());
+      slot.set_slot(offset, data_size, slot.is_redirect_target());
    } else if (get_fragmented_free_space() >= data_size) {
       // just reallocate slot
       header.data_start -= data_size;
@@ -126,35 +134,31 @@ void SlottedPage::erase(uint16_t slot_id) {
 }
 
 void SlottedPage::compactify(uint32_t page_size) {
-   char* tempData = new char[page_size];
-   auto& tempPage = *reinterpret_cast<SlottedPage*>(tempData);
-
-   tempPage.header.data_start = page_size;
-
+   // the records are packed into memory of the thread, so this doesn't allocate once it has grown
+   thread_local std::vector<char> scratch;
+   if (scratch.size() < page_size)
+      scratch.resize(page_size);
+   char* tempData = scratch.data();
+
+   // the slots are updated in place, only their data goes through the scratch memory
+   uint32_t dataStart = page_size;
+   auto* slots = get_slots();
    for (uint16_t s = 0; s < header.slot_count; ++s) {
-      auto slot = get_slot(s);
-      auto& newSlot = *reinterpret_cast<Slot*>(tempData + sizeof(Header) + s * sizeof(Slot));
-
-      // copy slot
-      memcpy(&newSlot, &slot, sizeof(Slot));
-
+      auto& slot = slots[s];
       if (slot.is_empty() || slot.is_redirect())
          continue;
 
       // copy data
-      tempPage.header.data_start -= slot.get_size();
+      dataStart -= slot.get_size();
       auto dataSize = std::min(page_size - slot.get_offset(), slot.get_size());
-      memcpy(tempData + tempPage.header.data_start, get_data() + slot.get_offset(), dataSize);
+      memcpy(tempData + dataStart, get_data() + slot.get_offset(), dataSize);
 
       // update slot
-      newSlot.set_slot(tempPage.header.data_start, slot.get_size(), slot.is_redirect_target());
+      slot.set_slot(dataStart, slot.get_size(), slot.is_redirect_target());
    }
 
-   tempPage.header.slot_count = header.slot_count;
-   tempPage.header.first_free_slot = header.first_free_slot;
-   tempPage.header.free_space = tempPage.get_fragmented_free_space();
-
-   // copy page back
-   memcpy(this, tempData, page_size);
-   delete[] tempData;
+   // copy only the data back, the rest of the page is free space
+   memcpy(get_data() + dataStart, tempData + dataStart, page_size - dataStart);
+   header.data_start = dataStart;
+   header.free_space = get_fragmented_free_space();
 }
@@ -1,5 +1,14 @@
 #include "simpledb/segment.h"
 #include "simpledb/slotted_page.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
 
 using simpledb::Segment;
 using simpledb::SPSegment;
@@ -7,107 +16,182 @@ using simpledb::TID;
 
 SPSegment::SPSegment(uint16_t segment_id, BufferManager& buffer_manager, SchemaSegment& schema, FSISegment& fsi, schema::Table& table)
    : Segment(segment_id, buffer_manager), schema(schema), fsi(fsi), table(table) {
+   for (auto& insertPage : insertPages) {
+      insertPage.store(FSISegment::invalidPid, std::memory_order_relaxed);
+   }
 }
 
-TID SPSegment::allocate(uint32_t size, bool is_redirect_target) {
-   auto oPid = fsi.find(size + sizeof(SlottedPage::Slot));
+namespace {
 
-   uint64_t pid;
-   bool created = false;
+/// Returns the insert page of an `SPSegment` that the calling thread uses, threads take them round robin.
+size_t insert_page_slot() {
+   static std::atomic<size_t> nextSlot = 0;
+   static thread_local size_t slot = nextSlot.fetch_add(1, std::memory_order_relaxed) % SPSegment::kInsertPages;
+   return slot;
+}
 
-   if (oPid.has_value()) {
-      pid = (static_cast<uint64_t>(segment_id) << 48) ^ oPid.value();
-   } else {
-      // create new page
-      created = true;
-      pid = (static_cast<uint64_t>(segment_id) << 48) ^ table.allocated_pages;
-      table.allocated_pages += 1;
-   }
+}
 
-   auto bf = &buffer_manager.fix_page(pid, true);
-   auto page = reinterpret_cast<SlottedPage*>(bf->get_data());
+simpledb::BufferFrame& SPSegment::fix_free_page(uint32_t size, uint64_t& pid, std::initializer_list<uint64_t> fixed_pages) {
+   auto required = size + sizeof(SlottedPage::Slot);
+   auto& insertPage = insertPages[insert_page_slot()];
 
-   if (created) {
-      // initialize new page
-      new (page) SlottedPage(buffer_manager.get_page_size());
+   // the pages that the caller holds and the ones that other threads insert into are skipped
+   auto usable = [&](uint64_t pageIndex) {
+      for (auto fixed : fixed_pages) {
+         if ((fixed & 0x0000FFFFFFFFFFFF) == pageIndex)
+            return false;
+      }
+      for (auto& other : insertPages) {
+         if (&other != &insertPage && other.load(std::memory_order_relaxed) == pageIndex)
+            return false;
+      }
+      return true;
+   };
+   auto fixIfFits = [&](uint64_t pageIndex) -> BufferFrame* {
+      pid = (static_cast<uint64_t>(segment_id) << 48) ^ pageIndex;
+      auto& bf = buffer_manager.fix_page(pid, true);
+      auto freeSpace = reinterpret_cast<SlottedPage*>(bf.get_data())->get_free_space();
+      if (freeSpace >= required)
+         return &bf;
+
+      // page actually does NOT have enough space, the inventory may be behind a concurrent insert
+      buffer_manager.unfix_page(bf, false);
+      fsi.update(pid, freeSpace);
+      return nullptr;
+   };
+
+   // the page that this thread inserted into before
+   if (auto pageIndex = insertPage.load(std::memory_order_relaxed); pageIndex != FSISegment::invalidPid && usable(pageIndex)) {
+      if (auto* bf = fixIfFits(pageIndex))
+         return *bf;
    }
 
-   if (page->get_free_space() < size + sizeof(SlottedPage::Slot)) {
-      assert(!created);
-
-      // page actually does NOT have enough space
-      buffer_manager.unfix_page(*bf, false);
-
-      // check next bigger encoding
-      uint8_t nextEnc = fsi.encode_free_space(size + sizeof(SlottedPage::Slot)) + 1;
-
-      oPid = {};
-
-      if (nextEnc < 16) {
-         uint32_t nextSize = fsi.decode_free_space(nextEnc);
-         oPid = fsi.find(nextSize);
+   // pages of the encoding of the required space may have less of it, so check the next bigger encodings
+   for (uint32_t search = required;;) {
+      auto oPid = fsi.find(search);
+      if (!oPid.has_value())
+         break;
+      if (usable(*oPid)) {
+         if (auto* bf = fixIfFits(*oPid)) {
+            insertPage.store(*oPid, std::memory_order_relaxed);
+            return *bf;
+         }
       }
 
-      created = false;
+      uint8_t nextEnc = fsi.encode_free_space(search) + 1;
+      if (nextEnc >= 16)
+         break;
+      search = fsi.decode_free_space(nextEnc);
+   }
 
-      if (oPid.has_value()) {
-         pid = (static_cast<uint64_t>(segment_id) << 48) ^ oPid.value();
-      } else {
-         // create new page
-         created = true;
-         pid = (static_cast<uint64_t>(segment_id) << 48) ^ table.allocated_pages;
-         table.allocated_pages += 1;
-      }
+   // create new page
+   auto pageIndex = std::atomic_ref(table.allocated_pages).fetch_add(1);
+   pid = (static_cast<uint64_t>(segment_id) << 48) ^ pageIndex;
+   auto& bf = buffer_manager.fix_page(pid, true);
+   new (bf.get_data()) SlottedPage(buffer_manager.get_page_size());
+   schema.write_allocated_pages(table);
+   insertPage.store(pageIndex, std::memory_order_relaxed);
+   return bf;
+}
 
-      bf = &buffer_manager.fix_page(pid, true);
-      page = reinterpret_cast<SlottedPage*>(bf->get_data());
+TID SPSegment::allocate(uint32_t size, bool is_redirect_target) {
+   return allocate(size, is_redirect_target, {});
+}
 
-      if (created) {
-         // initialize new page
-         new (page) SlottedPage(buffer_manager.get_page_size());
-      }
-   }
+TID SPSegment::allocate(uint32_t size, bool is_redirect_target, std::initializer_list<uint64_t> fixed_pages) {
+   uint64_t pid;
+   auto& bf = fix_free_page(size, pid, fixed_pages);
+   auto page = reinterpret_cast<SlottedPage*>(bf.get_data());
 
    // allocate new record
    auto sid = page->allocate(size, buffer_manager.get_page_size(), is_redirect_target);
-   buffer_manager.unfix_page(*bf, true);
+   auto freeSpace = page->get_free_space();
+   buffer_manager.unfix_page(bf, true);
 
    // update fsi
-   fsi.update(pid, page->get_free_space());
+   fsi.update(pid, freeSpace);
 
    return {pid, sid};
 }
 
+std::vector<TID> SPSegment::insert_batch(std::span<const std::span<const std::byte>> records) {
+   std::vector<TID> tids;
+   tids.reserve(records.size());
+   for (size_t i = 0; i < records.size();) {
+      uint64_t pid;
+      auto& bf = fix_free_page(records[i].size(), pid);
+      auto page = reinterpret_cast<SlottedPage*>(bf.get_data());
+
+      // fill the page with as many of the following records as fit
+      do {
+         auto sid = page->allocate(records[i].size(), buffer_manager.get_page_size());
+         std::memcpy(bf.get_data() + page->get_slot(sid).get_offset(), records[i].data(), records[i].size());
+         tids.emplace_back(pid, sid);
+         ++i;
+      } while (i < records.size() && page->get_free_space() >= records[i].size() + sizeof(SlottedPage::Slot));
+      auto freeSpace = page->get_free_space();
+      buffer_manager.unfix_page(bf, true);
+
+      // update fsi
+      fsi.update(pid, freeSpace);
+   }
+   return tids;
+}
+
 uint32_t SPSegment::read(TID tid, std::byte* record, uint32_t capacity) const {
+   auto view = this->view(tid);
+   if (!view)
+      return 0;
+   uint32_t size = std::min<size_t>(capacity, view.get_data().size());
+   std::memcpy(record, view.get_data().data(), size);
+   return size;
+}
+
+SPSegment::RecordView SPSegment::view(TID tid) const {
    auto [bf, page, slot] = get_slot(tid, false);
 
    assert(!slot.is_redirect_target());
 
-   if (slot.is_empty()) return 0;
+   if (slot.is_empty()) {
+      buffer_manager.unfix_page(bf, false);
+      return {};
+   }
 
    if (!slot.is_redirect()) {
-      // read record
-      uint32_t size = std::min(capacity, slot.get_size());
-      memcpy(record, bf.get_data() + slot.get_offset(), size);
-      buffer_manager.unfix_page(bf, false);
+      return {buffer_manager, bf, {reinterpret_cast<const std::byte*>(bf.get_data()) + slot.get_offset(), slot.get_size()}};
+   }
 
-      return size;
-   } else {
-      // follow redirect
-      auto rTid = slot.as_redirect_tid();
+   // follow redirect
+   auto rTid = slot.as_redirect_tid();
 
-      buffer_manager.unfix_page(bf, false);
+   buffer_manager.unfix_page(bf, false);
 
-      auto [rBf, rPage, rSlot] = get_slot(rTid, false);
+   auto [rBf, rPage, rSlot] = get_slot(rTid, false);
 
-      assert(rSlot.is_redirect_target() && !rSlot.is_empty() && "An empty redirect target doesn't make sense");
+   assert(rSlot.is_redirect_target() && !rSlot.is_empty() && "An empty redirect target doesn't make sense");
 
-      // read record
-      uint32_t size = std::min(capacity, rSlot.get_size());
-      memcpy(record, rBf.get_data() + rSlot.get_offset(), size);
-      buffer_manager.unfix_page(rBf, false);
+   return {buffer_manager, rBf, {reinterpret_cast<const std::byte*>(rBf.get_data()) + rSlot.get_offset(), rSlot.get_size()}};
+}
 
-      return size;
+SPSegment::RecordView::RecordView(RecordView&& other) noexcept
+   : buffer_manager(other.buffer_manager), frame(std::exchange(other.frame, nullptr)), record(std::exchange(other.record, {})) {}
+
+SPSegment::RecordView& SPSegment::RecordView::operator=(RecordView&& other) noexcept {
+   if (this != &other) {
+      release();
+      buffer_manager = other.buffer_manager;
+      frame = std::exchange(other.frame, nullptr);
+      record = std::exchange(other.record, {});
+   }
+   return *this;
+}
+
+void SPSegment::RecordView::release() {
+   if (frame) {
+      buffer_manager->unfix_page(*frame, false);
+      frame = nullptr;
+      record = {};
    }
 }
 
@@ -160,7 +244,7 @@ void SPSegment::resize(TID tid, uint32_t new_length) {
          // not enough space -> redirect
 
          // create new redirect target
-         auto newRTid = allocate(new_length, true);
+         auto newRTid = allocate(new_length, true, {tid.get_page_id(segment_id)});
          // copy over data TODO: make this into one operation (allocate and writing)
          write(newRTid, page->get_data() + slot.get_offset(), slot.get_size());
 
@@ -169,10 +253,11 @@ void SPSegment::resize(TID tid, uint32_t new_length) {
          slot.set_redirect_tid(newRTid);
       }
 
+      auto freeSpace = page->get_free_space();
       buffer_manager.unfix_page(bf, true);
 
       // update fsi
-      fsi.update(tid.get_page_id(segment_id), page->get_free_space());
+      fsi.update(tid.get_page_id(segment_id), freeSpace);
    } else {
       // follow redirect
       auto rTid = slot.as_redirect_tid();
@@ -180,23 +265,26 @@ void SPSegment::resize(TID tid, uint32_t new_length) {
 
       assert(rSlot.is_redirect_target());
 
+      uint32_t rFreeSpace;
       if (new_length < rSlot.get_size() || rPage->get_free_space() >= new_length - rSlot.get_size()) {
          buffer_manager.unfix_page(bf, false);
 
          // still fits (compactifies if needed)
          rPage->relocate(rTid.get_slot(), new_length, buffer_manager.get_page_size());
 
+         rFreeSpace = rPage->get_free_space();
          buffer_manager.unfix_page(rBf, true);
       } else {
          // not enough space -> re-redirect
 
          // create new redirect target
-         auto newRTid = allocate(new_length, true);
+         auto newRTid = allocate(new_length, true, {tid.get_page_id(segment_id), rTid.get_page_id(segment_id)});
          // copy over data TODO: make this into one operation (allocate and writing)
          write(newRTid, rPage->get_data() + rSlot.get_offset(), rSlot.get_size());
 
          // delete old redirect target
          rPage->erase(rTid.get_slot());
+         rFreeSpace = rPage->get_free_space();
          buffer_manager.unfix_page(rBf, true);
 
          // update redirect slot
@@ -205,7 +293,7 @@ void SPSegment::resize(TID tid, uint32_t new_length) {
       }
 
       // update fsi
-      fsi.update(rTid.get_page_id(segment_id), rPage->get_free_space());
+      fsi.update(rTid.get_page_id(segment_id), rFreeSpace);
    }
 }
 
@@ -215,15 +303,17 @@ void SPSegment::erase(TID tid) {
    if (!slot.is_redirect()) {
       // erase record
       page->erase(tid.get_slot());
+      auto freeSpace = page->get_free_space();
       buffer_manager.unfix_page(bf, true);
 
       // update fsi
-      fsi.update(tid.get_page_id(segment_id), page->get_free_space());
+      fsi.update(tid.get_page_id(segment_id), freeSpace);
    } else {
       // follow redirect
       auto rTid = slot.as_redirect_tid();
 
       page->erase(tid.get_slot());
+      auto freeSpace = page->get_free_space();
       buffer_manager.unfix_page(bf, true);
 
       auto [rBf, rPage, rSlot] = get_slot(rTid, true);
@@ -232,14 +322,157 @@ void SPSegment::erase(TID tid) {
 
       // erase record
       rPage->erase(rTid.get_slot());
+      auto rFreeSpace = rPage->get_free_space();
       buffer_manager.unfix_page(rBf, true);
 
       // update fsi
-      fsi.update(rTid.get_page_id(segment_id), rPage->get_free_space());
-      fsi.update(tid.get_page_id(segment_id), page->get_free_space());
+      fsi.update(rTid.get_page_id(segment_id), rFreeSpace);
+      fsi.update(tid.get_page_id(segment_id), freeSpace);
    }
 }
 
+void SPSegment::ScanBatch::append(TID tid, const std::byte* record, uint32_t size) {
+   tids.push_back(tid);
+   data.insert(data.end(), record, record + size);
+   offsets.push_back(data.size());
+}
+
+void SPSegment::ScanBatch::clear() {
+   tids.clear();
+   offsets.resize(1);
+   data.clear();
+}
+
+void SPSegment::scan(const std::function<bool(const ScanBatch&)>& callback, size_t batch_size) const {
+   ScanBatch batch;
+   std::vector<std::pair<TID, TID>> redirects;
+   if (scan_pages(0, std::atomic_ref(table.allocated_pages).load(), batch, redirects, callback, batch_size) && batch.size() > 0)
+      callback(batch);
+}
+
+namespace {
+
+/// Takes the next morsel from the front of a worker's own range of morsels, or steals one from the
+/// back of another worker's range once its own is exhausted. A range [begin, end) is stored as
+/// `begin << 32 | end`.
+std::optional<uint64_t> take_morsel(std::vector<std::atomic<uint64_t>>& ranges, size_t worker) {
+   auto& own = ranges[worker];
+   auto range = own.load();
+   while ((range >> 32) < (range & 0xFFFFFFFF)) {
+      if (own.compare_exchange_weak(range, range + (1ull << 32)))
+         return range >> 32;
+   }
+   for (size_t i = 1; i < ranges.size(); ++i) {
+      auto& victim = ranges[(worker + i) % ranges.size()];
+      range = victim.load();
+      while ((range >> 32) < (range & 0xFFFFFFFF)) {
+         if (victim.compare_exchange_weak(range, range - 1))
+            return (range & 0xFFFFFFFF) - 1;
+      }
+   }
+   return {};
+}
+
+}
+
+void SPSegment::parallel_scan(const std::function<void(size_t, const ScanBatch&)>& callback, size_t thread_count, size_t batch_size) const {
+   auto pageCount = std::atomic_ref(table.allocated_pages).load();
+   auto morselCount = (pageCount + kMorselPages - 1) / kMorselPages;
+   thread_count = std::min<uint64_t>(resolve_thread_count(thread_count), std::max<uint64_t>(morselCount, 1));
+
+   // every worker starts on its own contiguous share of the morsels
+   std::vector<std::atomic<uint64_t>> ranges(thread_count);
+   for (size_t worker = 0; worker < thread_count; ++worker) {
+      ranges[worker] = (morselCount * worker / thread_count) << 32 | morselCount * (worker + 1) / thread_count;
+   }
+
+   std::atomic<bool> failed = false;
+   std::exception_ptr error;
+   std::mutex errorLatch;
+   auto work = [&](size_t worker) {
+      try {
+         ScanBatch batch;
+         std::vector<std::pair<TID, TID>> redirects;
+         auto consume = [&](const ScanBatch& b) {
+            callback(worker, b);
+            return !failed.load();
+         };
+         while (auto morsel = take_morsel(ranges, worker)) {
+            auto first = *morsel * kMorselPages;
+            if (!scan_pages(first, std::min(first + kMorselPages, pageCount), batch, redirects, consume, batch_size))
+               return;
+         }
+         if (batch.size() > 0)
+            callback(worker, batch);
+      } catch (...) {
+         // the other workers stop after their current batch
+         std::unique_lock latch(errorLatch);
+         if (!error)
+            error = std::current_exception();
+         failed = true;
+      }
+   };
+
+   std::vector<std::thread> threads;
+   for (size_t worker = 1; worker < thread_count; ++worker) {
+      threads.emplace_back(work, worker);
+   }
+   work(0);
+   for (auto& thread : threads) {
+      thread.join();
+   }
+   if (error)
+      std::rethrow_exception(error);
+}
+
+bool SPSegment::scan_pages(uint64_t first, uint64_t last, ScanBatch& batch, std::vector<std::pair<TID, TID>>& redirects, const std::function<bool(const ScanBatch&)>& callback, size_t batch_size) const {
+   for (uint64_t pageIndex = first; pageIndex < last; ++pageIndex) {
+      if ((pageIndex - first) % kScanPrefetchPages == 0) {
+         // keep the next window of pages loading while this one is read
+         auto from = pageIndex == first ? first : pageIndex + kScanPrefetchPages;
+         auto to = std::min(pageIndex + 2 * kScanPrefetchPages, last);
+         if (from < to)
+            buffer_manager.prefetch((static_cast<uint64_t>(segment_id) << 48) ^ from, to - from, AccessHint::SEQUENTIAL_ONCE);
+      }
+
+      // a scan must not push the pages of other queries out
+      auto& bf = buffer_manager.fix_page((static_cast<uint64_t>(segment_id) << 48) ^ pageIndex, false, AccessHint::SEQUENTIAL_ONCE);
+      auto page = reinterpret_cast<const SlottedPage*>(bf.get_data());
+      for (uint16_t sid = 0; sid < page->header.slot_count; ++sid) {
+         const auto& slot = page->get_slot(sid);
+         // redirect targets are read together with their redirect
+         if (slot.is_empty() || slot.is_redirect_target())
+            continue;
+         if (slot.is_redirect()) {
+            redirects.emplace_back(TID(pageIndex, sid), slot.as_redirect_tid());
+         } else {
+            batch.append(TID(pageIndex, sid), reinterpret_cast<const std::byte*>(bf.get_data()) + slot.get_offset(), slot.get_size());
+         }
+      }
+      buffer_manager.unfix_page(bf, false);
+
+      // follow the redirects after the page was unfixed, their targets could be on any page
+      for (auto [tid, rTid] : redirects) {
+         auto [rBf, rPage, rSlot] = get_slot(rTid, false);
+         assert(rSlot.is_redirect_target() && !rSlot.is_empty() && "An empty redirect target doesn't make sense");
+         batch.append(tid, reinterpret_cast<const std::byte*>(rBf.get_data()) + rSlot.get_offset(), rSlot.get_size());
+         buffer_manager.unfix_page(rBf, false);
+      }
+      redirects.clear();
+
+      if (batch.size() >= batch_size) {
+         if (!callback(batch))
+            return false;
+         batch.clear();
+      }
+   }
+   return true;
+}
+
+size_t SPSegment::resolve_thread_count(size_t thread_count) {
+   return thread_count > 0 ? thread_count : std::max(std::thread::hardware_concurrency(), 1u);
+}
+
 std::tuple<simpledb::BufferFrame&, simpledb::SlottedPage*, simpledb::SlottedPage::Slot&> SPSegment::get_slot(simpledb::TID tid, bool exclusive) const {
    auto pid = tid.get_page_id(segment_id);
    auto sid = tid.get_slot();
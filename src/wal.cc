@@ -0,0 +1,443 @@
+#include "simpledb/wal.h"
+#include "simpledb/buffer_manager.h"
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
+#include <tuple>
+#include <unordered_map>
+#if defined(__SSE4_2__)
+#include <nmmintrin.h>
+#endif
+
+using simpledb::AccessHint;
+using simpledb::WriteAheadLog;
+
+namespace {
+
+/// Equal words between two changed ranges up to which both are logged as one range, which is
+/// cheaper than the header of another range.
+constexpr size_t kMergeGapWords = 2;
+
+/// The records of a page are at most a bit larger than the page, this bounds a page size of 64 MiB.
+constexpr size_t kMaxRecordSize = 1ull << 27;
+
+/// How much of the log is read at once during a scan.
+constexpr size_t kScanBlockSize = 1ull << 20;
+
+/// The flusher writes the buffered records once there are this many, even if nobody waits for them.
+constexpr size_t kFlushThreshold = 1ull << 20;
+
+/// How much is zeroed with one write when the log grows.
+constexpr size_t kZeroBlockSize = 1ull << 20;
+
+constexpr std::array<uint32_t, 256> kCrcTable = [] {
+   std::array<uint32_t, 256> table{};
+   for (uint32_t i = 0; i < 256; ++i) {
+      uint32_t crc = i;
+      for (int bit = 0; bit < 8; ++bit) {
+         // reflected Castagnoli polynomial
+         crc = (crc >> 1) ^ ((crc & 1) ? 0x82F63B78u : 0);
+      }
+      table[i] = crc;
+   }
+   return table;
+}();
+
+uint32_t crc32c(const char* data, size_t size) {
+   uint32_t crc = ~0u;
+#if defined(__SSE4_2__)
+   uint64_t crc64 = crc;
+   for (; size >= 8; data += 8, size -= 8) {
+      uint64_t word;
+      std::memcpy(&word, data, sizeof(word));
+      crc64 = _mm_crc32_u64(crc64, word);
+   }
+   crc = static_cast<uint32_t>(crc64);
+#endif
+   for (; size > 0; ++data, --size) {
+      crc = (crc >> 8) ^ kCrcTable[(crc ^ static_cast<uint8_t>(*data)) & 0xFF];
+   }
+   return ~crc;
+}
+
+/// Returns the checksum of a record, which covers everything behind the checksum itself.
+uint32_t record_checksum(const char* record, size_t size) {
+   constexpr auto skip = sizeof(WriteAheadLog::RecordHeader::checksum);
+   return crc32c(record + skip, size - skip);
+}
+
+/// Returns the checksum of a master record, which covers everything behind the checksum itself.
+uint32_t master_checksum(const WriteAheadLog::MasterRecord& master) {
+   constexpr auto skip = sizeof(WriteAheadLog::MasterRecord::checksum);
+   return crc32c(reinterpret_cast<const char*>(&master) + skip, sizeof(master) - skip);
+}
+
+} // namespace
+
+WriteAheadLog::WriteAheadLog(std::unique_ptr<File> file, std::chrono::microseconds group_commit_window, size_t chunk_size)
+   : file(std::move(file)), groupCommitWindow(group_commit_window), chunkSize(std::max<size_t>(chunk_size, 1)), epoch(0), appendedLsn(0),
+     bufferOffset(0), flushedLsn(0), requestedLsn(0), urgent(false), syncCount(0), master{}, nextMasterSlot(0), stopFlusher(false) {
+   size_t masterSlot;
+   master = readMaster(masterSlot);
+   nextMasterSlot = masterSlot ^ 1;
+
+   // the records in front of the last checkpoint are not needed anymore
+   uint32_t lastEpoch = 0;
+   appendedLsn = scan(master.checkpoint_lsn != 0 ? master.checkpoint_lsn : kLogStart, [](uint64_t, const RecordHeader&, const char*) { return true; }, lastEpoch);
+   bufferOffset = appendedLsn;
+   flushedLsn = appendedLsn;
+   requestedLsn = appendedLsn;
+   preallocate(appendedLsn + 1);
+
+   // The epoch is durable before anything is appended. A record that a crash lost can be
+   // overwritten by a record of the same size, and the records behind it must not look like
+   // they follow the new one.
+   epoch = std::max(master.epoch, lastEpoch) + 1;
+   master.epoch = epoch;
+   writeMaster(master);
+
+   flusher = std::thread([this] { runFlusher(); });
+}
+
+WriteAheadLog::~WriteAheadLog() {
+   {
+      std::unique_lock lock(latch);
+      requestedLsn = appendedLsn;
+      urgent = true;
+      stopFlusher = true;
+   }
+   flusherCv.notify_one();
+   flusher.join();
+}
+
+void WriteAheadLog::preallocate(size_t size) {
+   auto oldSize = file->size();
+   if (size <= oldSize)
+      return;
+
+   auto newSize = (size + chunkSize - 1) / chunkSize * chunkSize;
+   file->resize(newSize);
+   std::vector<char> zeros(std::min(kZeroBlockSize, newSize - oldSize));
+   for (auto offset = oldSize; offset < newSize; offset += zeros.size()) {
+      file->write_block(zeros.data(), offset, std::min(zeros.size(), newSize - offset));
+   }
+   file->sync();
+}
+
+uint64_t WriteAheadLog::log_page(uint64_t page_id, const char* before, const char* after, size_t page_size) {
+   assert(page_size % sizeof(uint64_t) == 0);
+
+   // build the record outside of the latch
+   thread_local std::vector<char> record;
+   record.resize(sizeof(RecordHeader));
+   auto words = page_size / sizeof(uint64_t);
+   auto differs = [&](size_t word) {
+      return std::memcmp(before + word * sizeof(uint64_t), after + word * sizeof(uint64_t), sizeof(uint64_t)) != 0;
+   };
+   for (size_t begin = 0; begin < words;) {
+      if (!differs(begin)) {
+         ++begin;
+         continue;
+      }
+
+      // extend the range over the following changes that are close enough
+      auto end = begin + 1;
+      for (auto word = end; word < words && word - end < kMergeGapWords; ++word) {
+         if (differs(word))
+            end = word + 1;
+      }
+
+      RangeHeader range{static_cast<uint32_t>(begin * sizeof(uint64_t)), static_cast<uint32_t>((end - begin) * sizeof(uint64_t))};
+      auto rangeOffset = record.size();
+      record.resize(rangeOffset + sizeof(range) + range.size);
+      std::memcpy(record.data() + rangeOffset, &range, sizeof(range));
+      std::memcpy(record.data() + rangeOffset + sizeof(range), after + range.offset, range.size);
+      begin = end;
+   }
+   if (record.size() == sizeof(RecordHeader))
+      return 0;
+
+   return append(record, page_id, kPageRecord);
+}
+
+uint64_t WriteAheadLog::log_image(uint64_t page_id, const char* data, size_t page_size) {
+   assert(page_size % sizeof(uint64_t) == 0);
+
+   thread_local std::vector<char> record;
+   RangeHeader range{0, static_cast<uint32_t>(page_size)};
+   record.resize(sizeof(RecordHeader) + sizeof(range) + page_size);
+   std::memcpy(record.data() + sizeof(RecordHeader), &range, sizeof(range));
+   std::memcpy(record.data() + sizeof(RecordHeader) + sizeof(range), data, page_size);
+   return append(record, page_id, kPageRecord);
+}
+
+uint64_t WriteAheadLog::append(std::vector<char>& record, uint64_t page_id, RecordKind kind) {
+   RecordHeader header{0, static_cast<uint32_t>(record.size()), epoch, kind, page_id};
+   std::memcpy(record.data(), &header, sizeof(header));
+   header.checksum = record_checksum(record.data(), record.size());
+   std::memcpy(record.data(), &header.checksum, sizeof(header.checksum));
+
+   std::unique_lock lock(latch);
+   buffer.insert(buffer.end(), record.begin(), record.end());
+   appendedLsn += record.size();
+   if (buffer.size() >= kFlushThreshold && requestedLsn < appendedLsn) {
+      // keep the buffer small, the write is sequential anyway
+      requestedLsn = appendedLsn;
+      flusherCv.notify_one();
+   }
+   return appendedLsn;
+}
+
+uint64_t WriteAheadLog::commit() {
+   std::unique_lock lock(latch);
+   auto lsn = appendedLsn;
+   waitFlushed(lock, lsn, false);
+   return lsn;
+}
+
+void WriteAheadLog::flush(uint64_t lsn) {
+   if (flushedLsn.load() >= lsn)
+      return;
+   std::unique_lock lock(latch);
+   waitFlushed(lock, lsn, true);
+}
+
+uint64_t WriteAheadLog::get_lsn() {
+   std::unique_lock lock(latch);
+   return appendedLsn;
+}
+
+uint64_t WriteAheadLog::get_redo_lsn() {
+   std::unique_lock lock(latch);
+   return master.checkpoint_lsn != 0 ? master.redo_lsn : kLogStart;
+}
+
+void WriteAheadLog::waitFlushed(std::unique_lock<std::mutex>& lock, uint64_t lsn, bool urgent) {
+   if (flushedLsn.load() >= lsn)
+      return;
+   assert(lsn <= appendedLsn);
+   requestedLsn = std::max(requestedLsn, lsn);
+   this->urgent |= urgent;
+   flusherCv.notify_one();
+   flushedCv.wait(lock, [&] { return flushedLsn.load() >= lsn || error; });
+   if (flushedLsn.load() < lsn)
+      std::rethrow_exception(error);
+}
+
+void WriteAheadLog::runFlusher() {
+   std::vector<char> writing;
+
+   std::unique_lock lock(latch);
+   while (true) {
+      flusherCv.wait(lock, [&] { return stopFlusher || (requestedLsn > flushedLsn.load() && !error); });
+      if (requestedLsn <= flushedLsn.load() || error)
+         break;
+
+      if (!urgent && groupCommitWindow.count() > 0) {
+         // give other commits the chance to join this write
+         flusherCv.wait_for(lock, groupCommitWindow, [&] { return urgent; });
+      }
+      urgent = false;
+
+      writing.swap(buffer);
+      auto offset = bufferOffset;
+      auto end = appendedLsn;
+      bufferOffset = end;
+      lock.unlock();
+
+      try {
+         preallocate(end);
+         file->write_block(writing.data(), offset, writing.size());
+         file->sync();
+      } catch (...) {
+         lock.lock();
+         error = std::current_exception();
+         flushedCv.notify_all();
+         continue;
+      }
+      writing.clear();
+
+      lock.lock();
+      flushedLsn = end;
+      ++syncCount;
+      flushedCv.notify_all();
+   }
+}
+
+WriteAheadLog::MasterRecord WriteAheadLog::readMaster(size_t& slot) const {
+   MasterRecord newest{};
+   slot = 1;
+   for (size_t i = 0; i < 2; ++i) {
+      MasterRecord copy;
+      if ((i + 1) * kMasterSlotSize > file->size())
+         break;
+      file->read_block(i * kMasterSlotSize, sizeof(copy), reinterpret_cast<char*>(&copy));
+      // a torn copy is older than the other one, which is valid
+      if (master_checksum(copy) != copy.checksum || (copy.checkpoint_lsn != 0 && copy.checkpoint_lsn < kLogStart))
+         continue;
+      if (std::tie(copy.epoch, copy.checkpoint_lsn) > std::tie(newest.epoch, newest.checkpoint_lsn)) {
+         newest = copy;
+         slot = i;
+      }
+   }
+   return newest;
+}
+
+void WriteAheadLog::writeMaster(MasterRecord& new_master) {
+   new_master.checksum = master_checksum(new_master);
+   file->write_block(reinterpret_cast<const char*>(&new_master), nextMasterSlot * kMasterSlotSize, sizeof(new_master));
+   file->sync();
+   nextMasterSlot ^= 1;
+}
+
+uint64_t WriteAheadLog::scan(uint64_t offset, const std::function<bool(uint64_t offset, const RecordHeader& header, const char* record)>& callback, uint32_t& last_epoch) const {
+   auto fileSize = file->size();
+   std::vector<char> window;
+   uint64_t windowOffset = 0;
+   // makes sure that `window` holds [offset, offset + size[
+   auto load = [&](uint64_t offset, size_t size) {
+      if (offset + size > fileSize)
+         return false;
+      if (offset < windowOffset || offset + size > windowOffset + window.size()) {
+         window.resize(std::min<size_t>(std::max(size, kScanBlockSize), fileSize - offset));
+         windowOffset = offset;
+         file->read_block(offset, window.size(), window.data());
+      }
+      return true;
+   };
+
+   last_epoch = 0;
+   while (load(offset, sizeof(RecordHeader))) {
+      RecordHeader header;
+      std::memcpy(&header, window.data() + (offset - windowOffset), sizeof(header));
+      if (header.size < sizeof(RecordHeader) || header.size > kMaxRecordSize || header.epoch < std::max(last_epoch, 1u) || !load(offset, header.size))
+         break;
+      const auto* record = window.data() + (offset - windowOffset);
+      if (record_checksum(record, header.size) != header.checksum)
+         break;
+
+      if (!callback(offset, header, record))
+         break;
+      last_epoch = header.epoch;
+      offset += header.size;
+   }
+   return offset;
+}
+
+uint64_t WriteAheadLog::checkpoint(BufferManager& buffer_manager) {
+   if (buffer_manager.get_wal() != this) {
+      throw std::logic_error("can only checkpoint a buffer manager that logs into this log");
+   }
+   std::unique_lock checkpointLock(checkpointLatch);
+
+   // A page that isn't dirty now has its changes in front of `beginLsn` written, and its next
+   // change is logged behind it. The dirty pages are replayed from their recovery LSN.
+   auto beginLsn = get_lsn();
+   auto dirtyPages = buffer_manager.get_dirty_pages();
+   buffer_manager.sync_segments();
+
+   auto redoLsn = beginLsn;
+   std::vector<char> record(sizeof(RecordHeader) + sizeof(CheckpointHeader) + dirtyPages.size() * sizeof(DirtyPage));
+   CheckpointHeader checkpointHeader{beginLsn, dirtyPages.size()};
+   std::memcpy(record.data() + sizeof(RecordHeader), &checkpointHeader, sizeof(checkpointHeader));
+   auto* entries = record.data() + sizeof(RecordHeader) + sizeof(CheckpointHeader);
+   for (size_t i = 0; i < dirtyPages.size(); ++i) {
+      DirtyPage entry{dirtyPages[i].first, dirtyPages[i].second};
+      std::memcpy(entries + i * sizeof(DirtyPage), &entry, sizeof(entry));
+      redoLsn = std::min(redoLsn, entry.rec_lsn);
+   }
+   if (record.size() > kMaxRecordSize) {
+      throw std::length_error("too many dirty pages for a checkpoint");
+   }
+   auto endLsn = append(record, 0, kCheckpointRecord);
+   flush(endLsn);
+
+   // the master record points to the checkpoint only once it is durable
+   MasterRecord newMaster{0, epoch, endLsn - record.size(), redoLsn};
+   writeMaster(newMaster);
+   {
+      std::unique_lock lock(latch);
+      master = newMaster;
+   }
+
+   // let the file system free the log in front of the redo LSN, it reads as zeros from now on
+   file->discard(kLogStart, redoLsn - kLogStart);
+   return redoLsn;
+}
+
+void WriteAheadLog::recover(BufferManager& buffer_manager) const {
+   if (buffer_manager.get_wal() == this) {
+      throw std::logic_error("can't recover into a buffer manager that logs into the same log");
+   }
+
+   // the records in front of the checkpoint only have to be replayed for the pages that were
+   // dirty, and only from their recovery LSN on
+   size_t masterSlot;
+   auto lastMaster = readMaster(masterSlot);
+   uint64_t beginLsn = kLogStart;
+   std::unordered_map<uint64_t, uint64_t> dirtyPages;
+   uint32_t lastEpoch;
+   if (lastMaster.checkpoint_lsn != 0) {
+      scan(lastMaster.checkpoint_lsn, [&](uint64_t, const RecordHeader& header, const char* record) {
+         CheckpointHeader checkpointHeader;
+         if (header.kind != kCheckpointRecord || header.size < sizeof(RecordHeader) + sizeof(checkpointHeader)) {
+            throw std::runtime_error("corrupt checkpoint record");
+         }
+         std::memcpy(&checkpointHeader, record + sizeof(RecordHeader), sizeof(checkpointHeader));
+         if (header.size != sizeof(RecordHeader) + sizeof(checkpointHeader) + checkpointHeader.dirty_page_count * sizeof(DirtyPage)) {
+            throw std::runtime_error("corrupt checkpoint record");
+         }
+         beginLsn = checkpointHeader.begin_lsn;
+         const auto* entries = record + sizeof(RecordHeader) + sizeof(checkpointHeader);
+         for (uint64_t i = 0; i < checkpointHeader.dirty_page_count; ++i) {
+            DirtyPage entry;
+            std::memcpy(&entry, entries + i * sizeof(entry), sizeof(entry));
+            auto [it, inserted] = dirtyPages.emplace(entry.page_id, entry.rec_lsn);
+            if (!inserted)
+               it->second = std::min(it->second, entry.rec_lsn);
+         }
+         return false;
+      },
+           lastEpoch);
+   }
+
+   scan(lastMaster.checkpoint_lsn != 0 ? lastMaster.redo_lsn : kLogStart, [&](uint64_t offset, const RecordHeader& header, const char* record) {
+      if (header.kind != kPageRecord)
+         return true;
+      if (offset < beginLsn) {
+         auto it = dirtyPages.find(header.page_id);
+         if (it == dirtyPages.end() || offset < it->second)
+            return true;
+      }
+
+      // A full image doesn't need the page on disk, which a crash may have torn. A torn slot of a
+      // compressed segment can't even be loaded.
+      auto isImage = false;
+      if (header.size == sizeof(RecordHeader) + sizeof(RangeHeader) + buffer_manager.get_page_size()) {
+         RangeHeader range;
+         std::memcpy(&range, record + sizeof(RecordHeader), sizeof(range));
+         isImage = range.offset == 0 && range.size == buffer_manager.get_page_size();
+      }
+      auto& bf = buffer_manager.fix_page(header.page_id, true, isImage ? AccessHint::OVERWRITE : AccessHint::NORMAL);
+      for (auto offset = sizeof(RecordHeader); offset < header.size;) {
+         RangeHeader range;
+         std::memcpy(&range, record + offset, sizeof(range));
+         offset += sizeof(range);
+         if (offset + range.size > header.size || range.offset + range.size > buffer_manager.get_page_size()) {
+            buffer_manager.unfix_page(bf, true);
+            throw std::runtime_error("corrupt log record");
+         }
+         std::memcpy(bf.get_data() + range.offset, record + offset, range.size);
+         offset += range.size;
+      }
+      buffer_manager.unfix_page(bf, true);
+      return true;
+   },
+        lastEpoch);
+
+   // the next checkpoint assumes that pages that aren't dirty are on disk
+   buffer_manager.flush_all();
+   buffer_manager.sync_segments();
+}
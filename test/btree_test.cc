@@ -1,11 +1,15 @@
 #include "simpledb/btree.h"
 #include <algorithm>
+#include <atomic>
 #include <barrier>
 #include <cstddef>
+#include <limits>
 #include <numeric>
+#include <optional>
 #include <random>
 #include <sstream>
 #include <thread>
+#include <type_traits>
 #include <vector>
 #include <gtest/gtest.h>
 
@@ -147,6 +151,32 @@ TEST(BTreeTest, LeafNodeSplit) {
    }
 }
 
+template <typename T>
+void test_node_search() {
+   std::vector<T> keys;
+   for (T i = 0; keys.size() < 40; ++i) {
+      keys.push_back(std::is_signed_v<T> ? 3 * i - 50 : 3 * i);
+   }
+   keys.back() = std::numeric_limits<T>::max();
+   for (size_t n = 0; n <= keys.size(); ++n) {
+      for (size_t i = 0; i < keys.size(); ++i) {
+         for (T val : {static_cast<T>(keys[i] - 1), keys[i], static_cast<T>(keys[i] + 1), std::numeric_limits<T>::min()}) {
+            ASSERT_EQ(std::lower_bound(keys.begin(), keys.begin() + n, val) - keys.begin(),
+                      simpledb::lower_bound_simd(keys.data(), keys.data() + n, val))
+               << "n=" << n << " val=" << val;
+         }
+      }
+   }
+}
+
+// NOLINTNEXTLINE
+TEST(BTreeTest, NodeSearch) {
+   test_node_search<uint64_t>();
+   test_node_search<int64_t>();
+   test_node_search<uint32_t>();
+   test_node_search<int32_t>();
+}
+
 // NOLINTNEXTLINE
 TEST(BTreeTest, InsertEmptyTree) {
    BufferManager buffer_manager(1024, 100);
@@ -410,6 +440,224 @@ TEST(BTreeTest, Erase) {
    }
 }
 
+// NOLINTNEXTLINE
+TEST(BTreeTest, BulkLoad) {
+   BufferManager buffer_manager(1024, 1000);
+   auto n = 50 * BTree::LeafNode::kCapacity + 7;
+   std::vector<std::pair<uint64_t, uint64_t>> entries;
+   for (auto i = 0ul; i < n; ++i) {
+      entries.emplace_back(2 * i, 4 * i);
+   }
+
+   for (auto fill : {1.0, 0.5}) {
+      BTree tree(static_cast<uint16_t>(fill * 10), buffer_manager);
+      tree.bulk_load(entries.begin(), entries.end(), fill);
+
+      // 51 full leaves fit below one root, twice as many half full ones don't
+      EXPECT_EQ(fill == 1.0 ? 2 : 3, tree.treeHeight.load());
+
+      for (auto i = 0ul; i < n; ++i) {
+         auto v = tree.lookup(2 * i);
+         ASSERT_TRUE(v)
+            << "key=" << 2 * i << " is missing";
+         ASSERT_EQ(*v, 4 * i);
+         ASSERT_FALSE(tree.lookup(2 * i + 1));
+      }
+
+      uint64_t expected = 0;
+      tree.scan(0, ~0ull, [&](uint64_t key, uint64_t value) {
+         EXPECT_EQ(expected, key);
+         EXPECT_EQ(2 * key, value);
+         expected += 2;
+         return true;
+      });
+      EXPECT_EQ(2 * n, expected);
+
+      // the tree behaves like any other afterwards
+      auto nodes = tree.nodeCount.load();
+      for (auto i = 0ul; i < n; ++i) {
+         tree.insert(2 * i + 1, 0);
+      }
+      if (fill == 0.5) {
+         // half full leaves take as many entries again without a split
+         EXPECT_EQ(nodes, tree.nodeCount.load());
+      }
+      for (auto i = 0ul; i < 2 * n; ++i) {
+         ASSERT_TRUE(tree.lookup(i))
+            << "key=" << i << " is missing";
+      }
+   }
+
+   // nothing to load
+   BTree tree(20, buffer_manager);
+   tree.bulk_load(entries.begin(), entries.begin());
+   EXPECT_EQ(1, tree.treeHeight.load());
+   EXPECT_FALSE(tree.lookup(0));
+}
+
+// NOLINTNEXTLINE
+TEST(BTreeTest, LookupBatch) {
+   BufferManager buffer_manager(1024, 1000);
+   BTree tree(0, buffer_manager);
+   auto n = 100 * BTree::LeafNode::kCapacity;
+   for (auto i = 0ul; i < n; ++i) {
+      tree.insert(2 * i, 4 * i);
+   }
+
+   std::vector<uint64_t> keys;
+   std::optional<uint64_t> none;
+   std::vector<std::optional<uint64_t>> values;
+   tree.lookup_batch(keys, values);
+
+   // duplicates, missing keys and a size that doesn't fill the last group
+   std::mt19937_64 engine{0};
+   std::uniform_int_distribution<uint64_t> distribution{0, 2 * n + 10};
+   for (size_t i = 0; i < 1000; ++i) {
+      keys.push_back(distribution(engine));
+   }
+   keys.push_back(keys.front());
+   values.resize(keys.size(), 42);
+   tree.lookup_batch(keys, values);
+   for (size_t i = 0; i < keys.size(); ++i) {
+      ASSERT_EQ(tree.lookup(keys[i]), values[i]) << "k=" << keys[i];
+      ASSERT_EQ(keys[i] % 2 == 0 && keys[i] < 2 * n ? std::optional<uint64_t>{2 * keys[i]} : none, values[i]) << "k=" << keys[i];
+   }
+}
+
+/// Returns the number of leaves, walking them through their sibling links.
+size_t count_leaves(BufferManager& buffer_manager, BTree& tree) {
+   auto pid = tree.root.load();
+   while (true) {
+      auto& frame = buffer_manager.fix_page(pid, false);
+      auto& node = *reinterpret_cast<BTree::InnerNode*>(frame.get_data());
+      auto leaf = node.is_leaf();
+      auto next = leaf ? reinterpret_cast<BTree::LeafNode&>(node).next : node.children[0];
+      buffer_manager.unfix_page(frame, false);
+      if (leaf)
+         break;
+      pid = next;
+   }
+   size_t leaves = 0;
+   while (pid != BTree::LeafNode::kNoLeaf) {
+      auto& frame = buffer_manager.fix_page(pid, false);
+      pid = reinterpret_cast<BTree::LeafNode*>(frame.get_data())->next;
+      buffer_manager.unfix_page(frame, false);
+      ++leaves;
+   }
+   return leaves;
+}
+
+// NOLINTNEXTLINE
+TEST(BTreeTest, EraseRebalance) {
+   BufferManager buffer_manager(1024, 1000);
+   BTree tree(0, buffer_manager);
+   auto n = 100 * BTree::LeafNode::kCapacity;
+
+   std::vector<uint64_t> keys(n);
+   std::iota(keys.begin(), keys.end(), 0);
+   std::shuffle(keys.begin(), keys.end(), std::mt19937_64{0});
+   for (auto key : keys) {
+      tree.insert(key, 2 * key);
+   }
+   EXPECT_EQ(3, tree.treeHeight.load());
+   auto nodes = tree.nodeCount.load();
+
+   // keep every 50th key
+   for (auto key : keys) {
+      if (key % 50 != 0) {
+         tree.erase(key);
+      }
+   }
+   for (auto i = 0ul; i < n; ++i) {
+      ASSERT_EQ(i % 50 == 0 ? std::optional<uint64_t>{2 * i} : std::optional<uint64_t>{}, tree.lookup(i))
+         << "k=" << i;
+   }
+   // two leaves are enough, with at least a quarter of the entries in each
+   EXPECT_EQ(2, tree.treeHeight.load());
+   EXPECT_GE(8, count_leaves(buffer_manager, tree));
+
+   uint64_t expected = 0;
+   tree.scan(0, n, [&](uint64_t key, uint64_t) {
+      EXPECT_EQ(expected, key);
+      expected += 50;
+      return true;
+   });
+   EXPECT_EQ(n, expected);
+
+   // the freed nodes are reused
+   for (auto key : keys) {
+      tree.insert(key, 2 * key);
+   }
+   EXPECT_GE(nodes + 20, tree.nodeCount.load());
+
+   // erasing everything leaves a single leaf
+   for (auto key : keys) {
+      tree.erase(key);
+   }
+   EXPECT_EQ(1, tree.treeHeight.load());
+   EXPECT_FALSE(tree.lookup(keys[0]));
+}
+
+// NOLINTNEXTLINE
+TEST(BTreeTest, Compact) {
+   BufferManager buffer_manager(1024, 1000);
+   BTree tree(0, buffer_manager, 0);
+   auto n = 100 * BTree::LeafNode::kCapacity;
+
+   std::vector<uint64_t> keys(n);
+   std::iota(keys.begin(), keys.end(), 0);
+   std::shuffle(keys.begin(), keys.end(), std::mt19937_64{0});
+   for (auto key : keys) {
+      tree.insert(key, 2 * key);
+   }
+   auto leaves = count_leaves(buffer_manager, tree);
+   for (auto key : keys) {
+      if (key % 4 != 0) {
+         tree.erase(key);
+      }
+   }
+   // no rebalancing
+   EXPECT_EQ(leaves, count_leaves(buffer_manager, tree));
+
+   tree.compact();
+   // full leaves, except for the last one below each parent
+   EXPECT_GE(n / 4 / BTree::LeafNode::kCapacity + 3, count_leaves(buffer_manager, tree));
+   EXPECT_EQ(2, tree.treeHeight.load());
+   for (auto i = 0ul; i < n; ++i) {
+      ASSERT_EQ(i % 4 == 0 ? std::optional<uint64_t>{2 * i} : std::optional<uint64_t>{}, tree.lookup(i))
+         << "k=" << i;
+   }
+
+   // leave room for inserts
+   BTree sparse(1, buffer_manager, 0);
+   for (auto key : keys) {
+      sparse.insert(key, 2 * key);
+   }
+   for (auto key : keys) {
+      if (key % 4 != 0) {
+         sparse.erase(key);
+      }
+   }
+   sparse.compact(0.5);
+   auto halfFull = n / 4 / (BTree::LeafNode::kCapacity / 2);
+   EXPECT_LE(halfFull, count_leaves(buffer_manager, sparse));
+   EXPECT_GE(halfFull + 3, count_leaves(buffer_manager, sparse));
+   auto nodes = sparse.nodeCount.load();
+   for (auto i = 0ul; i < n; i += 4) {
+      sparse.insert(i + 1, 2 * (i + 1));
+   }
+   EXPECT_EQ(nodes, sparse.nodeCount.load());
+
+   uint64_t expected = 0;
+   sparse.scan(0, n, [&](uint64_t key, uint64_t value) {
+      EXPECT_EQ(expected, key);
+      EXPECT_EQ(2 * key, value);
+      expected += expected % 4 == 0 ? 1 : 3;
+      return true;
+   });
+   EXPECT_EQ(n, expected);
+}
+
 TEST(BTreeTest, MultithreadWriters) {
    BufferManager buffer_manager(1024, 100);
    BTree tree(0, buffer_manager);
@@ -439,4 +687,127 @@ TEST(BTreeTest, MultithreadWriters) {
       t.join();
 }
 
+TEST(BTreeTest, Scan) {
+   BufferManager buffer_manager(1024, 100);
+   BTree tree(0, buffer_manager);
+
+   // only even keys, in random order so every leaf gets split somewhere
+   std::vector<uint64_t> keys(8 * BTree::LeafNode::kCapacity);
+   std::iota(keys.begin(), keys.end(), 0);
+   std::shuffle(keys.begin(), keys.end(), std::mt19937_64{0});
+   for (auto key : keys) {
+      tree.insert(2 * key, key);
+   }
+
+   auto scan = [&](uint64_t from, uint64_t to, size_t limit = ~0ull) {
+      std::vector<uint64_t> seen;
+      tree.scan(from, to, [&](uint64_t key, uint64_t value) {
+         EXPECT_EQ(key, 2 * value);
+         seen.push_back(key);
+         return seen.size() < limit;
+      });
+      return seen;
+   };
+
+   auto all = scan(0, ~0ull);
+   ASSERT_EQ(keys.size(), all.size());
+   for (size_t i = 0; i < all.size(); ++i) {
+      ASSERT_EQ(2 * i, all[i]);
+   }
+
+   // bounds that are not in the tree
+   std::vector<uint64_t> expected{102, 104, 106, 108};
+   EXPECT_EQ(expected, scan(101, 109));
+   EXPECT_EQ(expected, scan(102, 108));
+   EXPECT_EQ(std::vector<uint64_t>{102}, scan(101, 109, 1));
+   EXPECT_TRUE(scan(101, 101).empty());
+   EXPECT_TRUE(scan(2 * keys.size(), ~0ull).empty());
+
+   // a range that spans several leaves
+   auto range = scan(10, 10 + 6 * BTree::LeafNode::kCapacity);
+   EXPECT_EQ(3 * BTree::LeafNode::kCapacity + 1, range.size());
+   EXPECT_TRUE(std::is_sorted(range.begin(), range.end()));
+}
+
+TEST(BTreeTest, MultithreadReadersWriters) {
+   BufferManager buffer_manager(1024, 100);
+   BTree tree(0, buffer_manager);
+
+   static constexpr size_t kKeys = 8 * BTree::LeafNode::kCapacity;
+   std::atomic<bool> done = false;
+   std::vector<std::thread> threads;
+   // writers split and merge nodes all the time
+   for (size_t thread = 0; thread < 2; ++thread) {
+      threads.emplace_back([thread, &tree] {
+         for (auto i = thread; i < kKeys; i += 2) {
+            tree.insert(i, 2 * i);
+         }
+         for (size_t round = 0; round < 4; ++round) {
+            for (auto i = thread; i < kKeys; i += 4) {
+               tree.erase(i);
+            }
+            for (auto i = thread; i < kKeys; i += 4) {
+               tree.insert(i, 2 * i);
+            }
+         }
+         for (auto i = thread; i < kKeys; i += 4) {
+            tree.erase(i);
+         }
+      });
+   }
+   // readers never see a torn value
+   for (size_t thread = 0; thread < 2; ++thread) {
+      threads.emplace_back([thread, &tree, &done] {
+         std::mt19937_64 engine{thread};
+         std::uniform_int_distribution<uint64_t> keys{0, kKeys - 1};
+         while (!done) {
+            auto key = keys(engine);
+            auto res = tree.lookup(key);
+            if (res) {
+               ASSERT_EQ(2 * key, *res);
+            }
+         }
+      });
+   }
+   threads.emplace_back([&tree, &done] {
+      std::mt19937_64 engine{2};
+      std::uniform_int_distribution<uint64_t> distribution{0, kKeys - 1};
+      std::vector<uint64_t> keys(100);
+      std::vector<std::optional<uint64_t>> values(keys.size());
+      while (!done) {
+         for (auto& key : keys) {
+            key = distribution(engine);
+         }
+         tree.lookup_batch(keys, values);
+         for (size_t i = 0; i < keys.size(); ++i) {
+            if (values[i]) {
+               ASSERT_EQ(2 * keys[i], *values[i]);
+            }
+         }
+      }
+   });
+   // and scans see every key once in order
+   threads.emplace_back([&tree, &done] {
+      while (!done) {
+         std::optional<uint64_t> last;
+         tree.scan(0, kKeys, [&](uint64_t key, uint64_t value) {
+            EXPECT_TRUE(!last || *last < key);
+            EXPECT_EQ(2 * key, value);
+            last = key;
+            return true;
+         });
+      }
+   });
+   threads[0].join();
+   threads[1].join();
+   done = true;
+   for (size_t i = 2; i < threads.size(); ++i) {
+      threads[i].join();
+   }
+
+   for (auto i = 0ul; i < kKeys; ++i) {
+      EXPECT_EQ(i % 4 < 2 ? std::optional<uint64_t>{} : std::optional<uint64_t>{2 * i}, tree.lookup(i)) << "k=" << i;
+   }
+}
+
 } // namespace
@@ -1,10 +1,13 @@
 #include "simpledb/buffer_manager.h"
 #include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <cstdio>
 #include <cstring>
 #include <mutex>
 #include <random>
+#include <stdexcept>
 #include <thread>
 #include <vector>
 #include <gtest/gtest.h>
@@ -61,6 +64,313 @@ TEST(BufferManagerTest, PersistentRestart) {
    }
 }
 
+// NOLINTNEXTLINE
+TEST(BufferManagerTest, HugePageArena) {
+   // falls back to regular pages when no huge pages are available
+   simpledb::BufferManager buffer_manager{1024, 10, true};
+   std::vector<char*> data;
+   for (uint64_t i = 0; i < 20; ++i) {
+      auto& page = buffer_manager.fix_page(i, true);
+      ASSERT_TRUE(page.get_data());
+      std::memset(page.get_data(), static_cast<int>(i), 1024);
+      data.push_back(page.get_data());
+      buffer_manager.unfix_page(page, true);
+   }
+   // evicted pages are reloaded into the frames that are reused
+   std::sort(data.begin(), data.end());
+   EXPECT_EQ(10, std::unique(data.begin(), data.end()) - data.begin());
+   for (uint64_t i = 0; i < 20; ++i) {
+      auto& page = buffer_manager.fix_page(i, false);
+      EXPECT_EQ(static_cast<char>(i), page.get_data()[0]);
+      EXPECT_EQ(static_cast<char>(i), page.get_data()[1023]);
+      buffer_manager.unfix_page(page, false);
+   }
+}
+
+// NOLINTNEXTLINE
+TEST(BufferManagerTest, FlushAll) {
+   auto base = static_cast<char>(std::random_device{}() % 128);
+   simpledb::BufferManager buffer_manager{1024, 10};
+   // pages 2 and 4 are not adjacent to the others
+   for (uint64_t segment_page : {0, 1, 2, 4, 6, 7, 8}) {
+      uint64_t page_id = (1ull << 48) | segment_page;
+      auto& page = buffer_manager.fix_page(page_id, true);
+      std::memset(page.get_data(), base + static_cast<char>(segment_page), 1024);
+      buffer_manager.unfix_page(page, true);
+   }
+   buffer_manager.flush_all();
+
+   auto file = simpledb::File::open_file("1", simpledb::File::READ);
+   std::vector<char> block(1024);
+   for (uint64_t segment_page : {0, 1, 2, 4, 6, 7, 8}) {
+      file->read_block(segment_page * 1024, 1024, block.data());
+      EXPECT_EQ(std::vector<char>(1024, static_cast<char>(base + segment_page)), block);
+   }
+}
+
+// NOLINTNEXTLINE
+TEST(BufferManagerTest, BackgroundWriter) {
+   // segment files outlive the test, so don't rely on their old content
+   auto value = static_cast<char>(std::random_device{}() % 255 + 1);
+   simpledb::BufferManager buffer_manager{1024, 10};
+   for (uint64_t segment_page = 0; segment_page < 10; ++segment_page) {
+      uint64_t page_id = (2ull << 48) | segment_page;
+      auto& page = buffer_manager.fix_page(page_id, true);
+      std::memset(page.get_data(), value, 1024);
+      buffer_manager.unfix_page(page, true);
+   }
+
+   // the page that is evicted next is written back eventually without anyone asking for it
+   auto file = simpledb::File::open_file("2", simpledb::File::READ);
+   std::vector<char> block(1024);
+   for (int i = 0; i < 500; ++i) {
+      file->read_block(0, 1024, block.data());
+      if (block[0] == value)
+         break;
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+   }
+   EXPECT_EQ(std::vector<char>(1024, value), block);
+}
+
+/// Wait until the fifo list has the given length.
+std::vector<uint64_t> wait_for_fifo_list(const simpledb::BufferManager& buffer_manager, size_t length) {
+   auto fifo_list = buffer_manager.get_fifo_list();
+   for (int i = 0; i < 500 && fifo_list.size() < length; ++i) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      fifo_list = buffer_manager.get_fifo_list();
+   }
+   return fifo_list;
+}
+
+// NOLINTNEXTLINE
+TEST(BufferManagerTest, Prefetch) {
+   simpledb::BufferManager buffer_manager{1024, 16};
+   buffer_manager.prefetch(1, 4);
+   EXPECT_EQ((std::vector<uint64_t>{1, 2, 3, 4}), wait_for_fifo_list(buffer_manager, 4));
+
+   // the first fix of a prefetched page doesn't count as a second reference
+   auto& page = buffer_manager.fix_page(2, false);
+   buffer_manager.unfix_page(page, false);
+   EXPECT_EQ((std::vector<uint64_t>{1, 2, 3, 4}), buffer_manager.get_fifo_list());
+   EXPECT_TRUE(buffer_manager.get_lru_list().empty());
+
+   auto& page2 = buffer_manager.fix_page(2, false);
+   buffer_manager.unfix_page(page2, false);
+   EXPECT_EQ((std::vector<uint64_t>{1, 3, 4}), buffer_manager.get_fifo_list());
+   EXPECT_EQ(std::vector<uint64_t>{2}, buffer_manager.get_lru_list());
+
+   // at most a quarter of the pages, loaded pages are skipped
+   buffer_manager.prefetch(3, 10);
+   EXPECT_EQ((std::vector<uint64_t>{1, 3, 4, 5, 6}), wait_for_fifo_list(buffer_manager, 5));
+}
+
+// NOLINTNEXTLINE
+TEST(BufferManagerTest, ReadAhead) {
+   simpledb::BufferManager buffer_manager{1024, 64};
+   buffer_manager.set_read_ahead(4);
+   for (uint64_t i = 0; i < 2; ++i) {
+      auto& page = buffer_manager.fix_page(i, false);
+      buffer_manager.unfix_page(page, false);
+   }
+   // the second sequential miss reads the next window ahead
+   EXPECT_EQ((std::vector<uint64_t>{0, 1, 2, 3, 4, 5}), wait_for_fifo_list(buffer_manager, 6));
+
+   // fixing the first page of the window continues with the next one
+   auto& page = buffer_manager.fix_page(2, false);
+   buffer_manager.unfix_page(page, false);
+   EXPECT_EQ((std::vector<uint64_t>{0, 1, 2, 3, 4, 5, 6, 7, 8, 9}), wait_for_fifo_list(buffer_manager, 10));
+   EXPECT_TRUE(buffer_manager.get_lru_list().empty());
+}
+
+// NOLINTNEXTLINE
+TEST(BufferManagerTest, MappedSegment) {
+   // the segment must have exactly 20 pages
+   std::remove("5");
+   auto base = static_cast<char>(std::random_device{}() % 64);
+   simpledb::BufferManager buffer_manager{1024, 10};
+   for (uint64_t segment_page = 0; segment_page < 20; ++segment_page) {
+      uint64_t page_id = (5ull << 48) | segment_page;
+      auto& page = buffer_manager.fix_page(page_id, true);
+      std::memset(page.get_data(), base + static_cast<char>(segment_page), 1024);
+      buffer_manager.unfix_page(page, true);
+   }
+   buffer_manager.map_segment(5, simpledb::MappedFile::SEQUENTIAL);
+
+   auto fifo_list = buffer_manager.get_fifo_list();
+   for (uint64_t segment_page = 0; segment_page < 20; ++segment_page) {
+      auto& page = buffer_manager.fix_page((5ull << 48) | segment_page, false);
+      EXPECT_EQ(static_cast<char>(base + segment_page), page.get_data()[0]);
+      EXPECT_EQ(static_cast<char>(base + segment_page), page.get_data()[1023]);
+      buffer_manager.unfix_page(page, false);
+   }
+   // no frames were used
+   EXPECT_EQ(fifo_list, buffer_manager.get_fifo_list());
+   EXPECT_TRUE(buffer_manager.get_lru_list().empty());
+
+   EXPECT_THROW(buffer_manager.fix_page(5ull << 48, true), std::logic_error);
+   EXPECT_THROW(buffer_manager.fix_page((5ull << 48) | 20, false), std::out_of_range);
+
+   buffer_manager.unmap_segment(5);
+   auto& page = buffer_manager.fix_page(5ull << 48, true);
+   EXPECT_EQ(base, page.get_data()[0]);
+   buffer_manager.unfix_page(page, false);
+}
+
+// NOLINTNEXTLINE
+TEST(BufferManagerTest, CompressedSegment) {
+   std::remove("7");
+   constexpr size_t page_size = 16384;
+   constexpr uint64_t page_count = 30;
+   std::mt19937_64 engine{0};
+   std::vector<char> random(page_size);
+   for (auto& c : random) {
+      c = static_cast<char>(engine());
+   }
+
+   // mostly empty pages and one that doesn't compress, more than fit into the frames
+   auto fill = [&](uint64_t segment_page, char* data) {
+      if (segment_page == 3) {
+         std::memcpy(data, random.data(), page_size);
+      } else {
+         std::memset(data, 0, page_size);
+         std::memset(data, static_cast<char>(segment_page), 100);
+         std::memset(data + page_size - 100, static_cast<char>(segment_page + 1), 100);
+      }
+   };
+   {
+      simpledb::BufferManager buffer_manager{page_size, 10};
+      buffer_manager.set_compression(7, simpledb::PageCompression::LZ);
+      EXPECT_EQ(simpledb::PageCompression::LZ, buffer_manager.get_compression(7));
+      for (uint64_t segment_page = 0; segment_page < page_count; ++segment_page) {
+         auto& page = buffer_manager.fix_page((7ull << 48) | segment_page, true);
+         fill(segment_page, page.get_data());
+         buffer_manager.unfix_page(page, true);
+      }
+      EXPECT_THROW(buffer_manager.map_segment(7, simpledb::MappedFile::NORMAL), std::logic_error);
+   }
+
+   // read them back one by one and in batches
+   simpledb::BufferManager buffer_manager{page_size, 10};
+   buffer_manager.set_compression(7, simpledb::PageCompression::LZ);
+   std::vector<char> expected(page_size);
+   for (uint64_t segment_page = 0; segment_page < page_count; ++segment_page) {
+      if (segment_page % 5 == 0) {
+         buffer_manager.prefetch((7ull << 48) | segment_page, 5);
+      }
+      auto& page = buffer_manager.fix_page((7ull << 48) | segment_page, false);
+      fill(segment_page, expected.data());
+      ASSERT_EQ(0, std::memcmp(expected.data(), page.get_data(), page_size)) << segment_page;
+      buffer_manager.unfix_page(page, false);
+   }
+
+   // pages that were never written are empty
+   auto& page = buffer_manager.fix_page((7ull << 48) | (page_count + 5), false);
+   EXPECT_TRUE(std::all_of(page.get_data(), page.get_data() + page_size, [](char c) { return c == 0; }));
+   buffer_manager.unfix_page(page, false);
+}
+
+// NOLINTNEXTLINE
+TEST(BufferManagerTest, OptimisticFix) {
+   simpledb::BufferManager buffer_manager{1024, 10};
+   {
+      auto& page = buffer_manager.fix_page(1, true);
+      std::memset(page.get_data(), 7, 1024);
+      buffer_manager.unfix_page(page, true);
+   }
+
+   uint64_t version;
+   auto& frame = buffer_manager.fix_page_optimistic(1, version);
+   EXPECT_EQ(7, frame.get_optimistic_data()[1023]);
+   EXPECT_TRUE(simpledb::BufferManager::validate(frame, version));
+
+   // shared fixes don't invalidate optimistic reads
+   auto& shared = buffer_manager.fix_page(1, false);
+   buffer_manager.unfix_page(shared, false);
+   EXPECT_TRUE(simpledb::BufferManager::validate(frame, version));
+
+   // exclusive ones do
+   EXPECT_TRUE(buffer_manager.upgrade(frame, version));
+   buffer_manager.unfix_page(frame, false);
+   EXPECT_FALSE(simpledb::BufferManager::validate(frame, version));
+   EXPECT_FALSE(buffer_manager.upgrade(frame, version));
+
+   // pages that are only fixed optimistically are loaded as well
+   auto& other = buffer_manager.fix_page_optimistic(2, version);
+   EXPECT_TRUE(simpledb::BufferManager::validate(other, version));
+   EXPECT_EQ(std::vector<uint64_t>{2}, buffer_manager.get_fifo_list());
+   EXPECT_EQ(std::vector<uint64_t>{1}, buffer_manager.get_lru_list());
+}
+
+// NOLINTNEXTLINE
+TEST(BufferManagerTest, OptimisticSecondChance) {
+   simpledb::BufferManager buffer_manager{1024, 10};
+   for (uint64_t i = 0; i < 10; ++i) {
+      auto& page = buffer_manager.fix_page(i, false);
+      buffer_manager.unfix_page(page, false);
+   }
+   uint64_t version;
+   buffer_manager.fix_page_optimistic(0, version);
+
+   // page 0 was referenced again, so page 1 is evicted and page 0 moves to the lru list
+   auto& page = buffer_manager.fix_page(10, false);
+   buffer_manager.unfix_page(page, false);
+   EXPECT_EQ((std::vector<uint64_t>{2, 3, 4, 5, 6, 7, 8, 9, 10}), buffer_manager.get_fifo_list());
+   EXPECT_EQ(std::vector<uint64_t>{0}, buffer_manager.get_lru_list());
+}
+
+// NOLINTNEXTLINE
+TEST(BufferManagerTest, ScanRing) {
+   simpledb::BufferManager buffer_manager{1024, 10};
+   for (uint64_t i = 0; i < 7; ++i) {
+      for (auto j = 0; j < (i < 4 ? 2 : 1); ++j) {
+         auto& page = buffer_manager.fix_page(i, false);
+         buffer_manager.unfix_page(page, false);
+      }
+   }
+
+   // the scan takes the free frames and then reuses its own, the other pages stay
+   for (uint64_t i = 100; i < 200; ++i) {
+      auto& page = buffer_manager.fix_page(i, false, simpledb::AccessHint::SEQUENTIAL_ONCE);
+      buffer_manager.unfix_page(page, false);
+   }
+   auto& page = buffer_manager.fix_page(4, false, simpledb::AccessHint::SEQUENTIAL_ONCE);
+   buffer_manager.unfix_page(page, false);
+   EXPECT_EQ((std::vector<uint64_t>{4, 5, 6}), buffer_manager.get_fifo_list());
+   EXPECT_EQ((std::vector<uint64_t>{0, 1, 2, 3}), buffer_manager.get_lru_list());
+   EXPECT_EQ((std::vector<uint64_t>{197, 198, 199}), buffer_manager.get_ring_list());
+
+   // a reference that is not part of a scan moves the page to the fifo list
+   auto& scanned = buffer_manager.fix_page(199, false);
+   buffer_manager.unfix_page(scanned, false);
+   EXPECT_EQ((std::vector<uint64_t>{4, 5, 6, 199}), buffer_manager.get_fifo_list());
+   EXPECT_EQ((std::vector<uint64_t>{197, 198}), buffer_manager.get_ring_list());
+}
+
+// NOLINTNEXTLINE
+TEST(BufferManagerTest, PinHot) {
+   simpledb::BufferManager buffer_manager{1024, 10};
+   // at most a quarter of the pages are pinned
+   for (uint64_t i = 0; i < 3; ++i) {
+      auto& page = buffer_manager.fix_page(i, false, simpledb::AccessHint::PIN_HOT);
+      buffer_manager.unfix_page(page, false);
+   }
+   EXPECT_EQ(std::vector<uint64_t>{2}, buffer_manager.get_fifo_list());
+   EXPECT_EQ((std::vector<uint64_t>{0, 1}), buffer_manager.get_lru_list());
+
+   // pages that are used twice push each other out of the lru list, but not the pinned ones
+   for (uint64_t i = 10; i < 40; ++i) {
+      for (auto j = 0; j < 2; ++j) {
+         auto& page = buffer_manager.fix_page(i, false);
+         buffer_manager.unfix_page(page, false);
+      }
+   }
+   auto lru = buffer_manager.get_lru_list();
+   EXPECT_EQ(lru.size(), 10);
+   EXPECT_NE(std::find(lru.begin(), lru.end(), 0), lru.end());
+   EXPECT_NE(std::find(lru.begin(), lru.end(), 1), lru.end());
+   EXPECT_EQ(std::find(lru.begin(), lru.end(), 2), lru.end());
+}
+
 // NOLINTNEXTLINE
 TEST(BufferManagerTest, FIFOEvict) {
    simpledb::BufferManager buffer_manager{1024, 10};
@@ -100,6 +410,53 @@ TEST(BufferManagerTest, BufferFull) {
    }
 }
 
+// NOLINTNEXTLINE
+TEST(BufferManagerTest, Resize) {
+   simpledb::BufferManager buffer_manager{1024, 10, false, 20};
+   EXPECT_EQ(buffer_manager.get_page_count(), 10);
+   EXPECT_EQ(buffer_manager.get_max_page_count(), 20);
+
+   // more pages fit after growing
+   std::vector<simpledb::BufferFrame*> pages;
+   for (uint64_t i = 0; i < 10; ++i) {
+      pages.push_back(&buffer_manager.fix_page(i, true));
+   }
+   EXPECT_EQ(buffer_manager.resize(100), 20);
+   for (uint64_t i = 10; i < 20; ++i) {
+      pages.push_back(&buffer_manager.fix_page(i, true));
+   }
+   // NOLINTNEXTLINE
+   EXPECT_THROW(buffer_manager.fix_page(20, false), simpledb::buffer_full_error);
+
+   // shrinking stops at the fixed pages
+   for (uint64_t i = 0; i < 20; ++i) {
+      std::memcpy(pages[i]->get_data(), &i, sizeof(i));
+      buffer_manager.unfix_page(*pages[i], i < 15);
+   }
+   pages.clear();
+   for (uint64_t i = 0; i < 5; ++i) {
+      pages.push_back(&buffer_manager.fix_page(i, false));
+   }
+   EXPECT_EQ(buffer_manager.resize(2), 5);
+   EXPECT_EQ(buffer_manager.get_page_count(), 5);
+   // NOLINTNEXTLINE
+   EXPECT_THROW(buffer_manager.fix_page(20, false), simpledb::buffer_full_error);
+   for (auto* page : pages) {
+      buffer_manager.unfix_page(*page, false);
+   }
+
+   // the evicted pages were written back
+   EXPECT_EQ(buffer_manager.resize(3), 3);
+   for (uint64_t i = 0; i < 15; ++i) {
+      auto& page = buffer_manager.fix_page(i, false);
+      uint64_t value;
+      std::memcpy(&value, page.get_data(), sizeof(value));
+      EXPECT_EQ(value, i);
+      buffer_manager.unfix_page(page, false);
+   }
+   EXPECT_EQ(buffer_manager.get_fifo_list().size() + buffer_manager.get_lru_list().size(), 3);
+}
+
 // NOLINTNEXTLINE
 TEST(BufferManagerTest, MoveToLRU) {
    simpledb::BufferManager buffer_manager{1024, 10};
@@ -134,6 +491,32 @@ TEST(BufferManagerTest, LRURefresh) {
    EXPECT_EQ((std::vector<uint64_t>{2, 1}), buffer_manager.get_lru_list());
 }
 
+// NOLINTNEXTLINE
+TEST(BufferManagerTest, LRURefreshMiddle) {
+   simpledb::BufferManager buffer_manager{1024, 10};
+   for (uint64_t i = 1; i < 6; ++i) {
+      for (size_t j = 0; j < 2; ++j) {
+         auto& page = buffer_manager.fix_page(i, false);
+         buffer_manager.unfix_page(page, false);
+      }
+   }
+   EXPECT_EQ((std::vector<uint64_t>{1, 2, 3, 4, 5}), buffer_manager.get_lru_list());
+   auto& page = buffer_manager.fix_page(3, false);
+   buffer_manager.unfix_page(page, false);
+   EXPECT_TRUE(buffer_manager.get_fifo_list().empty());
+   EXPECT_EQ((std::vector<uint64_t>{1, 2, 4, 5, 3}), buffer_manager.get_lru_list());
+   // with all fifo pages fixed, the least recently used page has to be evicted
+   std::vector<simpledb::BufferFrame*> pages;
+   for (uint64_t i = 6; i < 12; ++i) {
+      pages.push_back(&buffer_manager.fix_page(i, false));
+   }
+   for (auto* page : pages) {
+      buffer_manager.unfix_page(*page, false);
+   }
+   EXPECT_EQ((std::vector<uint64_t>{6, 7, 8, 9, 10, 11}), buffer_manager.get_fifo_list());
+   EXPECT_EQ((std::vector<uint64_t>{2, 4, 5, 3}), buffer_manager.get_lru_list());
+}
+
 // NOLINTNEXTLINE
 TEST(BufferManagerTest, MultithreadParallelFix) {
    simpledb::BufferManager buffer_manager{1024, 10};
@@ -0,0 +1,100 @@
+#include "simpledb/compression.h"
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+
+namespace {
+
+/// Compresses and decompresses `data` and returns the compressed size.
+size_t roundTrip(const std::vector<char>& data) {
+   std::vector<char> compressed(data.size() + data.size() / 255 + 16);
+   auto size = simpledb::lz_compress(data.data(), data.size(), compressed.data(), compressed.size());
+   EXPECT_GT(size, 0);
+   std::vector<char> decompressed(data.size());
+   simpledb::lz_decompress(compressed.data(), size, decompressed.data(), decompressed.size());
+   EXPECT_EQ(data, decompressed);
+   return size;
+}
+
+// NOLINTNEXTLINE
+TEST(CompressionTest, RoundTrip) {
+   // empty and tiny inputs are literals only
+   EXPECT_EQ(1, roundTrip({}));
+   EXPECT_EQ(6, roundTrip({'a', 'b', 'c', 'd', 'e'}));
+
+   // runs of a single byte are overlapping matches
+   EXPECT_LT(roundTrip(std::vector<char>(4096, 0)), 40);
+   std::vector<char> page(4096, 0);
+   std::memset(page.data() + 4000, 'x', 96);
+   EXPECT_LT(roundTrip(page), 60);
+
+   // repeated records
+   std::string text;
+   for (int i = 0; i < 200; ++i) {
+      text += "customer#" + std::to_string(i % 17) + " furiously regular deposits|";
+   }
+   EXPECT_LT(roundTrip({text.begin(), text.end()}), text.size() / 4);
+
+   // long literal runs and sizes around the length extensions
+   std::mt19937_64 engine{0};
+   for (size_t size : {14, 15, 16, 17, 269, 270, 271, 1024, 70000}) {
+      std::vector<char> data(size);
+      for (auto& c : data) {
+         c = static_cast<char>(engine());
+      }
+      roundTrip(data);
+      if (size > 300) {
+         // repeat the start at the end, beyond a 16 bit offset for the largest size
+         std::memcpy(data.data() + size - 300, data.data(), 280);
+         roundTrip(data);
+      }
+   }
+}
+
+// NOLINTNEXTLINE
+TEST(CompressionTest, Capacity) {
+   std::mt19937_64 engine{0};
+   std::vector<char> data(1024);
+   for (auto& c : data) {
+      c = static_cast<char>(engine());
+   }
+   std::vector<char> compressed(data.size());
+   EXPECT_EQ(0, simpledb::lz_compress(data.data(), data.size(), compressed.data(), compressed.size() - 1));
+   EXPECT_EQ(0, simpledb::lz_compress(data.data(), data.size(), compressed.data(), 0));
+}
+
+// NOLINTNEXTLINE
+TEST(CompressionTest, Corrupt) {
+   std::vector<char> data(1024, 0);
+   std::memcpy(data.data(), "some header", 11);
+   std::vector<char> compressed(1024);
+   auto size = simpledb::lz_compress(data.data(), data.size(), compressed.data(), compressed.size());
+   ASSERT_GT(size, 0);
+   std::vector<char> decompressed(data.size());
+
+   // truncated, wrong size, offset before the start
+   EXPECT_THROW(simpledb::lz_decompress(compressed.data(), size - 1, decompressed.data(), decompressed.size()), std::runtime_error);
+   EXPECT_THROW(simpledb::lz_decompress(compressed.data(), size, decompressed.data(), decompressed.size() - 1), std::runtime_error);
+   EXPECT_THROW(simpledb::lz_decompress(compressed.data(), 0, decompressed.data(), decompressed.size()), std::runtime_error);
+   const char badOffset[] = {0x10, 'a', 0x05, 0x00};
+   EXPECT_THROW(simpledb::lz_decompress(badOffset, sizeof(badOffset), decompressed.data(), 5), std::runtime_error);
+
+   // random garbage never writes outside of the buffer
+   std::mt19937_64 engine{0};
+   for (int i = 0; i < 1000; ++i) {
+      std::vector<char> garbage(1 + engine() % 64);
+      for (auto& c : garbage) {
+         c = static_cast<char>(engine());
+      }
+      try {
+         simpledb::lz_decompress(garbage.data(), garbage.size(), decompressed.data(), decompressed.size());
+      } catch (const std::runtime_error&) {
+      }
+   }
+}
+
+} // namespace
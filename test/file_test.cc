@@ -0,0 +1,189 @@
+#include "simpledb/file.h"
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <system_error>
+#include <thread>
+#include <vector>
+#include <gtest/gtest.h>
+
+using File = simpledb::File;
+using IoRequest = simpledb::File::IoRequest;
+
+namespace {
+
+constexpr size_t kBlockSize = 4096;
+constexpr size_t kBlockCount = 600; // more than fit into one io_uring
+
+/// Writes every block with a batch, reads it back in a single vectored request and
+/// block by block in a batch.
+void test_roundtrip(File& file) {
+   file.resize(kBlockSize * kBlockCount);
+
+   std::vector<uint64_t> written(kBlockSize / sizeof(uint64_t) * kBlockCount);
+   for (size_t i = 0; i < written.size(); ++i) {
+      written[i] = i * 0x9E3779B97F4A7C15ull;
+   }
+
+   std::vector<::iovec> buffers;
+   std::vector<IoRequest> requests;
+   buffers.reserve(kBlockCount);
+   for (size_t i = 0; i < kBlockCount; ++i) {
+      buffers.push_back({reinterpret_cast<char*>(written.data()) + i * kBlockSize, kBlockSize});
+      requests.push_back({IoRequest::WRITE, i * kBlockSize, {&buffers.back(), 1}});
+   }
+   file.submit(requests);
+
+   // one request with all buffers
+   std::vector<uint64_t> read(written.size());
+   for (size_t i = 0; i < kBlockCount; ++i) {
+      buffers[i].iov_base = reinterpret_cast<char*>(read.data()) + i * kBlockSize;
+   }
+   IoRequest request{IoRequest::READ, 0, buffers};
+   file.submit({&request, 1});
+   EXPECT_EQ(read, written);
+
+   // one request per block
+   std::fill(read.begin(), read.end(), 0);
+   for (auto& r : requests) {
+      r.kind = IoRequest::READ;
+   }
+   file.submit(requests);
+   EXPECT_EQ(read, written);
+}
+
+/// Many threads submitting batches of single blocks to the same file at once.
+void test_concurrent(File& file) {
+   constexpr size_t kThreads = 8;
+   constexpr size_t kBlocksPerThread = 64;
+   file.resize(kBlockSize * kThreads * kBlocksPerThread);
+
+   std::vector<std::thread> threads;
+   for (size_t t = 0; t < kThreads; ++t) {
+      threads.emplace_back([&file, t] {
+         std::vector<char> data(kBlockSize * kBlocksPerThread);
+         std::vector<::iovec> buffers;
+         std::vector<IoRequest> requests;
+         buffers.reserve(kBlocksPerThread);
+         for (size_t i = 0; i < kBlocksPerThread; ++i) {
+            std::fill_n(&data[i * kBlockSize], kBlockSize, static_cast<char>(t * kBlocksPerThread + i));
+            buffers.push_back({&data[i * kBlockSize], kBlockSize});
+            requests.push_back({IoRequest::WRITE, (t * kBlocksPerThread + i) * kBlockSize, {&buffers.back(), 1}});
+         }
+         for (size_t round = 0; round < 10; ++round) {
+            file.submit(requests);
+         }
+
+         std::fill(data.begin(), data.end(), 0);
+         for (auto& r : requests) {
+            r.kind = IoRequest::READ;
+         }
+         file.submit(requests);
+         for (size_t i = 0; i < kBlocksPerThread; ++i) {
+            ASSERT_EQ(data[i * kBlockSize], static_cast<char>(t * kBlocksPerThread + i));
+            ASSERT_EQ(data[i * kBlockSize + kBlockSize - 1], static_cast<char>(t * kBlocksPerThread + i));
+         }
+      });
+   }
+   for (auto& thread : threads) {
+      thread.join();
+   }
+}
+
+// NOLINTNEXTLINE
+TEST(FileTest, Mapped) {
+   {
+      auto file = File::open_file("file_test_mapped", File::WRITE);
+      file->resize(2 * kBlockSize);
+      std::vector<char> block(kBlockSize, 'a');
+      file->write_block(block.data(), 0, kBlockSize);
+      std::fill(block.begin(), block.end(), 'b');
+      file->write_block(block.data(), kBlockSize, kBlockSize);
+   }
+   {
+      simpledb::MappedFile file("file_test_mapped");
+      EXPECT_EQ(File::READ, file.get_mode());
+      EXPECT_EQ(2 * kBlockSize, file.size());
+      file.advise(simpledb::MappedFile::SEQUENTIAL);
+      file.advise(simpledb::MappedFile::RANDOM, kBlockSize + 1, 10);
+
+      EXPECT_EQ('a', file.data()[kBlockSize - 1]);
+      EXPECT_EQ('b', file.data(kBlockSize)[0]);
+
+      std::vector<char> block(2, 0);
+      file.read_block(kBlockSize - 1, 2, block.data());
+      EXPECT_EQ((std::vector<char>{'a', 'b'}), block);
+
+      EXPECT_THROW(file.write_block(block.data(), 0, 2), std::system_error);
+      EXPECT_THROW(file.resize(0), std::system_error);
+   }
+   std::remove("file_test_mapped");
+}
+
+// NOLINTNEXTLINE
+TEST(FileTest, PosixSubmit) {
+   auto file = File::make_temporary_file();
+   test_roundtrip(*file);
+}
+
+// NOLINTNEXTLINE
+TEST(FileTest, ThreadPoolSubmit) {
+   {
+      simpledb::ThreadPoolFile file("file_test_thread_pool", File::WRITE);
+      test_roundtrip(file);
+      test_concurrent(file);
+   }
+   std::remove("file_test_thread_pool");
+}
+
+// NOLINTNEXTLINE
+TEST(FileTest, IoUringSubmit) {
+   std::unique_ptr<simpledb::IoUringFile> file;
+   try {
+      file = std::make_unique<simpledb::IoUringFile>("file_test_io_uring", File::WRITE);
+   } catch (const std::system_error&) {
+      std::remove("file_test_io_uring");
+      GTEST_SKIP() << "io_uring is not available";
+   }
+   test_roundtrip(*file);
+   test_concurrent(*file);
+   file.reset();
+   std::remove("file_test_io_uring");
+}
+
+// NOLINTNEXTLINE
+TEST(FileTest, IoUringSubmitFailure) {
+   std::unique_ptr<simpledb::IoUringFile> file;
+   try {
+      file = std::make_unique<simpledb::IoUringFile>("file_test_io_uring_failure", File::WRITE);
+   } catch (const std::system_error&) {
+      std::remove("file_test_io_uring_failure");
+      GTEST_SKIP() << "io_uring is not available";
+   }
+   file->resize(kBlockSize * kBlockCount);
+
+   std::vector<uint64_t> written(kBlockSize / sizeof(uint64_t) * kBlockCount, 42);
+   std::vector<::iovec> buffers;
+   std::vector<IoRequest> requests;
+   buffers.reserve(kBlockCount);
+   for (size_t i = 0; i < kBlockCount; ++i) {
+      buffers.push_back({reinterpret_cast<char*>(written.data()) + i * kBlockSize, kBlockSize});
+      requests.push_back({IoRequest::WRITE, i * kBlockSize, {&buffers.back(), 1}});
+   }
+
+   // the batch needs more than one submission, so whichever call fails, entries of it are queued
+   // or in flight already and have to complete before submit() throws
+   for (unsigned skip = 0; skip < 3; ++skip) {
+      simpledb::IoUringFile::inject_enter_failures(ENOMEM, 1, skip);
+      EXPECT_THROW(file->submit(requests), std::system_error); // NOLINT
+   }
+   simpledb::IoUringFile::inject_enter_failures(0, 0);
+
+   // the ring is still usable afterwards
+   test_roundtrip(*file);
+   file.reset();
+   std::remove("file_test_io_uring_failure");
+}
+
+}
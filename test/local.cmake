@@ -4,9 +4,15 @@
 
 set(TEST_CC
         test/buffer_manager_test.cc
+        test/compression_test.cc
         test/slotted_page_test.cc
+        test/pax_page_test.cc
         test/segment_test.cc
         test/btree_test.cc
+        test/string_btree_test.cc
+        test/file_test.cc
+        test/metrics_test.cc
+        test/wal_test.cc
         )
 
 # ---------------------------------------------------------------------------
@@ -0,0 +1,97 @@
+#include "simpledb/buffer_manager.h"
+#include "simpledb/file.h"
+#include "simpledb/metrics.h"
+#include <cstdint>
+#include <cstdio>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <gtest/gtest.h>
+
+using BufferManager = simpledb::BufferManager;
+using Counter = simpledb::metrics::Counter;
+using File = simpledb::File;
+
+namespace {
+
+// NOLINTNEXTLINE
+TEST(MetricsTest, BufferManager) {
+   constexpr uint64_t segment = 28ull << 48;
+   std::remove("28");
+   {
+      BufferManager buffer_manager(1024, 10);
+      auto before = simpledb::metrics::snapshot();
+
+      // a miss, a hit that promotes the page and pages that push the others out
+      for (uint64_t i = 0; i < 2; ++i) {
+         auto& page = buffer_manager.fix_page(segment, true);
+         buffer_manager.unfix_page(page, true);
+      }
+      for (uint64_t i = 1; i < 11; ++i) {
+         auto& page = buffer_manager.fix_page(segment | i, false);
+         buffer_manager.unfix_page(page, false);
+      }
+      std::vector<simpledb::BufferFrame*> pages;
+      for (uint64_t i = 11; i < 21; ++i) {
+         pages.push_back(&buffer_manager.fix_page(segment | i, false));
+      }
+      // NOLINTNEXTLINE
+      EXPECT_THROW(buffer_manager.fix_page(segment | 21, false), simpledb::buffer_full_error);
+      for (auto* page : pages) {
+         buffer_manager.unfix_page(*page, false);
+      }
+
+      auto metrics = simpledb::metrics::snapshot() - before;
+      EXPECT_EQ(metrics[Counter::PAGE_MISSES], 21);
+      EXPECT_EQ(metrics[Counter::PAGE_HITS], 1);
+      EXPECT_EQ(metrics.segments[28].misses, 21);
+      EXPECT_EQ(metrics.segments[28].hits, 1);
+      EXPECT_EQ(metrics[Counter::PROMOTIONS], 1);
+      EXPECT_EQ(metrics[Counter::CLEAN_EVICTIONS] + metrics[Counter::DIRTY_EVICTIONS], 11);
+      EXPECT_EQ(metrics[Counter::BUFFER_FULL_ERRORS], 1);
+
+      std::stringstream out;
+      metrics.print(out);
+      EXPECT_NE(out.str().find("segment 28 hits 1 misses 21\n"), std::string::npos);
+   }
+   std::remove("28");
+}
+
+// NOLINTNEXTLINE
+TEST(MetricsTest, Files) {
+   auto file = File::make_temporary_file();
+   std::vector<char> block(4096, 1);
+
+   auto before = simpledb::metrics::snapshot();
+   file->write_block(block.data(), 0, block.size());
+   file->read_block(0, block.size(), block.data());
+   auto metrics = simpledb::metrics::snapshot() - before;
+   EXPECT_EQ(metrics[Counter::BYTES_WRITTEN], block.size());
+   EXPECT_EQ(metrics[Counter::BYTES_READ], block.size());
+}
+
+// NOLINTNEXTLINE
+TEST(MetricsTest, Threads) {
+   auto before = simpledb::metrics::snapshot();
+
+   // the counts of threads are kept when they exit
+   std::vector<std::thread> threads;
+   for (size_t t = 0; t < 4; ++t) {
+      threads.emplace_back([] {
+         for (size_t i = 0; i < 1000; ++i) {
+            simpledb::metrics::count(Counter::BTREE_SPLITS);
+         }
+         simpledb::metrics::count_access(1000, false);
+      });
+   }
+   for (auto& thread : threads) {
+      thread.join();
+   }
+
+   auto metrics = simpledb::metrics::snapshot() - before;
+   EXPECT_EQ(metrics[Counter::BTREE_SPLITS], 4000);
+   EXPECT_EQ(metrics.segments[1000].misses, 4);
+}
+
+} // namespace
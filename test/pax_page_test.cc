@@ -0,0 +1,131 @@
+#include "simpledb/pax_page.h"
+#include "simpledb/schema.h"
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <vector>
+#include <gtest/gtest.h>
+
+using PaxPage = simpledb::PaxPage;
+
+namespace schema = simpledb::schema;
+
+namespace {
+
+schema::Table getPaxTable() {
+   return schema::Table(
+      "pax",
+      {
+         schema::Column("p_key", schema::Type::Integer()),
+         schema::Column("p_name", schema::Type::Char(13)),
+         schema::Column("p_value", schema::Type::Integer()),
+      },
+      {"p_key"},
+      10, 11,
+      0, schema::Table::kPax);
+}
+
+// NOLINTNEXTLINE
+TEST(PaxPageTest, Layout) {
+   auto table = getPaxTable();
+   PaxPage::Layout layout(table, 1024);
+
+   EXPECT_EQ(layout.record_width, 21);
+   EXPECT_EQ(layout.widths, (std::vector<uint32_t>{4, 13, 4}));
+   EXPECT_EQ(layout.record_offsets, (std::vector<uint32_t>{0, 4, 17}));
+   ASSERT_GT(layout.capacity, 0);
+
+   // the minipages are aligned, don't overlap and fit on the page
+   EXPECT_GE(layout.erased_offset, sizeof(PaxPage::Header));
+   EXPECT_GE(layout.offsets[0], layout.erased_offset + (layout.capacity + 63) / 64 * sizeof(uint64_t));
+   for (size_t column = 0; column < layout.offsets.size(); ++column) {
+      EXPECT_EQ(layout.offsets[column] % 64, 0);
+      auto end = layout.offsets[column] + layout.capacity * layout.widths[column];
+      EXPECT_LE(end, column + 1 < layout.offsets.size() ? layout.offsets[column + 1] : 1024);
+   }
+
+   // at most the alignment of the header, the bitmap and the minipages is wasted
+   EXPECT_GE(layout.capacity, (1024 - 5 * 64) / layout.record_width);
+}
+
+// NOLINTNEXTLINE
+TEST(PaxPageTest, AppendReadErase) {
+   auto table = getPaxTable();
+   PaxPage::Layout layout(table, 1024);
+   std::vector<std::byte> buffer(1024, std::byte{0xFF});
+   auto* page = new (buffer.data()) PaxPage(layout);
+   EXPECT_EQ(page->header.record_count, 0);
+
+   std::vector<std::vector<std::byte>> records;
+   while (!page->is_full(layout)) {
+      auto& record = records.emplace_back(layout.record_width);
+      for (size_t i = 0; i < record.size(); ++i) {
+         record[i] = static_cast<std::byte>(records.size() * 7 + i);
+      }
+      ASSERT_EQ(page->append(layout, record.data()), records.size() - 1);
+   }
+   ASSERT_EQ(records.size(), layout.capacity);
+
+   // the values of a column are stored back to back
+   for (size_t i = 0; i < records.size(); ++i) {
+      int32_t value;
+      std::memcpy(&value, records[i].data() + layout.record_offsets[2], sizeof(value));
+      EXPECT_EQ(reinterpret_cast<const int32_t*>(page->get_column(layout, 2))[i], value);
+   }
+
+   for (uint32_t i = 0; i < records.size(); i += 3) {
+      page->erase(layout, i);
+   }
+   EXPECT_EQ(page->header.erased_count, (records.size() + 2) / 3);
+
+   std::vector<std::byte> read(layout.record_width);
+   for (uint32_t i = 0; i < records.size(); ++i) {
+      if (i % 3 == 0) {
+         EXPECT_TRUE(page->is_erased(layout, i));
+         EXPECT_EQ(page->read(layout, i, read.data(), read.size()), 0);
+      } else {
+         EXPECT_FALSE(page->is_erased(layout, i));
+         ASSERT_EQ(page->read(layout, i, read.data(), read.size()), layout.record_width);
+         EXPECT_EQ(read, records[i]);
+      }
+   }
+
+   // a smaller buffer gets the prefix of the record
+   std::vector<std::byte> prefix(10);
+   ASSERT_EQ(page->read(layout, 1, prefix.data(), prefix.size()), 10);
+   EXPECT_EQ(0, std::memcmp(prefix.data(), records[1].data(), prefix.size()));
+}
+
+// NOLINTNEXTLINE
+TEST(PaxPageTest, FilterBetween) {
+   std::mt19937 engine(0);
+   std::uniform_int_distribution<int32_t> distribution(-100, 100);
+   constexpr auto min = std::numeric_limits<int32_t>::min();
+   constexpr auto max = std::numeric_limits<int32_t>::max();
+   std::vector<std::pair<int32_t, int32_t>> ranges{{-10, 10}, {0, 0}, {5, -5}, {min, 0}, {0, max}, {min, max}};
+
+   for (size_t count : {0, 1, 7, 8, 15, 16, 63, 64, 65, 200, 1000}) {
+      std::vector<int32_t> values(count);
+      for (auto& value : values) {
+         value = distribution(engine);
+      }
+      if (count > 2) {
+         values[0] = min;
+         values[1] = max;
+      }
+      for (auto [low, high] : ranges) {
+         // the bits after count are cleared as well
+         std::vector<uint64_t> selection((count + 63) / 64, ~0ull);
+         simpledb::filter_between(values.data(), count, low, high, selection.data());
+         for (size_t i = 0; i < count; ++i) {
+            ASSERT_EQ((selection[i / 64] >> (i % 64)) & 1, low <= values[i] && values[i] <= high) << i;
+         }
+         for (size_t i = count; i < selection.size() * 64; ++i) {
+            ASSERT_EQ((selection[i / 64] >> (i % 64)) & 1, 0);
+         }
+      }
+   }
+}
+
+} // namespace
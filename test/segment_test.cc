@@ -1,17 +1,25 @@
 #include "simpledb/buffer_manager.h"
+#include "simpledb/database.h"
 #include "simpledb/file.h"
 #include "simpledb/hex_dump.h"
 #include "simpledb/segment.h"
+#include <algorithm>
+#include <chrono>
 #include <cstdint>
 #include <cstring>
 #include <exception>
 #include <random>
+#include <stdexcept>
+#include <thread>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 #include <gtest/gtest.h>
 
 using BufferManager = simpledb::BufferManager;
+using Database = simpledb::Database;
 using FSISegment = simpledb::FSISegment;
+using PAXSegment = simpledb::PAXSegment;
 using SPSegment = simpledb::SPSegment;
 using SchemaSegment = simpledb::SchemaSegment;
 using SlottedPage = simpledb::SlottedPage;
@@ -164,6 +172,60 @@ TEST_F(SegmentTest, SchemaSerialiseTPCHLight) {
    EXPECT_EQ(schema_2->tables[2].primary_key[0], "r_regionkey");
 }
 
+// NOLINTNEXTLINE
+TEST_F(SegmentTest, SchemaAllocatedPages) {
+   BufferManager buffer_manager(1024, 10);
+   SchemaSegment schema_segment_1(0, buffer_manager);
+   schema_segment_1.set_schema(getTPCHSchemaLight());
+   auto& table = schema_segment_1.get_schema()->tables[1];
+
+   // the first update writes the whole schema, the next ones only the counter
+   table.allocated_pages = 3;
+   schema_segment_1.write_allocated_pages(table);
+   table.allocated_pages = 7;
+   schema_segment_1.write_allocated_pages(table);
+
+   SchemaSegment schema_segment_2(0, buffer_manager);
+   schema_segment_2.read();
+   auto* schema_2 = schema_segment_2.get_schema();
+   ASSERT_NE(nullptr, schema_2);
+   ASSERT_EQ(schema_2->tables.size(), 3);
+   EXPECT_EQ(schema_2->tables[0].allocated_pages, 0);
+   EXPECT_EQ(schema_2->tables[1].allocated_pages, 7);
+   EXPECT_EQ(schema_2->tables[1].id, "nation");
+   EXPECT_EQ(schema_2->tables[2].allocated_pages, 0);
+   EXPECT_EQ(schema_2->tables[2].columns.size(), 3);
+}
+
+// NOLINTNEXTLINE
+TEST_F(SegmentTest, SchemaImportJSON) {
+   auto json = getTPCHSchemaLight()->to_json();
+   auto imported = schema::Schema::from_json(json);
+   ASSERT_EQ(imported->tables.size(), 3);
+   EXPECT_EQ(imported->tables[2].id, "region");
+   EXPECT_EQ(imported->tables[2].columns[1].type.length, 25);
+   EXPECT_EQ(imported->to_json(), json);
+
+   // a schema segment that was written as JSON is still read
+   BufferManager buffer_manager(1024, 10);
+   {
+      auto& page = buffer_manager.fix_page(0, true);
+      uint64_t size = json.size();
+      std::memcpy(page.get_data(), &size, sizeof(size));
+      std::memcpy(page.get_data() + 20, json.data(), std::min<size_t>(json.size(), 1024 - 20));
+      buffer_manager.unfix_page(page, true);
+      for (size_t offset = 1024 - 20, pid = 1; offset < json.size(); offset += 1024, ++pid) {
+         auto& next = buffer_manager.fix_page(pid, true);
+         std::memcpy(next.get_data(), json.data() + offset, std::min<size_t>(json.size() - offset, 1024));
+         buffer_manager.unfix_page(next, true);
+      }
+   }
+   SchemaSegment schema_segment(0, buffer_manager);
+   schema_segment.read();
+   ASSERT_NE(nullptr, schema_segment.get_schema());
+   EXPECT_EQ(schema_segment.get_schema()->to_json(), json);
+}
+
 // NOLINTNEXTLINE
 TEST_F(SegmentTest, FSIEncoding) {
    BufferManager buffer_manager(1024, 10);
@@ -231,6 +293,42 @@ TEST_F(SegmentTest, FSIPersistence) {
    }
 }
 
+// NOLINTNEXTLINE
+TEST_F(SegmentTest, FSISavedFreeCache) {
+   BufferManager buffer_manager(1024, 10);
+   std::vector<uint64_t> expected;
+   {
+      SchemaSegment schema_segment(0, buffer_manager);
+      schema_segment.set_schema(getTPCHSchemaLight());
+      auto& table = schema_segment.get_schema()->tables[0];
+      table.allocated_pages = 4;
+      FSISegment fsi_segment(table.fsi_segment, buffer_manager, table);
+      fsi_segment.update(0, 0);
+      fsi_segment.update(1, 64);
+      fsi_segment.update(2, 512);
+      fsi_segment.update(3, 64);
+      for (auto& entry : fsi_segment.free_cache) {
+         expected.push_back(entry);
+      }
+      fsi_segment.save_free_cache();
+      schema_segment.write();
+   }
+
+   SchemaSegment schema_segment(0, buffer_manager);
+   schema_segment.read();
+   auto& table = schema_segment.get_schema()->tables[0];
+   EXPECT_EQ(table.free_cache, expected);
+
+   // the fsi pages aren't read anymore
+   auto& bf = buffer_manager.fix_page(static_cast<uint64_t>(table.fsi_segment) << 48, true);
+   std::memset(bf.get_data(), 0, buffer_manager.get_page_size());
+   buffer_manager.unfix_page(bf, true);
+   FSISegment fsi_segment(table.fsi_segment, buffer_manager, table);
+   for (size_t i = 0; i < expected.size(); ++i) {
+      EXPECT_EQ(fsi_segment.free_cache[i], expected[i]);
+   }
+}
+
 // NOLINTNEXTLINE
 TEST_F(SegmentTest, SPRecordAllocation) {
    BufferManager buffer_manager(1024, 10);
@@ -348,6 +446,64 @@ TEST_F(SegmentTest, SPRecordWriteReadRedirect) {
    ASSERT_EQ(x, max_records - 1);
 }
 
+// NOLINTNEXTLINE
+TEST_F(SegmentTest, SPRecordView) {
+   BufferManager buffer_manager(1024, 10);
+   SchemaSegment schema_segment(0, buffer_manager);
+   schema_segment.set_schema(getTPCHSchemaLight());
+   auto& table = schema_segment.get_schema()->tables[0];
+   FSISegment fsi_segment(table.fsi_segment, buffer_manager, table);
+   SPSegment sp_segment(table.sp_segment, buffer_manager, schema_segment, fsi_segment, table);
+
+   // a record that stays on its page and one that is redirected to another page
+   std::vector<std::byte> data(600, std::byte{0x42});
+   auto tid = sp_segment.allocate(100);
+   sp_segment.write(tid, data.data(), 100);
+   auto redirected = sp_segment.allocate(100);
+   for (int i = 0; i < 6; ++i) {
+      sp_segment.allocate(100);
+   }
+   sp_segment.resize(redirected, 600);
+   sp_segment.write(redirected, data.data(), 600);
+   {
+      auto [bf, page, slot] = sp_segment.get_slot(redirected, false);
+      EXPECT_TRUE(slot.is_redirect());
+      buffer_manager.unfix_page(bf, false);
+   }
+
+   {
+      auto view = sp_segment.view(tid);
+      ASSERT_TRUE(view);
+      EXPECT_EQ(100, view.get_data().size());
+      EXPECT_EQ(0, std::memcmp(data.data(), view.get_data().data(), 100));
+
+      // the view points into the page, other readers can still fix it
+      std::vector<std::byte> buffer(100);
+      EXPECT_EQ(100, sp_segment.read(tid, buffer.data(), buffer.size()));
+      auto& bf = buffer_manager.fix_page(tid.get_page_id(table.sp_segment), false);
+      auto* pageData = reinterpret_cast<const std::byte*>(bf.get_data());
+      EXPECT_TRUE(view.get_data().data() >= pageData && view.get_data().data() + 100 <= pageData + 1024);
+      buffer_manager.unfix_page(bf, false);
+
+      // views can be moved, the page stays fixed once
+      auto moved = std::move(view);
+      EXPECT_FALSE(view); // NOLINT(bugprone-use-after-move)
+      EXPECT_TRUE(moved);
+      moved = sp_segment.view(redirected);
+      EXPECT_EQ(600, moved.get_data().size());
+      EXPECT_EQ(0, std::memcmp(data.data(), moved.get_data().data(), 600));
+      moved.release();
+      EXPECT_FALSE(moved);
+      EXPECT_TRUE(moved.get_data().empty());
+   }
+
+   // all pages are unfixed again, so they can be written
+   sp_segment.write(tid, data.data(), 50);
+   sp_segment.erase(tid);
+   EXPECT_FALSE(sp_segment.view(tid));
+   EXPECT_EQ(0, sp_segment.read(tid, data.data(), data.size()));
+}
+
 // NOLINTNEXTLINE
 TEST_F(SegmentTest, SPRecordErase) {
    auto schema = getTPCHSchemaLight();
@@ -386,6 +542,431 @@ TEST_F(SegmentTest, SPRecordErase) {
    buffer_manager.unfix_page(*frame, true);
 }
 
+// NOLINTNEXTLINE
+TEST_F(SegmentTest, SPInsertBatch) {
+   BufferManager buffer_manager(1024, 10);
+   SchemaSegment schema_segment(0, buffer_manager);
+   schema_segment.set_schema(getTPCHSchemaLight());
+   auto& table = schema_segment.get_schema()->tables[0];
+   FSISegment fsi_segment(table.fsi_segment, buffer_manager, table);
+   SPSegment sp_segment(table.sp_segment, buffer_manager, schema_segment, fsi_segment, table);
+
+   // records of different sizes, some of them don't fit on one page together
+   std::vector<std::vector<std::byte>> data;
+   for (size_t i = 0; i < 500; ++i) {
+      data.emplace_back(i % 50 == 0 ? 700 : 10 + i % 30, static_cast<std::byte>(i));
+   }
+   std::vector<std::span<const std::byte>> records(data.begin(), data.end());
+   auto tids = sp_segment.insert_batch(records);
+   ASSERT_EQ(data.size(), tids.size());
+
+   std::vector<std::byte> readBuffer(1024);
+   for (size_t i = 0; i < data.size(); ++i) {
+      ASSERT_EQ(data[i].size(), sp_segment.read(tids[i], readBuffer.data(), readBuffer.size()));
+      ASSERT_EQ(0, std::memcmp(data[i].data(), readBuffer.data(), data[i].size()));
+   }
+
+   // the pages are filled as far as possible
+   size_t used = 0;
+   for (auto& record : data) {
+      used += record.size() + sizeof(SlottedPage::Slot);
+   }
+   EXPECT_GE(used / (1024 - sizeof(SlottedPage::Header)) + 12, table.allocated_pages);
+}
+
+// NOLINTNEXTLINE
+TEST_F(SegmentTest, SPMultithreadInsert) {
+   BufferManager buffer_manager(1024, 50);
+   SchemaSegment schema_segment(0, buffer_manager);
+   schema_segment.set_schema(getTPCHSchemaLight());
+   auto& table = schema_segment.get_schema()->tables[0];
+   FSISegment fsi_segment(table.fsi_segment, buffer_manager, table);
+   SPSegment sp_segment(table.sp_segment, buffer_manager, schema_segment, fsi_segment, table);
+
+   constexpr uint64_t kPerThread = 2000;
+   std::vector<std::vector<TID>> tids(4);
+   std::vector<std::thread> threads;
+   for (uint64_t thread = 0; thread < 4; ++thread) {
+      threads.emplace_back([&, thread] {
+         for (uint64_t i = thread * kPerThread; i < (thread + 1) * kPerThread; ++i) {
+            if (i % 2 == 0) {
+               auto tid = sp_segment.allocate(sizeof(i));
+               sp_segment.write(tid, reinterpret_cast<std::byte*>(&i), sizeof(i));
+               tids[thread].push_back(tid);
+            } else {
+               std::span<const std::byte> record{reinterpret_cast<std::byte*>(&i), sizeof(i)};
+               tids[thread].push_back(sp_segment.insert_batch({&record, 1})[0]);
+            }
+            // free some space again that the other threads may reuse
+            if (i % 7 == 3 && i >= thread * kPerThread + 3) {
+               sp_segment.erase(tids[thread][i - 3 - thread * kPerThread]);
+            }
+         }
+      });
+   }
+   for (auto& t : threads)
+      t.join();
+
+   // no record was allocated twice, erased ones may have been reused
+   std::unordered_set<uint64_t> seen;
+   size_t erased = 0;
+   for (uint64_t i = 0; i < 4 * kPerThread; ++i) {
+      auto wasErased = i % 7 == 0 && i % kPerThread + 3 < kPerThread;
+      erased += wasErased;
+      if (!wasErased) {
+         ASSERT_TRUE(seen.insert(tids[i / kPerThread][i % kPerThread].get_value()).second);
+      }
+   }
+   size_t records = 0;
+   sp_segment.scan([&](const SPSegment::ScanBatch& batch) {
+      for (size_t i = 0; i < batch.size(); ++i) {
+         uint64_t x;
+         std::memcpy(&x, batch.get_record(i).data(), sizeof(x));
+         EXPECT_FALSE(x % 7 == 0 && x % kPerThread + 3 < kPerThread) << x << " was erased";
+         EXPECT_EQ(tids[x / kPerThread][x % kPerThread].get_value(), batch.get_tid(i).get_value());
+      }
+      records += batch.size();
+      return true;
+   });
+   EXPECT_EQ(4 * kPerThread - erased, records);
+}
+
+// NOLINTNEXTLINE
+TEST_F(SegmentTest, SPScan) {
+   BufferManager buffer_manager(1024, 10);
+   SchemaSegment schema_segment(0, buffer_manager);
+   schema_segment.set_schema(getTPCHSchemaLight());
+   auto& table = schema_segment.get_schema()->tables[0];
+   FSISegment fsi_segment(table.fsi_segment, buffer_manager, table);
+   SPSegment sp_segment(table.sp_segment, buffer_manager, schema_segment, fsi_segment, table);
+
+   // more pages than frames, some records erased and some redirected
+   std::vector<std::pair<TID, uint64_t>> records;
+   for (uint64_t i = 0; i < 1000; ++i) {
+      auto tid = sp_segment.allocate(sizeof(i));
+      sp_segment.write(tid, reinterpret_cast<std::byte*>(&i), sizeof(i));
+      records.emplace_back(tid, i);
+   }
+   for (size_t i = 0; i < records.size(); i += 3) {
+      sp_segment.erase(records[i].first);
+   }
+   for (size_t i = 1; i < records.size(); i += 100) {
+      if (i % 3 != 0)
+         sp_segment.resize(records[i].first, 500);
+   }
+   ASSERT_LT(10, table.allocated_pages);
+
+   std::vector<std::pair<TID, uint64_t>> scanned;
+   size_t batches = 0;
+   sp_segment.scan([&](const SPSegment::ScanBatch& batch) {
+      ++batches;
+      for (size_t i = 0; i < batch.size(); ++i) {
+         uint64_t x;
+         std::memcpy(&x, batch.get_record(i).data(), sizeof(x));
+         EXPECT_EQ(x % 100 == 1 && x % 3 != 0 ? 500 : sizeof(x), batch.get_record(i).size());
+         scanned.emplace_back(batch.get_tid(i), x);
+      }
+      return true;
+   }, 100);
+   EXPECT_LT(1, batches);
+
+   std::vector<std::pair<TID, uint64_t>> expected;
+   for (size_t i = 0; i < records.size(); ++i) {
+      if (i % 3 != 0)
+         expected.push_back(records[i]);
+   }
+   auto byTid = [](const auto& a, const auto& b) { return a.first.get_value() < b.first.get_value(); };
+   std::sort(expected.begin(), expected.end(), byTid);
+   std::sort(scanned.begin(), scanned.end(), byTid);
+   ASSERT_EQ(expected.size(), scanned.size());
+   for (size_t i = 0; i < expected.size(); ++i) {
+      EXPECT_EQ(expected[i].first.get_value(), scanned[i].first.get_value());
+      EXPECT_EQ(expected[i].second, scanned[i].second);
+   }
+
+   // stops after the first batch
+   batches = 0;
+   sp_segment.scan([&](const SPSegment::ScanBatch&) { return ++batches < 1; });
+   EXPECT_EQ(1, batches);
+}
+
+// NOLINTNEXTLINE
+TEST_F(SegmentTest, SPParallelScan) {
+   BufferManager buffer_manager(1024, 50);
+   SchemaSegment schema_segment(0, buffer_manager);
+   schema_segment.set_schema(getTPCHSchemaLight());
+   auto& table = schema_segment.get_schema()->tables[0];
+   FSISegment fsi_segment(table.fsi_segment, buffer_manager, table);
+   SPSegment sp_segment(table.sp_segment, buffer_manager, schema_segment, fsi_segment, table);
+
+   constexpr uint64_t n = 20000;
+   for (uint64_t i = 0; i < n; ++i) {
+      auto tid = sp_segment.allocate(sizeof(i));
+      sp_segment.write(tid, reinterpret_cast<std::byte*>(&i), sizeof(i));
+   }
+   ASSERT_LT(4 * SPSegment::kMorselPages, table.allocated_pages);
+
+   // every record is seen by exactly one worker, even if one of them is slow and the others steal its pages
+   std::vector<std::vector<uint64_t>> seen(4);
+   sp_segment.parallel_scan([&](size_t worker, const SPSegment::ScanBatch& batch) {
+      if (worker == 0)
+         std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      for (size_t i = 0; i < batch.size(); ++i) {
+         uint64_t x;
+         std::memcpy(&x, batch.get_record(i).data(), sizeof(x));
+         seen[worker].push_back(x);
+      }
+   }, 4, 64);
+   std::vector<uint64_t> all;
+   for (auto& values : seen) {
+      all.insert(all.end(), values.begin(), values.end());
+   }
+   std::sort(all.begin(), all.end());
+   ASSERT_EQ(n, all.size());
+   for (uint64_t i = 0; i < n; ++i) {
+      ASSERT_EQ(i, all[i]);
+   }
+
+   // sum of the even values
+   auto sum = sp_segment.parallel_aggregate<uint64_t>(
+      0, [](uint64_t& partial, const SPSegment::ScanBatch& batch) {
+         for (size_t i = 0; i < batch.size(); ++i) {
+            uint64_t x;
+            std::memcpy(&x, batch.get_record(i).data(), sizeof(x));
+            partial += x % 2 == 0 ? x : 0;
+         } }, [](uint64_t& result, uint64_t partial) { result += partial; },
+      3);
+   EXPECT_EQ((n / 2) * (n - 2) / 2, sum);
+
+   // errors of a worker end the scan
+   EXPECT_THROW(sp_segment.parallel_scan([](size_t, const SPSegment::ScanBatch&) { throw std::runtime_error("failed"); }, 2), std::runtime_error);
+}
+
+// NOLINTNEXTLINE
+TEST_F(SegmentTest, PAXInsertReadErase) {
+   BufferManager buffer_manager(1024, 10);
+   schema::Table table("pax", {schema::Column("p_key", schema::Type::Integer()), schema::Column("p_name", schema::Type::Char(12))}, {"p_key"}, 10, 11, 0, schema::Table::kPax);
+   PAXSegment pax_segment(table.sp_segment, buffer_manager, table);
+   const auto& layout = pax_segment.get_layout();
+   ASSERT_EQ(layout.record_width, 16);
+
+   std::vector<std::vector<std::byte>> data;
+   for (size_t i = 0; i < 1000; ++i) {
+      auto& record = data.emplace_back(layout.record_width, static_cast<std::byte>(i));
+      auto key = static_cast<int32_t>(i);
+      std::memcpy(record.data(), &key, sizeof(key));
+   }
+   std::vector<std::span<const std::byte>> records(data.begin() + 1, data.end());
+   std::vector<TID> tids{pax_segment.insert(data[0])};
+   auto batchTids = pax_segment.insert_batch(records);
+   tids.insert(tids.end(), batchTids.begin(), batchTids.end());
+   ASSERT_EQ(data.size(), tids.size());
+   // all pages but the last one are full, there are more of them than buffer frames
+   EXPECT_LT(10, table.allocated_pages);
+   EXPECT_EQ(table.allocated_pages, (data.size() + layout.capacity - 1) / layout.capacity);
+
+   for (size_t i = 0; i < data.size(); i += 7) {
+      pax_segment.erase(tids[i]);
+   }
+   std::vector<std::byte> readBuffer(1024);
+   for (size_t i = 0; i < data.size(); ++i) {
+      if (i % 7 == 0) {
+         ASSERT_EQ(0, pax_segment.read(tids[i], readBuffer.data(), readBuffer.size()));
+      } else {
+         ASSERT_EQ(layout.record_width, pax_segment.read(tids[i], readBuffer.data(), readBuffer.size()));
+         ASSERT_EQ(0, std::memcmp(data[i].data(), readBuffer.data(), data[i].size()));
+      }
+   }
+}
+
+// NOLINTNEXTLINE
+TEST_F(SegmentTest, PAXScan) {
+   BufferManager buffer_manager(1024, 10);
+   schema::Table table("pax", {schema::Column("p_name", schema::Type::Char(9)), schema::Column("p_value", schema::Type::Integer())}, {"p_name"}, 10, 11, 0, schema::Table::kPax);
+   PAXSegment pax_segment(table.sp_segment, buffer_manager, table);
+   EXPECT_EQ(0, pax_segment.count_between(1, 0, 100));
+
+   std::mt19937_64 engine(0);
+   std::uniform_int_distribution<int32_t> distribution(-1000, 1000);
+   std::vector<int32_t> values;
+   std::vector<std::vector<std::byte>> data;
+   for (size_t i = 0; i < 5000; ++i) {
+      auto& record = data.emplace_back(pax_segment.get_layout().record_width, std::byte{'x'});
+      values.push_back(distribution(engine));
+      std::memcpy(record.data() + 9, &values.back(), sizeof(int32_t));
+   }
+   std::vector<std::span<const std::byte>> records(data.begin(), data.end());
+   auto tids = pax_segment.insert_batch(records);
+   for (size_t i = 0; i < tids.size(); i += 5) {
+      pax_segment.erase(tids[i]);
+   }
+
+   auto expected = [&](int32_t low, int32_t high) {
+      uint64_t count = 0;
+      for (size_t i = 0; i < values.size(); ++i) {
+         count += i % 5 != 0 && low <= values[i] && values[i] <= high;
+      }
+      return count;
+   };
+   EXPECT_EQ(expected(-100, 100), pax_segment.count_between(1, -100, 100));
+   EXPECT_EQ(expected(-1000, 1000), pax_segment.count_between(1, -1000, 1000));
+   EXPECT_EQ(0, pax_segment.count_between(1, 1, 0));
+
+   // the scan hands out the requested minipages page by page
+   std::vector<size_t> columns{1};
+   size_t seen = 0;
+   pax_segment.scan(columns, [&](const PAXSegment::ColumnBatch& batch) {
+      for (uint32_t i = 0; i < batch.record_count; ++i, ++seen) {
+         EXPECT_EQ(tids[seen].get_value(), batch.get_tid(i).get_value());
+         EXPECT_EQ(seen % 5 == 0, batch.is_erased(i));
+         EXPECT_EQ(values[seen], batch.get_values<int32_t>(0)[i]);
+      }
+      return true;
+   });
+   EXPECT_EQ(values.size(), seen);
+
+   // and stops when asked to
+   size_t pages = 0;
+   pax_segment.scan(columns, [&](const PAXSegment::ColumnBatch&) { return ++pages < 3; });
+   EXPECT_EQ(3, pages);
+}
+
+/// Returns the segments of the pages in a pool.
+std::unordered_set<uint16_t> getPoolSegments(BufferManager& pool) {
+   std::unordered_set<uint16_t> segments;
+   for (const auto& list : {pool.get_fifo_list(), pool.get_lru_list(), pool.get_ring_list()}) {
+      for (auto pid : list) {
+         segments.insert(BufferManager::get_segment_id(pid));
+      }
+   }
+   return segments;
+}
+
+// NOLINTNEXTLINE
+TEST_F(SegmentTest, DatabasePools) {
+   {
+      // the customer table lives in a pool of larger pages, that can grow
+      Database database({{1024, 16, 0}, {4096, 16, 64}});
+      database.assign_pool(10, 1);
+      database.assign_pool(11, 1);
+      database.load_new_schema(getTPCHSchemaLight());
+      auto& customer = database.get_schema().tables[0];
+
+      std::vector<std::vector<std::string>> rows;
+      for (size_t i = 0; i < 400; ++i) {
+         rows.push_back({std::to_string(i), "Customer#" + std::to_string(i), "address", "1", "phone", "100", "BUILDING", "comment"});
+      }
+      auto tids = database.insert_batch(customer, rows);
+      EXPECT_LT(16, customer.allocated_pages);
+
+      // the pages of the table never entered the first pool
+      EXPECT_EQ(std::unordered_set<uint16_t>{0}, getPoolSegments(database.get_pool(0)));
+      EXPECT_TRUE(getPoolSegments(database.get_pool(1)).contains(10));
+      // segments of the loaded schema stay where they are
+      EXPECT_THROW(database.assign_pool(10, 0), std::logic_error); // NOLINT
+      EXPECT_THROW(database.assign_pool(0, 1), std::logic_error); // NOLINT
+
+      auto check = [&] {
+         std::vector<std::byte> record(1024);
+         for (size_t i = 0; i < tids.size(); ++i) {
+            ASSERT_LT(0, database.read(customer, tids[i], record.data(), static_cast<uint32_t>(record.size())));
+            int32_t key;
+            std::memcpy(&key, record.data(), sizeof(key));
+            ASSERT_EQ(static_cast<int32_t>(i), key);
+         }
+      };
+      // the tuples stay readable while the pool shrinks and grows
+      EXPECT_EQ(4, database.resize_pool(1, 4));
+      EXPECT_EQ(4, database.get_pool(1).get_page_count());
+      check();
+      EXPECT_EQ(64, database.resize_pool(1, 64));
+      check();
+      EXPECT_EQ(std::unordered_set<uint16_t>{0}, getPoolSegments(database.get_pool(0)));
+   }
+   {
+      // the slotted pages and the free space inventory of a table need the same page size
+      Database database({{1024, 16, 0}, {4096, 16, 0}});
+      database.assign_pool(10, 1);
+      EXPECT_THROW(database.load_new_schema(getTPCHSchemaLight()), std::logic_error); // NOLINT
+   }
+}
+
+// NOLINTNEXTLINE
+TEST_F(SegmentTest, DatabaseScanReopen) {
+   std::vector<schema::Table> tables{
+      schema::Table("rows", {schema::Column("r_key", schema::Type::Integer()), schema::Column("r_name", schema::Type::Char(20))}, {"r_key"}, 10, 11),
+      schema::Table("pax", {schema::Column("p_name", schema::Type::Char(9)), schema::Column("p_key", schema::Type::Integer())}, {"p_key"}, 20, 21, 0, schema::Table::kPax),
+   };
+   std::vector<std::vector<std::string>> rows;
+   std::vector<std::vector<std::string>> paxRows;
+   for (size_t i = 0; i < 2000; ++i) {
+      rows.push_back({std::to_string(i), "name " + std::to_string(i)});
+      paxRows.push_back({"pax " + std::to_string(i % 100), std::to_string(i)});
+   }
+
+   // the rows as Database serializes them, the chars padded with spaces
+   auto serialize = [](std::initializer_list<std::pair<std::string, size_t>> columns) {
+      std::string record;
+      for (const auto& [value, width] : columns) {
+         if (width == 0) {
+            auto key = std::stoi(value);
+            record.append(reinterpret_cast<const char*>(&key), sizeof(key));
+         } else {
+            record += value + std::string(width - value.size(), ' ');
+         }
+      }
+      return record;
+   };
+   std::vector<std::vector<std::string>> expected(2);
+   for (size_t i = 0; i < rows.size(); ++i) {
+      expected[0].push_back(serialize({{rows[i][0], 0}, {rows[i][1], 20}}));
+      expected[1].push_back(serialize({{paxRows[i][0], 9}, {paxRows[i][1], 0}}));
+   }
+
+   std::vector<std::vector<TID>> tids(2);
+   std::vector<std::vector<uint64_t>> tidValues(2);
+   {
+      Database database({{1024, 16, 0}});
+      database.load_new_schema(std::make_unique<schema::Schema>(std::move(tables)));
+      tids[0] = database.insert_batch(database.get_schema().tables[0], rows);
+      tids[1] = database.insert_batch(database.get_schema().tables[1], paxRows);
+   }
+   for (size_t t = 0; t < 2; ++t) {
+      for (auto tid : tids[t]) {
+         tidValues[t].push_back(tid.get_value());
+      }
+   }
+
+   // the tables are opened again from the catalog
+   Database database({{1024, 16, 0}});
+   database.load_schema(0);
+   ASSERT_EQ(2, database.get_schema().tables.size());
+   for (size_t t = 0; t < 2; ++t) {
+      auto& table = database.get_schema().tables[t];
+      EXPECT_LT(16, table.allocated_pages);
+      std::vector<std::string> scanned;
+      std::vector<uint64_t> scannedTids;
+      database.scan(table, [&](TID tid, std::span<const std::byte> record) {
+         scanned.emplace_back(reinterpret_cast<const char*>(record.data()), record.size());
+         scannedTids.push_back(tid.get_value());
+         return true;
+      });
+      EXPECT_EQ(expected[t], scanned) << table.id;
+      EXPECT_EQ(tidValues[t], scannedTids) << table.id;
+
+      std::vector<std::byte> record(64);
+      for (size_t i = 0; i < tids[t].size(); i += 97) {
+         auto size = database.read(table, tids[t][i], record.data(), static_cast<uint32_t>(record.size()));
+         ASSERT_EQ(expected[t][i], std::string(reinterpret_cast<const char*>(record.data()), size)) << table.id;
+      }
+
+      // and the scan stops when asked to
+      size_t seen = 0;
+      database.scan(table, [&](TID, std::span<const std::byte>) { return ++seen < 10; });
+      EXPECT_EQ(10, seen);
+   }
+}
+
 // NOLINTNEXTLINE
 TEST_F(SegmentTest, SPFuzzing) {
    size_t count = 100;
@@ -168,4 +168,94 @@ TEST(SlottedPageTest, RelocateWithCompactification) {
    EXPECT_EQ(page->header.free_space, 0);
 }
 
+// NOLINTNEXTLINE
+TEST(SlottedPageTest, RelocateLowestRecord) {
+   size_t page_size = 1024;
+   std::vector<std::byte> buffer;
+   buffer.resize(page_size);
+   auto* page = new (&buffer[0]) SlottedPage(page_size);
+
+   // fill the page so that only 150 bytes are left below the lowest record
+   auto first = page->allocate(100, page_size);
+   page->allocate(page->get_fragmented_free_space() - 2 * sizeof(SlottedPage::Slot) - 250, page_size);
+   auto lowest = page->allocate(100, page_size);
+   ASSERT_EQ(page->get_fragmented_free_space(), 150);
+   std::memset(page->get_data() + page->get_slot(first).get_offset(), 1, 100);
+   std::memset(page->get_data() + page->get_slot(lowest).get_offset(), 2, 100);
+   auto firstOffset = page->get_slot(first).get_offset();
+   auto freeSpace = page->get_free_space();
+
+   // the lowest record grows downwards, the other records stay where they are
+   page->relocate(lowest, 200, page_size);
+   EXPECT_EQ(firstOffset, page->get_slot(first).get_offset());
+   EXPECT_EQ(page->header.data_start, page->get_slot(lowest).get_offset());
+   EXPECT_EQ(page->get_slot(lowest).get_size(), 200);
+   EXPECT_EQ(freeSpace - 100, page->get_free_space());
+   for (size_t i = 0; i < 100; ++i) {
+      ASSERT_EQ(std::byte{2}, page->get_data()[page->get_slot(lowest).get_offset() + i]);
+   }
+}
+
+// NOLINTNEXTLINE
+TEST(SlottedPageTest, CompactificationFuzzing) {
+   size_t page_size = 1024;
+   std::vector<std::byte> buffer;
+   buffer.resize(page_size);
+   auto* page = new (&buffer[0]) SlottedPage(page_size);
+
+   // the expected contents of every slot
+   std::vector<std::vector<std::byte>> records;
+   std::mt19937_64 engine{0};
+   auto fill = [&](uint16_t slot) {
+      if (records.size() <= slot)
+         records.resize(slot + 1);
+      const auto& s = page->get_slot(slot);
+      records[slot].resize(s.get_size());
+      for (size_t i = 0; i < s.get_size(); ++i) {
+         records[slot][i] = static_cast<std::byte>(engine());
+      }
+      std::memcpy(page->get_data() + s.get_offset(), records[slot].data(), s.get_size());
+   };
+
+   for (size_t step = 0; step < 20000; ++step) {
+      auto size = 1 + engine() % 120;
+      auto slot = static_cast<uint16_t>(engine() % (page->header.slot_count + 1));
+      bool exists = slot < page->header.slot_count && !page->get_slot(slot).is_empty();
+      switch (engine() % 3) {
+         case 0:
+            if (page->get_free_space() >= size + sizeof(SlottedPage::Slot))
+               fill(page->allocate(size, page_size));
+            break;
+         case 1:
+            if (exists) {
+               page->erase(slot);
+               records[slot].clear();
+            }
+            break;
+         case 2:
+            if (exists && (size <= records[slot].size() || page->get_free_space() >= size - records[slot].size())) {
+               // the prefix that fits into the new size stays
+               page->relocate(slot, size, page_size);
+               auto kept = std::min(size, records[slot].size());
+               ASSERT_EQ(0, std::memcmp(records[slot].data(), page->get_data() + page->get_slot(slot).get_offset(), kept));
+               fill(slot);
+            }
+            break;
+      }
+
+      // all records are intact and the free space adds up
+      uint32_t used = 0;
+      for (uint16_t s = 0; s < page->header.slot_count; ++s) {
+         const auto& slot = page->get_slot(s);
+         used += sizeof(SlottedPage::Slot);
+         if (slot.is_empty())
+            continue;
+         used += slot.get_size();
+         ASSERT_GE(slot.get_offset(), page->header.data_start);
+         ASSERT_EQ(0, std::memcmp(records[s].data(), page->get_data() + slot.get_offset(), slot.get_size())) << step;
+      }
+      ASSERT_EQ(page_size - sizeof(SlottedPage::Header) - used, page->get_free_space()) << step;
+   }
+}
+
 }
@@ -0,0 +1,190 @@
+#include "simpledb/string_btree.h"
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <gtest/gtest.h>
+
+using BufferManager = simpledb::BufferManager;
+using StringBTree = simpledb::StringBTree<uint64_t, 1024>;
+
+namespace {
+
+/// Keys like the ones of a `Char(20)` column, all with the same long prefix.
+std::string make_key(uint64_t i) {
+   char key[32];
+   std::snprintf(key, sizeof(key), "customer#%011lu", i);
+   return key;
+}
+
+/// Returns the node of a page, the caller has to unfix it.
+const StringBTree::Node& fix_node(BufferManager& buffer_manager, uint64_t pid, simpledb::BufferFrame*& frame) {
+   frame = &buffer_manager.fix_page(pid, false);
+   return *reinterpret_cast<const StringBTree::Node*>(frame->get_data());
+}
+
+// NOLINTNEXTLINE
+TEST(StringBTreeTest, InsertLookup) {
+   BufferManager buffer_manager(1024, 200);
+   StringBTree tree(0, buffer_manager);
+
+   EXPECT_FALSE(tree.lookup("missing"));
+
+   constexpr uint64_t n = 5000;
+   std::vector<uint64_t> order(n);
+   for (uint64_t i = 0; i < n; ++i) {
+      order[i] = i;
+   }
+   std::shuffle(order.begin(), order.end(), std::mt19937_64{0});
+   for (auto i : order) {
+      tree.insert(make_key(i), i);
+   }
+   EXPECT_LT(1, tree.treeHeight.load());
+
+   for (uint64_t i = 0; i < n; ++i) {
+      auto v = tree.lookup(make_key(i));
+      ASSERT_TRUE(v)
+         << "key=" << make_key(i) << " is missing";
+      ASSERT_EQ(i, *v);
+   }
+   EXPECT_FALSE(tree.lookup(make_key(n)));
+   EXPECT_FALSE(tree.lookup("customer#"));
+   EXPECT_FALSE(tree.lookup(""));
+
+   // overwrite
+   tree.insert(make_key(42), 4242);
+   EXPECT_EQ(4242, *tree.lookup(make_key(42)));
+}
+
+// NOLINTNEXTLINE
+TEST(StringBTreeTest, PrefixAndSeparators) {
+   BufferManager buffer_manager(1024, 200);
+   StringBTree tree(0, buffer_manager);
+   std::vector<uint64_t> order(5000);
+   for (uint64_t i = 0; i < order.size(); ++i) {
+      order[i] = i;
+   }
+   std::shuffle(order.begin(), order.end(), std::mt19937_64{0});
+   for (auto i : order) {
+      tree.insert(make_key(i), i);
+   }
+
+   simpledb::BufferFrame* rootFrame;
+   auto& root = fix_node(buffer_manager, tree.root, rootFrame);
+   ASSERT_FALSE(root.is_leaf());
+   uint32_t shortened = 0;
+   for (uint32_t i = 0; i < root.count; ++i) {
+      // the separators only need the digits where neighboring leaves differ
+      EXPECT_GE(make_key(0).size(), root.key(i).size());
+      shortened += root.key(i).size() < make_key(0).size();
+   }
+   EXPECT_LT(root.count / 2, shortened);
+
+   // the leaves cut off the common prefix of their fences
+   simpledb::BufferFrame* leafFrame;
+   const auto* node = &root;
+   auto pid = root.child(root.count / 2);
+   while (true) {
+      node = &fix_node(buffer_manager, pid, leafFrame);
+      if (node->is_leaf())
+         break;
+      pid = node->child(node->count / 2);
+      buffer_manager.unfix_page(*leafFrame, false);
+   }
+   EXPECT_LE(std::string("customer#").size(), node->prefixLength);
+   for (uint32_t i = 0; i < node->count; ++i) {
+      EXPECT_EQ(make_key(node->value(i)), node->key(i));
+   }
+   buffer_manager.unfix_page(*leafFrame, false);
+   buffer_manager.unfix_page(*rootFrame, false);
+}
+
+// NOLINTNEXTLINE
+TEST(StringBTreeTest, VariableLength) {
+   BufferManager buffer_manager(1024, 200);
+   StringBTree tree(0, buffer_manager);
+
+   // keys of all lengths, some of them prefixes of others
+   std::mt19937_64 engine{0};
+   std::vector<std::string> keys;
+   for (size_t i = 0; i < 3000; ++i) {
+      std::string key(engine() % StringBTree::kMaxKeyLength + 1, 'a');
+      for (auto& c : key) {
+         c = static_cast<char>('a' + engine() % 3);
+      }
+      keys.push_back(key);
+   }
+   keys.emplace_back("");
+   for (size_t i = 0; i < keys.size(); ++i) {
+      tree.insert(keys[i], i);
+   }
+   for (size_t i = 0; i < keys.size(); ++i) {
+      auto v = tree.lookup(keys[i]);
+      ASSERT_TRUE(v);
+      // duplicates keep the value of the last insert
+      ASSERT_EQ(keys[*v], keys[i]);
+   }
+
+   EXPECT_THROW(tree.insert(std::string(StringBTree::kMaxKeyLength + 1, 'a'), 0), std::length_error);
+   EXPECT_FALSE(tree.lookup(std::string(StringBTree::kMaxKeyLength + 1, 'a')));
+}
+
+// NOLINTNEXTLINE
+TEST(StringBTreeTest, Erase) {
+   BufferManager buffer_manager(1024, 200);
+   StringBTree tree(0, buffer_manager);
+   constexpr uint64_t n = 2000;
+   for (uint64_t i = 0; i < n; ++i) {
+      tree.insert(make_key(i), i);
+   }
+
+   for (uint64_t i = 0; i < n; i += 2) {
+      tree.erase(make_key(i));
+      ASSERT_FALSE(tree.lookup(make_key(i)));
+   }
+   tree.erase("not in the tree");
+   auto nodes = tree.nodeCount.load();
+
+   // the space of the erased keys is reused without another split
+   for (uint64_t i = 0; i < n; i += 2) {
+      tree.insert(make_key(i), 2 * i);
+   }
+   EXPECT_EQ(nodes, tree.nodeCount.load());
+   for (uint64_t i = 0; i < n; ++i) {
+      auto v = tree.lookup(make_key(i));
+      ASSERT_TRUE(v);
+      ASSERT_EQ(i % 2 ? i : 2 * i, *v);
+   }
+}
+
+// NOLINTNEXTLINE
+TEST(StringBTreeTest, MultithreadWriters) {
+   BufferManager buffer_manager(1024, 200);
+   StringBTree tree(0, buffer_manager);
+
+   constexpr uint64_t kPerThread = 1000;
+   std::vector<std::thread> threads;
+   for (uint64_t thread = 0; thread < 4; ++thread) {
+      threads.emplace_back([thread, &tree] {
+         for (uint64_t i = thread; i < 4 * kPerThread; i += 4) {
+            tree.insert(make_key(i), i);
+         }
+         for (uint64_t i = thread; i < 4 * kPerThread; i += 4) {
+            auto v = tree.lookup(make_key(i));
+            ASSERT_TRUE(v);
+            ASSERT_EQ(i, *v);
+         }
+      });
+   }
+   for (auto& t : threads)
+      t.join();
+
+   for (uint64_t i = 0; i < 4 * kPerThread; ++i) {
+      ASSERT_TRUE(tree.lookup(make_key(i)));
+   }
+}
+
+}
@@ -0,0 +1,340 @@
+#include "simpledb/btree.h"
+#include "simpledb/buffer_manager.h"
+#include "simpledb/file.h"
+#include "simpledb/wal.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <gtest/gtest.h>
+
+using BufferManager = simpledb::BufferManager;
+using File = simpledb::File;
+using WriteAheadLog = simpledb::WriteAheadLog;
+
+namespace {
+
+/// Returns the content of the pages `[0, count[` of a segment.
+std::vector<std::vector<char>> readPages(BufferManager& buffer_manager, uint16_t segment_id, size_t count) {
+   std::vector<std::vector<char>> pages;
+   for (uint64_t i = 0; i < count; ++i) {
+      auto& bf = buffer_manager.fix_page((static_cast<uint64_t>(segment_id) << 48) ^ i, false);
+      pages.emplace_back(bf.get_data(), bf.get_data() + buffer_manager.get_page_size());
+      buffer_manager.unfix_page(bf, false);
+   }
+   return pages;
+}
+
+void writePage(BufferManager& buffer_manager, uint64_t page_id, size_t offset, const std::string& value) {
+   auto& bf = buffer_manager.fix_page(page_id, true);
+   std::memcpy(bf.get_data() + offset, value.data(), value.size());
+   buffer_manager.unfix_page(bf, true);
+}
+
+// NOLINTNEXTLINE
+TEST(WALTest, LogPage) {
+   WriteAheadLog wal(File::make_temporary_file());
+   std::vector<char> before(1024);
+   auto after = before;
+
+   // nothing changed, nothing is logged
+   EXPECT_EQ(wal.log_page(1, before.data(), after.data(), after.size()), 0);
+
+   // the ranges are rounded to words, close ones are merged
+   after[3] = 1;
+   after[20] = 2;
+   after[500] = 3;
+   auto lsn = wal.log_page(1, before.data(), after.data(), after.size());
+   constexpr auto headers = sizeof(WriteAheadLog::RecordHeader) + 2 * sizeof(WriteAheadLog::RangeHeader);
+   EXPECT_EQ(lsn, WriteAheadLog::kLogStart + headers + 24 + 8);
+   EXPECT_EQ(wal.get_lsn(), lsn);
+
+   EXPECT_EQ(wal.commit(), lsn);
+   EXPECT_EQ(wal.get_flushed_lsn(), lsn);
+}
+
+// NOLINTNEXTLINE
+TEST(WALTest, RecoverLostPages) {
+   std::remove("25");
+   std::remove("wal_test_recover");
+   using BTree = simpledb::BTree<uint64_t, uint64_t, std::less<>, 1024>;
+
+   std::vector<std::vector<char>> expected;
+   {
+      WriteAheadLog wal(File::open_file("wal_test_recover", File::WRITE));
+      // few frames, so pages are written back while the tree is built
+      BufferManager buffer_manager(1024, 10);
+      buffer_manager.set_wal(&wal);
+
+      BTree tree(25, buffer_manager);
+      for (uint64_t i = 0; i < 2000; ++i) {
+         tree.insert(i * 7 % 2000, i);
+      }
+      for (uint64_t i = 0; i < 2000; i += 3) {
+         tree.erase(i);
+      }
+      wal.commit();
+      expected = readPages(buffer_manager, 25, tree.nodeCount);
+
+      // every page that was written back was logged before
+      buffer_manager.flush_all();
+      EXPECT_EQ(wal.get_flushed_lsn(), wal.get_lsn());
+   }
+
+   // lose all writes of the pages
+   std::remove("25");
+   {
+      WriteAheadLog wal(File::open_file("wal_test_recover", File::WRITE));
+      BufferManager buffer_manager(1024, 10);
+      wal.recover(buffer_manager);
+      EXPECT_EQ(expected, readPages(buffer_manager, 25, expected.size()));
+
+      buffer_manager.set_wal(&wal);
+      EXPECT_THROW(wal.recover(buffer_manager), std::logic_error);
+      buffer_manager.set_wal(nullptr);
+   }
+   std::remove("25");
+   std::remove("wal_test_recover");
+}
+
+// NOLINTNEXTLINE
+TEST(WALTest, TornTail) {
+   std::remove("26");
+   std::remove("wal_test_torn");
+   constexpr uint64_t page = 26ull << 48;
+
+   uint64_t durable;
+   {
+      WriteAheadLog wal(File::open_file("wal_test_torn", File::WRITE), std::chrono::microseconds{0}, 4096);
+      BufferManager buffer_manager(1024, 10);
+      buffer_manager.set_wal(&wal);
+      writePage(buffer_manager, page, 0, "first");
+      durable = wal.commit();
+      writePage(buffer_manager, page, 100, "second");
+      writePage(buffer_manager, page, 300, "third");
+      wal.commit();
+      buffer_manager.set_wal(nullptr);
+   }
+
+   // tear the second record, the third one is complete
+   {
+      auto file = File::open_file("wal_test_torn", File::WRITE);
+      char byte = 0;
+      file->read_block(durable + 20, 1, &byte);
+      byte ^= 1;
+      file->write_block(&byte, durable + 20, 1);
+   }
+
+   std::remove("26");
+   {
+      WriteAheadLog wal(File::open_file("wal_test_torn", File::WRITE), std::chrono::microseconds{0}, 4096);
+      EXPECT_EQ(wal.get_lsn(), durable);
+      BufferManager buffer_manager(1024, 10);
+      wal.recover(buffer_manager);
+      auto& bf = buffer_manager.fix_page(page, false);
+      EXPECT_EQ(std::string(bf.get_data(), 5), "first");
+      EXPECT_EQ(std::string(bf.get_data() + 100, 6), std::string(6, '\0'));
+      EXPECT_EQ(std::string(bf.get_data() + 300, 5), std::string(5, '\0'));
+      buffer_manager.unfix_page(bf, false);
+
+      // a record of the same size overwrites the torn one, the third one is behind it again
+      buffer_manager.set_wal(&wal);
+      writePage(buffer_manager, page, 404, "fourth");
+      wal.commit();
+      buffer_manager.set_wal(nullptr);
+   }
+
+   std::remove("26");
+   {
+      WriteAheadLog wal(File::open_file("wal_test_torn", File::WRITE), std::chrono::microseconds{0}, 4096);
+      BufferManager buffer_manager(1024, 10);
+      wal.recover(buffer_manager);
+      auto& bf = buffer_manager.fix_page(page, false);
+      EXPECT_EQ(std::string(bf.get_data(), 5), "first");
+      EXPECT_EQ(std::string(bf.get_data() + 100, 6), std::string(6, '\0'));
+      EXPECT_EQ(std::string(bf.get_data() + 300, 5), std::string(5, '\0'));
+      EXPECT_EQ(std::string(bf.get_data() + 404, 6), "fourth");
+      buffer_manager.unfix_page(bf, false);
+   }
+
+   // a session none of whose records survive, its first one is torn
+   std::filesystem::copy_file("26", "wal_test_torn_26", std::filesystem::copy_options::overwrite_existing);
+   uint64_t lost;
+   {
+      WriteAheadLog wal(File::open_file("wal_test_torn", File::WRITE), std::chrono::microseconds{0}, 4096);
+      BufferManager buffer_manager(1024, 10);
+      buffer_manager.set_wal(&wal);
+      lost = wal.get_lsn();
+      writePage(buffer_manager, page, 600, "fifth");
+      writePage(buffer_manager, page, 700, "sixth");
+      wal.commit();
+      buffer_manager.set_wal(nullptr);
+   }
+   {
+      auto file = File::open_file("wal_test_torn", File::WRITE);
+      char byte = 0;
+      file->read_block(lost + 20, 1, &byte);
+      byte ^= 1;
+      file->write_block(&byte, lost + 20, 1);
+   }
+
+   // the next session overwrites it with a record of the same size, but in a newer epoch
+   std::filesystem::rename("wal_test_torn_26", "26");
+   {
+      WriteAheadLog wal(File::open_file("wal_test_torn", File::WRITE), std::chrono::microseconds{0}, 4096);
+      EXPECT_EQ(wal.get_lsn(), lost);
+      BufferManager buffer_manager(1024, 10);
+      buffer_manager.set_wal(&wal);
+      writePage(buffer_manager, page, 800, "seven");
+      wal.commit();
+      buffer_manager.set_wal(nullptr);
+   }
+
+   std::remove("26");
+   {
+      WriteAheadLog wal(File::open_file("wal_test_torn", File::WRITE), std::chrono::microseconds{0}, 4096);
+      BufferManager buffer_manager(1024, 10);
+      wal.recover(buffer_manager);
+      auto& bf = buffer_manager.fix_page(page, false);
+      EXPECT_EQ(std::string(bf.get_data(), 5), "first");
+      EXPECT_EQ(std::string(bf.get_data() + 404, 6), "fourth");
+      EXPECT_EQ(std::string(bf.get_data() + 600, 5), std::string(5, '\0'));
+      EXPECT_EQ(std::string(bf.get_data() + 700, 5), std::string(5, '\0'));
+      EXPECT_EQ(std::string(bf.get_data() + 800, 5), "seven");
+      buffer_manager.unfix_page(bf, false);
+   }
+   std::remove("26");
+   std::remove("wal_test_torn");
+}
+
+// NOLINTNEXTLINE
+TEST(WALTest, RecoverTornCompressedPage) {
+   std::remove("29");
+   std::remove("wal_test_compressed");
+   constexpr uint64_t page = 29ull << 48;
+
+   {
+      WriteAheadLog wal(File::open_file("wal_test_compressed", File::WRITE));
+      BufferManager buffer_manager(1024, 10);
+      buffer_manager.set_compression(29, simpledb::PageCompression::LZ);
+      buffer_manager.set_wal(&wal);
+      writePage(buffer_manager, page, 0, "first");
+      writePage(buffer_manager, page, 500, "second");
+      wal.commit();
+      buffer_manager.flush_all();
+      buffer_manager.set_wal(nullptr);
+   }
+
+   // tear the compressed content of the slot, its size is intact
+   {
+      auto file = File::open_file("29", File::WRITE);
+      std::vector<char> garbage(16, static_cast<char>(0xFF));
+      file->write_block(garbage.data(), 4, garbage.size());
+   }
+   {
+      BufferManager buffer_manager(1024, 10);
+      buffer_manager.set_compression(29, simpledb::PageCompression::LZ);
+      EXPECT_THROW(buffer_manager.fix_page(page, false), std::runtime_error);
+   }
+
+   // the log has an image of the page, the slot isn't needed
+   {
+      WriteAheadLog wal(File::open_file("wal_test_compressed", File::WRITE));
+      BufferManager buffer_manager(1024, 10);
+      buffer_manager.set_compression(29, simpledb::PageCompression::LZ);
+      wal.recover(buffer_manager);
+   }
+   {
+      BufferManager buffer_manager(1024, 10);
+      buffer_manager.set_compression(29, simpledb::PageCompression::LZ);
+      auto& bf = buffer_manager.fix_page(page, false);
+      EXPECT_EQ(std::string(bf.get_data(), 5), "first");
+      EXPECT_EQ(std::string(bf.get_data() + 500, 6), "second");
+      buffer_manager.unfix_page(bf, false);
+   }
+   std::remove("29");
+   std::remove("wal_test_compressed");
+}
+
+// NOLINTNEXTLINE
+TEST(WALTest, Checkpoint) {
+   std::remove("27");
+   std::remove("27.checkpoint");
+   std::remove("wal_test_checkpoint");
+   using BTree = simpledb::BTree<uint64_t, uint64_t, std::less<>, 1024>;
+
+   std::vector<std::vector<char>> expected;
+   uint64_t redoLsn;
+   {
+      WriteAheadLog wal(File::open_file("wal_test_checkpoint", File::WRITE));
+      BufferManager buffer_manager(1024, 10);
+      buffer_manager.set_wal(&wal);
+      EXPECT_EQ(wal.get_redo_lsn(), WriteAheadLog::kLogStart);
+
+      BTree tree(27, buffer_manager);
+      for (uint64_t i = 0; i < 2000; ++i) {
+         tree.insert(i * 7 % 2000, i);
+      }
+      redoLsn = wal.checkpoint(buffer_manager);
+      EXPECT_GT(redoLsn, WriteAheadLog::kLogStart);
+      EXPECT_EQ(wal.get_redo_lsn(), redoLsn);
+      // the pages are as they were after the checkpoint, at worst with some later writes
+      std::filesystem::copy_file("27", "27.checkpoint");
+
+      for (uint64_t i = 0; i < 2000; i += 3) {
+         tree.erase(i);
+      }
+      wal.commit();
+      expected = readPages(buffer_manager, 27, tree.nodeCount);
+      buffer_manager.set_wal(nullptr);
+   }
+
+   // lose all writes of the pages after the checkpoint
+   std::filesystem::rename("27.checkpoint", "27");
+   {
+      WriteAheadLog wal(File::open_file("wal_test_checkpoint", File::WRITE));
+      EXPECT_EQ(wal.get_redo_lsn(), redoLsn);
+      BufferManager buffer_manager(1024, 10);
+      wal.recover(buffer_manager);
+      EXPECT_EQ(expected, readPages(buffer_manager, 27, expected.size()));
+   }
+   std::remove("27");
+   std::remove("wal_test_checkpoint");
+}
+
+// NOLINTNEXTLINE
+TEST(WALTest, GroupCommit) {
+   WriteAheadLog wal(File::make_temporary_file(), std::chrono::microseconds{200});
+   constexpr size_t threadCount = 8;
+   constexpr size_t commits = 100;
+
+   std::vector<std::thread> threads;
+   for (size_t t = 0; t < threadCount; ++t) {
+      threads.emplace_back([&, t] {
+         std::vector<char> before(1024);
+         auto after = before;
+         for (size_t i = 0; i < commits; ++i) {
+            after[i] = static_cast<char>(t + 1);
+            auto lsn = wal.log_page(t, before.data(), after.data(), after.size());
+            ASSERT_GE(wal.commit(), lsn);
+            ASSERT_GE(wal.get_flushed_lsn(), lsn);
+            before = after;
+         }
+      });
+   }
+   for (auto& thread : threads) {
+      thread.join();
+   }
+
+   EXPECT_EQ(wal.get_flushed_lsn(), wal.get_lsn());
+   // the commits of the threads share their syncs
+   EXPECT_LT(wal.get_sync_count(), threadCount * commits);
+}
+
+} // namespace
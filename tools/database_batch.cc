@@ -0,0 +1,398 @@
+#include "simpledb/database.h"
+#include "simpledb/metrics.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Runs a script of commands against a database, one per line. Lines starting with '#' are
+// comments.
+//
+//    schema tpch-light | catalog | <file.json>   load a schema, `catalog` opens the one in segment 0
+//    load <table> <file> [delimiter]             bulk insert a CSV or TPC-H .tbl file
+//    scan <table> [repeat]                       read all rows of a table
+//    lookup <table> <count>                      read random rows that were loaded or scanned
+//    metrics                                     print the counters since the script started
+//
+// Every command reports its rows/s and latency percentiles.
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+using Rows = std::vector<std::vector<std::string>>;
+
+namespace schema = simpledb::schema;
+
+/// The size of the pieces that a file is split into for the parsers.
+constexpr size_t kChunkSize = 4 << 20;
+
+std::unique_ptr<schema::Schema> getTPCHSchemaLight() {
+   std::vector<schema::Table> tables{
+      schema::Table(
+         "customer",
+         {
+            schema::Column("c_custkey", schema::Type::Integer()),
+            schema::Column("c_name", schema::Type::Char(25)),
+            schema::Column("c_address", schema::Type::Char(40)),
+            schema::Column("c_nationkey", schema::Type::Integer()),
+            schema::Column("c_phone", schema::Type::Char(15)),
+            schema::Column("c_acctbal", schema::Type::Integer()),
+            schema::Column("c_mktsegment", schema::Type::Char(10)),
+            schema::Column("c_comment", schema::Type::Char(117)),
+         },
+         {"c_custkey"},
+         10, 11),
+      schema::Table(
+         "nation",
+         {
+            schema::Column("n_nationkey", schema::Type::Integer()),
+            schema::Column("n_name", schema::Type::Char(25)),
+            schema::Column("n_regionkey", schema::Type::Integer()),
+            schema::Column("n_comment", schema::Type::Char(152)),
+         },
+         {"n_nationkey"},
+         20, 21),
+      schema::Table(
+         "region",
+         {
+            schema::Column("r_regionkey", schema::Type::Integer()),
+            schema::Column("r_name", schema::Type::Char(25)),
+            schema::Column("r_comment", schema::Type::Char(152)),
+         },
+         {"r_regionkey"},
+         30, 31),
+   };
+   return std::make_unique<schema::Schema>(std::move(tables));
+}
+
+/// The options of the command line.
+struct Options {
+   /// The page size of the buffer pool
+   size_t page_size = 4096;
+   /// The number of pages of the buffer pool
+   size_t page_count = 16384;
+   /// The number of threads that parse a file
+   size_t threads = std::max(1u, std::thread::hardware_concurrency());
+   /// The maximum number of rows of an `insert_batch()`
+   size_t batch = 10000;
+   /// The script, stdin if empty
+   std::string script;
+};
+
+/// Splits the lines of a piece of a file into fields. A field that starts with '"' is quoted, a
+/// quote in it is written twice. A quoted field must not span lines. The empty field after a
+/// trailing delimiter, as dbgen writes them, is dropped if the row would have too many fields.
+Rows parseRows(std::string_view text, char delimiter, size_t columns) {
+   Rows rows;
+   while (!text.empty()) {
+      auto end = text.find('\n');
+      auto line = text.substr(0, end);
+      text = end == std::string_view::npos ? std::string_view() : text.substr(end + 1);
+      if (!line.empty() && line.back() == '\r')
+         line.remove_suffix(1);
+      if (line.empty())
+         continue;
+
+      auto& row = rows.emplace_back();
+      row.reserve(columns + 1);
+      std::string field;
+      bool quoted = false;
+      for (size_t i = 0; i < line.size(); ++i) {
+         auto c = line[i];
+         if (quoted) {
+            if (c != '"') {
+               field += c;
+            } else if (i + 1 < line.size() && line[i + 1] == '"') {
+               field += '"';
+               ++i;
+            } else {
+               quoted = false;
+            }
+         } else if (c == '"' && field.empty() && (i == 0 || line[i - 1] == delimiter)) {
+            quoted = true;
+         } else if (c == delimiter) {
+            row.push_back(std::move(field));
+            field.clear();
+         } else {
+            field += c;
+         }
+      }
+      if (line.back() != delimiter || row.size() < columns)
+         row.push_back(std::move(field));
+      if (row.size() != columns) {
+         throw std::runtime_error("expected " + std::to_string(columns) + " fields, got " + std::to_string(row.size()) + ": " + std::string(line));
+      }
+   }
+   return rows;
+}
+
+/// Collects the latencies of a command.
+class Latencies {
+   public:
+   void add(Clock::duration latency) { latencies.push_back(latency); }
+
+   /// Prints the percentiles in microseconds.
+   void print(std::ostream& out) {
+      if (latencies.empty())
+         return;
+      std::sort(latencies.begin(), latencies.end());
+      auto percentile = [&](double p) {
+         auto i = std::min(latencies.size() - 1, static_cast<size_t>(p * static_cast<double>(latencies.size())));
+         return std::chrono::duration<double, std::micro>(latencies[i]).count();
+      };
+      out << std::fixed << std::setprecision(1) << ", latency us p50 " << percentile(0.5) << " p90 " << percentile(0.9)
+          << " p99 " << percentile(0.99) << " max " << percentile(1.0);
+   }
+
+   private:
+   std::vector<Clock::duration> latencies;
+};
+
+/// Prints the throughput of a command.
+void printRate(const std::string& command, size_t rows, Clock::duration duration) {
+   auto seconds = std::chrono::duration<double>(duration).count();
+   std::cout << std::fixed << std::setprecision(3) << command << ": " << rows << " rows in " << seconds << " s, "
+             << std::setprecision(0) << (seconds > 0 ? static_cast<double>(rows) / seconds : 0) << " rows/s";
+}
+
+/// Runs the commands of a script.
+class Runner {
+   public:
+   explicit Runner(const Options& options)
+      : options(options), database({{options.page_size, options.page_count, 0}}), start(simpledb::metrics::snapshot()) {}
+
+   /// Runs a command.
+   void run(const std::vector<std::string>& args) {
+      const auto& command = args[0];
+      if (command == "schema" && args.size() == 2) {
+         loadSchema(args[1]);
+      } else if (command == "load" && (args.size() == 3 || args.size() == 4)) {
+         auto delimiter = args.size() == 4 ? args[3][0] : args[2].ends_with(".tbl") ? '|' : ',';
+         load(getTable(args[1]), args[2], delimiter);
+      } else if (command == "scan" && (args.size() == 2 || args.size() == 3)) {
+         scan(getTable(args[1]), args.size() == 3 ? std::stoul(args[2]) : 1);
+      } else if (command == "lookup" && args.size() == 3) {
+         lookup(getTable(args[1]), std::stoul(args[2]));
+      } else if (command == "metrics" && args.size() == 1) {
+         (simpledb::metrics::snapshot() - start).print(std::cout);
+      } else {
+         throw std::runtime_error("unknown command or wrong number of arguments: " + command);
+      }
+   }
+
+   private:
+   void loadSchema(const std::string& name) {
+      if (name == "tpch-light") {
+         database.load_new_schema(getTPCHSchemaLight());
+      } else if (name == "catalog") {
+         database.load_schema(0);
+      } else {
+         std::ifstream file(name);
+         if (!file)
+            throw std::runtime_error("cannot open " + name);
+         std::stringstream json;
+         json << file.rdbuf();
+         database.load_new_schema(schema::Schema::from_json(json.str()));
+      }
+      schema_loaded = true;
+      tids.clear();
+   }
+
+   schema::Table& getTable(const std::string& name) {
+      if (!schema_loaded)
+         throw std::runtime_error("no schema is loaded");
+      for (auto& table : database.get_schema().tables) {
+         if (table.id == name)
+            return table;
+      }
+      throw std::runtime_error("no such table: " + name);
+   }
+
+   /// Reads a file in chunks that end at a line break, the threads parse them while the rows of
+   /// the oldest one are inserted.
+   void load(const schema::Table& table, const std::string& path, char delimiter) {
+      std::ifstream file(path, std::ios::binary);
+      if (!file)
+         throw std::runtime_error("cannot open " + path);
+
+      auto& table_tids = tids[table.id];
+      Latencies latencies;
+      size_t rows = 0;
+      auto insert = [&](Rows parsed) {
+         for (size_t i = 0; i < parsed.size(); i += options.batch) {
+            Rows batch(std::make_move_iterator(parsed.begin() + i), std::make_move_iterator(parsed.begin() + std::min(i + options.batch, parsed.size())));
+            auto begin = Clock::now();
+            auto batch_tids = database.insert_batch(table, batch);
+            latencies.add(Clock::now() - begin);
+            table_tids.insert(table_tids.end(), batch_tids.begin(), batch_tids.end());
+            rows += batch.size();
+         }
+      };
+
+      auto begin = Clock::now();
+      std::deque<std::future<Rows>> parsing;
+      std::string rest;
+      while (file) {
+         std::string chunk = std::move(rest);
+         auto offset = chunk.size();
+         chunk.resize(offset + kChunkSize);
+         file.read(chunk.data() + offset, kChunkSize);
+         chunk.resize(offset + file.gcount());
+         // the partial line at the end belongs to the next chunk
+         auto end = file ? chunk.rfind('\n') : std::string::npos;
+         if (file && end == std::string::npos) {
+            // a line that is longer than a chunk, read on until it ends
+            rest = std::move(chunk);
+            continue;
+         }
+         rest = end == std::string::npos ? std::string() : chunk.substr(end + 1);
+         chunk.resize(end == std::string::npos ? chunk.size() : end + 1);
+
+         if (parsing.size() >= options.threads) {
+            insert(parsing.front().get());
+            parsing.pop_front();
+         }
+         parsing.push_back(std::async(std::launch::async, [chunk = std::move(chunk), delimiter, columns = table.columns.size()] {
+            return parseRows(chunk, delimiter, columns);
+         }));
+      }
+      while (!parsing.empty()) {
+         insert(parsing.front().get());
+         parsing.pop_front();
+      }
+
+      printRate("load " + table.id, rows, Clock::now() - begin);
+      latencies.print(std::cout);
+      std::cout << std::endl;
+   }
+
+   /// Scans the table `repeat` times, the TIDs that the first scan finds can be looked up if the
+   /// table wasn't loaded by the script.
+   void scan(const schema::Table& table, size_t repeat) {
+      auto& table_tids = tids[table.id];
+      bool collect = table_tids.empty();
+      Latencies latencies;
+      size_t rows = 0;
+      auto begin = Clock::now();
+      for (size_t i = 0; i < repeat; ++i) {
+         auto scan_begin = Clock::now();
+         database.scan(table, [&](simpledb::TID tid, std::span<const std::byte>) {
+            if (collect)
+               table_tids.push_back(tid);
+            ++rows;
+            return true;
+         });
+         latencies.add(Clock::now() - scan_begin);
+         collect = false;
+      }
+      printRate("scan " + table.id, rows, Clock::now() - begin);
+      latencies.print(std::cout);
+      std::cout << std::endl;
+   }
+
+   /// Reads random rows of the table by their TIDs.
+   void lookup(const schema::Table& table, size_t count) {
+      const auto& table_tids = tids[table.id];
+      if (table_tids.empty())
+         throw std::runtime_error("no rows of " + table.id + " are known, load or scan it first");
+
+      std::mt19937_64 engine{0};
+      std::uniform_int_distribution<size_t> index{0, table_tids.size() - 1};
+      std::vector<std::byte> record(options.page_size);
+      Latencies latencies;
+      auto begin = Clock::now();
+      for (size_t i = 0; i < count; ++i) {
+         auto lookup_begin = Clock::now();
+         database.read(table, table_tids[index(engine)], record.data(), static_cast<uint32_t>(record.size()));
+         latencies.add(Clock::now() - lookup_begin);
+      }
+      printRate("lookup " + table.id, count, Clock::now() - begin);
+      latencies.print(std::cout);
+      std::cout << std::endl;
+   }
+
+   const Options& options;
+   simpledb::Database database;
+   /// The counters when the script started
+   simpledb::metrics::Snapshot start;
+   /// Has a schema been loaded?
+   bool schema_loaded = false;
+   /// The TIDs of the rows that were loaded or scanned, by table
+   std::unordered_map<std::string, std::vector<simpledb::TID>> tids;
+};
+
+void printUsage(const char* program) {
+   std::cerr << "usage: " << program << " [--page-size BYTES] [--pages COUNT] [--threads COUNT] [--batch ROWS] [SCRIPT]\n"
+             << "runs the commands of SCRIPT, or of stdin without one\n";
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+   Options options;
+   for (int i = 1; i < argc; ++i) {
+      std::string_view arg = argv[i];
+      auto value = [&]() -> size_t {
+         if (i + 1 == argc) {
+            printUsage(argv[0]);
+            std::exit(1);
+         }
+         return std::stoul(argv[++i]);
+      };
+      if (arg == "--page-size") {
+         options.page_size = value();
+      } else if (arg == "--pages") {
+         options.page_count = value();
+      } else if (arg == "--threads") {
+         options.threads = std::max<size_t>(1, value());
+      } else if (arg == "--batch") {
+         options.batch = std::max<size_t>(1, value());
+      } else if (arg.starts_with("-") || !options.script.empty()) {
+         printUsage(argv[0]);
+         return 1;
+      } else {
+         options.script = arg;
+      }
+   }
+
+   std::ifstream script_file;
+   if (!options.script.empty()) {
+      script_file.open(options.script);
+      if (!script_file) {
+         std::cerr << "cannot open " << options.script << std::endl;
+         return 1;
+      }
+   }
+   std::istream& script = options.script.empty() ? std::cin : script_file;
+
+   Runner runner(options);
+   std::string line;
+   for (size_t number = 1; std::getline(script, line); ++number) {
+      std::istringstream words(line);
+      std::vector<std::string> args;
+      for (std::string word; words >> word;) {
+         args.push_back(std::move(word));
+      }
+      if (args.empty() || args[0].starts_with("#"))
+         continue;
+      try {
+         runner.run(args);
+      } catch (const std::exception& e) {
+         std::cerr << "line " << number << ": " << e.what() << std::endl;
+         return 1;
+      }
+   }
+}
@@ -102,7 +102,8 @@ int main() {
             readLine(value);
             values.emplace_back(move(value));
          }
-         db.insert(table, values);
+         auto tid = db.insert(table, values);
+         std::cout << "Tuple with TID " << tid.get_value() << " inserted!\n";
       } else if (choice == 2) {
          do {
             std::cout << "Select table:\n";
@@ -2,7 +2,7 @@
 # Sources
 # ---------------------------------------------------------------------------
 
-set(TOOLS_SRC tools/database_wrapper.cc)
+set(TOOLS_SRC tools/database_wrapper.cc tools/database_batch.cc)
 
 # ---------------------------------------------------------------------------
 # Executables
@@ -11,6 +11,9 @@ set(TOOLS_SRC tools/database_wrapper.cc)
 add_executable(database_wrapper tools/database_wrapper.cc)
 target_link_libraries(database_wrapper simpledb Threads::Threads)
 
+add_executable(database_batch tools/database_batch.cc)
+target_link_libraries(database_batch simpledb Threads::Threads)
+
 # ---------------------------------------------------------------------------
 # Linting
 # ---------------------------------------------------------------------------